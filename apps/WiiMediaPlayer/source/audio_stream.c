@@ -0,0 +1,279 @@
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+#include <stdio.h>
+#include <string.h>
+#include <asndlib.h>
+#include "audio_stream.h"
+#include "pcm.h"
+
+// Ring of output buffers. Buffer n lives in slot n % AUDIO_STREAM_BUFFERS and
+// the counters only ever increase:
+//   released <= submitted <= filled
+// [released, submitted) belong to ASND, [submitted, filled) are ready to
+// queue and everything else may be refilled.
+static u8 streamBuffers[AUDIO_STREAM_BUFFERS][AUDIO_STREAM_BUFFER_SIZE] ATTRIBUTE_ALIGN(32);
+static int streamLengths[AUDIO_STREAM_BUFFERS];
+static int streamFrames[AUDIO_STREAM_BUFFERS];     // sample frames, without the padding
+static volatile u32 filled = 0;
+static volatile u32 submitted = 0;
+static volatile u32 released = 0;
+
+static s32 streamVoice = -1;
+static int streamFormat = VOICE_STEREO_16BIT;
+static int streamRate = 44100;
+static int streamVolume = 255;
+static int frameBytes = 4;
+
+static AudioFillCallback fillCallback = NULL;
+static void* fillUserdata = NULL;
+
+static lwp_t fillThread = LWP_THREAD_NULL;
+static lwpq_t fillQueue = LWP_TQUEUE_NULL;
+static u8 fillStack[16384] ATTRIBUTE_ALIGN(8);
+static volatile int streamRunning = 0;
+static volatile int streamEnded = 0;
+static volatile int streamPaused = 0;
+static volatile int underruns = 0;
+
+// Where the voice is: buffer number playing, when it started and the
+// sample frames of every buffer before it. Set in the callback, read
+// with interrupts off.
+static u32 playing = 0;
+static u64 playingSince = 0;
+static u64 playedFrames = 0;
+static u64 pausedAt = 0;
+
+static void StartedBuffer(u32 buffer) {
+    if(buffer == playing && playingSince) return;
+
+    while(playing < buffer) {
+        playedFrames += streamFrames[playing % AUDIO_STREAM_BUFFERS];
+        playing++;
+    }
+    playingSince = gettime();
+}
+
+static void StreamVoiceCallback(s32 voice) {
+    // ASND just started the buffer it had queued, so everything submitted
+    // before it has finished playing and can be refilled
+    if(submitted - released > 1) {
+        released = submitted - 1;
+        StartedBuffer(released);
+    }
+
+    // Runs in the audio interrupt: only hand over buffers that are ready
+    if(filled != submitted) {
+        int slot = submitted % AUDIO_STREAM_BUFFERS;
+        if(ASND_AddVoice(voice, streamBuffers[slot], streamLengths[slot]) == SND_OK) {
+            submitted++;
+        }
+    } else if(!streamEnded) {
+        underruns++;
+    }
+
+    LWP_ThreadSignal(fillQueue);
+}
+
+// Start (or restart after an underrun) the voice on the oldest ready buffer
+static void KickVoice() {
+    if(filled == submitted || streamPaused) return;
+    if(ASND_StatusVoice(streamVoice) != SND_UNUSED) return;
+
+    // Voice ran dry, nothing it owned is still playing
+    released = submitted;
+    StartedBuffer(submitted);
+
+    int slot = submitted % AUDIO_STREAM_BUFFERS;
+    ASND_SetVoice(streamVoice, streamFormat, streamRate, 0,
+                  streamBuffers[slot], streamLengths[slot],
+                  streamVolume, streamVolume, StreamVoiceCallback);
+    submitted++;
+
+    // Queue the second half of ASND's double buffer straight away
+    if(filled != submitted) {
+        slot = submitted % AUDIO_STREAM_BUFFERS;
+        if(ASND_AddVoice(streamVoice, streamBuffers[slot], streamLengths[slot]) == SND_OK) {
+            submitted++;
+        }
+    }
+}
+
+// Fill one free slot. Returns 0 once the source is exhausted.
+static int FillNextBuffer() {
+    int slot = filled % AUDIO_STREAM_BUFFERS;
+    u8* buffer = streamBuffers[slot];
+    int wanted = AUDIO_STREAM_BUFFER_SIZE - (AUDIO_STREAM_BUFFER_SIZE % frameBytes);
+    int size = 0;
+
+    // Decoders may return less than asked (frame boundaries), keep going
+    while(size < wanted) {
+        int n = fillCallback(fillUserdata, buffer + size, wanted - size);
+        if(n <= 0) break;
+        size += n;
+    }
+
+    if(size == 0) return 0;
+
+    streamFrames[slot] = size / frameBytes;
+    streamLengths[slot] = PadSamples32(buffer, size);
+    DCFlushRange(buffer, streamLengths[slot]);
+
+    u32 level;
+    _CPU_ISR_Disable(level);
+    filled++;
+    KickVoice();
+    _CPU_ISR_Restore(level);
+
+    return size == wanted;
+}
+
+static void* FillThread(void* arg) {
+    while(streamRunning) {
+        // Top up every free slot, then sleep until ASND frees another one
+        while(streamRunning && !streamEnded &&
+              filled - released < AUDIO_STREAM_BUFFERS) {
+            if(!FillNextBuffer()) {
+                streamEnded = 1;
+            }
+        }
+
+        if(streamRunning) {
+            LWP_ThreadSleep(fillQueue);
+        }
+    }
+
+    return NULL;
+}
+
+int StartAudioStream(int sampleRate, int channels, AudioFillCallback fill, void* userdata) {
+    StopAudioStream();
+
+    if(!fill || sampleRate <= 0 || channels < 1 || channels > 2) return -1;
+
+    streamVoice = ASND_GetFirstUnusedVoice();
+    if(streamVoice < 0) return -1;
+
+    streamFormat = (channels == 2) ? VOICE_STEREO_16BIT : VOICE_MONO_16BIT;
+    frameBytes = channels * 2;
+    streamRate = sampleRate;
+    fillCallback = fill;
+    fillUserdata = userdata;
+
+    filled = submitted = released = 0;
+    playing = 0;
+    playingSince = 0;
+    playedFrames = 0;
+    underruns = 0;
+    streamEnded = 0;
+    streamPaused = 0;
+    streamRunning = 1;
+
+    LWP_InitQueue(&fillQueue);
+
+    // Prime the ring before the voice starts so the first callback has
+    // something to queue
+    while(!streamEnded && filled < AUDIO_STREAM_BUFFERS) {
+        if(!FillNextBuffer()) {
+            streamEnded = 1;
+        }
+    }
+
+    if(LWP_CreateThread(&fillThread, FillThread, NULL, fillStack,
+                        sizeof(fillStack), AUDIO_STREAM_PRIORITY) < 0) {
+        fillThread = LWP_THREAD_NULL;
+        StopAudioStream();
+        return -1;
+    }
+
+    ASND_Pause(0);
+    return 0;
+}
+
+void StopAudioStream() {
+    if(!streamRunning) return;
+
+    streamRunning = 0;
+
+    if(streamVoice >= 0) {
+        ASND_StopVoice(streamVoice);
+    }
+
+    if(fillThread != LWP_THREAD_NULL) {
+        LWP_ThreadSignal(fillQueue);
+        LWP_JoinThread(fillThread, NULL);
+        fillThread = LWP_THREAD_NULL;
+    }
+
+    if(fillQueue != LWP_TQUEUE_NULL) {
+        LWP_CloseQueue(fillQueue);
+        fillQueue = LWP_TQUEUE_NULL;
+    }
+
+    streamVoice = -1;
+    fillCallback = NULL;
+    fillUserdata = NULL;
+}
+
+void PauseAudioStream(int pause) {
+    if(streamVoice < 0) return;
+
+    u32 level;
+    _CPU_ISR_Disable(level);
+    if(pause && !streamPaused) {
+        pausedAt = gettime();
+    } else if(!pause && streamPaused && playingSince) {
+        // The buffer playing resumes where it stopped
+        playingSince += gettime() - pausedAt;
+    }
+    streamPaused = pause;
+    _CPU_ISR_Restore(level);
+
+    ASND_PauseVoice(streamVoice, pause);
+
+    // The voice may have run dry while paused
+    if(!pause) {
+        _CPU_ISR_Disable(level);
+        KickVoice();
+        _CPU_ISR_Restore(level);
+    }
+}
+
+void SetAudioStreamVolume(int volume) {
+    if(volume < 0) volume = 0;
+    if(volume > 100) volume = 100;
+
+    streamVolume = volume * 255 / 100;
+
+    if(streamVoice >= 0) {
+        ASND_ChangeVolumeVoice(streamVoice, streamVolume, streamVolume);
+    }
+}
+
+int IsAudioStreamFinished() {
+    if(!streamRunning) return 1;
+    return streamEnded && filled == submitted &&
+           ASND_StatusVoice(streamVoice) == SND_UNUSED;
+}
+
+int GetAudioStreamUnderruns() {
+    return underruns;
+}
+
+s64 GetAudioStreamPosition() {
+    if(!streamRunning) return 0;
+
+    u32 level;
+    _CPU_ISR_Disable(level);
+    u64 frames = playedFrames;
+    u64 since = playingSince;
+    int length = streamFrames[playing % AUDIO_STREAM_BUFFERS];
+    u64 now = streamPaused ? pausedAt : gettime();
+    _CPU_ISR_Restore(level);
+
+    // Within the buffer by the time it has played, which the callback
+    // resets every buffer, so the timer's error never adds up; and never
+    // past its end, where an underrun leaves the voice
+    if(!since) return frames;
+    s64 within = (s64)ticks_to_microsecs(now - since) * streamRate / 1000000;
+    return frames + (within < length ? within : length);
+}
@@ -0,0 +1,29 @@
+#ifndef AUDIO_STREAM_H
+#define AUDIO_STREAM_H
+
+#include <gccore.h>
+
+// Streaming output on a single ASND voice. A ring of 32-byte aligned
+// buffers is kept full by a high priority fill thread; the ASND callback
+// only queues buffers that are already filled, so the voice never waits on
+// the SD card or the UI.
+#define AUDIO_STREAM_BUFFERS     4
+#define AUDIO_STREAM_BUFFER_SIZE 8192 // bytes, multiple of 32
+#define AUDIO_STREAM_PRIORITY    80
+
+// Fills buffer with up to size bytes of native-endian s16 PCM and returns
+// the number of bytes written, or 0 at end of stream.
+typedef int (*AudioFillCallback)(void* userdata, void* buffer, int size);
+
+// Function prototypes
+int StartAudioStream(int sampleRate, int channels, AudioFillCallback fill, void* userdata);
+void StopAudioStream();
+void PauseAudioStream(int pause);
+void SetAudioStreamVolume(int volume); // 0-100
+int IsAudioStreamFinished();
+int GetAudioStreamUnderruns();
+// Sample frames played since the stream started, as far as the voice has
+// got (not the fill thread): the clock to keep video in step with.
+s64 GetAudioStreamPosition();
+
+#endif // AUDIO_STREAM_H
@@ -0,0 +1,716 @@
+#include <stdlib.h>
+#include <string.h>
+#include "avi.h"
+#include "sidecar.h"
+
+// The header list is read whole; anything larger is not a real hdrl
+#define AVI_MAX_HEADER_LIST (1024 * 1024)
+// Index chunks are read in blocks of this size
+#define AVI_INDEX_BLOCK (16 * 1024)
+// RIFF-AVIX segments in an OpenDML file, one movi list each
+#define AVI_MAX_MOVI 256
+
+// idx1 flags
+#define AVIIF_LIST     0x00000001
+#define AVIIF_KEYFRAME 0x00000010
+
+// OpenDML index types
+#define AVI_INDEX_OF_INDEXES 0x00
+#define AVI_INDEX_OF_CHUNKS  0x01
+
+// An index entry packs the payload offset into the top 40 bits, the size
+// into the next 23 and the keyframe flag into bit 0
+#define AVI_ENTRY(offset, size, key) (((u64)(offset) << 24) | ((u64)(size) << 1) | (u64)(key))
+#define AVI_ENTRY_OFFSET(e) ((s64)((e) >> 24))
+#define AVI_ENTRY_SIZE(e)   ((int)(((e) >> 1) & 0x7FFFFF))
+#define AVI_ENTRY_KEY(e)    ((int)((e) & 1))
+#define AVI_MAX_ENTRY_SIZE  0x7FFFFF
+#define AVI_MAX_ENTRY_OFFSET ((s64)1 << 40)
+
+typedef struct {
+    u64* entries;
+    int count;
+    int capacity;
+    u32* keyframes;     // entry numbers, ascending
+    int keyframeCount;
+    int next;           // entry ReadAviPacket() returns next
+} AviTrack;
+
+// Where things are in the file, found while walking the RIFF lists
+typedef struct {
+    s64 movi[AVI_MAX_MOVI];     // offset of the "movi" list type
+    s64 moviEnd[AVI_MAX_MOVI];
+    int moviCount;
+    s64 idx1;                   // payload of "idx1", 0 if none
+    u32 idx1Size;
+    s64 indx[AVI_MAX_STREAMS];
+    u32 indxSize[AVI_MAX_STREAMS];
+} AviLayout;
+
+struct AviDemuxer {
+    MediaIO* io;
+    AviInfo info;
+    AviLayout layout;
+    AviTrack track[AVI_MAX_STREAMS];
+    int seekStream;     // the video stream, else stream 0
+    u8* block;          // AVI_INDEX_BLOCK bytes for reading indexes
+};
+
+static int IsFourcc(const u8* p, const char* id) {
+    return memcmp(p, id, 4) == 0;
+}
+
+// Chunk ids start with the stream number in two decimal digits
+static int StreamOfChunk(const u8* id) {
+    if(id[0] < '0' || id[0] > '9' || id[1] < '0' || id[1] > '9') return -1;
+    return (id[0] - '0') * 10 + (id[1] - '0');
+}
+
+static void ParseStreamHeader(const u8* p, u32 size, AviStream* s) {
+    if(size < 36) return;
+
+    if(IsFourcc(p, "vids")) {
+        s->type = AVI_STREAM_VIDEO;
+    } else if(IsFourcc(p, "auds")) {
+        s->type = AVI_STREAM_AUDIO;
+    }
+    s->handler = GetLE32(p + 4);
+    s->scale = GetLE32(p + 20);
+    s->rate = GetLE32(p + 24);
+    s->length = GetLE32(p + 32);
+}
+
+static void ParseStreamFormat(const u8* p, u32 size, AviStream* s) {
+    if(s->type == AVI_STREAM_VIDEO && size >= 20) {
+        // BITMAPINFOHEADER; a negative height means top-down rows
+        s->width = (s32)GetLE32(p + 4);
+        s->height = (s32)GetLE32(p + 8);
+        if(s->height < 0) s->height = -s->height;
+        s->handler = GetLE32(p + 16);
+    } else if(s->type == AVI_STREAM_AUDIO && size >= 14) {
+        // WAVEFORMATEX
+        s->formatTag = GetLE16(p);
+        s->channels = GetLE16(p + 2);
+        s->sampleRate = (int)GetLE32(p + 4);
+        s->blockAlign = GetLE16(p + 12);
+        s->bitsPerSample = size >= 16 ? GetLE16(p + 14) : 0;
+    }
+}
+
+// OpenDML video properties: only whether there are one or two fields per
+// frame. Writers leave the field descriptions zeroed, so they don't say
+// which one comes first.
+static void ParseVideoProperties(const u8* p, u32 size, AviStream* s) {
+    if(size < 36) return;
+
+    u32 fields = GetLE32(p + 32);
+    if(fields == 1) s->fieldOrder = MEDIA_FIELDS_PROGRESSIVE;
+}
+
+// Walk the chunks of a list held in memory. base is the file offset of
+// data[0], so chunk positions can be handed back as file offsets.
+static int ParseHeaderList(const u8* data, u32 size, s64 base, AviInfo* info,
+                           AviLayout* layout, s64* dmlhFrames) {
+    u32 pos = 0;
+
+    while(pos + 8 <= size) {
+        const u8* chunk = data + pos;
+        u32 chunkSize = GetLE32(chunk + 4);
+        if(chunkSize > size - pos - 8) chunkSize = size - pos - 8;
+        const u8* payload = chunk + 8;
+
+        if(IsFourcc(chunk, "avih") && chunkSize >= 40) {
+            u32 usPerFrame = GetLE32(payload);
+            if(usPerFrame) {
+                info->frameRate = 1000000;
+                info->frameScale = usPerFrame;
+            }
+            info->totalFrames = GetLE32(payload + 16);
+            info->width = (int)GetLE32(payload + 32);
+            info->height = (int)GetLE32(payload + 36);
+        } else if(IsFourcc(chunk, "LIST") && chunkSize >= 4) {
+            if(IsFourcc(payload, "strl")) {
+                if(info->streams >= AVI_MAX_STREAMS) return -1;
+                info->streams++;
+            }
+            // strl and odml are parsed in place; nested lists are flat enough
+            if(IsFourcc(payload, "strl") || IsFourcc(payload, "odml")) {
+                if(ParseHeaderList(payload + 4, chunkSize - 4, base + pos + 12,
+                                   info, layout, dmlhFrames) != 0) return -1;
+            }
+        } else if(info->streams > 0) {
+            AviStream* s = &info->stream[info->streams - 1];
+
+            if(IsFourcc(chunk, "strh")) {
+                ParseStreamHeader(payload, chunkSize, s);
+            } else if(IsFourcc(chunk, "strf")) {
+                ParseStreamFormat(payload, chunkSize, s);
+            } else if(IsFourcc(chunk, "vprp")) {
+                ParseVideoProperties(payload, chunkSize, s);
+            } else if(IsFourcc(chunk, "indx") && chunkSize >= 24) {
+                layout->indx[info->streams - 1] = base + pos + 8;
+                layout->indxSize[info->streams - 1] = chunkSize;
+            }
+        }
+
+        if(IsFourcc(chunk, "dmlh") && chunkSize >= 4) {
+            *dmlhFrames = GetLE32(payload);
+        }
+
+        pos += 8 + chunkSize + (chunkSize & 1);
+    }
+
+    return 0;
+}
+
+static int ReadHeaderList(MediaIO* io, s64 offset, u32 size, AviInfo* info,
+                          AviLayout* layout, s64* dmlhFrames) {
+    if(size > AVI_MAX_HEADER_LIST) return -1;
+
+    u8* data = malloc(size);
+    if(!data) return -1;
+
+    int result = -1;
+    if(SeekMediaIO(io, offset) == 0 && ReadMediaIO(io, data, size) == (int)size) {
+        result = ParseHeaderList(data, size, offset, info, layout, dmlhFrames);
+    }
+
+    free(data);
+    return result;
+}
+
+// Walk the RIFF segments. With headersOnly the walk stops after "hdrl".
+static int ParseAvi(MediaIO* io, AviInfo* info, AviLayout* layout, int headersOnly) {
+    u8 header[12];
+    s64 riff = 0;
+    s64 dmlhFrames = 0;
+    int haveHeaders = 0;
+
+    memset(info, 0, sizeof(AviInfo));
+    memset(layout, 0, sizeof(AviLayout));
+    info->videoStream = -1;
+    info->audioStream = -1;
+
+    while(riff + 12 <= io->size) {
+        if(SeekMediaIO(io, riff) != 0 || ReadMediaIO(io, header, 12) != 12) break;
+        if(!IsFourcc(header, "RIFF")) break;
+        if(riff == 0 ? !IsFourcc(header + 8, "AVI ") : !IsFourcc(header + 8, "AVIX")) break;
+
+        // Capture tools leave the size at 0 when they stop early
+        s64 riffEnd = riff + 8 + GetLE32(header + 4);
+        if(riffEnd <= riff + 12 || riffEnd > io->size) riffEnd = io->size;
+
+        s64 pos = riff + 12;
+        while(pos + 8 <= riffEnd) {
+            if(SeekMediaIO(io, pos) != 0 || ReadMediaIO(io, header, 12) < 8) break;
+
+            u32 chunkSize = GetLE32(header + 4);
+            s64 payload = pos + 8;
+            s64 chunkEnd = payload + chunkSize;
+
+            if(IsFourcc(header, "LIST") && IsFourcc(header + 8, "hdrl")) {
+                if(ReadHeaderList(io, payload + 4, chunkSize - 4, info, layout, &dmlhFrames) != 0) {
+                    return -1;
+                }
+                haveHeaders = 1;
+                if(headersOnly) break;
+            } else if(IsFourcc(header, "LIST") && IsFourcc(header + 8, "movi")) {
+                if(chunkSize == 0 || chunkEnd > riffEnd) chunkEnd = riffEnd;
+                if(layout->moviCount < AVI_MAX_MOVI) {
+                    layout->movi[layout->moviCount] = payload;
+                    layout->moviEnd[layout->moviCount] = chunkEnd;
+                    layout->moviCount++;
+                }
+            } else if(IsFourcc(header, "idx1") && riff == 0) {
+                layout->idx1 = payload;
+                layout->idx1Size = chunkSize;
+            }
+
+            pos = chunkEnd + (chunkSize & 1);
+        }
+
+        if(headersOnly && haveHeaders) break;
+        riff = riffEnd + ((riffEnd - riff) & 1);
+    }
+
+    if(!haveHeaders || info->streams == 0) return -1;
+
+    for(int i = 0; i < info->streams; i++) {
+        AviStream* s = &info->stream[i];
+        if(s->type == AVI_STREAM_VIDEO && info->videoStream < 0) info->videoStream = i;
+        if(s->type == AVI_STREAM_AUDIO && info->audioStream < 0) info->audioStream = i;
+    }
+
+    // The stream header is more reliable than avih, dmlh counts all segments
+    if(info->videoStream >= 0) {
+        const AviStream* v = &info->stream[info->videoStream];
+        if(v->width > 0 && v->height > 0) {
+            info->width = v->width;
+            info->height = v->height;
+        }
+        if(v->rate && v->scale) {
+            info->frameRate = v->rate;
+            info->frameScale = v->scale;
+        }
+        if(v->length > info->totalFrames) info->totalFrames = v->length;
+    }
+    if(dmlhFrames > info->totalFrames) info->totalFrames = dmlhFrames;
+
+    if(info->frameRate && info->frameScale) {
+        info->duration = (int)(info->totalFrames * info->frameScale / info->frameRate);
+    }
+
+    return 0;
+}
+
+static int AddEntry(AviTrack* t, s64 offset, u32 size, int key) {
+    if(size > AVI_MAX_ENTRY_SIZE || offset < 0 || offset >= AVI_MAX_ENTRY_OFFSET) return -1;
+
+    if(t->count == t->capacity) {
+        int capacity = t->capacity ? t->capacity * 2 : 1024;
+        u64* grown = realloc(t->entries, capacity * sizeof(u64));
+        if(!grown) return -1;
+        t->entries = grown;
+        t->capacity = capacity;
+    }
+
+    t->entries[t->count++] = AVI_ENTRY(offset, size, key);
+    return 0;
+}
+
+static void ClearIndex(AviDemuxer* demux) {
+    for(int i = 0; i < AVI_MAX_STREAMS; i++) {
+        free(demux->track[i].entries);
+        free(demux->track[i].keyframes);
+        demux->track[i].entries = NULL;
+        demux->track[i].keyframes = NULL;
+        demux->track[i].count = 0;
+        demux->track[i].capacity = 0;
+        demux->track[i].keyframeCount = 0;
+    }
+}
+
+// A standard index ("ix##") chunk: entries of a base offset plus a 32-bit
+// offset to the payload and its size, bit 31 set for non-keyframes
+static int LoadStandardIndex(AviDemuxer* demux, AviTrack* t, const u8* header, s64 entriesAt) {
+    MediaIO* io = demux->io;
+    int stride = GetLE16(header) * 4;
+    u32 count = GetLE32(header + 4);
+    s64 base = (s64)GetLE64(header + 12);
+
+    if(header[3] != AVI_INDEX_OF_CHUNKS || stride < 8) return -1;
+
+    int perBlock = AVI_INDEX_BLOCK / stride;
+    for(u32 done = 0; done < count; ) {
+        int n = count - done < (u32)perBlock ? (int)(count - done) : perBlock;
+        if(SeekMediaIO(io, entriesAt + (s64)done * stride) != 0 ||
+           ReadMediaIO(io, demux->block, n * stride) != n * stride) return -1;
+
+        for(int i = 0; i < n; i++) {
+            const u8* e = demux->block + i * stride;
+            u32 size = GetLE32(e + 4);
+            if(AddEntry(t, base + GetLE32(e), size & 0x7FFFFFFF, !(size & 0x80000000)) != 0) {
+                return -1;
+            }
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+// The "indx" super index lists the "ix##" chunks of one stream, one per
+// RIFF segment or so
+static int LoadOpenDmlIndex(AviDemuxer* demux, int stream) {
+    MediaIO* io = demux->io;
+    AviTrack* t = &demux->track[stream];
+    s64 indx = demux->layout.indx[stream];
+    u8 header[32];
+
+    if(SeekMediaIO(io, indx) != 0 || ReadMediaIO(io, header, 24) != 24) return -1;
+
+    // Rarely the indx is a standard index itself
+    if(header[3] == AVI_INDEX_OF_CHUNKS) return LoadStandardIndex(demux, t, header, indx + 24);
+    if(header[3] != AVI_INDEX_OF_INDEXES) return -1;
+
+    int stride = GetLE16(header) * 4;
+    u32 count = GetLE32(header + 4);
+    if(stride < 16 || 24 + (s64)count * stride > demux->layout.indxSize[stream]) return -1;
+
+    for(u32 i = 0; i < count; i++) {
+        u8 entry[16];
+        if(SeekMediaIO(io, indx + 24 + (s64)i * stride) != 0 ||
+           ReadMediaIO(io, entry, 16) != 16) return -1;
+
+        // qwOffset points at the ix## chunk header
+        s64 chunk = (s64)GetLE64(entry);
+        if(chunk <= 0) continue;
+        if(SeekMediaIO(io, chunk) != 0 || ReadMediaIO(io, header, 32) != 32) return -1;
+        if(LoadStandardIndex(demux, t, header + 8, chunk + 32) != 0) return -1;
+    }
+
+    return 0;
+}
+
+// idx1 entries point at the chunk header, relative to the "movi" list
+// type or, from some muxers, to the start of the file
+static int LoadIdx1(AviDemuxer* demux) {
+    MediaIO* io = demux->io;
+    s64 idx1 = demux->layout.idx1;
+    u32 count = demux->layout.idx1Size / 16;
+    s64 base = -1;
+
+    if(demux->layout.moviCount == 0) return -1;
+
+    for(u32 done = 0; done < count; ) {
+        int n = count - done < AVI_INDEX_BLOCK / 16 ? (int)(count - done) : AVI_INDEX_BLOCK / 16;
+        if(SeekMediaIO(io, idx1 + (s64)done * 16) != 0 ||
+           ReadMediaIO(io, demux->block, n * 16) != n * 16) return -1;
+
+        for(int i = 0; i < n; i++) {
+            const u8* e = demux->block + i * 16;
+            u32 flags = GetLE32(e + 4);
+            int stream = StreamOfChunk(e);
+            if((flags & AVIIF_LIST) || stream < 0 || stream >= demux->info.streams) continue;
+
+            u32 offset = GetLE32(e + 8);
+            if(base < 0) {
+                u8 id[4];
+                base = demux->layout.movi[0];
+                if(SeekMediaIO(io, base + offset) != 0 || ReadMediaIO(io, id, 4) != 4 ||
+                   memcmp(id, e, 4) != 0) {
+                    if(SeekMediaIO(io, offset) == 0 && ReadMediaIO(io, id, 4) == 4 &&
+                       memcmp(id, e, 4) == 0) base = 0;
+                }
+            }
+
+            if(AddEntry(&demux->track[stream], base + offset + 8, GetLE32(e + 12),
+                        (flags & AVIIF_KEYFRAME) != 0) != 0) return -1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+// No usable index: walk the chunk headers of every movi list. Nothing
+// marks keyframes here, so every chunk counts as one.
+static int ScanMovi(AviDemuxer* demux) {
+    MediaIO* io = demux->io;
+    u8 header[12];
+
+    for(int m = 0; m < demux->layout.moviCount; m++) {
+        s64 pos = demux->layout.movi[m] + 4;
+        s64 end = demux->layout.moviEnd[m];
+
+        while(pos + 8 <= end) {
+            if(SeekMediaIO(io, pos) != 0 || ReadMediaIO(io, header, 8) != 8) break;
+
+            u32 size = GetLE32(header + 4);
+
+            // Step into "rec " lists, their chunks follow the list type
+            if(IsFourcc(header, "LIST")) {
+                pos += 12;
+                continue;
+            }
+
+            // A truncated last chunk ends the scan
+            if(pos + 8 + size > end) break;
+
+            int stream = StreamOfChunk(header);
+            if(stream >= 0 && stream < demux->info.streams) {
+                if(AddEntry(&demux->track[stream], pos + 8, size, 1) != 0) return -1;
+            }
+
+            pos += 8 + size + (size & 1);
+        }
+    }
+
+    return 0;
+}
+
+static int BuildKeyframes(AviTrack* t) {
+    u32 count = 0;
+    for(int i = 0; i < t->count; i++) {
+        count += AVI_ENTRY_KEY(t->entries[i]);
+    }
+
+    // Some muxers flag nothing; then any frame is a place to start
+    int all = count == 0;
+    if(all) count = (u32)t->count;
+
+    t->keyframes = malloc((count ? count : 1) * sizeof(u32));
+    if(!t->keyframes) return -1;
+
+    for(int i = 0; i < t->count; i++) {
+        if(all || AVI_ENTRY_KEY(t->entries[i])) t->keyframes[t->keyframeCount++] = i;
+    }
+
+    return 0;
+}
+
+// Keyframes and totals from the entries, however they were loaded
+static int FinishIndex(AviDemuxer* demux) {
+    AviInfo* info = &demux->info;
+
+    for(int i = 0; i < info->streams; i++) {
+        AviTrack* t = &demux->track[i];
+
+        // Give back the slack of the doubling
+        if(t->count > 0 && t->count < t->capacity) {
+            u64* shrunk = realloc(t->entries, t->count * sizeof(u64));
+            if(shrunk) {
+                t->entries = shrunk;
+                t->capacity = t->count;
+            }
+        }
+
+        info->stream[i].chunks = t->count;
+    }
+
+    AviTrack* seek = &demux->track[demux->seekStream];
+    if(BuildKeyframes(seek) != 0) return -1;
+    info->stream[demux->seekStream].keyframes = seek->keyframeCount;
+
+    // Each video chunk is a frame, dropped ones included
+    if(info->videoStream >= 0 && seek->count > 0) {
+        info->totalFrames = seek->count;
+        if(info->frameRate && info->frameScale) {
+            info->duration = (int)(info->totalFrames * info->frameScale / info->frameRate);
+        }
+    }
+
+    return 0;
+}
+
+static int LoadIndex(AviDemuxer* demux) {
+    AviInfo* info = &demux->info;
+    int haveIndx = 0;
+
+    for(int i = 0; i < info->streams; i++) {
+        if(demux->layout.indx[i]) haveIndx = 1;
+    }
+
+    info->index = AVI_INDEX_NONE;
+    if(haveIndx) {
+        int ok = 1;
+        for(int i = 0; i < info->streams && ok; i++) {
+            if(demux->layout.indx[i] && LoadOpenDmlIndex(demux, i) != 0) ok = 0;
+        }
+        if(ok) info->index = AVI_INDEX_OPENDML;
+        else ClearIndex(demux);
+    }
+    if(info->index == AVI_INDEX_NONE && demux->layout.idx1) {
+        if(LoadIdx1(demux) == 0) info->index = AVI_INDEX_IDX1;
+        else ClearIndex(demux);
+    }
+    if(info->index == AVI_INDEX_NONE && ScanMovi(demux) != 0) return -1;
+
+    return FinishIndex(demux);
+}
+
+// Entries as WriteAviIndex stored them. Returns 0, or -1 if they do not
+// fit this file.
+static int ReadIndex(AviDemuxer* demux, SidecarBuffer* index) {
+    AviInfo* info = &demux->info;
+
+    info->index = (AviIndexType)GetSidecar32(index);
+    if((int)GetSidecar32(index) != info->streams) return -1;
+
+    for(int i = 0; i < info->streams && !index->error; i++) {
+        AviTrack* t = &demux->track[i];
+        u32 count = GetSidecar32(index);
+        if(count > (u32)(index->size - index->at) / 8) return -1;
+
+        t->entries = malloc((count ? count : 1) * sizeof(u64));
+        if(!t->entries) return -1;
+        t->capacity = count;
+
+        for(u32 n = 0; n < count; n++) {
+            u64 entry = GetSidecar64(index);
+            if(AVI_ENTRY_OFFSET(entry) + AVI_ENTRY_SIZE(entry) > demux->io->size) return -1;
+            t->entries[t->count++] = entry;
+        }
+    }
+
+    return index->error ? -1 : 0;
+}
+
+static AviDemuxer* Open(MediaIO* io, SidecarBuffer* index) {
+    AviDemuxer* demux = calloc(1, sizeof(AviDemuxer));
+    if(!demux) return NULL;
+
+    demux->io = io;
+    demux->block = malloc(AVI_INDEX_BLOCK);
+    if(!demux->block || ParseAvi(io, &demux->info, &demux->layout, 0) != 0) {
+        CloseAviDemuxer(demux);
+        return NULL;
+    }
+
+    demux->seekStream = demux->info.videoStream >= 0 ? demux->info.videoStream : 0;
+
+    int loaded = 0;
+    if(index) {
+        if(ReadIndex(demux, index) == 0) loaded = 1;
+        else ClearIndex(demux);
+    }
+
+    if(loaded ? FinishIndex(demux) != 0 : LoadIndex(demux) != 0) {
+        CloseAviDemuxer(demux);
+        return NULL;
+    }
+
+    // Only needed while loading the index
+    free(demux->block);
+    demux->block = NULL;
+
+    return demux;
+}
+
+AviDemuxer* OpenAviDemuxer(MediaIO* io) {
+    return Open(io, NULL);
+}
+
+AviDemuxer* OpenAviDemuxerWithIndex(MediaIO* io, SidecarBuffer* index) {
+    return Open(io, index);
+}
+
+void CloseAviDemuxer(AviDemuxer* demux) {
+    if(!demux) return;
+
+    ClearIndex(demux);
+    free(demux->block);
+    free(demux);
+}
+
+const AviInfo* GetAviInfo(const AviDemuxer* demux) {
+    return &demux->info;
+}
+
+static int ReadTrackPacket(AviDemuxer* demux, int stream, AviPacket* packet, u8* buffer, int bufferSize) {
+    AviTrack* t = &demux->track[stream];
+    if(t->next >= t->count) return 0;
+
+    u64 e = t->entries[t->next];
+    packet->stream = stream;
+    packet->keyframe = AVI_ENTRY_KEY(e);
+    packet->number = t->next;
+    packet->offset = AVI_ENTRY_OFFSET(e);
+    packet->size = AVI_ENTRY_SIZE(e);
+    t->next++;
+
+    int n = packet->size < bufferSize ? packet->size : bufferSize;
+    if(n > 0) {
+        if(SeekMediaIO(demux->io, packet->offset) != 0) return 0;
+        if(ReadMediaIO(demux->io, buffer, n) != n) return 0;
+    }
+
+    return 1;
+}
+
+int ReadAviPacket(AviDemuxer* demux, AviPacket* packet, u8* buffer, int bufferSize) {
+    int stream = -1;
+    s64 offset = 0;
+
+    // Streams are interleaved in the file; take the one stored first
+    for(int i = 0; i < demux->info.streams; i++) {
+        const AviTrack* t = &demux->track[i];
+        if(t->next >= t->count) continue;
+
+        s64 o = AVI_ENTRY_OFFSET(t->entries[t->next]);
+        if(stream < 0 || o < offset) {
+            stream = i;
+            offset = o;
+        }
+    }
+    if(stream < 0) return 0;
+
+    return ReadTrackPacket(demux, stream, packet, buffer, bufferSize);
+}
+
+int ReadAviStreamPacket(AviDemuxer* demux, int stream, AviPacket* packet, u8* buffer, int bufferSize) {
+    if(stream < 0 || stream >= demux->info.streams) return 0;
+    return ReadTrackPacket(demux, stream, packet, buffer, bufferSize);
+}
+
+// First entry stored at or after offset
+static int FindEntryAfter(const AviTrack* t, s64 offset) {
+    int lo = 0, hi = t->count;
+
+    while(lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(AVI_ENTRY_OFFSET(t->entries[mid]) < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return lo;
+}
+
+s64 SeekAviFrame(AviDemuxer* demux, s64 frame) {
+    AviTrack* seek = &demux->track[demux->seekStream];
+    if(seek->keyframeCount == 0) return -1;
+
+    // Last keyframe at or before frame
+    int lo = 0, hi = seek->keyframeCount - 1;
+    while(lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if(seek->keyframes[mid] <= frame) lo = mid;
+        else hi = mid - 1;
+    }
+
+    int key = seek->keyframes[lo];
+    s64 offset = AVI_ENTRY_OFFSET(seek->entries[key]);
+
+    for(int i = 0; i < demux->info.streams; i++) {
+        AviTrack* t = &demux->track[i];
+        t->next = t == seek ? key : FindEntryAfter(t, offset);
+    }
+
+    return key;
+}
+
+s64 SeekAviStreamBytes(AviDemuxer* demux, int stream, s64 bytes) {
+    if(stream < 0 || stream >= demux->info.streams || bytes < 0) return -1;
+
+    // Chunks of a PCM track vary in size, so their sizes are added up
+    AviTrack* t = &demux->track[stream];
+    s64 start = 0;
+    for(int i = 0; i < t->count; i++) {
+        int size = AVI_ENTRY_SIZE(t->entries[i]);
+        if(start + size > bytes) {
+            t->next = i;
+            return start;
+        }
+        start += size;
+    }
+    if(bytes > start) return -1;
+
+    t->next = t->count;
+    return start;
+}
+
+s64 GetAviPosition(const AviDemuxer* demux) {
+    return demux->track[demux->seekStream].next;
+}
+
+int ReadAviInfo(MediaIO* io, AviInfo* info) {
+    AviLayout layout;
+    return ParseAvi(io, info, &layout, 1);
+}
+
+int WriteAviIndex(const AviDemuxer* demux, SidecarBuffer* index) {
+    const AviInfo* info = &demux->info;
+
+    PutSidecar32(index, info->index);
+    PutSidecar32(index, info->streams);
+    for(int i = 0; i < info->streams; i++) {
+        const AviTrack* t = &demux->track[i];
+
+        PutSidecar32(index, t->count);
+        for(int n = 0; n < t->count; n++) {
+            PutSidecar64(index, t->entries[n]);
+        }
+    }
+
+    return index->error ? -1 : 0;
+}
@@ -0,0 +1,105 @@
+#ifndef AVI_H
+#define AVI_H
+
+#include "platform.h"
+#include "mediaio.h"
+#include "registry.h"
+
+// RIFF/AVI demuxer. The stream headers are parsed from "hdrl" and the
+// chunk index is loaded once at open into one packed 64-bit entry per
+// chunk and stream: the OpenDML "indx"/"ix##" indexes when present (files
+// past 1 GB), else "idx1", else a walk over the "movi" chunk headers.
+// Seeks are a binary search over the keyframe list of the video stream.
+
+#define AVI_MAX_STREAMS 8
+
+typedef enum {
+    AVI_STREAM_OTHER,
+    AVI_STREAM_VIDEO,
+    AVI_STREAM_AUDIO
+} AviStreamType;
+
+typedef enum {
+    AVI_INDEX_NONE,     // built by walking the movi lists
+    AVI_INDEX_IDX1,
+    AVI_INDEX_OPENDML
+} AviIndexType;
+
+typedef struct {
+    AviStreamType type;
+    u32 handler;        // fccHandler, or biCompression for video
+    u32 scale;          // rate / scale units per second
+    u32 rate;
+    s64 length;         // in rate / scale units
+    s64 chunks;         // index entries
+    s64 keyframes;
+
+    // Video
+    int width;
+    int height;
+    MediaFieldOrder fieldOrder;     // from vprp
+
+    // Audio
+    int formatTag;
+    int channels;
+    int sampleRate;
+    int bitsPerSample;
+    int blockAlign;
+} AviStream;
+
+typedef struct {
+    int streams;
+    AviStream stream[AVI_MAX_STREAMS];
+    int videoStream;    // -1 when there is none
+    int audioStream;
+    int width;
+    int height;
+    u32 frameRate;      // frames per second as frameRate / frameScale
+    u32 frameScale;
+    s64 totalFrames;    // video frames over all RIFF segments
+    int duration;       // seconds
+    AviIndexType index;
+} AviInfo;
+
+typedef struct {
+    int stream;
+    int keyframe;
+    s64 number;         // chunk number within the stream
+    s64 offset;         // of the payload
+    int size;           // full payload size, even if the buffer was smaller
+} AviPacket;
+
+typedef struct AviDemuxer AviDemuxer;
+
+// Function prototypes
+AviDemuxer* OpenAviDemuxer(MediaIO* io);
+void CloseAviDemuxer(AviDemuxer* demuxer);
+const AviInfo* GetAviInfo(const AviDemuxer* demuxer);
+
+// Next chunk of any stream in file order. Copies at most bufferSize bytes
+// of the payload. Returns 1 for a packet, 0 at the end of the movie.
+int ReadAviPacket(AviDemuxer* demuxer, AviPacket* packet, u8* buffer, int bufferSize);
+// Next chunk of one stream, each stream keeps its own place
+int ReadAviStreamPacket(AviDemuxer* demuxer, int stream, AviPacket* packet, u8* buffer, int bufferSize);
+
+// Move to the last video keyframe at or before frame. The other streams
+// continue from the first chunk stored after that keyframe. Returns the
+// keyframe's frame number, or -1.
+s64 SeekAviFrame(AviDemuxer* demuxer, s64 frame);
+// Move one stream to the chunk holding byte offset bytes of its data,
+// counted over the payloads in order (the sample data of an audio track).
+// Returns the offset that chunk starts at, or -1 past the end.
+s64 SeekAviStreamBytes(AviDemuxer* demuxer, int stream, s64 bytes);
+// Video frame number of the next video packet
+s64 GetAviPosition(const AviDemuxer* demuxer);
+
+// Stream headers only, without loading the index
+int ReadAviInfo(MediaIO* io, AviInfo* info);
+
+// The chunk index for a sidecar file (sidecar.h), and open with it
+// instead of reading the file's own. A stale index falls back to that.
+struct SidecarBuffer;
+int WriteAviIndex(const AviDemuxer* demuxer, struct SidecarBuffer* index);
+AviDemuxer* OpenAviDemuxerWithIndex(MediaIO* io, struct SidecarBuffer* index);
+
+#endif // AVI_H
@@ -0,0 +1,46 @@
+#include <string.h>
+#include "avsync.h"
+
+void ResetMediaClock(MediaClock* clock, int rate, s64 start) {
+    clock->rate = rate > 0 ? rate : 1000000;
+    clock->start = start;
+    clock->position = 0;
+    memset(&clock->stats, 0, sizeof(AVSyncStats));
+}
+
+void SetMediaClockPosition(MediaClock* clock, s64 position) {
+    if(position > clock->position) clock->position = position;
+}
+
+void SetMediaClockRate(MediaClock* clock, int rate) {
+    if(rate <= 0 || rate == clock->rate) return;
+
+    s64 now = GetMediaClock(clock);
+    clock->rate = rate;
+    clock->start = now - clock->position * 1000 / rate;
+}
+
+void SetMediaClockOffset(MediaClock* clock, s32 offset) {
+    if(offset > AVSYNC_OFFSET_MAX) offset = AVSYNC_OFFSET_MAX;
+    if(offset < -AVSYNC_OFFSET_MAX) offset = -AVSYNC_OFFSET_MAX;
+    clock->offset = offset;
+}
+
+s64 GetMediaClock(const MediaClock* clock) {
+    return clock->start + clock->position * 1000 / clock->rate;
+}
+
+s64 GetVideoClock(const MediaClock* clock) {
+    return GetMediaClock(clock) - clock->offset;
+}
+
+void CountSyncedFrame(MediaClock* clock, s64 pts) {
+    AVSyncStats* stats = &clock->stats;
+    s64 drift = pts - GetVideoClock(clock);
+    s32 size = (s32)(drift < 0 ? -drift : drift);
+
+    stats->frames++;
+    stats->drift = (s32)drift;
+    stats->averageDrift = stats->frames == 1 ? size : stats->averageDrift + (size - stats->averageDrift) / 8;
+    if(size > (stats->worstDrift < 0 ? -stats->worstDrift : stats->worstDrift)) stats->worstDrift = (s32)drift;
+}
@@ -0,0 +1,48 @@
+#ifndef AVSYNC_H
+#define AVSYNC_H
+
+#include "platform.h"
+
+// The media clock, mastered by the audio: the voice's sample position
+// (GetAudioStreamPosition) turned into milliseconds, from scratch every
+// time rather than added up, so it can't wander from the sound however
+// long the file. Without audio the master is the system timer in
+// microseconds. Video is shown against the clock minus the user's A/V
+// offset, and the pipeline drops or repeats frames to stay on it.
+#define AVSYNC_OFFSET_STEP  10      // ms per press in the settings
+#define AVSYNC_OFFSET_MAX   1000
+
+typedef struct {
+    u32 frames;             // new frames shown
+    s32 drift;              // ms the last one was off its time, + early
+    s32 averageDrift;       // running average of the size of it
+    s32 worstDrift;         // largest either way
+} AVSyncStats;
+
+typedef struct {
+    int rate;               // master units per second: sample rate, or 1000000
+    s64 start;              // ms at master position 0
+    s64 position;           // latest master position, only goes forward
+    s32 offset;             // ms; + shows video later
+    AVSyncStats stats;
+} MediaClock;
+
+// Function prototypes
+
+// Starts the clock at start ms on a master counting rate per second
+// (after a seek too); the offset is kept, the statistics cleared.
+void ResetMediaClock(MediaClock* clock, int rate, s64 start);
+void SetMediaClockPosition(MediaClock* clock, s64 position);
+// A new master rate from here on (audio played faster or slower), the
+// clock carrying on from where it is
+void SetMediaClockRate(MediaClock* clock, int rate);
+// Offsets beyond AVSYNC_OFFSET_MAX either way are clamped
+void SetMediaClockOffset(MediaClock* clock, s32 offset);
+// ms of audio played
+s64 GetMediaClock(const MediaClock* clock);
+// ms of video that should be on screen
+s64 GetVideoClock(const MediaClock* clock);
+// Records a new frame going up with timestamp pts (ms)
+void CountSyncedFrame(MediaClock* clock, s64 pts);
+
+#endif // AVSYNC_H
@@ -0,0 +1,207 @@
+#include "colorkernels.h"
+#include "videofilter.h"
+
+static inline int ClampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+static inline float ClampFloat(float value, float low, float high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+void FilterPairsRef(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]) {
+    const int round = 1 << (VIDEO_FILTER_MATRIX_SHIFT - 1);
+    s32 m00 = matrix[0][0], m01 = matrix[0][1];
+    s32 m10 = matrix[1][0], m11 = matrix[1][1];
+
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        int cb = frame[1] - VIDEO_CHROMA_ZERO;
+        int cr = frame[3] - VIDEO_CHROMA_ZERO;
+
+        frame[0] = luma[frame[0]];
+        frame[2] = luma[frame[2]];
+        frame[1] = ClampInt(VIDEO_CHROMA_ZERO + ((m00 * cb + m01 * cr + round) >> VIDEO_FILTER_MATRIX_SHIFT),
+                            VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+        frame[3] = ClampInt(VIDEO_CHROMA_ZERO + ((m10 * cb + m11 * cr + round) >> VIDEO_FILTER_MATRIX_SHIFT),
+                            VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+    }
+}
+
+// The matrix scaled to floats, columns as the paired-single code holds
+// them: lane 0 makes Cb, lane 1 Cr. The bias carries the 128 offset and
+// the 0.5 of the fixed-point rounding.
+typedef struct {
+    float column0[2];
+    float column1[2];
+    float bias[2];
+    float zero[2];
+    float low[2];
+    float high[2];
+} FilterConstants;
+
+static void GetFilterConstants(const s32 matrix[2][2], FilterConstants* k) {
+    const float scale = 1.0f / (1 << VIDEO_FILTER_MATRIX_SHIFT);
+
+    k->column0[0] = matrix[0][0] * scale;
+    k->column0[1] = matrix[1][0] * scale;
+    k->column1[0] = matrix[0][1] * scale;
+    k->column1[1] = matrix[1][1] * scale;
+    k->bias[0] = k->bias[1] = VIDEO_CHROMA_ZERO + 0.5f;
+    k->zero[0] = k->zero[1] = VIDEO_CHROMA_ZERO;
+    k->low[0] = k->low[1] = VIDEO_CHROMA_MIN;
+    k->high[0] = k->high[1] = VIDEO_CHROMA_MAX;
+}
+
+void FilterPairsFloat(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]) {
+    FilterConstants k;
+    GetFilterConstants(matrix, &k);
+
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        float cb = frame[1] - k.zero[0];
+        float cr = frame[3] - k.zero[1];
+
+        // ps_madds0 then ps_madds1, one lane each
+        float outCb = k.column0[0] * cb + k.bias[0];
+        float outCr = k.column0[1] * cb + k.bias[1];
+        outCb = k.column1[0] * cr + outCb;
+        outCr = k.column1[1] * cr + outCr;
+
+        frame[0] = luma[frame[0]];
+        frame[2] = luma[frame[2]];
+        frame[1] = (u8)ClampFloat(outCb, k.low[0], k.high[0]);
+        frame[3] = (u8)ClampFloat(outCr, k.low[1], k.high[1]);
+    }
+}
+
+void InvertPairsRef(u8* frame, int pairs) {
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        frame[0] = ClampInt(VIDEO_LUMA_BLACK + VIDEO_LUMA_WHITE - frame[0], VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+        frame[2] = ClampInt(VIDEO_LUMA_BLACK + VIDEO_LUMA_WHITE - frame[2], VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+        frame[1] = ClampInt(2 * VIDEO_CHROMA_ZERO - frame[1], VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+        frame[3] = ClampInt(2 * VIDEO_CHROMA_ZERO - frame[3], VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+    }
+}
+
+// Lane 0 is Y, lane 1 chroma, as a pair load of Y0 Cb or Y1 Cr gives them
+static const float invertPivot[2] = {VIDEO_LUMA_BLACK + VIDEO_LUMA_WHITE, 2 * VIDEO_CHROMA_ZERO};
+static const float invertLow[2] = {VIDEO_LUMA_BLACK, VIDEO_CHROMA_MIN};
+static const float invertHigh[2] = {VIDEO_LUMA_WHITE, VIDEO_CHROMA_MAX};
+
+void InvertPairsFloat(u8* frame, int pairs) {
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        for(int k = 0; k < 4; k++) {
+            float v = invertPivot[k & 1] - frame[k];
+            frame[k] = (u8)ClampFloat(v, invertLow[k & 1], invertHigh[k & 1]);
+        }
+    }
+}
+
+#if COLOR_KERNELS_PS
+
+// GQR2 converts u8 on quantized loads and stores, unscaled. It is set for
+// the length of a call and put back, GQR0 stays the plain float one.
+#define GQR2        914
+#define GQR_U8      0x00040004
+
+static inline u32 SetQuantizer(u32 value) {
+    u32 old;
+    __asm__ volatile("mfspr %0, %1" : "=r"(old) : "i"(GQR2));
+    __asm__ volatile("mtspr %0, %1" : : "i"(GQR2), "r"(value));
+    return old;
+}
+
+static inline void RestoreQuantizer(u32 value) {
+    __asm__ volatile("mtspr %0, %1" : : "i"(GQR2), "r"(value));
+}
+
+void FilterPairsPS(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]) {
+    if(pairs <= 0) return;
+
+    FilterConstants k;
+    GetFilterConstants(matrix, &k);
+    u32 old = SetQuantizer(GQR_U8);
+
+    // Per pair: Y0 and Y1 through the table in the integer unit while
+    // Cb and Cr load as one (Cb, Cr) pair, go through the matrix and
+    // the clamp, and store back one lane at a time
+    double column0, column1, bias, zero, low, high, cb, cr, c, t, u;
+    u32 y0, y1;
+    __asm__ volatile(
+        "psq_l      %[column0], 0(%[k]), 0, 0\n\t"
+        "psq_l      %[column1], 8(%[k]), 0, 0\n\t"
+        "psq_l      %[bias], 16(%[k]), 0, 0\n\t"
+        "psq_l      %[zero], 24(%[k]), 0, 0\n\t"
+        "psq_l      %[low], 32(%[k]), 0, 0\n\t"
+        "psq_l      %[high], 40(%[k]), 0, 0\n\t"
+        "mtctr      %[pairs]\n"
+        "1:\n\t"
+        "lbz        %[y0], 0(%[p])\n\t"
+        "lbz        %[y1], 2(%[p])\n\t"
+        "psq_l      %[cb], 1(%[p]), 1, 2\n\t"
+        "psq_l      %[cr], 3(%[p]), 1, 2\n\t"
+        "lbzx       %[y0], %[luma], %[y0]\n\t"
+        "lbzx       %[y1], %[luma], %[y1]\n\t"
+        "ps_merge00 %[c], %[cb], %[cr]\n\t"
+        "ps_sub     %[c], %[c], %[zero]\n\t"
+        "ps_madds0  %[t], %[column0], %[c], %[bias]\n\t"
+        "ps_madds1  %[t], %[column1], %[c], %[t]\n\t"
+        "ps_sub     %[u], %[t], %[low]\n\t"
+        "ps_sel     %[t], %[u], %[t], %[low]\n\t"
+        "ps_sub     %[u], %[high], %[t]\n\t"
+        "ps_sel     %[t], %[u], %[t], %[high]\n\t"
+        "stb        %[y0], 0(%[p])\n\t"
+        "stb        %[y1], 2(%[p])\n\t"
+        "psq_st     %[t], 1(%[p]), 1, 2\n\t"
+        "ps_merge11 %[t], %[t], %[t]\n\t"
+        "psq_st     %[t], 3(%[p]), 1, 2\n\t"
+        "addi       %[p], %[p], 4\n\t"
+        "bdnz       1b"
+        : [p] "+b"(frame), [y0] "=&r"(y0), [y1] "=&r"(y1),
+          [column0] "=&f"(column0), [column1] "=&f"(column1), [bias] "=&f"(bias),
+          [zero] "=&f"(zero), [low] "=&f"(low), [high] "=&f"(high),
+          [cb] "=&f"(cb), [cr] "=&f"(cr), [c] "=&f"(c), [t] "=&f"(t), [u] "=&f"(u)
+        : [k] "b"(&k), [luma] "b"(luma), [pairs] "r"(pairs)
+        : "ctr", "memory");
+
+    RestoreQuantizer(old);
+}
+
+void InvertPairsPS(u8* frame, int pairs) {
+    if(pairs <= 0) return;
+
+    u32 old = SetQuantizer(GQR_U8);
+
+    // (Y0, Cb) and (Y1, Cr) are each one pair load and one pair store
+    double pivot, low, high, a, b, u;
+    __asm__ volatile(
+        "psq_l      %[pivot], 0(%[pivots]), 0, 0\n\t"
+        "psq_l      %[low], 0(%[lows]), 0, 0\n\t"
+        "psq_l      %[high], 0(%[highs]), 0, 0\n\t"
+        "mtctr      %[pairs]\n"
+        "1:\n\t"
+        "psq_l      %[a], 0(%[p]), 0, 2\n\t"
+        "psq_l      %[b], 2(%[p]), 0, 2\n\t"
+        "ps_sub     %[a], %[pivot], %[a]\n\t"
+        "ps_sub     %[b], %[pivot], %[b]\n\t"
+        "ps_sub     %[u], %[a], %[low]\n\t"
+        "ps_sel     %[a], %[u], %[a], %[low]\n\t"
+        "ps_sub     %[u], %[b], %[low]\n\t"
+        "ps_sel     %[b], %[u], %[b], %[low]\n\t"
+        "ps_sub     %[u], %[high], %[a]\n\t"
+        "ps_sel     %[a], %[u], %[a], %[high]\n\t"
+        "ps_sub     %[u], %[high], %[b]\n\t"
+        "ps_sel     %[b], %[u], %[b], %[high]\n\t"
+        "psq_st     %[a], 0(%[p]), 0, 2\n\t"
+        "psq_st     %[b], 2(%[p]), 0, 2\n\t"
+        "addi       %[p], %[p], 4\n\t"
+        "bdnz       1b"
+        : [p] "+b"(frame), [pivot] "=&f"(pivot), [low] "=&f"(low), [high] "=&f"(high),
+          [a] "=&f"(a), [b] "=&f"(b), [u] "=&f"(u)
+        : [pivots] "b"(invertPivot), [lows] "b"(invertLow), [highs] "b"(invertHigh),
+          [pairs] "r"(pairs)
+        : "ctr", "memory");
+
+    RestoreQuantizer(old);
+}
+
+#endif
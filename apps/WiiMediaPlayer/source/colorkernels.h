@@ -0,0 +1,50 @@
+#ifndef COLORKERNELS_H
+#define COLORKERNELS_H
+
+#include "platform.h"
+
+// Per-pair color kernels for the YCbYCr frame (videofilter.h), the ones
+// that do arithmetic rather than table lookups. Each comes in three
+// forms that give the same bytes:
+//   ...Ref    fixed point, the definition
+//   ...Float  the paired-single algorithm in portable single precision,
+//             so a host can check it bit for bit against the reference
+//   ...PS     that algorithm in paired-single code, two lanes per
+//             instruction, with quantized loads and stores doing the
+//             u8 conversions; Broadway only
+// The float forms are exact, not close: every intermediate is an integer
+// or a multiple of 2^-12 below 2^12, well inside a 24-bit mantissa, and
+// values are clamped before the truncating store so it acts as floor.
+// The plain names pick Ref. The PS forms have not yet been run on
+// Broadway, so they are opt-in (make paired, COLOR_KERNELS_PAIRED) until
+// kernelbench's comparison has passed on hardware or in Dolphin.
+
+#if defined(GEKKO) && defined(__PPC__) && defined(COLOR_KERNELS_PAIRED)
+#define COLOR_KERNELS_PS 1
+#else
+#define COLOR_KERNELS_PS 0
+#endif
+
+// Function prototypes
+
+// Y through the table, then (Cb, Cr) - 128 through the Q12 matrix
+// (VIDEO_FILTER_MATRIX_SHIFT), back around 128 and clamped to 16-240
+void FilterPairsRef(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]);
+void FilterPairsFloat(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]);
+
+// Y and Cb/Cr mirrored within video range
+void InvertPairsRef(u8* frame, int pairs);
+void InvertPairsFloat(u8* frame, int pairs);
+
+#if COLOR_KERNELS_PS
+void FilterPairsPS(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]);
+void InvertPairsPS(u8* frame, int pairs);
+
+#define FilterPairs FilterPairsPS
+#define InvertPairs InvertPairsPS
+#else
+#define FilterPairs FilterPairsRef
+#define InvertPairs InvertPairsRef
+#endif
+
+#endif // COLORKERNELS_H
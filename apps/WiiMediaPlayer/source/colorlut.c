@@ -0,0 +1,255 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "colorlut.h"
+#include "mem2.h"
+#include "videofilter.h"
+
+static inline int ClampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Tetrahedral: walk from the cell's first node to its last one axis at
+// a time, largest position first. Which axes come first and second, by
+// (fy >= fb, fb >= fr, fy >= fr); the two combinations that can't happen
+// get any order. A table rather than branches: on noisy video the
+// comparisons are a coin toss.
+static const u8 tetrahedra[8][3] = {
+    {2, 1, 0}, {2, 1, 0}, {1, 2, 0}, {1, 0, 2}, {2, 0, 1}, {0, 2, 1}, {0, 1, 2}, {0, 1, 2}
+};
+
+int BuildColorLut(ColorLut* lut, int size, ColorLutMap map, const void* context) {
+    if(size != COLOR_LUT_SMALL && size != COLOR_LUT_LARGE) return -1;
+
+    int count = size * size * size;
+    u8* nodes = (u8*)lut->chroma;
+    if(!nodes || lut->size != size) {
+        nodes = Mem2Alloc(count * 5);
+        if(!nodes) return -1;
+        Mem2Free(lut->chroma);
+    }
+    u32* chroma = (u32*)nodes;
+    u8* luma = nodes + count * 4;
+
+    // Node i sits at i * 255 / (size - 1), so 0 and 255 are both nodes
+    for(int n = 0; n < count; n++) {
+        int y = n / (size * size), cb = n / size % size, cr = n % size;
+        float in[3] = {y * 255.0f / (size - 1), cb * 255.0f / (size - 1), cr * 255.0f / (size - 1)};
+        float out[3];
+        map(context, in, out);
+
+        luma[n] = ClampInt((int)lrintf(out[0]), 0, 255);
+        chroma[n] = ClampInt((int)lrintf(out[1]), 0, 255) | ClampInt((int)lrintf(out[2]), 0, 255) << 16;
+    }
+
+    lut->size = size;
+    lut->chroma = chroma;
+    lut->luma = luma;
+
+    u32 stride[3] = {size * size, size, 1};
+    for(int i = 0; i < 8; i++) {
+        lut->path[i][0] = stride[tetrahedra[i][0]];
+        lut->path[i][1] = stride[tetrahedra[i][0]] + stride[tetrahedra[i][1]];
+    }
+    lut->far = stride[0] + stride[1] + stride[2];
+
+    // The last value lands on the last node: the cell before it, all the
+    // way across
+    for(int v = 0; v < 256; v++) {
+        int position = v * (size - 1);
+        int cell = position / 255;
+        if(cell > size - 2) cell = size - 2;
+
+        lut->weight[v] = ((position - cell * 255) * 256 + 127) / 255;
+        for(int axis = 0; axis < 3; axis++) lut->offset[axis][v] = cell * stride[axis];
+    }
+    return 0;
+}
+
+void FreeColorLut(ColorLut* lut) {
+    Mem2Free(lut->chroma);
+    lut->chroma = NULL;
+    lut->luma = NULL;
+    lut->size = 0;
+}
+
+static inline int Max(int a, int b) {
+    return a > b ? a : b;
+}
+
+static inline int Min(int a, int b) {
+    return a < b ? a : b;
+}
+
+// The corners of the tetrahedron around a point and their weights, which
+// sum to 256
+static inline void Locate(const ColorLut* lut, u32 first, int fy, int fb, int fr, u32 corner[4], int weight[4]) {
+    int index = (fy >= fb) << 2 | (fb >= fr) << 1 | (fy >= fr);
+    int high = Max(fy, Max(fb, fr)), low = Min(fy, Min(fb, fr));
+    int middle = fy + fb + fr - high - low;
+
+    corner[0] = first;
+    corner[1] = first + lut->path[index][0];
+    corner[2] = first + lut->path[index][1];
+    corner[3] = first + lut->far;
+    weight[0] = 256 - high;
+    weight[1] = high - middle;
+    weight[2] = middle - low;
+    weight[3] = low;
+}
+
+static inline int LookupLuma(const ColorLut* lut, int y, u32 chroma, int fb, int fr) {
+    u32 corner[4];
+    int weight[4];
+    Locate(lut, lut->offset[0][y] + chroma, lut->weight[y], fb, fr, corner, weight);
+
+    const u8* luma = lut->luma;
+    return (luma[corner[0]] * weight[0] + luma[corner[1]] * weight[1] + luma[corner[2]] * weight[2] +
+            luma[corner[3]] * weight[3] + 128) >> 8;
+}
+
+// Cb and Cr both at once: each product is at most 255 * 256, so the two
+// 16-bit lanes never carry into each other
+static inline u32 LookupChroma(const ColorLut* lut, int y, u32 chroma, int fb, int fr) {
+    u32 corner[4];
+    int weight[4];
+    Locate(lut, lut->offset[0][y] + chroma, lut->weight[y], fb, fr, corner, weight);
+
+    const u32* nodes = lut->chroma;
+    return nodes[corner[0]] * weight[0] + nodes[corner[1]] * weight[1] + nodes[corner[2]] * weight[2] +
+           nodes[corner[3]] * weight[3] + 0x00800080;
+}
+
+void ColorLutYUYV(const ColorLut* lut, u8* frame, int pairs) {
+    if(!lut->size) return;
+
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        int y0 = frame[0], cb = frame[1], y1 = frame[2], cr = frame[3];
+        u32 chroma = lut->offset[1][cb] + lut->offset[2][cr];
+        int fb = lut->weight[cb], fr = lut->weight[cr];
+
+        u32 mixed = LookupChroma(lut, (y0 + y1 + 1) >> 1, chroma, fb, fr);
+        frame[0] = LookupLuma(lut, y0, chroma, fb, fr);
+        frame[1] = mixed >> 8;
+        frame[2] = LookupLuma(lut, y1, chroma, fb, fr);
+        frame[3] = mixed >> 24;
+    }
+}
+
+// A .cube grid as read, red fastest
+typedef struct {
+    int size;
+    float* rgb;
+    float domainMin[3];
+    float domainMax[3];
+} CubeSource;
+
+static float Clamp01(float value) {
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+// Trilinear within the file's grid; the grid is fine enough that the
+// tetrahedral pass on top adds nothing
+static void SampleCube(const CubeSource* cube, const float rgb[3], float out[3]) {
+    int index[3];
+    float fraction[3];
+
+    for(int k = 0; k < 3; k++) {
+        float range = cube->domainMax[k] - cube->domainMin[k];
+        float position = range > 0.0f ? (rgb[k] - cube->domainMin[k]) / range : 0.0f;
+        position = Clamp01(position) * (cube->size - 1);
+        index[k] = (int)position;
+        if(index[k] > cube->size - 2) index[k] = cube->size - 2;
+        fraction[k] = position - index[k];
+    }
+
+    out[0] = out[1] = out[2] = 0.0f;
+    for(int corner = 0; corner < 8; corner++) {
+        int r = index[0] + (corner & 1), g = index[1] + ((corner >> 1) & 1), b = index[2] + (corner >> 2);
+        float weight = ((corner & 1) ? fraction[0] : 1.0f - fraction[0]) *
+                       (((corner >> 1) & 1) ? fraction[1] : 1.0f - fraction[1]) *
+                       ((corner >> 2) ? fraction[2] : 1.0f - fraction[2]);
+        const float* value = cube->rgb + ((b * cube->size + g) * cube->size + r) * 3;
+        for(int k = 0; k < 3; k++) out[k] += value[k] * weight;
+    }
+}
+
+// BT.601 video range both ways. Grid nodes that aren't RGB colors take
+// the grade of the nearest one plus how far off they are, so cells
+// straddling the gamut's edge stay smooth (and identity stays identity).
+static void CubeMap(const void* context, const float in[3], float out[3]) {
+    float y = (in[0] - VIDEO_LUMA_BLACK) / 219.0f;
+    float cb = (in[1] - VIDEO_CHROMA_ZERO) / 224.0f;
+    float cr = (in[2] - VIDEO_CHROMA_ZERO) / 224.0f;
+    float rgb[3] = {y + 1.402f * cr, y - 0.344136f * cb - 0.714136f * cr, y + 1.772f * cb};
+    float color[3] = {Clamp01(rgb[0]), Clamp01(rgb[1]), Clamp01(rgb[2])};
+    float graded[3];
+
+    SampleCube(context, color, graded);
+    float r = graded[0] + rgb[0] - color[0], g = graded[1] + rgb[1] - color[1], b = graded[2] + rgb[2] - color[2];
+    out[0] = VIDEO_LUMA_BLACK + 219.0f * (0.299f * r + 0.587f * g + 0.114f * b);
+    out[1] = VIDEO_CHROMA_ZERO + 224.0f * (-0.168736f * r - 0.331264f * g + 0.5f * b);
+    out[2] = VIDEO_CHROMA_ZERO + 224.0f * (0.5f * r - 0.418688f * g - 0.081312f * b);
+}
+
+static int ReadCube(FILE* file, CubeSource* cube) {
+    char line[256];
+    int count = 0, total = 0;
+
+    while(fgets(line, sizeof(line), file)) {
+        char* p = line;
+        while(isspace((unsigned char)*p)) p++;
+        if(*p == '\0' || *p == '#') continue;
+
+        if(strncmp(p, "LUT_3D_SIZE", 11) == 0) {
+            int size = atoi(p + 11);
+            if(cube->rgb || size < 2 || size > COLOR_LUT_MAX_SOURCE) return -1;
+            total = size * size * size;
+            cube->rgb = malloc(total * 3 * sizeof(float));
+            if(!cube->rgb) return -1;
+            cube->size = size;
+        } else if(strncmp(p, "DOMAIN_MIN", 10) == 0) {
+            if(sscanf(p + 10, "%f %f %f", &cube->domainMin[0], &cube->domainMin[1], &cube->domainMin[2]) != 3) {
+                return -1;
+            }
+        } else if(strncmp(p, "DOMAIN_MAX", 10) == 0) {
+            if(sscanf(p + 10, "%f %f %f", &cube->domainMax[0], &cube->domainMax[1], &cube->domainMax[2]) != 3) {
+                return -1;
+            }
+        } else if(strncmp(p, "LUT_3D_INPUT_RANGE", 18) == 0) {
+            float low, high;
+            if(sscanf(p + 18, "%f %f", &low, &high) != 2) return -1;
+            for(int k = 0; k < 3; k++) {
+                cube->domainMin[k] = low;
+                cube->domainMax[k] = high;
+            }
+        } else if(strncmp(p, "LUT_1D_SIZE", 11) == 0) {
+            return -1;
+        } else if(isalpha((unsigned char)*p)) {
+            continue;   // TITLE and the like
+        } else {
+            float* rgb = cube->rgb + count * 3;
+            if(count >= total || sscanf(p, "%f %f %f", &rgb[0], &rgb[1], &rgb[2]) != 3) return -1;
+            count++;
+        }
+    }
+    return total && count == total ? 0 : -1;
+}
+
+int LoadCubeLut(ColorLut* lut, const char* path) {
+    FILE* file = fopen(path, "r");
+    if(!file) return -1;
+
+    CubeSource cube = {0, NULL, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f}};
+    int result = ReadCube(file, &cube);
+    fclose(file);
+
+    if(result == 0) {
+        int size = cube.size > COLOR_LUT_SMALL ? COLOR_LUT_LARGE : COLOR_LUT_SMALL;
+        result = BuildColorLut(lut, size, CubeMap, &cube);
+    }
+    free(cube.rgb);
+    return result;
+}
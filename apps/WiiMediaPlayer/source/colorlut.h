@@ -0,0 +1,47 @@
+#ifndef COLORLUT_H
+#define COLORLUT_H
+
+#include "platform.h"
+
+// 3D lookup tables for color grading, on YCbYCr pairs (videofilter.h).
+// The table is a grid of COLOR_LUT_SMALL or COLOR_LUT_LARGE nodes per axis
+// over Y, Cb and Cr, each node holding the Y Cb Cr that comes out. In
+// between, the four nodes of the tetrahedron around the input are mixed
+// with weights in 1/256. Grading files are RGB in and RGB out; they are
+// resampled onto the grid once, when loaded, so per pixel there is no RGB
+// and no float, and every look costs the same. Tables are in MEM2 (mem2.h).
+//
+// Y is looked up per pixel with the pair's Cb/Cr; Cb/Cr once per pair,
+// at the pair's mean Y, as sepia does.
+#define COLOR_LUT_SMALL       17
+#define COLOR_LUT_LARGE       33
+#define COLOR_LUT_MAX_SOURCE  65    // largest .cube grid accepted
+
+typedef struct {
+    int size;               // nodes per axis, 0 while empty
+    u32* chroma;            // Cb | Cr << 16 per node, Cr fastest, then Cb, then Y
+    u8* luma;               // Y per node, after chroma in the same block
+    u32 offset[3][256];     // a value's cell along Y, Cb, Cr, in nodes
+    u16 weight[256];        // a value's position within its cell, 0-256
+    u32 path[8][2];         // a tetrahedron's second and third corner
+    u32 far;                // the cell's last corner
+} ColorLut;
+
+// What a table does at an input Y Cb Cr, all in byte units (0-255, not
+// rounded); out is rounded and clamped to 0-255
+typedef void (*ColorLutMap)(const void* context, const float in[3], float out[3]);
+
+// Function prototypes
+
+// Fills lut (zeroed, or built before) with size COLOR_LUT_SMALL or
+// COLOR_LUT_LARGE. Returns 0, or -1 for another size or no memory, with
+// lut as it was.
+int BuildColorLut(ColorLut* lut, int size, ColorLutMap map, const void* context);
+// Loads a .cube file (3D only, any DOMAIN_MIN/MAX), resampled to
+// COLOR_LUT_LARGE if it has more than COLOR_LUT_SMALL points per axis.
+// Returns 0, or -1 with lut as it was.
+int LoadCubeLut(ColorLut* lut, const char* path);
+void FreeColorLut(ColorLut* lut);
+void ColorLutYUYV(const ColorLut* lut, u8* frame, int pairs);
+
+#endif // COLORLUT_H
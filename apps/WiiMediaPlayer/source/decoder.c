@@ -1,247 +1,301 @@
-#include <gccore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <fat.h>
-
-// Decoder structures
-typedef struct {
-    FILE* file;
-    char filename[256];
-    int fileSize;
-    int currentPosition;
-    int duration;
-    int sampleRate;
-    int channels;
-    int bitDepth;
-} AudioDecoder;
-
-typedef struct {
-    FILE* file;
-    char filename[256];
-    int fileSize;
-    int currentPosition;
-    int duration;
-    int width;
-    int height;
-    int fps;
-    int bitrate;
-} VideoDecoder;
-
-// Global decoders
-static AudioDecoder* audioDecoder = NULL;
-static VideoDecoder* videoDecoder = NULL;
-
-// Function prototypes
-AudioDecoder* InitAudioDecoder(const char* filename);
-VideoDecoder* InitVideoDecoder(const char* filename);
-void CloseAudioDecoder(AudioDecoder* decoder);
-void CloseVideoDecoder(VideoDecoder* decoder);
-int ReadAudioFrame(AudioDecoder* decoder, void* buffer, int bufferSize);
-int ReadVideoFrame(VideoDecoder* decoder, void* buffer, int bufferSize);
-int GetAudioDuration(const char* filename);
-int GetVideoDuration(const char* filename);
-int GetVideoDimensions(const char* filename, int* width, int* height);
+#include "decoder.h"
+#include "metadata.h"
+#include "readahead.h"
+#include "sidecar.h"
+
+// Blocks each decoder keeps read ahead, 0 for synchronous reads
+static int readAheadWindow = MEDIA_READAHEAD_WINDOW;
+
+void SetDecoderReadAhead(int window) {
+    readAheadWindow = window;
+}
+
+// A sidecar that still matches the file names the format and carries its
+// index, so neither probing nor an index scan is needed. Otherwise the
+// content picks the format and the extension only breaks ties. Returns
+// the format, or NULL if none of the right type claims the file.
+static const MediaFormat* OpenStream(MediaIO* io, const char* filename, MediaType type,
+                                     MediaStreamInfo* info, void** stream, int* indexSize) {
+    char name[SIDECAR_FORMAT_SIZE];
+    SidecarBuffer index;
+
+    memset(info, 0, sizeof(MediaStreamInfo));
+    *stream = NULL;
+    *indexSize = 0;
+
+    // The registry's probe cache isn't shared with a browser probe
+    WaitMediaIOJob();
+
+    if(LoadSidecar(filename, io->size, io->mtime, name, info, &index) == 0) {
+        const MediaFormat* format = FindMediaFormat(name);
+        if(format && format->type == type && format->openIndexed) {
+            *stream = format->openIndexed(io, info, &index);
+            *indexSize = index.size;
+        }
+        FreeSidecarBuffer(&index);
+
+        if(*stream) return format;
+        SeekMediaIO(io, 0);
+        memset(info, 0, sizeof(MediaStreamInfo));
+        *indexSize = 0;
+    }
+
+    const MediaFormat* format = ProbeMediaFormat(io, filename);
+    if(!format || format->type != type) return NULL;
+
+    *stream = format->open(io, info);
+    return format;
+}
 
 AudioDecoder* InitAudioDecoder(const char* filename) {
     AudioDecoder* decoder = malloc(sizeof(AudioDecoder));
     if(!decoder) return NULL;
-    
+
+    memset(decoder, 0, sizeof(AudioDecoder));
+
     // Open file
-    decoder->file = fopen(filename, "rb");
-    if(!decoder->file) {
+    if(OpenMediaIO(&decoder->io, filename) != 0) {
         free(decoder);
         return NULL;
     }
-    
-    strcpy(decoder->filename, filename);
-    
-    // Get file size
-    fseek(decoder->file, 0, SEEK_END);
-    decoder->fileSize = ftell(decoder->file);
-    fseek(decoder->file, 0, SEEK_SET);
-    
+
+    // From here on the I/O thread reads the file; if it cannot, reads
+    // simply stay synchronous
+    if(readAheadWindow > 0) StartMediaReadAhead(&decoder->io, readAheadWindow);
+
+    strncpy(decoder->filename, filename, sizeof(decoder->filename) - 1);
+    decoder->fileSize = decoder->io.size;
     decoder->currentPosition = 0;
-    
-    // Try to determine format and get metadata
-    char* ext = strrchr(filename, '.');
-    if(ext) {
-        ext++; // Skip the dot
-        if(strcasecmp(ext, "mp3") == 0) {
-            // MP3 format - would need MP3 decoder library
-            decoder->sampleRate = 44100;
-            decoder->channels = 2;
-            decoder->bitDepth = 16;
-            decoder->duration = GetAudioDuration(filename);
-        } else if(strcasecmp(ext, "wav") == 0) {
-            // WAV format - parse header
-            char header[44];
-            fread(header, 1, 44, decoder->file);
-            
-            if(strncmp(header, "RIFF", 4) == 0 && strncmp(header + 8, "WAVE", 4) == 0) {
-                decoder->sampleRate = *(int*)(header + 24);
-                decoder->channels = *(short*)(header + 22);
-                decoder->bitDepth = *(short*)(header + 34);
-                
-                // Calculate duration
-                int dataSize = *(int*)(header + 40);
-                decoder->duration = dataSize / (decoder->sampleRate * decoder->channels * (decoder->bitDepth / 8));
-            }
-            
-            fseek(decoder->file, 0, SEEK_SET);
-        } else if(strcasecmp(ext, "ogg") == 0) {
-            // OGG format - would need OGG decoder library
-            decoder->sampleRate = 44100;
-            decoder->channels = 2;
-            decoder->bitDepth = 16;
-            decoder->duration = GetAudioDuration(filename);
-        }
+
+    MediaStreamInfo* info = &decoder->info;
+    const MediaFormat* format = OpenStream(&decoder->io, filename, MEDIA_TYPE_AUDIO, info,
+                                           &decoder->stream, &decoder->indexSize);
+    // Nothing to play without a format: no rate, no samples
+    if(!format || !decoder->stream) {
+        CloseAudioDecoder(decoder);
+        return NULL;
     }
-    
+
+    // The browser and the duration helpers read this instead of the file
+    StoreMediaMetadata(filename, decoder->io.size, decoder->io.mtime, format, info);
+
+    decoder->format = format;
+    decoder->sampleRate = info->sampleRate;
+    decoder->channels = info->channels;
+    decoder->bitDepth = 16; // output depth after conversion
+    decoder->duration = info->duration;
+
     return decoder;
 }
 
 VideoDecoder* InitVideoDecoder(const char* filename) {
     VideoDecoder* decoder = malloc(sizeof(VideoDecoder));
     if(!decoder) return NULL;
-    
+
+    memset(decoder, 0, sizeof(VideoDecoder));
+
     // Open file
-    decoder->file = fopen(filename, "rb");
-    if(!decoder->file) {
+    if(OpenMediaIO(&decoder->io, filename) != 0) {
         free(decoder);
         return NULL;
     }
-    
-    strcpy(decoder->filename, filename);
-    
-    // Get file size
-    fseek(decoder->file, 0, SEEK_END);
-    decoder->fileSize = ftell(decoder->file);
-    fseek(decoder->file, 0, SEEK_SET);
-    
+
+    if(readAheadWindow > 0) StartMediaReadAhead(&decoder->io, readAheadWindow);
+
+    strncpy(decoder->filename, filename, sizeof(decoder->filename) - 1);
+    decoder->fileSize = decoder->io.size;
     decoder->currentPosition = 0;
-    
-    // Try to determine format and get metadata
-    char* ext = strrchr(filename, '.');
-    if(ext) {
-        ext++; // Skip the dot
-        if(strcasecmp(ext, "mp4") == 0) {
-            // MP4 format - would need MP4 decoder library
-            decoder->width = 640;
-            decoder->height = 480;
-            decoder->fps = 30;
-            decoder->bitrate = 1000000;
-            decoder->duration = GetVideoDuration(filename);
-        } else if(strcasecmp(ext, "avi") == 0) {
-            // AVI format - parse header
-            char header[56];
-            fread(header, 1, 56, decoder->file);
-            
-            if(strncmp(header, "RIFF", 4) == 0 && strncmp(header + 8, "AVI ", 4) == 0) {
-                // Parse AVI header for basic info
-                decoder->width = *(int*)(header + 40);
-                decoder->height = *(int*)(header + 44);
-                decoder->fps = *(int*)(header + 48);
-                decoder->bitrate = *(int*)(header + 52);
-                decoder->duration = *(int*)(header + 36) / decoder->fps;
-            }
-            
-            fseek(decoder->file, 0, SEEK_SET);
-        } else if(strcasecmp(ext, "mkv") == 0) {
-            // MKV format - would need MKV decoder library
-            decoder->width = 640;
-            decoder->height = 480;
-            decoder->fps = 30;
-            decoder->bitrate = 1000000;
-            decoder->duration = GetVideoDuration(filename);
+
+    MediaStreamInfo* info = &decoder->info;
+    const MediaFormat* format = OpenStream(&decoder->io, filename, MEDIA_TYPE_VIDEO, info,
+                                           &decoder->stream, &decoder->indexSize);
+    if(format) {
+        if(!decoder->stream) {
+            CloseVideoDecoder(decoder);
+            return NULL;
         }
+
+        StoreMediaMetadata(filename, decoder->io.size, decoder->io.mtime, format, info);
+
+        decoder->format = format;
+        decoder->width = info->width;
+        decoder->height = info->height;
+        decoder->fps = info->fps;
+        decoder->duration = info->duration;
+        decoder->bitrate = info->bitrate;
     }
-    
+
+    return decoder;
+}
+
+AudioDecoder* InitSoundTrackDecoder(const VideoDecoder* video) {
+    if(!video || !video->format || !video->format->soundTrack) return NULL;
+
+    AudioDecoder* decoder = malloc(sizeof(AudioDecoder));
+    if(!decoder) return NULL;
+
+    memset(decoder, 0, sizeof(AudioDecoder));
+
+    // A handle of its own, so the pictures and the sound each keep their
+    // place in the file
+    if(OpenMediaIO(&decoder->io, video->filename) != 0) {
+        free(decoder);
+        return NULL;
+    }
+
+    if(readAheadWindow > 0) StartMediaReadAhead(&decoder->io, readAheadWindow);
+
+    strcpy(decoder->filename, video->filename);
+    decoder->fileSize = decoder->io.size;
+    decoder->currentPosition = 0;
+
+    // Not the file's own format, so it stays out of the metadata cache
+    // and the sidecar
+    const MediaFormat* format = video->format->soundTrack;
+    decoder->stream = format->open(&decoder->io, &decoder->info);
+    if(!decoder->stream) {
+        CloseAudioDecoder(decoder);
+        return NULL;
+    }
+
+    decoder->format = format;
+    decoder->sampleRate = decoder->info.sampleRate;
+    decoder->channels = decoder->info.channels;
+    decoder->bitDepth = 16;
+    decoder->duration = decoder->info.duration;
+
     return decoder;
 }
 
 void CloseAudioDecoder(AudioDecoder* decoder) {
     if(decoder) {
-        if(decoder->file) {
-            fclose(decoder->file);
+        if(decoder->stream) {
+            // Whatever the index gained since it was opened is kept
+            if(SaveStreamSidecar(decoder->filename, &decoder->io, decoder->format, decoder->stream,
+                                 &decoder->info, decoder->indexSize, 0) == 0) {
+                StoreMediaMetadata(decoder->filename, decoder->io.size, decoder->io.mtime,
+                                   decoder->format, &decoder->info);
+            }
+            decoder->format->close(decoder->stream);
         }
+        CloseMediaIO(&decoder->io);
         free(decoder);
     }
 }
 
 void CloseVideoDecoder(VideoDecoder* decoder) {
     if(decoder) {
-        if(decoder->file) {
-            fclose(decoder->file);
+        if(decoder->stream) {
+            if(SaveStreamSidecar(decoder->filename, &decoder->io, decoder->format, decoder->stream,
+                                 &decoder->info, decoder->indexSize, 0) == 0) {
+                StoreMediaMetadata(decoder->filename, decoder->io.size, decoder->io.mtime,
+                                   decoder->format, &decoder->info);
+            }
+            decoder->format->close(decoder->stream);
         }
+        CloseMediaIO(&decoder->io);
         free(decoder);
     }
 }
 
 int ReadAudioFrame(AudioDecoder* decoder, void* buffer, int bufferSize) {
-    if(!decoder || !decoder->file) return 0;
-    
-    // Read raw audio data
-    int bytesRead = fread(buffer, 1, bufferSize, decoder->file);
-    decoder->currentPosition += bytesRead;
-    
+    if(!decoder || !decoder->stream) return 0;
+
+    // Native-endian s16, ready for ASND
+    int bytesRead = decoder->format->read(decoder->stream, buffer, bufferSize);
+    decoder->currentPosition = decoder->format->position(decoder->stream);
+
     return bytesRead;
 }
 
+int SeekAudioDecoder(AudioDecoder* decoder, int seconds) {
+    if(!decoder || !decoder->stream) return -1;
+
+    if(decoder->format->seek(decoder->stream, seconds) != 0) return -1;
+    decoder->currentPosition = decoder->format->position(decoder->stream);
+
+    return 0;
+}
+
 int ReadVideoFrame(VideoDecoder* decoder, void* buffer, int bufferSize) {
-    if(!decoder || !decoder->file) return 0;
-    
+    if(!decoder || !decoder->io.file) return 0;
+
+    if(decoder->stream) {
+        // One frame per call
+        int bytesRead = decoder->format->read(decoder->stream, buffer, bufferSize);
+        decoder->currentPosition = decoder->format->position(decoder->stream);
+        return bytesRead;
+    }
+
     // Read raw video data
-    int bytesRead = fread(buffer, 1, bufferSize, decoder->file);
+    int bytesRead = ReadMediaIO(&decoder->io, buffer, bufferSize);
     decoder->currentPosition += bytesRead;
     
     return bytesRead;
 }
 
-int GetAudioDuration(const char* filename) {
-    // This would need proper decoder libraries
-    // For now, return estimated duration based on file size
-    FILE* file = fopen(filename, "rb");
-    if(!file) return 0;
-    
-    fseek(file, 0, SEEK_END);
-    int fileSize = ftell(file);
-    fclose(file);
-    
-    // Rough estimate: assume 128kbps for MP3, 1.4Mbps for WAV
-    char* ext = strrchr(filename, '.');
-    if(ext) {
-        ext++;
-        if(strcasecmp(ext, "mp3") == 0) {
-            return fileSize / (128 * 1024 / 8); // 128kbps
-        } else if(strcasecmp(ext, "wav") == 0) {
-            return fileSize / (1400 * 1024 / 8); // 1.4Mbps
-        } else if(strcasecmp(ext, "ogg") == 0) {
-            return fileSize / (128 * 1024 / 8); // 128kbps
-        }
-    }
-    
+int SeekVideoDecoder(VideoDecoder* decoder, int seconds) {
+    if(!decoder || !decoder->stream) return -1;
+
+    // Lands on the keyframe at or before the time
+    if(decoder->format->seek(decoder->stream, seconds) != 0) return -1;
+    decoder->currentPosition = decoder->format->position(decoder->stream);
+
     return 0;
 }
 
+s64 SeekVideoKeyframe(VideoDecoder* decoder, s64 frame) {
+    if(!decoder || !decoder->stream) return -1;
+
+    if(decoder->format->seekFrame) {
+        if(decoder->format->seekFrame(decoder->stream, frame < 0 ? 0 : frame) < 0) return -1;
+    } else {
+        // Whole seconds only; frame numbers need the exact rate
+        u32 frameNanoseconds = decoder->info.frameNanoseconds;
+        if(!frameNanoseconds) frameNanoseconds = 1000000000 / (decoder->fps > 0 ? decoder->fps : 25);
+        if(decoder->format->seek(decoder->stream, (int)(frame * frameNanoseconds / 1000000000)) != 0) return -1;
+    }
+    decoder->currentPosition = decoder->format->position(decoder->stream);
+
+    return decoder->currentPosition;
+}
+
+// The three helpers below share the metadata cache: a file is probed
+// once, and not at all if a decoder has already opened it
+int GetAudioDuration(const char* filename) {
+    MediaMetadata metadata;
+
+    if(GetMediaMetadata(filename, &metadata) != 0 || metadata.type != MEDIA_TYPE_AUDIO) return 0;
+    return metadata.info.duration;
+}
+
 int GetVideoDuration(const char* filename) {
-    // This would need proper decoder libraries
-    // For now, return estimated duration based on file size
-    FILE* file = fopen(filename, "rb");
-    if(!file) return 0;
-    
-    fseek(file, 0, SEEK_END);
-    int fileSize = ftell(file);
-    fclose(file);
-    
-    // Rough estimate: assume 1Mbps bitrate
-    return fileSize / (1000 * 1024 / 8); // 1Mbps
+    MediaMetadata metadata;
+
+    if(GetMediaMetadata(filename, &metadata) == 0 && metadata.type == MEDIA_TYPE_VIDEO) {
+        return metadata.info.duration;
+    }
+
+    // Without a demuxer it is still a 1Mbps guess
+    return (int)(metadata.size / (1000 * 1024 / 8));
 }
 
 int GetVideoDimensions(const char* filename, int* width, int* height) {
-    // This would need proper decoder libraries
-    // For now, return default dimensions
+    MediaMetadata metadata;
+
+    // Default for files no demuxer claims
     *width = 640;
     *height = 480;
-    return 0;
+
+    int result = GetMediaMetadata(filename, &metadata);
+    if(result == 0 && metadata.type == MEDIA_TYPE_VIDEO &&
+       metadata.info.width > 0 && metadata.info.height > 0) {
+        *width = metadata.info.width;
+        *height = metadata.info.height;
+    }
+
+    return result == 0 || metadata.size > 0 ? 0 : -1;
 }
@@ -0,0 +1,64 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stdio.h>
+#include "platform.h"
+#include "mediaio.h"
+#include "registry.h"
+
+// Decoder structures. The format is chosen by ProbeMediaFormat() from the
+// file's content, or named by its sidecar (sidecar.h); stream is that
+// format's state.
+typedef struct {
+    MediaIO io;
+    char filename[256];
+    s64 fileSize;
+    s64 currentPosition; // sample frames decoded so far
+    int duration;
+    int sampleRate;
+    int channels;
+    int bitDepth;
+    const MediaFormat* format;
+    void* stream;
+    MediaStreamInfo info;
+    int indexSize;      // bytes of sidecar index it was opened with
+} AudioDecoder;
+
+typedef struct {
+    MediaIO io;
+    char filename[256];
+    s64 fileSize;
+    s64 currentPosition; // next video frame
+    int duration;
+    int width;
+    int height;
+    int fps;
+    int bitrate;
+    const MediaFormat* format;
+    void* stream;
+    MediaStreamInfo info;
+    int indexSize;
+} VideoDecoder;
+
+// Function prototypes
+// NULL unless a format claims the file and opens it
+AudioDecoder* InitAudioDecoder(const char* filename);
+VideoDecoder* InitVideoDecoder(const char* filename);
+// The video's sound track, read apart from the pictures; NULL when there
+// is none the format can decode
+AudioDecoder* InitSoundTrackDecoder(const VideoDecoder* video);
+void CloseAudioDecoder(AudioDecoder* decoder);
+void CloseVideoDecoder(VideoDecoder* decoder);
+int ReadAudioFrame(AudioDecoder* decoder, void* buffer, int bufferSize);
+int SeekAudioDecoder(AudioDecoder* decoder, int seconds);
+// One frame; MEDIA_FRAME_TOO_BIG for one that didn't fit, which is skipped
+int ReadVideoFrame(VideoDecoder* decoder, void* buffer, int bufferSize);
+int SeekVideoDecoder(VideoDecoder* decoder, int seconds);
+// To the last keyframe at or before frame; returns its number, or -1
+s64 SeekVideoKeyframe(VideoDecoder* decoder, s64 frame);
+void SetDecoderReadAhead(int window); // blocks per decoder, 0 to read synchronously
+int GetAudioDuration(const char* filename);
+int GetVideoDuration(const char* filename);
+int GetVideoDimensions(const char* filename, int* width, int* height);
+
+#endif // DECODER_H
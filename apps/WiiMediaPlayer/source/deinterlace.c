@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <string.h>
+#include "deinterlace.h"
+
+void InitDeinterlacer(Deinterlacer* deinterlacer, DeinterlaceMode mode, int bottomFirst) {
+    memset(deinterlacer, 0, sizeof(Deinterlacer));
+    deinterlacer->mode = mode;
+    deinterlacer->bottomFirst = bottomFirst;
+}
+
+void CloseDeinterlacer(Deinterlacer* deinterlacer) {
+    free(deinterlacer->history);
+    deinterlacer->history = NULL;
+    deinterlacer->historySize = 0;
+    deinterlacer->historyValid = 0;
+}
+
+void ResetDeinterlacer(Deinterlacer* deinterlacer) {
+    deinterlacer->historyValid = 0;
+}
+
+// The line between two first-field lines, every byte (Y, Cb and Cr all
+// sit in the same columns from line to line)
+static void BobLine(u8* line, const u8* above, const u8* below, int count) {
+    for(int i = 0; i < count; i++) {
+        line[i] = (above[i] + below[i] + 1) >> 1;
+    }
+}
+
+// The bob value held between the previous and next fields' values at the
+// same place: where they agree nothing moved and the line comes back
+// exactly, where they differ the bob value is used as far as they allow.
+// The next field's line goes to history on the way.
+static void AdaptiveLine(u8* line, const u8* above, const u8* below, u8* previous, int count) {
+    for(int i = 0; i < count; i++) {
+        int spatial = (above[i] + below[i] + 1) >> 1;
+        int last = previous[i];
+        int next = line[i];
+        int low = last < next ? last : next;
+        int high = last < next ? next : last;
+
+        previous[i] = next;
+        line[i] = spatial < low ? low : spatial > high ? high : spatial;
+    }
+}
+
+void DeinterlaceYUYV(Deinterlacer* deinterlacer, u8* frame, int width, int height) {
+    int adaptive = deinterlacer->mode == DEINTERLACE_ADAPTIVE;
+
+    // History only follows the frames the adaptive mode sees
+    if(!adaptive) deinterlacer->historyValid = 0;
+    if(deinterlacer->mode == DEINTERLACE_OFF || deinterlacer->mode == DEINTERLACE_WEAVE) return;
+    if(!frame || width <= 0 || height < 2) return;
+
+    int stride = width * 2;
+
+    if(adaptive) {
+        int size = stride * ((height + 1) / 2);
+        if(size > deinterlacer->historySize) {
+            u8* grown = realloc(deinterlacer->history, size);
+            if(grown) {
+                deinterlacer->history = grown;
+                deinterlacer->historySize = size;
+            }
+        }
+
+        if(width != deinterlacer->width || height != deinterlacer->height) deinterlacer->historyValid = 0;
+        deinterlacer->width = width;
+        deinterlacer->height = height;
+        if(size > deinterlacer->historySize) adaptive = 0;
+    }
+
+    int useHistory = adaptive && deinterlacer->historyValid;
+    if(deinterlacer->mode == DEINTERLACE_ADAPTIVE && !useHistory) deinterlacer->bobbed++;
+
+    // The second field is the odd lines of a top-first frame, the even
+    // ones of a bottom-first frame. Edges repeat the one neighbour there is.
+    for(int y = deinterlacer->bottomFirst ? 0 : 1; y < height; y += 2) {
+        u8* line = frame + y * stride;
+        const u8* above = y > 0 ? line - stride : line + stride;
+        const u8* below = y + 1 < height ? line + stride : line - stride;
+
+        if(useHistory) {
+            AdaptiveLine(line, above, below, deinterlacer->history + (y / 2) * stride, stride);
+        } else {
+            if(adaptive) memcpy(deinterlacer->history + (y / 2) * stride, line, stride);
+            BobLine(line, above, below, stride);
+        }
+    }
+
+    deinterlacer->historyValid = adaptive;
+    deinterlacer->frames++;
+}
@@ -0,0 +1,48 @@
+#ifndef DEINTERLACE_H
+#define DEINTERLACE_H
+
+#include "platform.h"
+
+// Deinterlacing of YCbYCr frames (videofilter.h) in place, one progressive
+// frame out per interlaced frame in, at the time of its first field. The
+// first field's lines are kept; the second field's are rebuilt.
+//
+// The motion-adaptive mode works on a ring of three fields: the second
+// field of the previous frame, the first and the second of this one,
+// which for each rebuilt line are the previous, current and next fields.
+// Two of them are in the frame itself. The previous one is the only
+// thing kept between frames, half a frame, and it is kept a line at a
+// time: each second-field line is read as "next", stored as the coming
+// frame's "previous" and then overwritten, so no frame is ever copied.
+typedef enum {
+    DEINTERLACE_OFF,
+    DEINTERLACE_BOB,        // second field from the first alone: never
+                            // combs, half the vertical detail
+    DEINTERLACE_WEAVE,      // fields left together: full detail when still,
+                            // combs on motion
+    DEINTERLACE_ADAPTIVE    // weave where the previous and next fields
+                            // agree, bob where they do not (yadif-lite)
+} DeinterlaceMode;
+
+typedef struct {
+    DeinterlaceMode mode;
+    int bottomFirst;        // field order of the source
+    int width;              // the frame history was kept for
+    int height;
+    u8* history;            // previous frame's second field
+    int historySize;
+    int historyValid;       // 0 after a seek or a size change
+    u32 frames;             // frames deinterlaced
+    u32 bobbed;             // adaptive frames that had no history
+} Deinterlacer;
+
+// Function prototypes
+
+void InitDeinterlacer(Deinterlacer* deinterlacer, DeinterlaceMode mode, int bottomFirst);
+void CloseDeinterlacer(Deinterlacer* deinterlacer);
+// The next frame does not follow the last one (seek, new file); it is
+// bobbed, then the adaptive mode picks up again
+void ResetDeinterlacer(Deinterlacer* deinterlacer);
+void DeinterlaceYUYV(Deinterlacer* deinterlacer, u8* frame, int width, int height);
+
+#endif // DEINTERLACE_H
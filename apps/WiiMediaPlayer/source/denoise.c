@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include "denoise.h"
+
+void InitDenoiser(Denoiser* denoiser, u32 budgetMicroseconds) {
+    memset(denoiser, 0, sizeof(Denoiser));
+    denoiser->level = DENOISE_TEMPORAL;
+    denoiser->budgetMicroseconds = budgetMicroseconds;
+}
+
+void CloseDenoiser(Denoiser* denoiser) {
+    free(denoiser->history);
+    denoiser->history = NULL;
+    denoiser->historySize = 0;
+    denoiser->historyValid = 0;
+}
+
+void ResetDenoiser(Denoiser* denoiser) {
+    denoiser->historyValid = 0;
+}
+
+// Luma only: Y is every other byte
+static int BlockSAD(const u8* frame, const u8* history, int stride, int bytes, int rows) {
+    int sad = 0;
+    for(int y = 0; y < rows; y++, frame += stride, history += stride) {
+        for(int i = 0; i < bytes; i += 2) sad += abs(frame[i] - history[i]);
+    }
+    return sad;
+}
+
+// Every byte 1/2^shift of the way from history to the frame, unless it
+// moved too far; the result is the new history as well
+static void BlendBlock(u8* frame, u8* history, int stride, int bytes, int rows, int shift) {
+    int round = 1 << (shift - 1);
+
+    for(int y = 0; y < rows; y++, frame += stride, history += stride) {
+        for(int i = 0; i < bytes; i++) {
+            int old = history[i];
+            int diff = frame[i] - old;
+            int out = abs(diff) > DENOISE_PIXEL_LIMIT ? frame[i] : old + ((diff + round) >> shift);
+            frame[i] = history[i] = out;
+        }
+    }
+}
+
+static void CopyBlock(u8* history, const u8* frame, int stride, int bytes, int rows) {
+    for(int y = 0; y < rows; y++, frame += stride, history += stride) memcpy(history, frame, bytes);
+}
+
+void DenoiseTemporalYUYV(Denoiser* denoiser, u8* frame, int width, int height) {
+    int stride = width * 2;
+    int size = stride * height;
+    if(width <= 0 || height <= 0) return;
+
+    if(size > denoiser->historySize) {
+        u8* grown = realloc(denoiser->history, size);
+        if(!grown) return;
+        denoiser->history = grown;
+        denoiser->historySize = size;
+    }
+    if(width != denoiser->width || height != denoiser->height) denoiser->historyValid = 0;
+    denoiser->width = width;
+    denoiser->height = height;
+
+    if(!denoiser->historyValid) {
+        memcpy(denoiser->history, frame, size);
+        denoiser->historyValid = 1;
+        return;
+    }
+
+    // Blocks a row at a time, so the frame and history rows stream once
+    for(int by = 0; by < height; by += DENOISE_BLOCK) {
+        int rows = height - by < DENOISE_BLOCK ? height - by : DENOISE_BLOCK;
+
+        for(int bx = 0; bx < width; bx += DENOISE_BLOCK) {
+            int pixels = width - bx < DENOISE_BLOCK ? width - bx : DENOISE_BLOCK;
+            int offset = by * stride + bx * 2;
+            u8* block = frame + offset;
+            u8* history = denoiser->history + offset;
+
+            // The thresholds are for whole blocks; edge blocks scale them
+            int sad = BlockSAD(block, history, stride, pixels * 2, rows) * DENOISE_BLOCK * DENOISE_BLOCK
+                      / (pixels * rows);
+
+            if(sad <= DENOISE_STILL_SAD) {
+                BlendBlock(block, history, stride, pixels * 2, rows, 2);
+                denoiser->stats.stillBlocks++;
+            } else if(sad <= DENOISE_MOVING_SAD) {
+                BlendBlock(block, history, stride, pixels * 2, rows, 1);
+                denoiser->stats.blendedBlocks++;
+            } else {
+                CopyBlock(history, block, stride, pixels * 2, rows);
+                denoiser->stats.movingBlocks++;
+            }
+        }
+    }
+}
+
+void DenoiseSpatialYUYV(u8* frame, int width, int height) {
+    int stride = width * 2;
+
+    for(int y = 0; y < height; y++) {
+        u8* line = frame + y * stride;
+        int left = line[0];
+
+        // left is the original, the byte before has been written already.
+        // A select, not a branch: noise makes the test a coin toss.
+        for(int x = 1; x < width - 1; x++) {
+            int center = line[x * 2];
+            int smoothed = (left + 2 * center + line[x * 2 + 2] + 2) >> 2;
+
+            line[x * 2] = abs(smoothed - center) <= DENOISE_SPATIAL_LIMIT ? smoothed : center;
+            left = center;
+        }
+    }
+}
+
+void DenoiseYUYV(Denoiser* denoiser, u8* frame, int width, int height) {
+    if(!frame || width <= 0 || height <= 0) return;
+
+    DenoiseStats* stats = &denoiser->stats;
+    stats->frames++;
+
+    u64 start = NowMicroseconds();
+    switch(denoiser->level) {
+        case DENOISE_TEMPORAL:
+            DenoiseTemporalYUYV(denoiser, frame, width, height);
+            stats->temporalFrames++;
+            break;
+        case DENOISE_SPATIAL:
+            DenoiseSpatialYUYV(frame, width, height);
+            stats->spatialFrames++;
+            break;
+        case DENOISE_OFF:
+            stats->skippedFrames++;
+            break;
+    }
+    u32 cost = (u32)(NowMicroseconds() - start);
+
+    stats->lastMicroseconds = cost;
+    stats->averageMicroseconds = stats->frames == 1 ? cost
+                                 : stats->averageMicroseconds + ((s32)cost - (s32)stats->averageMicroseconds) / 8;
+    if(cost > stats->worstMicroseconds) stats->worstMicroseconds = cost;
+
+    // Down after a run of slow frames, a step back up now and then in
+    // case the content got easier
+    if(denoiser->budgetMicroseconds && cost > denoiser->budgetMicroseconds) {
+        if(++denoiser->overBudget >= DENOISE_OVER_BUDGET && denoiser->level > DENOISE_OFF) {
+            denoiser->level--;
+            denoiser->overBudget = 0;
+            denoiser->sinceStepDown = 0;
+            stats->stepDowns++;
+        }
+    } else {
+        denoiser->overBudget = 0;
+    }
+
+    if(denoiser->level != DENOISE_TEMPORAL && ++denoiser->sinceStepDown >= DENOISE_RETRY) {
+        denoiser->level++;
+        denoiser->sinceStepDown = 0;
+    }
+
+    // Temporal history is only good while every frame went through it
+    if(denoiser->level != DENOISE_TEMPORAL) denoiser->historyValid = 0;
+}
@@ -0,0 +1,78 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include "platform.h"
+
+// Noise reduction on YCbYCr frames (videofilter.h), in place.
+//
+// Temporal: each 8x8 block's luma is compared with the last output frame
+// (sum of absolute differences). Blocks that did not move are blended
+// into that history recursively, 1/4 new when still and 1/2 when nearly
+// so; blocks that moved pass through. Inside a blended block, a byte that
+// changed by more than DENOISE_PIXEL_LIMIT passes through too, so small
+// moving detail does not smear. The history is the one frame kept,
+// allocated once and reused for every frame and size that fits.
+//
+// Spatial: luma smoothed across each line [1 2 1] wherever that moves it
+// by DENOISE_SPATIAL_LIMIT or less, so edges stay; no history. Cheaper,
+// and the step down when temporal frames run over the budget.
+//
+// Each frame's cost is measured. DENOISE_OVER_BUDGET frames in a row
+// over budget drop a level, temporal to spatial to off; every
+// DENOISE_RETRY frames below temporal the next level up is tried again.
+#define DENOISE_BLOCK         8
+#define DENOISE_STILL_SAD     (2 * DENOISE_BLOCK * DENOISE_BLOCK)
+#define DENOISE_MOVING_SAD    (6 * DENOISE_BLOCK * DENOISE_BLOCK)
+#define DENOISE_PIXEL_LIMIT   12
+#define DENOISE_SPATIAL_LIMIT 6
+#define DENOISE_OVER_BUDGET   3
+#define DENOISE_RETRY         120
+#define DENOISE_BUDGET        6000    // microseconds, a third of a 60 Hz frame
+
+typedef enum {
+    DENOISE_OFF,
+    DENOISE_SPATIAL,
+    DENOISE_TEMPORAL
+} DenoiseLevel;
+
+typedef struct {
+    u32 frames;                 // frames given to DenoiseYUYV
+    u32 temporalFrames;
+    u32 spatialFrames;
+    u32 skippedFrames;          // passed through, the budget ran out
+    u32 stepDowns;
+    u32 stillBlocks;            // temporal block decisions, all frames
+    u32 blendedBlocks;
+    u32 movingBlocks;
+    u32 lastMicroseconds;       // cost of the last frame
+    u32 averageMicroseconds;    // running average, 1/8 per frame
+    u32 worstMicroseconds;
+} DenoiseStats;
+
+typedef struct {
+    DenoiseLevel level;         // what the next frame gets
+    u32 budgetMicroseconds;     // per frame, 0 for no limit
+    u8* history;                // the last temporal output
+    int historySize;
+    int width;                  // the frame history was kept for
+    int height;
+    int historyValid;
+    int overBudget;             // frames in a row
+    int sinceStepDown;
+    DenoiseStats stats;
+} Denoiser;
+
+// Function prototypes
+
+void InitDenoiser(Denoiser* denoiser, u32 budgetMicroseconds);
+void CloseDenoiser(Denoiser* denoiser);
+// The next frame does not follow the last one (seek, new file)
+void ResetDenoiser(Denoiser* denoiser);
+void DenoiseYUYV(Denoiser* denoiser, u8* frame, int width, int height);
+
+// The levels on their own, without timing or stepping. Without valid
+// history the temporal one only keeps the frame for the next.
+void DenoiseTemporalYUYV(Denoiser* denoiser, u8* frame, int width, int height);
+void DenoiseSpatialYUYV(u8* frame, int width, int height);
+
+#endif // DENOISE_H
@@ -0,0 +1,221 @@
+#include <string.h>
+#include "effectchain.h"
+#include "colorkernels.h"
+
+static inline int ClampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Same arithmetic as FilterPairsRef
+static inline void ApplyMatrix(const s32 m[2][2], int* cb, int* cr) {
+    const int round = 1 << (VIDEO_FILTER_MATRIX_SHIFT - 1);
+    int inCb = *cb - VIDEO_CHROMA_ZERO;
+    int inCr = *cr - VIDEO_CHROMA_ZERO;
+
+    *cb = ClampInt(VIDEO_CHROMA_ZERO + ((m[0][0] * inCb + m[0][1] * inCr + round) >> VIDEO_FILTER_MATRIX_SHIFT),
+                   VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+    *cr = ClampInt(VIDEO_CHROMA_ZERO + ((m[1][0] * inCb + m[1][1] * inCr + round) >> VIDEO_FILTER_MATRIX_SHIFT),
+                   VIDEO_CHROMA_MIN, VIDEO_CHROMA_MAX);
+}
+
+static void ResetStage(VideoPointStage* stage) {
+    for(int y = 0; y < 256; y++) stage->luma[y] = stage->sourceLuma[y] = y;
+    stage->chroma = VIDEO_CHROMA_PAIR;
+    stage->matrixCount = 0;
+    stage->lut = NULL;
+    stage->next = NULL;
+}
+
+static void ComposeLuma(VideoPointStage* stage, const u8* table) {
+    for(int y = 0; y < 256; y++) stage->luma[y] = table[stage->luma[y]];
+}
+
+static void AddMatrix(VideoPointStage* stage, const s32 matrix[2][2]) {
+    if(stage->chroma == VIDEO_CHROMA_CONSTANT) {
+        // A constant stays constant
+        int cb = stage->constantCb, cr = stage->constantCr;
+        ApplyMatrix(matrix, &cb, &cr);
+        stage->constantCb = cb;
+        stage->constantCr = cr;
+    } else if(stage->matrixCount < VIDEO_MAX_EFFECTS) {
+        memcpy(stage->matrix[stage->matrixCount++], matrix, sizeof(s32) * 4);
+    }
+}
+
+static void FinishStage(VideoPointStage* stage) {
+    stage->identity = stage->chroma == VIDEO_CHROMA_PAIR && stage->matrixCount == 0;
+    for(int y = 0; y < 256 && stage->identity; y++) {
+        if(stage->luma[y] != y) stage->identity = 0;
+    }
+}
+
+static int DoesNothing(const VideoPointStage* stage) {
+    return stage->identity && !stage->lut;
+}
+
+// A LUT runs after the stage's own work, and what comes after it in
+// a stage of its own, in the same sweep
+static VideoPointStage* AddLut(CompiledVideoEffects* compiled, VideoPointStage* stage, const ColorLut* lut) {
+    if(!lut || !lut->size) return stage;
+
+    stage->lut = lut;
+    FinishStage(stage);
+    VideoPointStage* next = &compiled->chained[compiled->chainedCount++];
+    ResetStage(next);
+    stage->next = next;
+    return next;
+}
+
+// Ends the point stage at an effect that reads neighbours, unless the
+// effect does nothing; returns the stage that follows
+static VideoPointStage* AddArea(CompiledVideoEffects* compiled, VideoPointStage* stage, const VideoEffect* effect) {
+    if(effect->type == VIDEO_EFFECT_BLUR && (effect->radius <= 0 || effect->passes <= 0)) return stage;
+    if(effect->type == VIDEO_EFFECT_SHARPEN && effect->amount <= 0) return stage;
+
+    FinishStage(stage);
+    compiled->areas[compiled->areaCount++] = *effect;
+    stage = &compiled->points[compiled->areaCount];
+    ResetStage(stage);
+    return stage;
+}
+
+void CompileVideoEffects(const VideoEffect* effects, int count, const CompiledVideoFilter* filter,
+                         CompiledVideoEffects* compiled) {
+    // Invert is a luma table and the negative identity on Cb/Cr, which
+    // with the matrix rounding is exactly 256 - c
+    static const s32 negate[2][2] = {{-(1 << VIDEO_FILTER_MATRIX_SHIFT), 0},
+                                     {0, -(1 << VIDEO_FILTER_MATRIX_SHIFT)}};
+    u8 invert[256];
+    for(int y = 0; y < 256; y++) {
+        invert[y] = ClampInt(VIDEO_LUMA_BLACK + VIDEO_LUMA_WHITE - y, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+    }
+
+    const u8 *sepiaLuma, *sepiaCb, *sepiaCr;
+    GetSepiaTables(&sepiaLuma, &sepiaCb, &sepiaCr);
+
+    compiled->areaCount = 0;
+    compiled->chainedCount = 0;
+    VideoPointStage* stage = &compiled->points[0];
+    ResetStage(stage);
+
+    if(count > VIDEO_MAX_EFFECTS) count = VIDEO_MAX_EFFECTS;
+    for(int i = 0; i < count; i++) {
+        switch(effects[i].type) {
+            case VIDEO_EFFECT_FILTER: {
+                if(!filter->lumaIdentity) ComposeLuma(stage, filter->luma);
+                if(!filter->chromaIdentity) AddMatrix(stage, filter->chroma);
+
+                VideoEffect sharpen = {VIDEO_EFFECT_SHARPEN, 0, 0, filter->sharpenAmount, filter->sharpenThreshold,
+                                       NULL};
+                stage = AddArea(compiled, stage, &sharpen);
+                break;
+            }
+
+            case VIDEO_EFFECT_SEPIA:
+                // Its chroma wants the luma as it arrives, and replaces
+                // whatever chroma came before
+                memcpy(stage->sourceLuma, stage->luma, 256);
+                ComposeLuma(stage, sepiaLuma);
+                stage->chroma = VIDEO_CHROMA_SEPIA;
+                stage->matrixCount = 0;
+                break;
+
+            case VIDEO_EFFECT_GRAYSCALE:
+                stage->chroma = VIDEO_CHROMA_CONSTANT;
+                stage->constantCb = VIDEO_CHROMA_ZERO;
+                stage->constantCr = VIDEO_CHROMA_ZERO;
+                stage->matrixCount = 0;
+                break;
+
+            case VIDEO_EFFECT_INVERT:
+                ComposeLuma(stage, invert);
+                AddMatrix(stage, negate);
+                break;
+
+            case VIDEO_EFFECT_BLUR:
+            case VIDEO_EFFECT_SHARPEN:
+                stage = AddArea(compiled, stage, &effects[i]);
+                break;
+
+            case VIDEO_EFFECT_LUT:
+                stage = AddLut(compiled, stage, effects[i].lut);
+                break;
+        }
+    }
+
+    FinishStage(stage);
+}
+
+static void RunStage(const VideoPointStage* stage, u8* frame, int pairs) {
+    const u8* luma = stage->luma;
+
+    if(stage->chroma == VIDEO_CHROMA_PAIR && stage->matrixCount <= 1) {
+        // The common cases have kernels of their own
+        if(stage->matrixCount == 1) {
+            FilterPairs(frame, pairs, luma, stage->matrix[0]);
+        } else {
+            for(int i = 0; i < pairs; i++, frame += 4) {
+                frame[0] = luma[frame[0]];
+                frame[2] = luma[frame[2]];
+            }
+        }
+        return;
+    }
+
+    const u8 *sepiaLuma, *sepiaCb, *sepiaCr;
+    GetSepiaTables(&sepiaLuma, &sepiaCb, &sepiaCr);
+
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        int y0 = frame[0], y1 = frame[2];
+        int cb, cr;
+
+        if(stage->chroma == VIDEO_CHROMA_SEPIA) {
+            int mean = (stage->sourceLuma[y0] + stage->sourceLuma[y1] + 1) >> 1;
+            cb = sepiaCb[mean];
+            cr = sepiaCr[mean];
+        } else if(stage->chroma == VIDEO_CHROMA_CONSTANT) {
+            cb = stage->constantCb;
+            cr = stage->constantCr;
+        } else {
+            cb = frame[1];
+            cr = frame[3];
+        }
+
+        for(int m = 0; m < stage->matrixCount; m++) ApplyMatrix(stage->matrix[m], &cb, &cr);
+
+        frame[0] = luma[y0];
+        frame[1] = cb;
+        frame[2] = luma[y1];
+        frame[3] = cr;
+    }
+}
+
+static void RunPointStage(const void* data, u8* frame, int pairs) {
+    for(const VideoPointStage* stage = data; stage; stage = stage->next) {
+        if(!stage->identity) RunStage(stage, frame, pairs);
+        if(stage->lut) ColorLutYUYV(stage->lut, frame, pairs);
+    }
+}
+
+void RunVideoEffects(const CompiledVideoEffects* compiled, u8* frame, int width, int height) {
+    if(compiled->areaCount == 0) {
+        RunPointStage(&compiled->points[0], frame, width * height / 2);
+        return;
+    }
+
+    // The stage before the first area effect goes in as it reads; each
+    // later stage as the effect before it writes
+    for(int a = 0; a < compiled->areaCount; a++) {
+        const VideoEffect* area = &compiled->areas[a];
+        VideoPointHook before = {RunPointStage, &compiled->points[0]};
+        VideoPointHook after = {RunPointStage, &compiled->points[a + 1]};
+        const VideoPointHook* first = a == 0 && !DoesNothing(&compiled->points[0]) ? &before : NULL;
+        const VideoPointHook* then = DoesNothing(&compiled->points[a + 1]) ? NULL : &after;
+
+        if(area->type == VIDEO_EFFECT_SHARPEN) {
+            SharpenLumaYUYVFused(frame, width, height, area->amount, area->threshold, first, then);
+        } else {
+            BoxBlurYUYVFused(frame, width, height, area->radius, area->passes, first, then);
+        }
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef EFFECTCHAIN_H
+#define EFFECTCHAIN_H
+
+#include "platform.h"
+#include "videofilter.h"
+#include "colorlut.h"
+
+// Stacked effects, compiled so the frame is swept as few times as
+// possible. Every run of point effects (filter, sepia, grayscale,
+// invert) becomes one per-pair stage: their luma steps compose into a
+// single table, and Cb/Cr come from a source (the pair itself, sepia's
+// tables or a constant) through the matrices that follow it. A color
+// LUT ends a stage's own work; the effects after it start another stage
+// that runs on the same pairs straight after, in the same sweep. The
+// effects that read neighbours, blur and the filter's sharpening, take
+// the stages either side into their own line and strip buffers. So a
+// chain costs one sweep per sharpen and two per blur, or one if it has
+// neither, however long it is, and gives the same bytes as running the
+// effects one after another.
+#define VIDEO_MAX_EFFECTS 8
+
+typedef enum {
+    VIDEO_EFFECT_FILTER,    // the compiled VideoFilter, sharpening included
+    VIDEO_EFFECT_SEPIA,
+    VIDEO_EFFECT_GRAYSCALE,
+    VIDEO_EFFECT_INVERT,
+    VIDEO_EFFECT_BLUR,
+    VIDEO_EFFECT_SHARPEN,
+    VIDEO_EFFECT_LUT        // a loaded color grade (colorlut.h)
+} VideoEffectType;
+
+typedef struct {
+    VideoEffectType type;
+    int radius;             // blur only
+    int passes;
+    int amount;             // sharpen only
+    int threshold;
+    const ColorLut* lut;    // LUT only, kept by the caller
+} VideoEffect;
+
+typedef enum {
+    VIDEO_CHROMA_PAIR,      // the pair's own Cb and Cr
+    VIDEO_CHROMA_SEPIA,     // sepia's tables at the mean of sourceLuma
+    VIDEO_CHROMA_CONSTANT
+} VideoChromaSource;
+
+typedef struct VideoPointStage {
+    u8 luma[256];           // every luma step composed
+    u8 sourceLuma[256];     // the luma steps before the sepia
+    VideoChromaSource chroma;
+    u8 constantCb;
+    u8 constantCr;
+    int matrixCount;
+    s32 matrix[VIDEO_MAX_EFFECTS][2][2];
+    int identity;           // of the above
+    const ColorLut* lut;    // after the above, NULL for none
+    const struct VideoPointStage* next;     // after the LUT
+} VideoPointStage;
+
+// points[0], areas[0], points[1], areas[1] ... points[areaCount]; the
+// areas are the blurs and sharpens, a filter's sharpening among them.
+// The stages after LUTs are in chained, pointed to from within, so the
+// struct can't be copied.
+typedef struct {
+    VideoPointStage points[VIDEO_MAX_EFFECTS + 1];
+    VideoEffect areas[VIDEO_MAX_EFFECTS];
+    int areaCount;
+    VideoPointStage chained[VIDEO_MAX_EFFECTS];
+    int chainedCount;
+} CompiledVideoEffects;
+
+// Function prototypes
+
+// filter is what VIDEO_EFFECT_FILTER entries apply. Entries past
+// VIDEO_MAX_EFFECTS are ignored.
+void CompileVideoEffects(const VideoEffect* effects, int count, const CompiledVideoFilter* filter,
+                         CompiledVideoEffects* compiled);
+void RunVideoEffects(const CompiledVideoEffects* compiled, u8* frame, int width, int height);
+
+#endif // EFFECTCHAIN_H
@@ -0,0 +1,685 @@
+#include <stdlib.h>
+#include <string.h>
+#include "registry.h"
+#include "sidecar.h"
+#include "pcm.h"
+#include "wav.h"
+#include "mp3.h"
+#include "vorbis.h"
+#include "avi.h"
+#include "mp4.h"
+#include "mkv.h"
+
+// Largest read we convert through the WAV scratch buffer in one go
+#define AUDIO_SCRATCH_SIZE 8192
+
+static void SetCodec(MediaStreamInfo* info, const char* codec) {
+    strncpy(info->codec, codec, sizeof(info->codec) - 1);
+    info->codec[sizeof(info->codec) - 1] = 0;
+}
+
+// Four character codes as stored, e.g. 'avc1' or an AVI handler
+static void SetFourCC(MediaStreamInfo* info, u32 code, int bigEndian) {
+    for(int i = 0; i < 4; i++) {
+        int shift = bigEndian ? 24 - 8 * i : 8 * i;
+        char c = (char)(code >> shift);
+        info->codec[i] = c >= ' ' && c <= '~' ? c : '?';
+    }
+    info->codec[4] = 0;
+}
+
+// WAV - walk the RIFF chunks, header fields are little-endian
+
+typedef struct {
+    MediaIO* io;
+    WavInfo wav;
+    u8* scratch;        // conversion buffer for 24/32-bit sources
+    s64 position;
+} WavStream;
+
+// RF64 is left to the extension: ParseWavHeader reads no ds64 chunk, and
+// a file past 4 GB can't be on FAT32 anyway
+static int ProbeWav(const u8* data, int size) {
+    if(size < 12 || memcmp(data + 8, "WAVE", 4) != 0) return 0;
+    return memcmp(data, "RIFF", 4) == 0 ? 100 : 0;
+}
+
+static void FillWavInfo(const WavInfo* wav, MediaStreamInfo* info) {
+    info->sampleRate = wav->sampleRate;
+    info->channels = wav->channels;
+    info->duration = (int)(wav->totalFrames / wav->sampleRate);
+    info->bitrate = wav->sampleRate * wav->blockAlign * 8;
+    SetCodec(info, "pcm");
+}
+
+static void* OpenWav(MediaIO* io, MediaStreamInfo* info) {
+    WavStream* s = calloc(1, sizeof(WavStream));
+    if(!s) return NULL;
+
+    s->io = io;
+    if(ParseWavHeader(io, &s->wav) != 0) {
+        free(s);
+        return NULL;
+    }
+
+    // 24/32-bit sources are wider than the output, convert via scratch
+    if(s->wav.bitsPerSample > 16) {
+        s->scratch = malloc(AUDIO_SCRATCH_SIZE * s->wav.bitsPerSample / 16);
+        if(!s->scratch) {
+            free(s);
+            return NULL;
+        }
+    }
+
+    FillWavInfo(&s->wav, info);
+    return s;
+}
+
+static void CloseWav(void* stream) {
+    WavStream* s = stream;
+    free(s->scratch);
+    free(s);
+}
+
+static int ReadWav(void* stream, void* buffer, int bufferSize) {
+    WavStream* s = stream;
+    int frameBytes = s->wav.channels * 2;
+
+    if(bufferSize > AUDIO_SCRATCH_SIZE && s->scratch) bufferSize = AUDIO_SCRATCH_SIZE;
+
+    int frames = ReadWavFrames(s->io, &s->wav, (s16*)buffer, bufferSize / frameBytes, s->scratch);
+    s->position += frames;
+    return frames * frameBytes;
+}
+
+static int SeekWav(void* stream, int seconds) {
+    WavStream* s = stream;
+    s64 frame = (s64)seconds * s->wav.sampleRate;
+
+    if(SeekWavFrame(s->io, &s->wav, frame) != 0) return -1;
+    s->position = frame;
+    return 0;
+}
+
+static s64 WavPosition(void* stream) {
+    return ((WavStream*)stream)->position;
+}
+
+static int WavInfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    WavInfo wav;
+    if(ParseWavHeader(io, &wav) != 0) return -1;
+
+    FillWavInfo(&wav, info);
+    return 0;
+}
+
+// MP3 - fixed-point Layer III decoder, length from the Xing/VBRI header
+// or the bitrate until the frame index is complete
+
+static const u16 mp3Bitrates[2][15] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},    // MPEG-1
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}          // MPEG-2/2.5
+};
+static const u16 mp3SampleRates[3] = {44100, 48000, 32000};
+
+// Length of the Layer III frame starting at p, or 0 if it is not one
+static int Mp3FrameLength(const u8* p) {
+    if(p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return 0;
+
+    int version = (p[1] >> 3) & 3;      // 0: 2.5, 2: 2, 3: 1
+    int layer = (p[1] >> 1) & 3;        // 1: Layer III
+    int bitrate = p[2] >> 4;
+    int rate = (p[2] >> 2) & 3;
+    if(version == 1 || layer != 1 || bitrate == 0 || bitrate == 15 || rate == 3) return 0;
+
+    int mpeg1 = version == 3;
+    int sampleRate = mp3SampleRates[rate] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+    return (mpeg1 ? 144 : 72) * mp3Bitrates[!mpeg1][bitrate] * 1000 / sampleRate + ((p[2] >> 1) & 1);
+}
+
+static int ProbeMp3(const u8* data, int size) {
+    int offset = 0;
+    int score = 0;
+
+    // ID3v2 tag, its size is syncsafe
+    if(size >= 10 && memcmp(data, "ID3", 3) == 0) {
+        offset = 10 + ((data[6] & 0x7F) << 21 | (data[7] & 0x7F) << 14 |
+                       (data[8] & 0x7F) << 7 | (data[9] & 0x7F));
+        if(offset + 4 > size) return 50; // the frames are past what was read
+        score = 20;
+    }
+
+    // Two frames back to back; a lone sync word says little
+    for(int i = offset; i + 4 <= size && i < offset + 1024; i++) {
+        int length = Mp3FrameLength(data + i);
+        if(!length) continue;
+
+        if(i + length + 4 > size) return score + 25;
+        if(Mp3FrameLength(data + i + length)) return i == offset ? 100 : score + 60;
+    }
+    return score;
+}
+
+static void FillMp3Info(const Mp3Info* mp3, MediaStreamInfo* info) {
+    info->sampleRate = mp3->sampleRate;
+    info->channels = mp3->channels;
+    info->duration = (int)(mp3->totalSamples / mp3->sampleRate);
+    info->bitrate = mp3->bitrate * 1000;
+    SetCodec(info, "mp3");
+}
+
+static void* OpenMp3(MediaIO* io, MediaStreamInfo* info) {
+    Mp3Decoder* dec = OpenMp3Decoder(io);
+    if(dec) FillMp3Info(GetMp3Info(dec), info);
+    return dec;
+}
+
+static void CloseMp3(void* stream) {
+    CloseMp3Decoder(stream);
+}
+
+static int ReadMp3(void* stream, void* buffer, int bufferSize) {
+    int frameBytes = GetMp3Info(stream)->channels * 2;
+    return ReadMp3Samples(stream, (s16*)buffer, bufferSize / frameBytes) * frameBytes;
+}
+
+static int SeekMp3(void* stream, int seconds) {
+    return SeekMp3Sample(stream, (s64)seconds * GetMp3Info(stream)->sampleRate);
+}
+
+static s64 Mp3Position(void* stream) {
+    return GetMp3Position(stream);
+}
+
+static int Mp3InfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    Mp3Decoder* dec = OpenMp3Decoder(io);
+    if(!dec) return -1;
+
+    FillMp3Info(GetMp3Info(dec), info);
+    CloseMp3Decoder(dec);
+    return 0;
+}
+
+// The frame table grows while playing; complete scans the rest, after
+// which the length is exact
+static int SaveMp3Index(void* stream, SidecarBuffer* index, MediaStreamInfo* info, int complete) {
+    if(WriteMp3Index(stream, index, complete) != 0) return -1;
+
+    FillMp3Info(GetMp3Info(stream), info);
+    return 0;
+}
+
+static void* OpenMp3Indexed(MediaIO* io, MediaStreamInfo* info, SidecarBuffer* index) {
+    Mp3Decoder* dec = OpenMp3DecoderWithIndex(io, index);
+    if(dec) FillMp3Info(GetMp3Info(dec), info);
+    return dec;
+}
+
+// OGG - integer Vorbis decoder, length from the granule position of the
+// last page
+
+static int ProbeOgg(const u8* data, int size) {
+    if(size < 27 || memcmp(data, "OggS", 4) != 0) return 0;
+
+    // The first packet follows the segment table of the first page
+    int packet = 27 + data[26];
+    if(packet + 7 <= size && data[packet] == 1 && memcmp(data + packet + 1, "vorbis", 6) == 0) return 100;
+    return 10; // Ogg, but not a codec we decode
+}
+
+static void FillVorbisInfo(const VorbisInfo* vorbis, MediaStreamInfo* info) {
+    info->sampleRate = vorbis->sampleRate;
+    info->channels = vorbis->channels;
+    info->duration = (int)(vorbis->totalSamples / vorbis->sampleRate);
+    info->bitrate = vorbis->bitrate * 1000;
+    SetCodec(info, "vorbis");
+}
+
+static void* OpenOgg(MediaIO* io, MediaStreamInfo* info) {
+    VorbisDecoder* dec = OpenVorbisDecoder(io);
+    if(dec) FillVorbisInfo(GetVorbisInfo(dec), info);
+    return dec;
+}
+
+static void CloseOgg(void* stream) {
+    CloseVorbisDecoder(stream);
+}
+
+static int ReadOgg(void* stream, void* buffer, int bufferSize) {
+    int frameBytes = GetVorbisInfo(stream)->channels * 2;
+    return ReadVorbisSamples(stream, (s16*)buffer, bufferSize / frameBytes) * frameBytes;
+}
+
+static int SeekOgg(void* stream, int seconds) {
+    return SeekVorbisSample(stream, (s64)seconds * GetVorbisInfo(stream)->sampleRate);
+}
+
+static s64 OggPosition(void* stream) {
+    return GetVorbisPosition(stream);
+}
+
+static int OggInfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    VorbisInfo vorbis;
+    if(ReadVorbisInfo(io, &vorbis) != 0) return -1;
+
+    FillVorbisInfo(&vorbis, info);
+    return 0;
+}
+
+// AVI - stream headers from hdrl, chunks from the index
+
+static int ProbeAvi(const u8* data, int size) {
+    if(size < 12 || memcmp(data, "RIFF", 4) != 0) return 0;
+    return memcmp(data + 8, "AVI ", 4) == 0 ? 100 : 0;
+}
+
+static void FillAviInfo(const AviInfo* avi, s64 fileSize, MediaStreamInfo* info) {
+    info->width = avi->width;
+    info->height = avi->height;
+    info->fps = avi->frameScale ? (avi->frameRate + avi->frameScale / 2) / avi->frameScale : 0;
+    info->frameNanoseconds = avi->frameRate ? (u32)((u64)avi->frameScale * 1000000000 / avi->frameRate) : 0;
+    info->duration = avi->duration;
+    info->bitrate = avi->duration > 0 ? (int)(fileSize * 8 / avi->duration) : 0;
+    if(avi->videoStream >= 0) {
+        SetFourCC(info, avi->stream[avi->videoStream].handler, 0);
+        info->fieldOrder = avi->stream[avi->videoStream].fieldOrder;
+    }
+}
+
+static void* OpenAvi(MediaIO* io, MediaStreamInfo* info) {
+    AviDemuxer* demux = OpenAviDemuxer(io);
+    if(demux) FillAviInfo(GetAviInfo(demux), io->size, info);
+    return demux;
+}
+
+static void CloseAvi(void* stream) {
+    CloseAviDemuxer(stream);
+}
+
+// One frame per call; dropped frames are empty chunks and skipped
+static int ReadAvi(void* stream, void* buffer, int bufferSize) {
+    const AviInfo* info = GetAviInfo(stream);
+    AviPacket packet;
+
+    while(ReadAviStreamPacket(stream, info->videoStream, &packet, buffer, bufferSize)) {
+        if(packet.size > bufferSize) return MEDIA_FRAME_TOO_BIG;
+        if(packet.size > 0) return packet.size;
+    }
+    return 0;
+}
+
+// Lands on the keyframe at or before the time
+static int SeekAvi(void* stream, int seconds) {
+    const AviInfo* info = GetAviInfo(stream);
+    if(!info->frameScale) return -1;
+
+    s64 frame = (s64)seconds * info->frameRate / info->frameScale;
+    return SeekAviFrame(stream, frame) < 0 ? -1 : 0;
+}
+
+static s64 SeekAviKeyframe(void* stream, s64 frame) {
+    return SeekAviFrame(stream, frame);
+}
+
+static s64 AviPosition(void* stream) {
+    return GetAviPosition(stream);
+}
+
+static int AviInfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    AviInfo avi;
+    if(ReadAviInfo(io, &avi) != 0) return -1;
+
+    FillAviInfo(&avi, io->size, info);
+    return 0;
+}
+
+// The chunk index is complete once open
+static int SaveAviIndex(void* stream, SidecarBuffer* index, MediaStreamInfo* info, int complete) {
+    return WriteAviIndex(stream, index);
+}
+
+static void* OpenAviIndexed(MediaIO* io, MediaStreamInfo* info, SidecarBuffer* index) {
+    AviDemuxer* demux = OpenAviDemuxerWithIndex(io, index);
+    if(demux) FillAviInfo(GetAviInfo(demux), io->size, info);
+    return demux;
+}
+
+// AVI sound track - integer PCM chunks of the first audio stream, on a
+// demuxer of its own so it keeps its place apart from the pictures. MP3
+// and other compressed tracks are not decoded.
+
+typedef struct {
+    MediaIO* io;
+    AviDemuxer* demux;
+    int stream;
+    int channels;
+    int bytesPerSample;
+    int blockAlign;
+    u8* chunk;          // payload of the chunk being played
+    int chunkCapacity;
+    int chunkSize;
+    int chunkRead;
+    s64 skip;           // bytes of the next chunk before a seek's target
+    s64 position;
+} AviSoundTrack;
+
+static void CloseAviSoundTrack(void* stream) {
+    AviSoundTrack* s = stream;
+    CloseAviDemuxer(s->demux);
+    free(s->chunk);
+    free(s);
+}
+
+static void* OpenAviSoundTrack(MediaIO* io, MediaStreamInfo* info) {
+    AviSoundTrack* s = calloc(1, sizeof(AviSoundTrack));
+    if(!s) return NULL;
+
+    s->io = io;
+    s->demux = OpenAviDemuxer(io);
+    const AviInfo* avi = s->demux ? GetAviInfo(s->demux) : NULL;
+    const AviStream* a = avi && avi->audioStream >= 0 ? &avi->stream[avi->audioStream] : NULL;
+    int bits = a ? a->bitsPerSample : 0;
+    if(!a || a->formatTag != WAVE_FORMAT_PCM || a->channels < 1 || a->channels > 2 || a->sampleRate <= 0 ||
+       (bits != 8 && bits != 16 && bits != 24 && bits != 32) || a->blockAlign != a->channels * bits / 8) {
+        if(s->demux) CloseAviDemuxer(s->demux);
+        free(s);
+        return NULL;
+    }
+
+    s->stream = avi->audioStream;
+    s->channels = a->channels;
+    s->bytesPerSample = bits / 8;
+    s->blockAlign = a->blockAlign;
+
+    info->sampleRate = a->sampleRate;
+    info->channels = a->channels;
+    info->duration = a->rate ? (int)(a->length * a->scale / a->rate) : avi->duration;
+    info->bitrate = a->sampleRate * a->blockAlign * 8;
+    SetCodec(info, "pcm");
+    return s;
+}
+
+// Loads the next chunk, past any bytes a seek still owes; 0 at the end
+static int NextSoundChunk(AviSoundTrack* s) {
+    AviPacket packet;
+
+    do {
+        if(!ReadAviStreamPacket(s->demux, s->stream, &packet, s->chunk, s->chunkCapacity)) return 0;
+        if(packet.size > s->chunkCapacity) {
+            u8* chunk = realloc(s->chunk, packet.size);
+            if(!chunk) return 0;
+            s->chunk = chunk;
+            s->chunkCapacity = packet.size;
+            if(SeekMediaIO(s->io, packet.offset) != 0 || ReadMediaIO(s->io, s->chunk, packet.size) != packet.size) {
+                return 0;
+            }
+        }
+
+        s->chunkSize = packet.size;
+        s->chunkRead = s->skip < packet.size ? (int)s->skip : packet.size;
+        s->skip -= s->chunkRead;
+    } while(s->chunkSize - s->chunkRead < s->blockAlign);
+
+    return 1;
+}
+
+static int ReadAviSoundTrack(void* stream, void* buffer, int bufferSize) {
+    AviSoundTrack* s = stream;
+    s16* out = buffer;
+    int wanted = bufferSize / (s->channels * 2);
+    int frames = 0;
+
+    while(frames < wanted) {
+        if(s->chunkSize - s->chunkRead < s->blockAlign && !NextSoundChunk(s)) break;
+
+        // A sample split across chunks would be odd and is dropped
+        int n = (s->chunkSize - s->chunkRead) / s->blockAlign;
+        if(n > wanted - frames) n = wanted - frames;
+
+        const u8* in = s->chunk + s->chunkRead;
+        s16* to = out + frames * s->channels;
+        int count = n * s->channels;
+        switch(s->bytesPerSample) {
+            case 1: ConvertSamplesU8(to, in, count); break;
+            case 2: ConvertSamplesS16LE(to, (const s16*)in, count); break;
+            case 3: ConvertSamplesS24LE(to, in, count); break;
+            default: ConvertSamplesS32LE(to, in, count); break;
+        }
+
+        s->chunkRead += n * s->blockAlign;
+        frames += n;
+    }
+
+    s->position += frames;
+    return frames * s->channels * 2;
+}
+
+static int SeekAviSoundTrack(void* stream, int seconds) {
+    AviSoundTrack* s = stream;
+    const AviInfo* avi = GetAviInfo(s->demux);
+    s64 frame = (s64)seconds * avi->stream[s->stream].sampleRate;
+    s64 bytes = frame * s->blockAlign;
+
+    s64 start = SeekAviStreamBytes(s->demux, s->stream, bytes);
+    if(start < 0) return -1;
+
+    s->chunkSize = 0;
+    s->chunkRead = 0;
+    s->skip = bytes - start;
+    s->position = frame;
+    return 0;
+}
+
+static s64 AviSoundTrackPosition(void* stream) {
+    return ((AviSoundTrack*)stream)->position;
+}
+
+static const MediaFormat aviSoundTrack = {
+    "avi-pcm", MEDIA_TYPE_AUDIO, "", NULL, OpenAviSoundTrack, CloseAviSoundTrack, ReadAviSoundTrack,
+    SeekAviSoundTrack, AviSoundTrackPosition, NULL, NULL, NULL, NULL, NULL
+};
+
+// MP4/MOV - box headers at open, sample tables on first read. The tables
+// are the index and are read straight from moov, so there is no sidecar.
+
+static int ProbeMp4(const u8* data, int size) {
+    if(size < 8 || GetBE32(data) < 8) return 0;
+
+    const u8* type = data + 4;
+    if(memcmp(type, "ftyp", 4) == 0) return 100;
+    if(memcmp(type, "moov", 4) == 0 || memcmp(type, "mdat", 4) == 0 ||
+       memcmp(type, "wide", 4) == 0 || memcmp(type, "free", 4) == 0 ||
+       memcmp(type, "skip", 4) == 0) return 60;
+    return 0;
+}
+
+static void FillMp4Info(const Mp4Info* mp4, s64 fileSize, MediaStreamInfo* info) {
+    info->width = mp4->width;
+    info->height = mp4->height;
+    if(mp4->videoTrack >= 0) {
+        const Mp4Track* track = &mp4->track[mp4->videoTrack];
+        if(track->duration > 0) {
+            info->fps = (int)((track->samples * track->timescale + track->duration / 2) / track->duration);
+            // The average, for tracks whose frame times vary
+            if(track->samples) {
+                info->frameNanoseconds = (u32)(track->duration * 1e9 / ((double)track->samples * track->timescale));
+            }
+        }
+    }
+    info->duration = mp4->seconds;
+    info->bitrate = mp4->seconds > 0 ? (int)(fileSize * 8 / mp4->seconds) : 0;
+    if(mp4->videoTrack >= 0) {
+        SetFourCC(info, mp4->track[mp4->videoTrack].codec, 1);
+        info->fieldOrder = mp4->track[mp4->videoTrack].fieldOrder;
+    }
+}
+
+static void* OpenMp4(MediaIO* io, MediaStreamInfo* info) {
+    Mp4Demuxer* demux = OpenMp4Demuxer(io);
+    if(demux) FillMp4Info(GetMp4Info(demux), io->size, info);
+    return demux;
+}
+
+static void CloseMp4(void* stream) {
+    CloseMp4Demuxer(stream);
+}
+
+static int ReadMp4(void* stream, void* buffer, int bufferSize) {
+    const Mp4Info* info = GetMp4Info(stream);
+    Mp4Packet packet;
+
+    if(info->videoTrack < 0) return 0;
+    while(ReadMp4Packet(stream, info->videoTrack, &packet, buffer, bufferSize)) {
+        if(packet.size > bufferSize) return MEDIA_FRAME_TOO_BIG;
+        if(packet.size > 0) return packet.size;
+    }
+    return 0;
+}
+
+// Sync sample at or before the time, other tracks follow
+static int SeekMp4(void* stream, int seconds) {
+    return SeekMp4Time(stream, (s64)seconds * 1000) < 0 ? -1 : 0;
+}
+
+// Frame numbers to time at the track's average rate, rounded up so the
+// frame's own sync sample is at or before it
+static s64 SeekMp4Keyframe(void* stream, s64 frame) {
+    const Mp4Info* info = GetMp4Info(stream);
+    if(info->videoTrack < 0) return -1;
+
+    const Mp4Track* track = &info->track[info->videoTrack];
+    s64 units = (s64)track->samples * track->timescale;
+    if(units <= 0) return -1;
+
+    s64 ms = (frame * track->duration * 1000 + units - 1) / units;
+    return SeekMp4Time(stream, ms) < 0 ? -1 : GetMp4Position(stream);
+}
+
+static s64 Mp4Position(void* stream) {
+    return GetMp4Position(stream);
+}
+
+static int Mp4InfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    Mp4Info mp4;
+    if(ReadMp4Info(io, &mp4) != 0) return -1;
+
+    FillMp4Info(&mp4, io->size, info);
+    return 0;
+}
+
+// MKV/WebM - SeekHead, tracks and cue points at open
+
+static int ProbeMkv(const u8* data, int size) {
+    if(size < 4 || GetBE32(data) != 0x1A45DFA3) return 0;
+
+    // The DocType is near the start of the EBML header
+    for(int i = 4; i + 8 <= size && i < 64; i++) {
+        if(memcmp(data + i, "matroska", 8) == 0 || memcmp(data + i, "webm", 4) == 0) return 100;
+    }
+    return 50;
+}
+
+static void FillMkvInfo(const MkvInfo* mkv, s64 fileSize, MediaStreamInfo* info) {
+    info->width = mkv->width;
+    info->height = mkv->height;
+    if(mkv->videoTrack >= 0 && mkv->track[mkv->videoTrack].defaultDuration) {
+        u64 frame = mkv->track[mkv->videoTrack].defaultDuration;
+        info->fps = (int)((1000000000 + frame / 2) / frame);
+        info->frameNanoseconds = (u32)frame;
+    }
+    info->duration = mkv->seconds;
+    info->bitrate = mkv->seconds > 0 ? (int)(fileSize * 8 / mkv->seconds) : 0;
+    if(mkv->videoTrack >= 0) {
+        SetCodec(info, mkv->track[mkv->videoTrack].codec);
+        info->fieldOrder = mkv->track[mkv->videoTrack].fieldOrder;
+    }
+}
+
+static void* OpenMkv(MediaIO* io, MediaStreamInfo* info) {
+    MkvDemuxer* demux = OpenMkvDemuxer(io);
+    if(demux) FillMkvInfo(GetMkvInfo(demux), io->size, info);
+    return demux;
+}
+
+static void CloseMkv(void* stream) {
+    CloseMkvDemuxer(stream);
+}
+
+// Packets point into the demuxer's buffer; this is the only copy
+static int ReadMkv(void* stream, void* buffer, int bufferSize) {
+    const MkvInfo* info = GetMkvInfo(stream);
+    MkvPacket packet;
+
+    if(info->videoTrack < 0) return 0;
+    while(ReadMkvPacket(stream, &packet)) {
+        if(packet.track == info->videoTrack && packet.size > 0) {
+            if(packet.size > bufferSize) return MEDIA_FRAME_TOO_BIG;
+            memcpy(buffer, packet.data, packet.size);
+            return packet.size;
+        }
+    }
+    return 0;
+}
+
+// Cue point at or before the time, then its keyframe
+static int SeekMkv(void* stream, int seconds) {
+    return SeekMkvTime(stream, (s64)seconds * 1000) < 0 ? -1 : 0;
+}
+
+// Matroska has times rather than frame numbers
+static s64 MkvPosition(void* stream) {
+    const MkvInfo* info = GetMkvInfo(stream);
+    if(info->videoTrack < 0 || !info->track[info->videoTrack].defaultDuration) return 0;
+
+    return GetMkvPosition(stream) * 1000000 / (s64)info->track[info->videoTrack].defaultDuration;
+}
+
+// Block times are whole ms, so the frame's time is rounded up
+static s64 SeekMkvKeyframe(void* stream, s64 frame) {
+    const MkvInfo* info = GetMkvInfo(stream);
+    if(info->videoTrack < 0 || !info->track[info->videoTrack].defaultDuration) return -1;
+
+    s64 ms = (frame * (s64)info->track[info->videoTrack].defaultDuration + 999999) / 1000000;
+    return SeekMkvTime(stream, ms) < 0 ? -1 : MkvPosition(stream);
+}
+
+static int MkvInfoOnly(MediaIO* io, MediaStreamInfo* info) {
+    MkvInfo mkv;
+    if(ReadMkvInfo(io, &mkv) != 0) return -1;
+
+    FillMkvInfo(&mkv, io->size, info);
+    return 0;
+}
+
+// Cue points from the file or, without Cues, from the cluster walk of the
+// first seek; complete does that walk now
+static int SaveMkvIndex(void* stream, SidecarBuffer* index, MediaStreamInfo* info, int complete) {
+    return WriteMkvIndex(stream, index, complete);
+}
+
+static void* OpenMkvIndexed(MediaIO* io, MediaStreamInfo* info, SidecarBuffer* index) {
+    MkvDemuxer* demux = OpenMkvDemuxerWithIndex(io, index);
+    if(demux) FillMkvInfo(GetMkvInfo(demux), io->size, info);
+    return demux;
+}
+
+static const MediaFormat builtinFormats[] = {
+    {"wav", MEDIA_TYPE_AUDIO, "wav", ProbeWav, OpenWav, CloseWav, ReadWav, SeekWav, WavPosition, WavInfoOnly,
+     NULL, NULL, NULL, NULL},
+    {"mp3", MEDIA_TYPE_AUDIO, "mp3", ProbeMp3, OpenMp3, CloseMp3, ReadMp3, SeekMp3, Mp3Position, Mp3InfoOnly,
+     SaveMp3Index, OpenMp3Indexed, NULL, NULL},
+    {"ogg", MEDIA_TYPE_AUDIO, "ogg oga", ProbeOgg, OpenOgg, CloseOgg, ReadOgg, SeekOgg, OggPosition, OggInfoOnly,
+     NULL, NULL, NULL, NULL},
+    {"avi", MEDIA_TYPE_VIDEO, "avi", ProbeAvi, OpenAvi, CloseAvi, ReadAvi, SeekAvi, AviPosition, AviInfoOnly,
+     SaveAviIndex, OpenAviIndexed, SeekAviKeyframe, &aviSoundTrack},
+    {"mp4", MEDIA_TYPE_VIDEO, "mp4 m4v mov", ProbeMp4, OpenMp4, CloseMp4, ReadMp4, SeekMp4, Mp4Position, Mp4InfoOnly,
+     NULL, NULL, SeekMp4Keyframe, NULL},
+    {"mkv", MEDIA_TYPE_VIDEO, "mkv webm", ProbeMkv, OpenMkv, CloseMkv, ReadMkv, SeekMkv, MkvPosition, MkvInfoOnly,
+     SaveMkvIndex, OpenMkvIndexed, SeekMkvKeyframe, NULL}
+};
+
+void RegisterBuiltinFormats() {
+    for(int i = 0; i < (int)(sizeof(builtinFormats) / sizeof(builtinFormats[0])); i++) {
+        RegisterMediaFormat(&builtinFormats[i]);
+    }
+}
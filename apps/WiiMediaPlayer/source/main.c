@@ -1,4 +1,5 @@
 #include <gccore.h>
+#include <ogc/lwp_watchdog.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,8 +9,17 @@
 #include <asndlib.h>
 #include <wchar.h>
 #include <locale.h>
+#include <time.h>
 #include "playlist.h"
 #include "movie_features.h"
+#include "decoder.h"
+#include "metadata.h"
+#include "audio_stream.h"
+#include "pipeline.h"
+#include "avsync.h"
+#include "trickplay.h"
+#include "timestretch.h"
+#include "mem2.h"
 
 // Video globals
 static void *xfb = NULL;
@@ -24,6 +34,11 @@ static GXRModeObj *rmode = NULL;
 #define YELLOW 0xFFFF00FF
 #define GRAY  0x808080FF
 
+// The main thread draws and reads the pads, under the audio fill (80),
+// read-ahead (72) and video decode (PIPELINE_PRIORITY) threads, so a busy
+// frame here never starves them
+#define UI_PRIORITY 48
+
 // Media player states
 typedef enum {
     STATE_MENU,
@@ -57,9 +72,24 @@ static MediaFile* fileList = NULL;
 static int fileCount = 0;
 static char currentPath[512] = "sd:/";
 static int currentEffect = 0;
-static int currentBookmark = 0;
 static int settingsPage = 0;
 static int isJapaneseWii = 0;  // Japanese Wii detection
+static AudioDecoder* audioDecoder = NULL;    // the file, or a video's sound track
+static TimeStretch audioStretch;       // between audioDecoder and the stream
+static int audioStretched = 0;         // 0 when the format is beyond it
+static VideoDecoder* videoDecoder = NULL;
+static Pipeline videoPipeline;         // open while videoDecoder is
+static u8* videoPicture = NULL;        // the shown frame scaled and with its effects, in MEM2
+static int videoPictureValid = 0;
+static u32 videoPictureVersion = 0;    // GetVideoEffectsVersion() it was made with
+static MediaClock mediaClock;          // the audio's, or the timer's for silent video
+static int audioMaster = 0;            // the voice runs mediaClock; off once a sound track ends
+static s64 timerMicroseconds = 0;      // played so far, when the timer is the master
+static u64 timerTick = 0;
+static int showSyncStats = 0;
+static TrickPlay trickPlay;            // speed 0 in normal play
+static char colorGradeName[256] = "";  // the .cube in sd:/luts, "" for none
+static char browserNotice[128] = "";   // why the last file didn't play, under the list
 
 // Function prototypes
 void Initialise();
@@ -78,6 +108,7 @@ void StopMedia();
 void UpdatePlayback();
 void DrawProgressBar(int x, int y, int width, int height, float progress, u32 color);
 void InitializePlaylists();
+void NextColorGrade();
 
 int main(int argc, char *argv[]) {
     // Initialize the Wii
@@ -107,8 +138,9 @@ int main(int argc, char *argv[]) {
                 break;
             case STATE_PLAYING_VIDEO:
             case STATE_PLAYING_AUDIO:
-                DrawPlayer();
+                // The picture first, the player's text goes over it
                 UpdatePlayback();
+                DrawPlayer();
                 break;
             case STATE_PLAYLIST:
                 DrawFileBrowser(); // Reuse file browser for playlist
@@ -132,6 +164,8 @@ int main(int argc, char *argv[]) {
 }
 
 void Initialise() {
+    LWP_SetThreadPriority(LWP_THREAD_NULL, UI_PRIORITY);
+
     // Initialize video
     VIDEO_Init();
     WPAD_Init();
@@ -263,6 +297,23 @@ void DrawFileBrowser() {
     
     if(endIndex > fileCount) endIndex = fileCount;
     
+    // The first unknown entry in view is probed on the I/O thread, one at
+    // a time, so drawing never waits on the card; the answer is cached,
+    // so each file is only read once
+    for(int i = startIndex; i < endIndex; i++) {
+        if(fileList[i].duration < 0) {
+            MediaMetadata metadata;
+            int result = PollMediaMetadata(fileList[i].path, &metadata);
+            if(result == 0) {
+                fileList[i].isVideo = metadata.type == MEDIA_TYPE_VIDEO;
+                fileList[i].duration = metadata.info.duration;
+            } else if(result < 0) {
+                fileList[i].duration = 0;
+            }
+            break;
+        }
+    }
+    
     for(int i = startIndex; i < endIndex; i++) {
         int y = startY + (i - startIndex) * 20;
         u32 color = (i == selectedItem) ? YELLOW : WHITE;
@@ -274,6 +325,12 @@ void DrawFileBrowser() {
         }
         
         DrawText(150, y, fileList[i].name, color);
+        
+        if(fileList[i].duration > 0) {
+            char durationStr[16];
+            sprintf(durationStr, "%d:%02d", fileList[i].duration / 60, fileList[i].duration % 60);
+            DrawText(560, y, durationStr, GRAY);
+        }
     }
     
     // Draw scroll indicator
@@ -284,6 +341,10 @@ void DrawFileBrowser() {
         DrawText(320, 380, "v", WHITE);
     }
     
+    if(browserNotice[0]) {
+        DrawText(320, 400, browserNotice, RED);
+    }
+    
     // Draw instructions
     DrawText(320, 420, "A: Play  B: Back  D-Pad: Navigate  HOME: Exit", GRAY);
 }
@@ -304,10 +365,13 @@ void DrawPlayer() {
     DrawProgressBar(100, 150, 500, 20, progress, GREEN);
     
     // Draw time info
-    char timeStr[64];
+    char timeStr[96];
     sprintf(timeStr, "%02d:%02d / %02d:%02d", 
             currentTime / 60, currentTime % 60,
             totalTime / 60, totalTime % 60);
+    if(audioDecoder && audioStretched && playbackSettings.playback_speed != 1.0f) {
+        sprintf(timeStr + strlen(timeStr), "  (%.2gx)", playbackSettings.playback_speed);
+    }
     DrawText(320, 180, timeStr, WHITE);
     
     // Draw volume
@@ -315,11 +379,40 @@ void DrawPlayer() {
     DrawText(320, 220, timeStr, WHITE);
     
     // Draw play/pause indicator
-    DrawText(320, 260, isPlaying ? "PAUSED" : "PLAYING", isPlaying ? RED : GREEN);
+    if(trickPlay.speed) {
+        sprintf(timeStr, "%s %dx", trickPlay.speed > 0 ? "FAST FORWARD" : "REWIND", abs(trickPlay.speed));
+        DrawText(320, 260, timeStr, YELLOW);
+    } else {
+        DrawText(320, 260, isPlaying ? "PAUSED" : "PLAYING", isPlaying ? RED : GREEN);
+    }
     
     // Draw controls
     DrawText(320, 320, "A: Play/Pause  B: Stop  +/-: Volume  HOME: Exit", GRAY);
-    DrawText(320, 350, "Left/Right: Seek  Up/Down: Volume", GRAY);
+    DrawText(320, 350, currentFile.isVideo ? "Left/Right: Rewind/Fast Forward  Down: Sync Stats"
+                                           : "Left/Right: Seek  Z/C: Slow/Fast  Down: Sync Stats", GRAY);
+
+    if(showSyncStats) {
+        const AVSyncStats* sync = &mediaClock.stats;
+        sprintf(timeStr, "Clock %lld ms (%s)  Offset %+d ms", (long long)GetMediaClock(&mediaClock),
+                audioMaster ? "audio" : "timer", (int)mediaClock.offset);
+        DrawText(320, 390, timeStr, YELLOW);
+        sprintf(timeStr, "Drift %d ms  Avg %d  Worst %d  Frames %u", (int)sync->drift, (int)sync->averageDrift,
+                (int)sync->worstDrift, (unsigned)sync->frames);
+        DrawText(320, 410, timeStr, YELLOW);
+        if(trickPlay.speed) {
+            const TrickPlayStats* trick = &trickPlay.stats;
+            sprintf(timeStr, "Keyframes %u asked  %u shown  %u repeated  %u ms each", (unsigned)trick->requested,
+                    (unsigned)trick->shown, (unsigned)trick->repeated, (unsigned)(trick->averageMicroseconds / 1000));
+        } else if(videoDecoder) {
+            const PipelineStats* stats = &videoPipeline.stats;
+            sprintf(timeStr, "Dropped %u  Repeated %u  Queue %u/%u", (unsigned)stats->dropped,
+                    (unsigned)stats->repeated, (unsigned)stats->demux.depth, (unsigned)stats->decode.depth);
+        } else {
+            sprintf(timeStr, "Underruns %d  Stretched %u segments", GetAudioStreamUnderruns(),
+                    (unsigned)audioStretch.stats.segments);
+        }
+        DrawText(320, 430, timeStr, YELLOW);
+    }
 }
 
 void LoadFileList() {
@@ -340,14 +433,9 @@ void LoadFileList() {
     struct stat st;
     while(dirnext(dir, filename, &st) == 0) {
         if(!(st.st_mode & S_IFDIR)) { // Not a directory
-            char* ext = strrchr(filename, '.');
-            if(ext) {
-                ext++; // Skip the dot
-                if(strcasecmp(ext, "mp4") == 0 || strcasecmp(ext, "avi") == 0 ||
-                   strcasecmp(ext, "mkv") == 0 || strcasecmp(ext, "mp3") == 0 ||
-                   strcasecmp(ext, "wav") == 0 || strcasecmp(ext, "ogg") == 0) {
-                    fileCount++;
-                }
+            // Listed by extension; the content decides when it is played
+            if(FindMediaFormatByName(filename)) {
+                fileCount++;
             }
         }
     }
@@ -364,22 +452,21 @@ void LoadFileList() {
         int index = 0;
         while(dirnext(dir, filename, &st) == 0 && index < fileCount) {
             if(!(st.st_mode & S_IFDIR)) {
-                char* ext = strrchr(filename, '.');
-                if(ext) {
-                    ext++;
-                    int isVideo = (strcasecmp(ext, "mp4") == 0 || 
-                                  strcasecmp(ext, "avi") == 0 || 
-                                  strcasecmp(ext, "mkv") == 0);
+                const MediaFormat* format = FindMediaFormatByName(filename);
+                if(format) {
+                    strcpy(fileList[index].name, filename);
+                    sprintf(fileList[index].path, "%s%s", currentPath, filename);
+                    fileList[index].isVideo = format->type == MEDIA_TYPE_VIDEO;
                     
-                    if(isVideo || strcasecmp(ext, "mp3") == 0 || 
-                       strcasecmp(ext, "wav") == 0 || strcasecmp(ext, "ogg") == 0) {
-                        
-                        strcpy(fileList[index].name, filename);
-                        sprintf(fileList[index].path, "%s%s", currentPath, filename);
-                        fileList[index].isVideo = isVideo;
-                        fileList[index].duration = 0; // Would need to parse file for this
-                        index++;
+                    // Known files are free; the rest are probed while drawing
+                    MediaMetadata metadata;
+                    if(FindMediaMetadata(fileList[index].path, st.st_size, st.st_mtime, &metadata) == 0) {
+                        if(metadata.format) fileList[index].isVideo = metadata.type == MEDIA_TYPE_VIDEO;
+                        fileList[index].duration = metadata.info.duration;
+                    } else {
+                        fileList[index].duration = -1;
                     }
+                    index++;
                 }
             }
         }
@@ -388,45 +475,305 @@ void LoadFileList() {
     dirclose(dir);
 }
 
+// The decoder feeds the time-stretch stage, which is the refill callback
+// for the ASND stream; both run on the audio fill thread
+static int ReadDecodedAudio(void* userdata, void* buffer, int size) {
+    return ReadAudioFrame((AudioDecoder*)userdata, buffer, size);
+}
+
+static int FillAudioStream(void* userdata, void* buffer, int size) {
+    return ReadTimeStretch((TimeStretch*)userdata, buffer, size);
+}
+
+// playback_speed (slow motion, fast forward) in the stage's units
+static int AudioSpeed() {
+    return audioStretched ? (int)(playbackSettings.playback_speed * TIME_STRETCH_UNITY + 0.5f) : TIME_STRETCH_UNITY;
+}
+
+// The voice's samples per second of the file
+static int AudioClockRate() {
+    return (int)((s64)audioDecoder->sampleRate * TIME_STRETCH_UNITY / AudioSpeed());
+}
+
+// Starts the stream from where the decoder is
+static int StartAudio() {
+    if(!audioStretched) {
+        return StartAudioStream(audioDecoder->sampleRate, audioDecoder->channels, ReadDecodedAudio, audioDecoder);
+    }
+    ResetTimeStretch(&audioStretch);
+    SetTimeStretchSpeed(&audioStretch, AudioSpeed());
+    return StartAudioStream(audioDecoder->sampleRate, audioDecoder->channels, FillAudioStream, &audioStretch);
+}
+
+// Slow motion and fast forward on audio: the stage takes the speed up at
+// its next segment and the clock runs at it from now
+static void ApplyAudioSpeed() {
+    if(!audioMaster || !audioStretched) return;
+
+    SetTimeStretchSpeed(&audioStretch, AudioSpeed());
+    SetMediaClockRate(&mediaClock, AudioClockRate());
+}
+
+// The timer master starts again at ms
+static void StartTimerClock(s64 ms) {
+    ResetMediaClock(&mediaClock, 1000000, ms);
+    timerMicroseconds = 0;
+    timerTick = gettime();
+}
+
+// The audio goes on from seconds in and the clock with it. Returns 0, or
+// -1 if it can't seek there or the stream won't start.
+static int RestartAudio(int seconds) {
+    // The fill thread reads the decoder, and the voice's position
+    // starts again with the stream
+    StopAudioStream();
+    if(SeekAudioDecoder(audioDecoder, seconds) != 0 || StartAudio() != 0) return -1;
+
+    ResetMediaClock(&mediaClock, AudioClockRate(), audioDecoder->currentPosition * 1000 / audioDecoder->sampleRate);
+    if(!isPlaying) PauseAudioStream(1);
+    return 0;
+}
+
+// Video starts again at ms, the effects' history with it. The sound track
+// is the master from the whole second before; the picture waits for it.
+// Without one, or one that won't play from there, the timer is.
+static void RestartVideoClock(s64 ms) {
+    audioMaster = audioDecoder && RestartAudio((int)(ms / 1000)) == 0;
+    if(!audioMaster) StartTimerClock(ms);
+    ResetVideoHistory();
+}
+
 void PlayMedia(const char* path, int isVideo) {
+    StopMedia();
+    PlayerState returnState = currentState;
+    browserNotice[0] = 0;
+
     strcpy(currentFile.path, path);
     strcpy(currentFile.name, strrchr(path, '/') ? strrchr(path, '/') + 1 : path);
     currentFile.isVideo = isVideo;
     
     // Reset playback state
     currentTime = 0;
-    totalTime = 300; // Default 5 minutes, would parse from file
+    totalTime = 300; // Default 5 minutes when the headers give no duration
+    MediaMetadata metadata;
+    if(GetMediaMetadata(path, &metadata) == 0 && metadata.info.duration > 0) {
+        totalTime = metadata.info.duration;
+    }
     isPlaying = 1;
     
     if(isVideo) {
         currentState = STATE_PLAYING_VIDEO;
         printf("Starting video playback: %s\n", path);
-        // Here you would initialize video decoder
+
+        videoDecoder = InitVideoDecoder(path);
+        if(videoDecoder && OpenPipeline(&videoPipeline, videoDecoder) == 0) {
+            if(videoDecoder->duration > 0) {
+                totalTime = videoDecoder->duration;
+            }
+            SetVideoFieldOrder(videoDecoder->info.fieldOrder);
+            // A sound track the format decodes is the clock's master
+            audioDecoder = InitSoundTrackDecoder(videoDecoder);
+            if(audioDecoder) {
+                SetAudioStreamVolume(volume);
+                audioStretched = InitTimeStretch(&audioStretch, audioDecoder->sampleRate, audioDecoder->channels,
+                                                 ReadDecodedAudio, audioDecoder) == 0;
+            }
+            // Without it every pass scales and applies the effects again
+            videoPicture = Mem2Alloc(rmode->fbWidth * rmode->xfbHeight * VI_DISPLAY_PIX_SZ);
+            videoPictureValid = 0;
+            // Otherwise UpdatePlayback decodes in between drawing
+            if(StartPipelineThread(&videoPipeline, PIPELINE_PRIORITY) != 0) {
+                printf("Unable to start the decode thread\n");
+            }
+            RestartVideoClock(0);
+        } else {
+            // Back to the list rather than a player with nothing to show
+            if(videoDecoder && !FindPipelineDecoder(videoDecoder->info.codec)) {
+                snprintf(browserNotice, sizeof(browserNotice), "Unsupported codec: %s",
+                         videoDecoder->info.codec[0] ? videoDecoder->info.codec : "unknown");
+            } else {
+                snprintf(browserNotice, sizeof(browserNotice), "Unsupported video file");
+            }
+            printf("%s: %s\n", browserNotice, path);
+            CloseVideoDecoder(videoDecoder);
+            videoDecoder = NULL;
+            isPlaying = 0;
+            currentState = returnState;
+        }
     } else {
         currentState = STATE_PLAYING_AUDIO;
         printf("Starting audio playback: %s\n", path);
-        // Here you would initialize audio decoder
+
+        audioDecoder = InitAudioDecoder(path);
+        if(audioDecoder) {
+            SetAudioStreamVolume(volume);
+            audioStretched = InitTimeStretch(&audioStretch, audioDecoder->sampleRate, audioDecoder->channels,
+                                             ReadDecodedAudio, audioDecoder) == 0;
+        }
+        // A stream that won't start plays nothing either
+        if(audioDecoder && StartAudio() == 0) {
+            if(audioDecoder->duration > 0) {
+                totalTime = audioDecoder->duration;
+            }
+            ResetMediaClock(&mediaClock, AudioClockRate(), 0);
+            audioMaster = 1;
+        } else {
+            // Back to the list, saying whether the file or the output failed
+            if(audioDecoder) {
+                snprintf(browserNotice, sizeof(browserNotice), "Unable to start audio output");
+            } else {
+                snprintf(browserNotice, sizeof(browserNotice), "Unsupported audio file");
+            }
+            printf("%s: %s\n", browserNotice, path);
+            CloseAudioDecoder(audioDecoder);
+            audioDecoder = NULL;
+            isPlaying = 0;
+            currentState = returnState;
+        }
     }
 }
 
 void StopMedia() {
     isPlaying = 0;
     currentTime = 0;
-    printf("Media playback stopped\n");
-    // Here you would stop decoders and free resources
+    if(trickPlay.speed) {
+        // Trick play ends with the file, and mustn't carry over as speed
+        playbackSettings.fast_forward = 0;
+        playbackSettings.reverse_playback = 0;
+        playbackSettings.playback_speed = 1.0f;
+    }
+    trickPlay.speed = 0;
+    
+    // The fill thread reads from the decoder, stop it before closing
+    StopAudioStream();
+    audioMaster = 0;
+    if(audioDecoder) {
+        CloseAudioDecoder(audioDecoder);
+        audioDecoder = NULL;
+        if(!videoDecoder) printf("Media playback stopped\n");
+    }
+    if(videoDecoder) {
+        ClosePipeline(&videoPipeline);
+        CloseVideoDecoder(videoDecoder);
+        videoDecoder = NULL;
+        Mem2Free(videoPicture);
+        videoPicture = NULL;
+        videoPictureValid = 0;
+        printf("Media playback stopped\n");
+    }
+}
+
+// Jumps to a time; the clock restarts from where the decoder lands (a
+// keyframe for video)
+static void SeekMedia(int seconds) {
+    if(videoDecoder) {
+        s64 landed = SeekPipeline(&videoPipeline, seconds);
+        if(landed >= 0) RestartVideoClock(landed);
+    } else if(audioDecoder) {
+        RestartAudio(seconds);
+    }
+    currentTime = (int)(GetMediaClock(&mediaClock) / 1000);
+}
+
+// Video only: 1 is normal play, else the trick play speed. Normal play
+// picks up at the keyframe on screen.
+static void SetPlaybackRate(int speed) {
+    if(!videoDecoder) return;
+
+    // Set first: the sound track starts again at this speed
+    playbackSettings.fast_forward = speed > 1;
+    playbackSettings.reverse_playback = speed < 0;
+    playbackSettings.playback_speed = (float)abs(speed);
+
+    if(speed != 1) {
+        // The sound track is held while the scan runs
+        if(!trickPlay.speed && audioMaster) PauseAudioStream(1);
+        StartTrickPlay(&trickPlay, speed, GetVideoClock(&mediaClock), (s64)totalTime * 1000,
+                       ticks_to_microsecs(gettime()));
+        isPlaying = 1;
+    } else if(trickPlay.speed) {
+        s64 landed = StopTrickPlay(&trickPlay, &videoPipeline);
+        if(landed >= 0) RestartVideoClock(landed);
+        else if(audioMaster) PauseAudioStream(!isPlaying);
+    }
+}
+
+// A new frame gets the stages with history once, at its own size, then is
+// scaled and has its effects applied, and that picture is kept: passes
+// with nothing new (24 fps on a 60 Hz TV, pause) only copy it back, unless
+// the effects changed in between
+static void DrawVideoPicture(const PipelineFrame* fresh) {
+    PipelineFrame* frame = videoPipeline.shown;
+    if(!frame) return;
+
+    u32 size = rmode->fbWidth * rmode->xfbHeight * VI_DISPLAY_PIX_SZ;
+    if(!fresh && videoPictureValid && videoPictureVersion == GetVideoEffectsVersion()) {
+        memcpy(xfb, videoPicture, size);
+        return;
+    }
+
+    // The UI holds the shown frame until the next one is presented
+    if(fresh) PrepareVideoFrame(frame->data, videoPipeline.width, videoPipeline.height);
+    ScaleVideoFrame(frame->data, videoPipeline.width, videoPipeline.height, videoPipeline.width * 2,
+                    xfb, rmode->fbWidth, rmode->xfbHeight);
+    ApplyVideoEffects(xfb, rmode->fbWidth, rmode->xfbHeight);
+
+    if(videoPicture) {
+        memcpy(videoPicture, xfb, size);
+        videoPictureValid = 1;
+        videoPictureVersion = GetVideoEffectsVersion();
+    }
 }
 
 void UpdatePlayback() {
-    if(isPlaying && currentTime < totalTime) {
-        currentTime++;
-        // Here you would update actual media playback
+    // A sound track shorter than the pictures hands over to the timer
+    if(audioMaster && videoDecoder && !trickPlay.speed && IsAudioStreamFinished()) {
+        audioMaster = 0;
+        StartTimerClock(GetMediaClock(&mediaClock));
+    }
+
+    // The master: the voice's position, or the timer, which only runs
+    // while playing
+    if(audioMaster) {
+        SetMediaClockPosition(&mediaClock, GetAudioStreamPosition());
+    } else {
+        u64 now = gettime();
+        if(isPlaying) timerMicroseconds += ticks_to_microsecs(now - timerTick);
+        timerTick = now;
+        SetMediaClockPosition(&mediaClock, timerMicroseconds);
+    }
+    currentTime = (int)(GetMediaClock(&mediaClock) / 1000);
+
+    if(videoDecoder) {
+        RunPipeline(&videoPipeline);   // only if the decode thread didn't start
+        const PipelineFrame* fresh;
+        if(trickPlay.speed) {
+            // The scan is the clock meanwhile; keyframes are far apart, so
+            // the effects start each one afresh
+            fresh = RunTrickPlay(&trickPlay, &videoPipeline, ticks_to_microsecs(gettime()));
+            if(fresh) ResetVideoHistory();
+            currentTime = (int)(trickPlay.position / 1000000);
+        } else {
+            fresh = PresentPipelineFrame(&videoPipeline, GetVideoClock(&mediaClock));
+            if(fresh) CountSyncedFrame(&mediaClock, fresh->pts);
+        }
+
+        // The XFB is cleared every pass, so the frame on screen goes back
+        // up even when nothing new is due
+        DrawVideoPicture(fresh);
+        if(trickPlay.speed) {
+            if(IsTrickPlayAtEnd(&trickPlay)) SetPlaybackRate(1);
+        } else if(IsPipelineFinished(&videoPipeline)) {
+            isPlaying = 0;
+        }
+    } else if(audioDecoder && IsAudioStreamFinished()) {
+        isPlaying = 0;
     }
 }
 
 void HandleInput() {
     WPAD_ScanPads();
     u32 pressed = WPAD_ButtonsDown(0);
-    u32 held = WPAD_ButtonsHeld(0);
     
     switch(currentState) {
         case STATE_MENU:
@@ -495,6 +842,7 @@ void HandleInput() {
             if(pressed & WPAD_BUTTON_B) {
                 currentState = STATE_MENU;
                 selectedItem = 0;
+                browserNotice[0] = 0;
             }
             break;
             
@@ -536,8 +884,29 @@ void HandleInput() {
                                 break;
                         }
                         break;
+                    case 1: // Video settings
+                        switch(selectedItem) {
+                            case 0: // Aspect Ratio: auto, 4:3, 16:9, stretch
+                                SetAspectRatio((currentFilter.aspect_ratio + 1) % 4);
+                                break;
+                            case 1: // Deinterlace: off, bob, weave, adaptive
+                                SetDeinterlaceMode((currentFilter.deinterlace + 1) % 4);
+                                break;
+                            case 2: // Noise Reduction
+                                EnableNoiseReduction(!currentFilter.noise_reduction);
+                                break;
+                        }
+                        break;
+                    case 2: // Audio settings
+                        if(selectedItem == 1) SetMediaClockOffset(&mediaClock, 0);   // Audio Sync
+                        break;
                 }
             }
+            // Audio Sync: + shows video later, - earlier
+            if(settingsPage == 2 && selectedItem == 1) {
+                if(pressed & WPAD_BUTTON_PLUS) SetMediaClockOffset(&mediaClock, mediaClock.offset + AVSYNC_OFFSET_STEP);
+                if(pressed & WPAD_BUTTON_MINUS) SetMediaClockOffset(&mediaClock, mediaClock.offset - AVSYNC_OFFSET_STEP);
+            }
             if(pressed & WPAD_BUTTON_B) {
                 currentState = STATE_MENU;
                 selectedItem = 2;
@@ -590,7 +959,7 @@ void HandleInput() {
                 if(selectedItem > 0) selectedItem--;
             }
             if(pressed & WPAD_BUTTON_DOWN) {
-                if(selectedItem < 8) selectedItem++;
+                if(selectedItem < 9) selectedItem++;
             }
             if(pressed & WPAD_BUTTON_PLUS) {
                 // Increase effect value
@@ -633,10 +1002,18 @@ void HandleInput() {
                 }
             }
             if(pressed & WPAD_BUTTON_A) {
-                // Apply effect
-                if(currentState == STATE_PLAYING_VIDEO) {
-                    // Apply video filter to current frame
-                    ApplyVideoFilter(&currentFilter, xfb, rmode->fbWidth, rmode->xfbHeight);
+                if(selectedItem == 9) {
+                    NextColorGrade();
+                } else if(selectedItem >= 5) {
+                    // Sepia, grayscale, invert and blur stack in the order
+                    // they are switched on
+                    static const VideoEffectType toggles[] = {
+                        VIDEO_EFFECT_SEPIA, VIDEO_EFFECT_GRAYSCALE, VIDEO_EFFECT_INVERT, VIDEO_EFFECT_BLUR
+                    };
+                    ToggleVideoEffect(toggles[selectedItem - 5]);
+                } else if(currentState == STATE_PLAYING_VIDEO) {
+                    // Apply the whole stack to the current frame
+                    ApplyVideoEffects(xfb, rmode->fbWidth, rmode->xfbHeight);
                 }
             }
             if(pressed & WPAD_BUTTON_B) {
@@ -648,23 +1025,36 @@ void HandleInput() {
         case STATE_PLAYING_VIDEO:
         case STATE_PLAYING_AUDIO:
             if(pressed & WPAD_BUTTON_A) {
-                isPlaying = !isPlaying;
+                // Out of trick play into normal play
+                if(trickPlay.speed) SetPlaybackRate(1);
+                else isPlaying = !isPlaying;
+                PauseAudioStream(!isPlaying);
             }
             if(pressed & WPAD_BUTTON_B) {
                 StopMedia();
                 currentState = STATE_MENU;
             }
-            if(held & WPAD_BUTTON_LEFT) {
-                if(currentTime > 10) currentTime -= 10;
+            // Video scans by keyframes, each press doubling the speed that
+            // way or halving it the other; audio jumps, a press per jump as
+            // the stream restarts on every seek
+            if(pressed & WPAD_BUTTON_LEFT) {
+                if(videoDecoder) SetPlaybackRate(StepTrickSpeed(trickPlay.speed ? trickPlay.speed : 1, -1));
+                else SeekMedia(currentTime > 10 ? currentTime - 10 : 0);
             }
-            if(held & WPAD_BUTTON_RIGHT) {
-                if(currentTime < totalTime - 10) currentTime += 10;
+            if(pressed & WPAD_BUTTON_RIGHT) {
+                if(videoDecoder) SetPlaybackRate(StepTrickSpeed(trickPlay.speed ? trickPlay.speed : 1, 1));
+                else if(currentTime < totalTime - 10) SeekMedia(currentTime + 10);
+            }
+            if(pressed & WPAD_BUTTON_DOWN) {
+                showSyncStats = !showSyncStats;
             }
             if(pressed & WPAD_BUTTON_PLUS) {
                 if(volume < 100) volume += 10;
+                SetAudioStreamVolume(volume);
             }
             if(pressed & WPAD_BUTTON_MINUS) {
                 if(volume > 0) volume -= 10;
+                SetAudioStreamVolume(volume);
             }
             // Enhanced playback controls
             if(pressed & WPAD_BUTTON_1) {
@@ -682,10 +1072,15 @@ void HandleInput() {
             if(pressed & WPAD_BUTTON_Z) {
                 // Toggle slow motion
                 EnableSlowMotion(!playbackSettings.slow_motion);
+                ApplyAudioSpeed();
             }
             if(pressed & WPAD_BUTTON_C) {
-                // Toggle fast forward
-                EnableFastForward(!playbackSettings.fast_forward);
+                // Toggle fast forward, at 2x
+                if(videoDecoder) SetPlaybackRate(trickPlay.speed ? 1 : 2);
+                else {
+                    EnableFastForward(!playbackSettings.fast_forward);
+                    ApplyAudioSpeed();
+                }
             }
             break;
     }
@@ -697,6 +1092,11 @@ void HandleInput() {
 }
 
 void DrawSettings() {
+    static const char* aspectNames[] = {"Auto", "4:3", "16:9", "Stretch"};
+    static const char* deinterlaceNames[] = {"Off", "Bob", "Weave", "Adaptive"};
+    static const char* noiseNames[] = {"Auto off", "Spatial", "On"};
+    char valueStr[64];
+
     // Draw title
     DrawText(320, 20, "Settings", WHITE);
     DrawText(320, 50, "=========", WHITE);
@@ -713,14 +1113,27 @@ void DrawSettings() {
         case 1: // Video settings
             DrawText(320, 100, "Video Settings", YELLOW);
             DrawText(320, 130, "Aspect Ratio", selectedItem == 0 ? GREEN : WHITE);
+            DrawText(500, 130, aspectNames[currentFilter.aspect_ratio & 3], GRAY);
             DrawText(320, 160, "Deinterlace", selectedItem == 1 ? GREEN : WHITE);
+            DrawText(500, 160, deinterlaceNames[currentFilter.deinterlace & 3], GRAY);
             DrawText(320, 190, "Noise Reduction", selectedItem == 2 ? GREEN : WHITE);
+            if(!currentFilter.noise_reduction) {
+                DrawText(500, 190, "Off", GRAY);
+            } else {
+                // Shows when slow content has made it step down
+                DenoiseStats stats;
+                DenoiseLevel level = GetNoiseReductionLevel(&stats);
+                sprintf(valueStr, "%s %u us", noiseNames[level], (unsigned)stats.averageMicroseconds);
+                DrawText(500, 190, valueStr, level == DENOISE_TEMPORAL ? GRAY : YELLOW);
+            }
             DrawText(320, 220, "Sharpness", selectedItem == 3 ? GREEN : WHITE);
             break;
         case 2: // Audio settings
             DrawText(320, 100, "Audio Settings", YELLOW);
             DrawText(320, 130, "Default Volume", selectedItem == 0 ? GREEN : WHITE);
             DrawText(320, 160, "Audio Sync", selectedItem == 1 ? GREEN : WHITE);
+            sprintf(valueStr, "%+d ms", (int)mediaClock.offset);
+            DrawText(500, 160, valueStr, GRAY);
             DrawText(320, 190, "Equalizer", selectedItem == 2 ? GREEN : WHITE);
             break;
     }
@@ -787,6 +1200,7 @@ void DrawEffects() {
     DrawText(320, 280, "Grayscale", selectedItem == 6 ? YELLOW : WHITE);
     DrawText(320, 310, "Invert Colors", selectedItem == 7 ? YELLOW : WHITE);
     DrawText(320, 340, "Blur Effect", selectedItem == 8 ? YELLOW : WHITE);
+    DrawText(320, 370, "Color Grade", selectedItem == 9 ? YELLOW : WHITE);
     
     // Draw current effect values
     char valueStr[64];
@@ -800,12 +1214,46 @@ void DrawEffects() {
     DrawText(500, 190, valueStr, GRAY);
     sprintf(valueStr, "Sharpness: %d", currentFilter.sharpness);
     DrawText(500, 220, valueStr, GRAY);
+    DrawText(500, 250, IsVideoEffectEnabled(VIDEO_EFFECT_SEPIA) ? "On" : "Off", GRAY);
+    DrawText(500, 280, IsVideoEffectEnabled(VIDEO_EFFECT_GRAYSCALE) ? "On" : "Off", GRAY);
+    DrawText(500, 310, IsVideoEffectEnabled(VIDEO_EFFECT_INVERT) ? "On" : "Off", GRAY);
+    DrawText(500, 340, IsVideoEffectEnabled(VIDEO_EFFECT_BLUR) ? "On" : "Off", GRAY);
+    DrawText(500, 370, IsVideoEffectEnabled(VIDEO_EFFECT_LUT) ? colorGradeName : "Off", GRAY);
     
     // Draw instructions
-    DrawText(320, 400, "A: Apply effect  B: Back  +/-: Adjust value", GRAY);
+    DrawText(320, 400, "A: Apply / switch effect  B: Back  +/-: Adjust value", GRAY);
     DrawText(320, 430, "D-Pad: Navigate  HOME: Reset to default", GRAY);
 }
 
+// Steps to the next .cube in sd:/luts by name, and off after the last
+void NextColorGrade() {
+    char next[256] = "";
+
+    DIR_ITER* dir = diropen("sd:/luts");
+    if(dir) {
+        char filename[256];
+        struct stat st;
+        while(dirnext(dir, filename, &st) == 0) {
+            if(st.st_mode & S_IFDIR) continue;
+            char* ext = strrchr(filename, '.');
+            if(!ext || strcasecmp(ext, ".cube") != 0) continue;
+            if(strcasecmp(filename, colorGradeName) <= 0) continue;
+            if(!next[0] || strcasecmp(filename, next) < 0) strcpy(next, filename);
+        }
+        dirclose(dir);
+    }
+
+    // One that won't load is skipped on the next press
+    strcpy(colorGradeName, next);
+    if(next[0]) {
+        char fullPath[512];
+        sprintf(fullPath, "sd:/luts/%s", next);
+        if(LoadColorGrade(fullPath) != 0) ClearColorGrade();
+    } else {
+        ClearColorGrade();
+    }
+}
+
 void InitializePlaylists() {
     // Create default playlists directory
     mkdir("sd:/playlists", 0777);
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "mediaio.h"
+#include "readahead.h"
+
+int OpenMediaIO(MediaIO* io, const char* filename) {
+    memset(io, 0, sizeof(MediaIO));
+
+    io->file = fopen(filename, "rb");
+    if(!io->file) return -1;
+
+    // Size and time from the directory entry, without seeking the file
+    struct stat st;
+    if(fstat(fileno(io->file), &st) == 0) {
+        io->size = (s64)st.st_size;
+        io->mtime = (s64)st.st_mtime;
+    } else {
+        fseeko(io->file, 0, SEEK_END);
+        io->size = (s64)ftello(io->file);
+        fseeko(io->file, 0, SEEK_SET);
+    }
+
+    io->position = 0;
+    return 0;
+}
+
+void CloseMediaIO(MediaIO* io) {
+    StopMediaReadAhead(io);
+
+    if(io->file) {
+        fclose(io->file);
+        io->file = NULL;
+    }
+}
+
+int ReadMediaIO(MediaIO* io, void* buffer, int size) {
+    if(!io->file || size <= 0) return 0;
+    if(io->ahead) return ReadAheadMediaIO(io, buffer, size);
+
+    int bytesRead = fread(buffer, 1, size, io->file);
+    io->position += bytesRead;
+
+    return bytesRead;
+}
+
+int SeekMediaIO(MediaIO* io, s64 offset) {
+    if(!io->file) return -1;
+    if(offset < 0) offset = 0;
+    if(offset == io->position) return 0;
+
+    // The I/O thread follows the reader
+    if(io->ahead) {
+        io->position = offset;
+        return 0;
+    }
+
+    if(fseeko(io->file, (off_t)offset, SEEK_SET) != 0) return -1;
+    io->position = offset;
+
+    return 0;
+}
+
+int SkipMediaIO(MediaIO* io, s64 count) {
+    return SeekMediaIO(io, io->position + count);
+}
@@ -0,0 +1,52 @@
+#ifndef MEDIAIO_H
+#define MEDIAIO_H
+
+#include <stdio.h>
+#include "platform.h"
+
+// File handle shared by all demuxers and decoders. Offsets are 64-bit so
+// files past 2 GB work; everything goes through these calls so the I/O
+// strategy can change without touching the parsers.
+typedef struct MediaReadAhead MediaReadAhead;
+
+typedef struct {
+    FILE* file;
+    s64 size;
+    s64 mtime;      // modification time, for caches keyed on the file
+    s64 position;
+    MediaReadAhead* ahead; // set while the I/O thread owns the file (readahead.h)
+} MediaIO;
+
+// Function prototypes
+int OpenMediaIO(MediaIO* io, const char* filename);
+void CloseMediaIO(MediaIO* io);
+int ReadMediaIO(MediaIO* io, void* buffer, int size);
+int SeekMediaIO(MediaIO* io, s64 offset);
+int SkipMediaIO(MediaIO* io, s64 count);
+
+// Byte order helpers for parsing headers
+static inline u16 GetLE16(const u8* p) {
+    return (u16)(p[0] | (p[1] << 8));
+}
+
+static inline u32 GetLE32(const u8* p) {
+    return (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+}
+
+static inline u64 GetLE64(const u8* p) {
+    return (u64)GetLE32(p) | ((u64)GetLE32(p + 4) << 32);
+}
+
+static inline u16 GetBE16(const u8* p) {
+    return (u16)((p[0] << 8) | p[1]);
+}
+
+static inline u32 GetBE32(const u8* p) {
+    return ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | (u32)p[3];
+}
+
+static inline u64 GetBE64(const u8* p) {
+    return ((u64)GetBE32(p) << 32) | (u64)GetBE32(p + 4);
+}
+
+#endif // MEDIAIO_H
@@ -0,0 +1,37 @@
+#include <stdlib.h>
+#include "mem2.h"
+
+#ifdef GEKKO
+#include <ogc/lwp_heap.h>
+
+static heap_cntrl mem2Heap;
+static int mem2Ready = 0;
+
+// The arena can't take memory back, so the heap's block is taken once
+static int InitMem2Heap() {
+    void* start = SYS_AllocArena2MemLo(MEM2_HEAP_SIZE, 32);
+    if(!start) return -1;
+
+    __lwp_heap_init(&mem2Heap, start, MEM2_HEAP_SIZE, 32);
+    mem2Ready = 1;
+    return 0;
+}
+
+void* Mem2Alloc(u32 size) {
+    if(!mem2Ready && InitMem2Heap() != 0) return NULL;
+    return __lwp_heap_allocate(&mem2Heap, size);
+}
+
+void Mem2Free(void* block) {
+    if(block && mem2Ready) __lwp_heap_free(&mem2Heap, block);
+}
+#else
+void* Mem2Alloc(u32 size) {
+    void* block = NULL;
+    return posix_memalign(&block, 32, size) == 0 ? block : NULL;
+}
+
+void Mem2Free(void* block) {
+    free(block);
+}
+#endif
@@ -0,0 +1,19 @@
+#ifndef MEM2_H
+#define MEM2_H
+
+#include "platform.h"
+
+// Large buffers that live as long as a file or a setting: decoded frame
+// pools, color tables. On the Wii they come from a heap in MEM2, the
+// 64MB that the default heap only reaches once MEM1 is full, taken from
+// the arena the first time it is used. MEM1 stays for the code, the
+// stacks and the small allocations. Host builds use malloc.
+#define MEM2_HEAP_SIZE (24 << 20)
+
+// Function prototypes
+
+// 32-byte aligned, NULL when the heap is full
+void* Mem2Alloc(u32 size);
+void Mem2Free(void* block);
+
+#endif // MEM2_H
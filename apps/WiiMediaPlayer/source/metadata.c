@@ -0,0 +1,189 @@
+#include <string.h>
+#include <sys/stat.h>
+#include "metadata.h"
+#include "readahead.h"
+#include "sidecar.h"
+
+typedef struct {
+    char path[256];
+    u32 hash;           // of path, checked before the string
+    s64 size;
+    s64 mtime;
+    u32 lastUse;        // 0 for a free slot
+    MediaMetadata metadata;
+} MetadataEntry;
+
+static MetadataEntry entries[METADATA_CACHE_SIZE];
+static u32 useClock = 0;
+
+// The browser's probe: filled in by the I/O thread, stored in the cache
+// by the main loop when it collects it
+typedef struct {
+    char path[256];
+    s64 size;
+    s64 mtime;
+    int result;         // -1 if the file can't be opened
+    const MediaFormat* format;
+    MediaStreamInfo info;
+} MetadataProbe;
+
+static MetadataProbe probe;
+static int probeQueued = 0;
+
+// FNV-1a
+static u32 HashPath(const char* path) {
+    u32 hash = 2166136261u;
+    while(*path) {
+        hash ^= (u8)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static MetadataEntry* Lookup(const char* path, u32 hash, s64 size, s64 mtime) {
+    for(int i = 0; i < METADATA_CACHE_SIZE; i++) {
+        MetadataEntry* entry = &entries[i];
+        if(entry->lastUse && entry->hash == hash && entry->size == size &&
+           entry->mtime == mtime && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int FindMediaMetadata(const char* path, s64 size, s64 mtime, MediaMetadata* metadata) {
+    MetadataEntry* entry = Lookup(path, HashPath(path), size, mtime);
+    if(!entry) return -1;
+
+    entry->lastUse = ++useClock;
+    *metadata = entry->metadata;
+    return 0;
+}
+
+void StoreMediaMetadata(const char* path, s64 size, s64 mtime, const MediaFormat* format,
+                        const MediaStreamInfo* info) {
+    if(strlen(path) >= sizeof(entries[0].path)) return;
+
+    u32 hash = HashPath(path);
+    MetadataEntry* entry = Lookup(path, hash, size, mtime);
+
+    // Else the least recently used slot; free slots have lastUse 0
+    if(!entry) {
+        entry = &entries[0];
+        for(int i = 1; i < METADATA_CACHE_SIZE && entry->lastUse; i++) {
+            if(entries[i].lastUse < entry->lastUse) entry = &entries[i];
+        }
+
+        strcpy(entry->path, path);
+        entry->hash = hash;
+        entry->size = size;
+        entry->mtime = mtime;
+    }
+
+    entry->lastUse = ++useClock;
+    entry->metadata.type = format ? format->type : MEDIA_TYPE_UNKNOWN;
+    entry->metadata.format = format;
+    entry->metadata.size = size;
+    if(info) {
+        entry->metadata.info = *info;
+    } else {
+        memset(&entry->metadata.info, 0, sizeof(MediaStreamInfo));
+    }
+}
+
+// The sidecar's header, else the file's own. Touches no cache but the
+// registry's, so it can run on the I/O thread. Returns 0 with format NULL
+// when nothing reads the file, or -1 if it can't be opened.
+static int ProbeMetadata(const char* path, s64 size, s64 mtime, const MediaFormat** format,
+                         MediaStreamInfo* info) {
+    // A sidecar header answers without opening the file itself
+    char name[SIDECAR_FORMAT_SIZE];
+    if(ReadSidecarInfo(path, size, mtime, name, info) == 0) {
+        *format = FindMediaFormat(name);
+        if(*format) return 0;
+    }
+
+    MediaIO io;
+    if(OpenMediaIO(&io, path) != 0) return -1;
+
+    memset(info, 0, sizeof(MediaStreamInfo));
+
+    *format = ProbeMediaFormat(&io, path);
+    if(*format && (*format)->info(&io, info) != 0) *format = NULL;
+
+    CloseMediaIO(&io);
+    return 0;
+}
+
+static void FillMetadata(MediaMetadata* metadata, s64 size, const MediaFormat* format,
+                         const MediaStreamInfo* info) {
+    metadata->type = format ? format->type : MEDIA_TYPE_UNKNOWN;
+    metadata->format = format;
+    metadata->size = size;
+    metadata->info = *info;
+}
+
+int GetMediaMetadata(const char* path, MediaMetadata* metadata) {
+    memset(metadata, 0, sizeof(MediaMetadata));
+
+    struct stat st;
+    if(stat(path, &st) != 0) return -1;
+
+    if(FindMediaMetadata(path, st.st_size, st.st_mtime, metadata) == 0) {
+        return metadata->format ? 0 : -1;
+    }
+
+    // The registry's probe cache isn't shared with a browser probe
+    WaitMediaIOJob();
+
+    const MediaFormat* format;
+    MediaStreamInfo info;
+    if(ProbeMetadata(path, st.st_size, st.st_mtime, &format, &info) != 0) return -1;
+
+    // Failures are remembered too, so a bad file is not reread
+    FillMetadata(metadata, st.st_size, format, &info);
+    StoreMediaMetadata(path, st.st_size, st.st_mtime, format, &info);
+
+    return metadata->format ? 0 : -1;
+}
+
+static void RunProbe(void* arg) {
+    MetadataProbe* job = arg;
+    struct stat st;
+
+    job->result = -1;
+    memset(&job->info, 0, sizeof(MediaStreamInfo));
+    if(stat(job->path, &st) != 0) return;
+
+    job->size = st.st_size;
+    job->mtime = st.st_mtime;
+    job->result = ProbeMetadata(job->path, job->size, job->mtime, &job->format, &job->info);
+}
+
+int PollMediaMetadata(const char* path, MediaMetadata* metadata) {
+    memset(metadata, 0, sizeof(MediaMetadata));
+    if(strlen(path) >= sizeof(probe.path)) return GetMediaMetadata(path, metadata);
+
+    if(probeQueued) {
+        if(!IsMediaIOJobDone()) return 1;
+        probeQueued = 0;
+
+        if(probe.result == 0) StoreMediaMetadata(probe.path, probe.size, probe.mtime, probe.format, &probe.info);
+        if(strcmp(probe.path, path) == 0) {
+            if(probe.result != 0) return -1;
+            FillMetadata(metadata, probe.size, probe.format, &probe.info);
+            return probe.format ? 0 : -1;
+        }
+    }
+
+    strcpy(probe.path, path);
+    if(QueueMediaIOJob(RunProbe, &probe) != 0) return GetMediaMetadata(path, metadata);
+
+    probeQueued = 1;
+    return 1;
+}
+
+void ClearMediaMetadata() {
+    memset(entries, 0, sizeof(entries));
+    useClock = 0;
+}
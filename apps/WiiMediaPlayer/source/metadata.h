@@ -0,0 +1,36 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include "platform.h"
+#include "registry.h"
+
+// What the browser and the player need to know about a file, probed once
+// and kept in a least recently used table keyed by path, size and
+// modification time. A changed file misses the cache and is probed again.
+
+#define METADATA_CACHE_SIZE 128
+
+typedef struct {
+    MediaType type;             // MEDIA_TYPE_UNKNOWN if nothing reads the file
+    const MediaFormat* format;
+    s64 size;
+    MediaStreamInfo info;       // duration, bitrate, codec, dimensions
+} MediaMetadata;
+
+// Function prototypes
+
+// Cached entry only, no I/O. Returns 0 on a hit.
+int FindMediaMetadata(const char* path, s64 size, s64 mtime, MediaMetadata* metadata);
+void StoreMediaMetadata(const char* path, s64 size, s64 mtime, const MediaFormat* format,
+                        const MediaStreamInfo* info);
+// stat() for the key, then the cache, else a probe of the headers.
+// Returns 0, or -1 if no format can read the file.
+int GetMediaMetadata(const char* path, MediaMetadata* metadata);
+// For the render loop: the probe runs on the read-ahead I/O thread
+// (QueueMediaIOJob) and the answer is cached when it is collected.
+// Returns 0, 1 while the file is still being read (call again next
+// frame) or -1 if no format can read it. Main loop only, as is the cache.
+int PollMediaMetadata(const char* path, MediaMetadata* metadata);
+void ClearMediaMetadata();
+
+#endif // METADATA_H
@@ -0,0 +1,958 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mkv.h"
+#include "sidecar.h"
+
+// The read buffer starts at this size and doubles for larger blocks
+#define MKV_READ_BUFFER (128 * 1024)
+// Reads while parsing headers or walking clusters stay this small
+#define MKV_HEADER_READ 4096
+// Elements read whole (blocks, CuePoints, Tracks) are never larger
+#define MKV_MAX_ELEMENT (16 * 1024 * 1024)
+
+// Element IDs, marker bits included
+#define ID_EBML             0x1A45DFA3
+#define ID_DOCTYPE          0x4282
+#define ID_SEGMENT          0x18538067
+#define ID_SEEKHEAD         0x114D9B74
+#define ID_SEEK             0x4DBB
+#define ID_SEEKID           0x53AB
+#define ID_SEEKPOSITION     0x53AC
+#define ID_INFO             0x1549A966
+#define ID_TIMECODESCALE    0x2AD7B1
+#define ID_DURATION         0x4489
+#define ID_TRACKS           0x1654AE6B
+#define ID_TRACKENTRY       0xAE
+#define ID_TRACKNUMBER      0xD7
+#define ID_TRACKTYPE        0x83
+#define ID_CODECID          0x86
+#define ID_DEFAULTDURATION  0x23E383
+#define ID_VIDEO            0xE0
+#define ID_PIXELWIDTH       0xB0
+#define ID_PIXELHEIGHT      0xBA
+#define ID_FLAGINTERLACED   0x9A
+#define ID_FIELDORDER       0x9D
+#define ID_AUDIO            0xE1
+#define ID_SAMPLINGFREQ     0xB5
+#define ID_CHANNELS         0x9F
+#define ID_CUES             0x1C53BB6B
+#define ID_CUEPOINT         0xBB
+#define ID_CUETIME          0xB3
+#define ID_CUETRACKPOS      0xB7
+#define ID_CUETRACK         0xF7
+#define ID_CUECLUSTERPOS    0xF1
+#define ID_CUERELATIVEPOS   0xF0
+#define ID_CLUSTER          0x1F43B675
+#define ID_TIMECODE         0xE7
+#define ID_SIMPLEBLOCK      0xA3
+#define ID_BLOCKGROUP       0xA0
+#define ID_BLOCK            0xA1
+#define ID_REFERENCEBLOCK   0xFB
+#define ID_CHAPTERS         0x1043A770
+#define ID_ATTACHMENTS      0x1941A469
+#define ID_TAGS             0x1254C367
+
+typedef struct {
+    s64 time;           // in timecode units
+    s64 cluster;        // file offset of the Cluster element
+    u32 relative;       // of the block inside the cluster data, 0 if unknown
+} MkvCue;
+
+struct MkvDemuxer {
+    MediaIO* io;
+    MkvInfo info;
+    s64 segment;        // segment data; SeekHead and Cues positions count from here
+    s64 segmentEnd;
+    s64 firstCluster;
+    int seekTrack;
+
+    MkvCue* cues;
+    int cueCount;
+    int cueCapacity;
+    int scanned;        // cue points were built from the cluster headers
+
+    // Shared read buffer, data[0] is at file offset base
+    u8* data;
+    int capacity;
+    int fill;
+    int at;
+    s64 base;
+    int readAhead;
+
+    // Block being handed out one frame at a time
+    s64 clusterTime;
+    s64 blockStart;     // file offset of its SimpleBlock or BlockGroup
+    int blockTrack;
+    int blockKey;
+    s64 blockTime;      // ms
+    const u8* frame;
+    int laceCount;
+    int laceIndex;
+    int laceSizes[256];
+
+    s64 position;
+    s64 memory;
+    s64 peakMemory;
+};
+
+static int IsLevel1(u32 id) {
+    return id == ID_CLUSTER || id == ID_CUES || id == ID_SEEKHEAD || id == ID_INFO ||
+           id == ID_TRACKS || id == ID_CHAPTERS || id == ID_ATTACHMENTS || id == ID_TAGS;
+}
+
+static void Account(MkvDemuxer* demux, s64 bytes) {
+    demux->memory += bytes;
+    if(demux->memory > demux->peakMemory) demux->peakMemory = demux->memory;
+}
+
+static inline s64 Position(const MkvDemuxer* demux) {
+    return demux->base + demux->at;
+}
+
+static void SetPosition(MkvDemuxer* demux, s64 offset) {
+    if(offset >= demux->base && offset <= demux->base + demux->fill) {
+        demux->at = (int)(offset - demux->base);
+    } else {
+        demux->base = offset;
+        demux->fill = 0;
+        demux->at = 0;
+    }
+}
+
+// Makes n bytes available at the read position unless the segment ends
+// first. Earlier bytes are dropped, so pointers into the buffer from
+// before the call may no longer be valid. Returns the bytes available.
+static int Fill(MkvDemuxer* demux, s64 n) {
+    int avail = demux->fill - demux->at;
+    if(avail >= n) return avail;
+    if(n > MKV_MAX_ELEMENT) return avail;
+
+    if(demux->at > 0) {
+        memmove(demux->data, demux->data + demux->at, avail);
+        demux->base += demux->at;
+        demux->fill = avail;
+        demux->at = 0;
+    }
+
+    if(n > demux->capacity) {
+        int capacity = demux->capacity ? demux->capacity : MKV_READ_BUFFER;
+        while(capacity < n) capacity *= 2;
+
+        u8* data = realloc(demux->data, capacity);
+        if(!data) return avail;
+        Account(demux, capacity - demux->capacity);
+        demux->data = data;
+        demux->capacity = capacity;
+    }
+
+    s64 want = n - avail;
+    if(want < demux->readAhead) want = demux->readAhead;
+    if(want > demux->capacity - demux->fill) want = demux->capacity - demux->fill;
+    s64 left = demux->segmentEnd - (demux->base + demux->fill);
+    if(want > left) want = left;
+
+    if(want > 0 && SeekMediaIO(demux->io, demux->base + demux->fill) == 0) {
+        int got = ReadMediaIO(demux->io, demux->data + demux->fill, (int)want);
+        if(got > 0) demux->fill += got;
+    }
+
+    return demux->fill - demux->at;
+}
+
+static int VintLength(u8 first) {
+    for(int n = 1; n <= 8; n++) {
+        if(first & (0x80 >> (n - 1))) return n;
+    }
+    return 0;
+}
+
+// Variable-size integer with the length marker removed. Returns its
+// length, or 0 if it does not fit in avail bytes.
+static int ReadVint(const u8* p, s64 avail, u64* value) {
+    if(avail < 1) return 0;
+
+    int n = VintLength(p[0]);
+    if(n == 0 || n > avail) return 0;
+
+    u64 v = p[0] & (0xFF >> n);
+    for(int i = 1; i < n; i++) v = (v << 8) | p[i];
+    *value = v;
+    return n;
+}
+
+// Element ID and size. An all-ones size is returned as -1 (unknown,
+// used by live streams for Segment and Cluster). Returns the header
+// length, or 0 if it is invalid or does not fit in avail bytes.
+static int ParseHeader(const u8* p, s64 avail, u32* id, s64* size) {
+    if(avail < 2) return 0;
+
+    int idLength = VintLength(p[0]);
+    if(idLength == 0 || idLength > 4 || idLength >= avail) return 0;
+
+    u32 v = 0;
+    for(int i = 0; i < idLength; i++) v = (v << 8) | p[i];
+
+    u64 s;
+    int sizeLength = ReadVint(p + idLength, avail - idLength, &s);
+    if(sizeLength == 0) return 0;
+
+    *id = v;
+    *size = s == ((u64)1 << (7 * sizeLength)) - 1 ? -1 : (s64)s;
+    return idLength + sizeLength;
+}
+
+// Next child of a master element held in memory
+static int NextChild(const u8** p, const u8* end, u32* id, const u8** data, s64* size) {
+    int h = ParseHeader(*p, end - *p, id, size);
+    if(h == 0) return -1;
+
+    *data = *p + h;
+    if(*size < 0 || *size > end - *data) *size = end - *data;
+    *p = *data + *size;
+    return 0;
+}
+
+static u64 ReadUInt(const u8* p, s64 size) {
+    u64 v = 0;
+    for(int i = 0; i < size && i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static double ReadFloat(const u8* p, s64 size) {
+    if(size == 4) {
+        union { u32 i; float f; } v = {GetBE32(p)};
+        return v.f;
+    }
+    if(size == 8) {
+        union { u64 i; double f; } v = {GetBE64(p)};
+        return v.f;
+    }
+    return 0;
+}
+
+static int PeekHeader(MkvDemuxer* demux, u32* id, s64* size) {
+    int avail = Fill(demux, 12);
+    return ParseHeader(demux->data + demux->at, avail, id, size);
+}
+
+// Header at offset; the read position is left at its payload
+static int ReadHeader(MkvDemuxer* demux, s64 offset, u32* id, s64* size) {
+    SetPosition(demux, offset);
+
+    int h = PeekHeader(demux, id, size);
+    demux->at += h;
+    return h;
+}
+
+static const u8* ReadPayload(MkvDemuxer* demux, s64 size) {
+    if(size < 0 || Fill(demux, size) < size) return NULL;
+
+    const u8* p = demux->data + demux->at;
+    demux->at += (int)size;
+    return p;
+}
+
+static int AddCue(MkvDemuxer* demux, s64 time, s64 cluster, u32 relative) {
+    if(demux->cueCount == demux->cueCapacity) {
+        int capacity = demux->cueCapacity ? demux->cueCapacity * 2 : 256;
+        MkvCue* cues = realloc(demux->cues, capacity * sizeof(MkvCue));
+        if(!cues) return -1;
+        Account(demux, (s64)(capacity - demux->cueCapacity) * sizeof(MkvCue));
+        demux->cues = cues;
+        demux->cueCapacity = capacity;
+    }
+
+    MkvCue* cue = &demux->cues[demux->cueCount++];
+    cue->time = time;
+    cue->cluster = cluster;
+    cue->relative = relative;
+    return 0;
+}
+
+static int CompareCues(const void* a, const void* b) {
+    s64 ta = ((const MkvCue*)a)->time;
+    s64 tb = ((const MkvCue*)b)->time;
+    return ta < tb ? -1 : ta > tb;
+}
+
+static void ParseSeekHead(MkvDemuxer* demux, const u8* p, const u8* end, s64* positions) {
+    u32 id;
+    const u8* data;
+    s64 size;
+
+    while(NextChild(&p, end, &id, &data, &size) == 0) {
+        if(id != ID_SEEK) continue;
+
+        u32 target = 0;
+        s64 position = -1;
+        const u8* q = data;
+        const u8* seekEnd = data + size;
+        while(NextChild(&q, seekEnd, &id, &data, &size) == 0) {
+            if(id == ID_SEEKID) target = (u32)ReadUInt(data, size);
+            else if(id == ID_SEEKPOSITION) position = (s64)ReadUInt(data, size);
+        }
+        if(position < 0) continue;
+
+        // Info, Tracks, Cues and a further SeekHead
+        if(target == ID_INFO) positions[0] = demux->segment + position;
+        else if(target == ID_TRACKS) positions[1] = demux->segment + position;
+        else if(target == ID_CUES) positions[2] = demux->segment + position;
+        else if(target == ID_SEEKHEAD) positions[3] = demux->segment + position;
+    }
+}
+
+static void ParseInfo(MkvDemuxer* demux, const u8* p, const u8* end) {
+    MkvInfo* info = &demux->info;
+    double duration = 0;
+    u32 id;
+    const u8* data;
+    s64 size;
+
+    while(NextChild(&p, end, &id, &data, &size) == 0) {
+        if(id == ID_TIMECODESCALE) {
+            info->timecodeScale = ReadUInt(data, size);
+        } else if(id == ID_DURATION) {
+            duration = ReadFloat(data, size);
+        }
+    }
+
+    if(info->timecodeScale == 0) info->timecodeScale = 1000000;
+    info->duration = (s64)(duration * info->timecodeScale / 1000000);
+}
+
+static void ParseTrackEntry(const u8* p, const u8* end, MkvTrack* track) {
+    u32 id;
+    const u8* data;
+    s64 size;
+
+    track->channels = 1;
+
+    while(NextChild(&p, end, &id, &data, &size) == 0) {
+        switch(id) {
+            case ID_TRACKNUMBER:
+                track->number = ReadUInt(data, size);
+                break;
+            case ID_TRACKTYPE: {
+                u64 type = ReadUInt(data, size);
+                track->type = type == 1 ? MKV_TRACK_VIDEO : type == 2 ? MKV_TRACK_AUDIO : MKV_TRACK_OTHER;
+                break;
+            }
+            case ID_CODECID: {
+                int n = size < (s64)sizeof(track->codec) - 1 ? (int)size : (int)sizeof(track->codec) - 1;
+                memcpy(track->codec, data, n);
+                track->codec[n] = 0;
+                break;
+            }
+            case ID_DEFAULTDURATION:
+                track->defaultDuration = ReadUInt(data, size);
+                break;
+            case ID_VIDEO:
+            case ID_AUDIO: {
+                const u8* q = data;
+                const u8* settingsEnd = data + size;
+                while(NextChild(&q, settingsEnd, &id, &data, &size) == 0) {
+                    if(id == ID_PIXELWIDTH) track->width = (int)ReadUInt(data, size);
+                    else if(id == ID_PIXELHEIGHT) track->height = (int)ReadUInt(data, size);
+                    else if(id == ID_FIELDORDER) track->fieldOrder = GetMediaFieldOrder((int)ReadUInt(data, size));
+                    else if(id == ID_FLAGINTERLACED && ReadUInt(data, size) == 2 && !track->fieldOrder) {
+                        track->fieldOrder = MEDIA_FIELDS_PROGRESSIVE;
+                    }
+                    else if(id == ID_SAMPLINGFREQ) track->sampleRate = (int)ReadFloat(data, size);
+                    else if(id == ID_CHANNELS) track->channels = (int)ReadUInt(data, size);
+                }
+                break;
+            }
+        }
+    }
+}
+
+static void ParseTracks(MkvDemuxer* demux, const u8* p, const u8* end) {
+    MkvInfo* info = &demux->info;
+    u32 id;
+    const u8* data;
+    s64 size;
+
+    while(NextChild(&p, end, &id, &data, &size) == 0 && info->tracks < MKV_MAX_TRACKS) {
+        if(id != ID_TRACKENTRY) continue;
+
+        MkvTrack* track = &info->track[info->tracks];
+        memset(track, 0, sizeof(MkvTrack));
+        ParseTrackEntry(data, data + size, track);
+        if(track->number == 0) continue;
+
+        if(track->type == MKV_TRACK_VIDEO && info->videoTrack < 0) info->videoTrack = info->tracks;
+        if(track->type == MKV_TRACK_AUDIO && info->audioTrack < 0) info->audioTrack = info->tracks;
+        info->tracks++;
+    }
+}
+
+// Reads a level 1 element whole and hands it to its parser
+static int ParseElement(MkvDemuxer* demux, s64 offset, u32 expected, s64* positions) {
+    u32 id;
+    s64 size;
+    if(ReadHeader(demux, offset, &id, &size) == 0 || id != expected) return -1;
+
+    const u8* p = ReadPayload(demux, size);
+    if(!p) return -1;
+
+    if(id == ID_SEEKHEAD) ParseSeekHead(demux, p, p + size, positions);
+    else if(id == ID_INFO) ParseInfo(demux, p, p + size);
+    else if(id == ID_TRACKS) ParseTracks(demux, p, p + size);
+    return 0;
+}
+
+// Keeps the cue points of the seek track only
+static int LoadCues(MkvDemuxer* demux, s64 offset) {
+    u32 id;
+    s64 size;
+    if(ReadHeader(demux, offset, &id, &size) == 0 || id != ID_CUES || size < 0) return -1;
+
+    s64 end = Position(demux) + size;
+    if(end > demux->segmentEnd) end = demux->segmentEnd;
+
+    u64 number = demux->info.track[demux->seekTrack].number;
+    int sorted = 1;
+
+    while(Position(demux) < end) {
+        s64 start = Position(demux);
+        int h = PeekHeader(demux, &id, &size);
+        if(h == 0 || size < 0) break;
+
+        if(id != ID_CUEPOINT) {
+            SetPosition(demux, start + h + size);
+            continue;
+        }
+
+        demux->at += h;
+        const u8* p = ReadPayload(demux, size);
+        if(!p) break;
+
+        const u8* end = p + size;
+        const u8* data;
+        s64 time = -1;
+        while(NextChild(&p, end, &id, &data, &size) == 0) {
+            if(id == ID_CUETIME) {
+                time = (s64)ReadUInt(data, size);
+            } else if(id == ID_CUETRACKPOS && time >= 0) {
+                u64 track = 0;
+                s64 cluster = -1;
+                u32 relative = 0;
+
+                const u8* q = data;
+                const u8* positionEnd = data + size;
+                while(NextChild(&q, positionEnd, &id, &data, &size) == 0) {
+                    if(id == ID_CUETRACK) track = ReadUInt(data, size);
+                    else if(id == ID_CUECLUSTERPOS) cluster = (s64)ReadUInt(data, size);
+                    else if(id == ID_CUERELATIVEPOS) relative = (u32)ReadUInt(data, size);
+                }
+
+                if(track == number && cluster >= 0) {
+                    if(demux->cueCount > 0 && time < demux->cues[demux->cueCount - 1].time) sorted = 0;
+                    if(AddCue(demux, time, demux->segment + cluster, relative) != 0) return -1;
+                    break;
+                }
+            }
+        }
+    }
+
+    if(!sorted) qsort(demux->cues, demux->cueCount, sizeof(MkvCue), CompareCues);
+    return 0;
+}
+
+// Timecode of the cluster whose data starts at the read position. It
+// comes first in practice; only a few small elements may precede it.
+static int ReadClusterTime(MkvDemuxer* demux, s64* time) {
+    for(int i = 0; i < 4; i++) {
+        u32 id;
+        s64 size;
+        int h = PeekHeader(demux, &id, &size);
+        if(h == 0 || size < 0 || size > 64) return -1;
+
+        demux->at += h;
+        const u8* p = ReadPayload(demux, size);
+        if(!p) return -1;
+
+        if(id == ID_TIMECODE) {
+            *time = (s64)ReadUInt(p, size);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Cluster-level cue points for files without Cues; only the cluster
+// headers are read, except for clusters of unknown size whose children
+// have to be stepped over to find the next one
+static void ScanClusters(MkvDemuxer* demux) {
+    demux->scanned = 1;
+    demux->readAhead = MKV_HEADER_READ;
+
+    s64 offset = demux->firstCluster;
+    while(offset < demux->segmentEnd) {
+        u32 id;
+        s64 size, time;
+        int h = ReadHeader(demux, offset, &id, &size);
+        if(h == 0 || (size < 0 && id != ID_CLUSTER)) break;
+
+        if(id == ID_CLUSTER && ReadClusterTime(demux, &time) == 0) {
+            if(AddCue(demux, time, offset, 0) != 0) break;
+        }
+
+        if(size >= 0) {
+            offset += h + size;
+            continue;
+        }
+
+        // Up to the next level 1 element
+        offset = Position(demux);
+        while(offset < demux->segmentEnd) {
+            h = ReadHeader(demux, offset, &id, &size);
+            if(h == 0 || size < 0 || IsLevel1(id)) break;
+            offset += h + size;
+        }
+        if(h == 0 || !IsLevel1(id)) break;
+    }
+
+    demux->readAhead = MKV_READ_BUFFER;
+}
+
+static int FindTrack(const MkvDemuxer* demux, u64 number) {
+    for(int i = 0; i < demux->info.tracks; i++) {
+        if(demux->info.track[i].number == number) return i;
+    }
+    return -1;
+}
+
+// Splits a Block or SimpleBlock payload into its frames. keyframe is -1
+// to take it from the SimpleBlock flags.
+static void StartBlock(MkvDemuxer* demux, const u8* p, s64 size, int keyframe) {
+    const u8* end = p + size;
+    u64 number;
+
+    demux->laceCount = 0;
+    demux->laceIndex = 0;
+
+    int n = ReadVint(p, size, &number);
+    if(n == 0 || size < n + 3) return;
+
+    int track = FindTrack(demux, number);
+    if(track < 0) return;
+
+    s16 relative = (s16)GetBE16(p + n);
+    u8 flags = p[n + 2];
+    const u8* q = p + n + 3;
+    int count = 1;
+
+    int lacing = (flags >> 1) & 3;
+    if(lacing) {
+        if(q >= end) return;
+        count = *q++ + 1;
+
+        s64 total = 0;
+        if(lacing == 1) {
+            // Xiph: sizes as runs of 255 plus a final byte
+            for(int i = 0; i < count - 1; i++) {
+                int s = 0;
+                u8 b;
+                do {
+                    if(q >= end) return;
+                    b = *q++;
+                    s += b;
+                } while(b == 255);
+                demux->laceSizes[i] = s;
+                total += s;
+            }
+        } else if(lacing == 3) {
+            // EBML: first size, then signed differences
+            u64 v;
+            int m = ReadVint(q, end - q, &v);
+            if(m == 0) return;
+            q += m;
+            demux->laceSizes[0] = (int)v;
+            total = (s64)v;
+
+            for(int i = 1; i < count - 1; i++) {
+                m = ReadVint(q, end - q, &v);
+                if(m == 0) return;
+                q += m;
+
+                s64 s = demux->laceSizes[i - 1] + (s64)v - (((s64)1 << (7 * m - 1)) - 1);
+                if(s < 0) return;
+                demux->laceSizes[i] = (int)s;
+                total += s;
+            }
+        } else {
+            // Fixed: equal sizes
+            for(int i = 0; i < count - 1; i++) {
+                demux->laceSizes[i] = (int)((end - q) / count);
+                total += demux->laceSizes[i];
+            }
+        }
+
+        if(total > end - q) return;
+    }
+    // The last frame takes what the others left
+    s64 rest = end - q;
+    for(int i = 0; i < count - 1; i++) rest -= demux->laceSizes[i];
+    demux->laceSizes[count - 1] = (int)rest;
+
+    demux->frame = q;
+    demux->blockTrack = track;
+    demux->blockKey = keyframe >= 0 ? keyframe : (flags & 0x80) != 0;
+    demux->blockTime = (demux->clusterTime + relative) * (s64)demux->info.timecodeScale / 1000000;
+    demux->laceCount = count;
+}
+
+static void StartBlockGroup(MkvDemuxer* demux, const u8* p, s64 size) {
+    const u8* end = p + size;
+    const u8* block = NULL;
+    s64 blockSize = 0;
+    int keyframe = 1;
+    u32 id;
+    const u8* data;
+
+    while(NextChild(&p, end, &id, &data, &size) == 0) {
+        if(id == ID_BLOCK) {
+            block = data;
+            blockSize = size;
+        } else if(id == ID_REFERENCEBLOCK) {
+            keyframe = 0;
+        }
+    }
+
+    demux->laceCount = 0;
+    demux->laceIndex = 0;
+    if(block) StartBlock(demux, block, blockSize, keyframe);
+}
+
+static MkvDemuxer* Open(MediaIO* io, int loadCues) {
+    MkvDemuxer* demux = calloc(1, sizeof(MkvDemuxer));
+    if(!demux) return NULL;
+
+    demux->io = io;
+    demux->segmentEnd = io->size;
+    demux->readAhead = MKV_HEADER_READ;
+    Account(demux, sizeof(MkvDemuxer));
+
+    MkvInfo* info = &demux->info;
+    info->videoTrack = -1;
+    info->audioTrack = -1;
+    info->timecodeScale = 1000000;
+
+    u32 id;
+    s64 size;
+    int h;
+
+    // EBML header with a Matroska or WebM doctype
+    if(ReadHeader(demux, 0, &id, &size) == 0 || id != ID_EBML) goto fail;
+    const u8* p = ReadPayload(demux, size);
+    if(!p) goto fail;
+
+    const u8* end = p + size;
+    const u8* data;
+    while(NextChild(&p, end, &id, &data, &size) == 0) {
+        if(id == ID_DOCTYPE && !(size == 8 && memcmp(data, "matroska", 8) == 0) &&
+           !(size == 4 && memcmp(data, "webm", 4) == 0)) goto fail;
+    }
+
+    s64 offset = Position(demux);
+    for(;;) {
+        h = ReadHeader(demux, offset, &id, &size);
+        if(h == 0 || (id != ID_SEGMENT && size < 0)) goto fail;
+        if(id == ID_SEGMENT) break;
+        offset += h + size;
+    }
+
+    demux->segment = Position(demux);
+    if(size >= 0 && demux->segment + size < io->size) demux->segmentEnd = demux->segment + size;
+
+    // Level 1 elements up to the first cluster. Anything stored later is
+    // found through the SeekHead: Info, Tracks, Cues, another SeekHead.
+    s64 positions[4] = {0, 0, 0, 0};
+    int haveInfo = 0, haveTracks = 0, haveSeekHead2 = 0;
+
+    offset = demux->segment;
+    demux->firstCluster = demux->segmentEnd;
+    while(offset < demux->segmentEnd) {
+        h = ReadHeader(demux, offset, &id, &size);
+        if(h == 0) break;
+        if(id == ID_CLUSTER) {
+            demux->firstCluster = offset;
+            break;
+        }
+        if(size < 0) break;
+
+        if(id == ID_SEEKHEAD || id == ID_INFO || id == ID_TRACKS) {
+            if(ParseElement(demux, offset, id, positions) == 0) {
+                if(id == ID_INFO) haveInfo = 1;
+                if(id == ID_TRACKS) haveTracks = 1;
+                if(id == ID_SEEKHEAD && positions[3] == offset) haveSeekHead2 = 1;
+            }
+        } else if(id == ID_CUES) {
+            positions[2] = offset;
+        }
+
+        offset += h + size;
+    }
+
+    if(positions[3] && !haveSeekHead2 && (!positions[0] || !positions[1] || !positions[2])) {
+        ParseElement(demux, positions[3], ID_SEEKHEAD, positions);
+    }
+    if(!haveInfo && positions[0]) ParseElement(demux, positions[0], ID_INFO, positions);
+    if(!haveTracks && positions[1]) ParseElement(demux, positions[1], ID_TRACKS, positions);
+    if(info->tracks == 0) goto fail;
+
+    if(info->videoTrack >= 0) {
+        const MkvTrack* v = &info->track[info->videoTrack];
+        info->width = v->width;
+        info->height = v->height;
+    }
+    info->seconds = (int)(info->duration / 1000);
+
+    demux->seekTrack = info->videoTrack >= 0 ? info->videoTrack : 0;
+
+    if(loadCues && positions[2]) {
+        LoadCues(demux, positions[2]);
+        info->cues = demux->cueCount;
+    }
+
+    demux->readAhead = MKV_READ_BUFFER;
+    SetPosition(demux, demux->firstCluster);
+    return demux;
+
+fail:
+    CloseMkvDemuxer(demux);
+    return NULL;
+}
+
+MkvDemuxer* OpenMkvDemuxer(MediaIO* io) {
+    return Open(io, 1);
+}
+
+// Cue points as WriteMkvIndex stored them. Returns 0, or -1 if they do
+// not fit this file.
+static int ReadIndex(MkvDemuxer* demux, SidecarBuffer* index) {
+    if(GetSidecar64(index) != demux->info.track[demux->seekTrack].number) return -1;
+
+    int scanned = (int)GetSidecar32(index);
+    u32 count = GetSidecar32(index);
+    if(index->error || count > (u32)(index->size - index->at) / 20) return -1;
+
+    for(u32 i = 0; i < count; i++) {
+        s64 time = (s64)GetSidecar64(index);
+        s64 cluster = (s64)GetSidecar64(index);
+        u32 relative = GetSidecar32(index);
+        if(index->error || cluster < demux->segment || cluster >= demux->segmentEnd) return -1;
+        if(AddCue(demux, time, cluster, relative) != 0) return -1;
+    }
+
+    demux->scanned = scanned;
+    demux->info.cues = scanned ? 0 : demux->cueCount;
+    return 0;
+}
+
+MkvDemuxer* OpenMkvDemuxerWithIndex(MediaIO* io, SidecarBuffer* index) {
+    MkvDemuxer* demux = Open(io, 0);
+    if(!demux) return NULL;
+
+    if(ReadIndex(demux, index) != 0) {
+        CloseMkvDemuxer(demux);
+        SeekMediaIO(io, 0);
+        return OpenMkvDemuxer(io);
+    }
+
+    return demux;
+}
+
+void CloseMkvDemuxer(MkvDemuxer* demux) {
+    if(!demux) return;
+
+    free(demux->cues);
+    free(demux->data);
+    free(demux);
+}
+
+const MkvInfo* GetMkvInfo(const MkvDemuxer* demux) {
+    return &demux->info;
+}
+
+int ReadMkvPacket(MkvDemuxer* demux, MkvPacket* packet) {
+    while(demux->laceIndex >= demux->laceCount) {
+        s64 start = Position(demux);
+        if(start >= demux->segmentEnd) return 0;
+
+        u32 id;
+        s64 size;
+        int h = PeekHeader(demux, &id, &size);
+        if(h == 0) return 0;
+
+        // Clusters are entered rather than skipped, so their size may be unknown
+        if(id == ID_CLUSTER) {
+            demux->at += h;
+            continue;
+        }
+        if(size < 0) return 0;
+
+        if(id == ID_TIMECODE || id == ID_SIMPLEBLOCK || id == ID_BLOCKGROUP) {
+            // The whole element, header included, stays in the buffer
+            if(Fill(demux, h + size) < h + size) {
+                SetPosition(demux, start + h + size);
+                continue;
+            }
+
+            const u8* p = demux->data + demux->at + h;
+            demux->at += h + (int)size;
+
+            if(id == ID_TIMECODE) {
+                demux->clusterTime = (s64)ReadUInt(p, size);
+            } else {
+                demux->blockStart = start;
+                if(id == ID_SIMPLEBLOCK) StartBlock(demux, p, size, -1);
+                else StartBlockGroup(demux, p, size);
+            }
+            continue;
+        }
+
+        SetPosition(demux, start + h + size);
+    }
+
+    const MkvTrack* track = &demux->info.track[demux->blockTrack];
+    int i = demux->laceIndex++;
+
+    packet->track = demux->blockTrack;
+    packet->keyframe = demux->blockKey;
+    packet->time = demux->blockTime + (s64)(i * track->defaultDuration / 1000000);
+    packet->offset = demux->base + (demux->frame - demux->data);
+    packet->size = demux->laceSizes[i];
+    packet->data = demux->frame;
+    demux->frame += packet->size;
+
+    if(packet->track == demux->seekTrack) demux->position = packet->time;
+    return 1;
+}
+
+// Read position to a cue point's cluster, or its block when the cue has
+// a relative position. -1 starts from the first cluster.
+static int StartAtCue(MkvDemuxer* demux, int index) {
+    demux->laceCount = 0;
+    demux->laceIndex = 0;
+    demux->clusterTime = 0;
+
+    if(index < 0) {
+        SetPosition(demux, demux->firstCluster);
+        return 0;
+    }
+
+    const MkvCue* cue = &demux->cues[index];
+    u32 id;
+    s64 size;
+    if(ReadHeader(demux, cue->cluster, &id, &size) == 0 || id != ID_CLUSTER) return -1;
+
+    if(cue->relative) {
+        s64 data = Position(demux);
+        if(ReadClusterTime(demux, &demux->clusterTime) != 0) return -1;
+        SetPosition(demux, data + cue->relative);
+    }
+    return 0;
+}
+
+// Back to the start of a keyframe's block so it is read next
+static s64 Land(MkvDemuxer* demux, s64 blockStart, s64 clusterTime, s64 time) {
+    SetPosition(demux, blockStart);
+    demux->clusterTime = clusterTime;
+    demux->laceCount = 0;
+    demux->laceIndex = 0;
+    demux->position = time;
+    return time;
+}
+
+s64 SeekMkvTime(MkvDemuxer* demux, s64 ms) {
+    if(demux->cueCount == 0 && !demux->scanned) ScanClusters(demux);
+    if(ms < 0) ms = 0;
+
+    s64 target = ms * 1000000 / (s64)demux->info.timecodeScale;
+
+    // Last cue point at or before the target
+    int lo = 0, hi = demux->cueCount - 1, found = -1;
+    while(lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if(demux->cues[mid].time <= target) {
+            found = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    MkvPacket packet;
+
+    if(!demux->scanned) {
+        // Cue points name keyframes: the first one from there at the cue
+        // time is it, a cluster may hold several
+        s64 cueTime = found >= 0 ? demux->cues[found].time * (s64)demux->info.timecodeScale / 1000000 : 0;
+        if(StartAtCue(demux, found) != 0) return -1;
+        while(ReadMkvPacket(demux, &packet)) {
+            if(packet.track == demux->seekTrack && packet.keyframe && packet.time >= cueTime) {
+                return Land(demux, demux->blockStart, demux->clusterTime, packet.time);
+            }
+        }
+        return -1;
+    }
+
+    // Clusters need not start with a keyframe: take the last one up to
+    // the target, from an earlier cluster if this one has none
+    for(int i = found; i >= -1; i--) {
+        if(StartAtCue(demux, i) != 0) return -1;
+
+        s64 keyStart = -1, keyCluster = 0, keyTime = 0;
+        while(ReadMkvPacket(demux, &packet)) {
+            if(packet.track != demux->seekTrack) continue;
+            if(packet.time > ms) break;
+            if(packet.keyframe) {
+                keyStart = demux->blockStart;
+                keyCluster = demux->clusterTime;
+                keyTime = packet.time;
+            }
+        }
+
+        if(keyStart >= 0) return Land(demux, keyStart, keyCluster, keyTime);
+    }
+
+    return -1;
+}
+
+s64 GetMkvPosition(const MkvDemuxer* demux) {
+    return demux->position;
+}
+
+s64 GetMkvMemoryPeak(const MkvDemuxer* demux) {
+    return demux->peakMemory;
+}
+
+int ReadMkvInfo(MediaIO* io, MkvInfo* info) {
+    MkvDemuxer* demux = Open(io, 0);
+    if(!demux) return -1;
+
+    *info = demux->info;
+    CloseMkvDemuxer(demux);
+    return 0;
+}
+
+int WriteMkvIndex(MkvDemuxer* demux, SidecarBuffer* index, int complete) {
+    if(complete && demux->cueCount == 0 && !demux->scanned) {
+        ScanClusters(demux);
+        SetPosition(demux, demux->firstCluster);
+    }
+    if(demux->cueCount == 0) return -1;
+
+    PutSidecar64(index, demux->info.track[demux->seekTrack].number);
+    PutSidecar32(index, demux->scanned);
+    PutSidecar32(index, demux->cueCount);
+    for(int i = 0; i < demux->cueCount; i++) {
+        PutSidecar64(index, demux->cues[i].time);
+        PutSidecar64(index, demux->cues[i].cluster);
+        PutSidecar32(index, demux->cues[i].relative);
+    }
+
+    return index->error ? -1 : 0;
+}
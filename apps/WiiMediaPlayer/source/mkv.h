@@ -0,0 +1,97 @@
+#ifndef MKV_H
+#define MKV_H
+
+#include "platform.h"
+#include "mediaio.h"
+#include "registry.h"
+
+// Matroska/WebM demuxer. Opening reads the SeekHead, Info, Tracks and the
+// Cues of the seek track (video, else the first track), so a seek is a
+// binary search over the cue points and a jump straight to the cluster,
+// or to the block itself when the cue has a relative position. Files
+// without Cues get cluster-level cue points from a walk over the cluster
+// headers on the first seek.
+//
+// Packets are slices of one read buffer shared by the whole demuxer: the
+// data pointer stays valid until the next call into the demuxer. The
+// buffer only grows when a single block does not fit. Compressed tracks
+// (ContentEncoding) are not supported.
+
+#define MKV_MAX_TRACKS 8
+
+typedef enum {
+    MKV_TRACK_OTHER,
+    MKV_TRACK_VIDEO,
+    MKV_TRACK_AUDIO
+} MkvTrackType;
+
+typedef struct {
+    MkvTrackType type;
+    u64 number;         // TrackNumber used by the blocks
+    char codec[24];     // CodecID, e.g. "V_MPEG4/ISO/AVC"
+    u64 defaultDuration; // nanoseconds per frame, 0 when not given
+
+    // Video
+    int width;
+    int height;
+    MediaFieldOrder fieldOrder;
+
+    // Audio
+    int channels;
+    int sampleRate;
+} MkvTrack;
+
+typedef struct {
+    int tracks;
+    MkvTrack track[MKV_MAX_TRACKS];
+    int videoTrack;     // -1 when there is none
+    int audioTrack;
+    int width;
+    int height;
+    u64 timecodeScale;  // nanoseconds per timecode unit
+    s64 duration;       // milliseconds
+    int seconds;
+    int cues;           // cue points of the seek track in the file
+} MkvInfo;
+
+typedef struct {
+    int track;          // index into MkvInfo.track
+    int keyframe;
+    s64 time;           // milliseconds
+    s64 offset;         // of the frame data
+    int size;
+    const u8* data;     // inside the demuxer's buffer
+} MkvPacket;
+
+typedef struct MkvDemuxer MkvDemuxer;
+
+// Function prototypes
+MkvDemuxer* OpenMkvDemuxer(MediaIO* io);
+void CloseMkvDemuxer(MkvDemuxer* demuxer);
+const MkvInfo* GetMkvInfo(const MkvDemuxer* demuxer);
+
+// Next frame of any track in file order; laced blocks come out one frame
+// at a time. Returns 1 for a packet, 0 at the end of the segment.
+int ReadMkvPacket(MkvDemuxer* demuxer, MkvPacket* packet);
+
+// Move to the last keyframe of the seek track at or before ms. Packets
+// of the other tracks stored before that keyframe are skipped. Returns
+// the keyframe's time in ms, or -1.
+s64 SeekMkvTime(MkvDemuxer* demuxer, s64 ms);
+// Time in ms of the last packet of the seek track read or seeked to
+s64 GetMkvPosition(const MkvDemuxer* demuxer);
+// Most bytes the demuxer has held at once: read buffer and cue points
+s64 GetMkvMemoryPeak(const MkvDemuxer* demuxer);
+
+// Headers and tracks only, without loading the Cues
+int ReadMkvInfo(MediaIO* io, MkvInfo* info);
+
+// The cue points for a sidecar file (sidecar.h), and open with them
+// instead of the Cues element or a cluster walk. complete walks the
+// clusters of a file without Cues first and rewinds to the first
+// cluster, so call it before reading packets.
+struct SidecarBuffer;
+int WriteMkvIndex(MkvDemuxer* demuxer, struct SidecarBuffer* index, int complete);
+MkvDemuxer* OpenMkvDemuxerWithIndex(MediaIO* io, struct SidecarBuffer* index);
+
+#endif // MKV_H
@@ -2,19 +2,14 @@
 #define MOVIE_FEATURES_H
 
 #include <gccore.h>
+#include "videofilter.h"
+#include "effectchain.h"
+#include "deinterlace.h"
+#include "denoise.h"
+#include "scaler.h"
+#include "registry.h"
 
-// Movie feature structures
-typedef struct {
-    float brightness;
-    float contrast;
-    float saturation;
-    float hue;
-    float gamma;
-    int sharpness;
-    int noise_reduction;
-    int deinterlace;
-    int aspect_ratio; // 0=auto, 1=4:3, 2=16:9, 3=stretch
-} VideoFilter;
+// Movie feature structures (VideoFilter is in videofilter.h)
 
 typedef struct {
     int slow_motion;
@@ -44,7 +39,27 @@ typedef struct {
 } Bookmark;
 
 // Function prototypes
+
+// The frame is the YCbYCr external framebuffer, width and height in pixels
 void ApplyVideoFilter(VideoFilter* filter, void* frameBuffer, int width, int height);
+// The stages that keep history, deinterlacing then noise reduction, on a
+// decoded frame at its own size. Once per new frame, in order; after a
+// seek call ResetVideoHistory first.
+void PrepareVideoFrame(void* frame, int width, int height);
+// currentFilter and the effects switched on, in as few sweeps as
+// possible, on the scaled picture. Keeps nothing between frames.
+void ApplyVideoEffects(void* frameBuffer, int width, int height);
+// Changes with anything that changes what ScaleVideoFrame and
+// ApplyVideoEffects make of a frame, for callers that keep the result
+u32 GetVideoEffectsVersion();
+void ResetVideoHistory();
+// VIDEO_EFFECT_LUT only goes on with a grade loaded
+void ToggleVideoEffect(VideoEffectType type);
+int IsVideoEffectEnabled(VideoEffectType type);
+// A .cube grade, switched on in the chain where it was or at the end.
+// Returns -1, keeping the grade before, if the file won't load.
+int LoadColorGrade(const char* path);
+void ClearColorGrade();
 void SetBrightness(float brightness);
 void SetContrast(float contrast);
 void SetSaturation(float saturation);
@@ -52,8 +67,22 @@ void SetHue(float hue);
 void SetGamma(float gamma);
 void SetSharpness(int level);
 void EnableNoiseReduction(int enable);
+// The level the next frame gets, DENOISE_OFF when switched off or when
+// the budget ran out (the counters tell which), and the counters
+DenoiseLevel GetNoiseReductionLevel(DenoiseStats* stats);
 void EnableDeinterlace(int enable);
+void SetDeinterlaceMode(int mode);
+// From the container, when a file opens: bottom first goes to the
+// deinterlacer, unknown is taken as top first, and a progressive source
+// isn't deinterlaced whatever the mode
+void SetVideoFieldOrder(MediaFieldOrder order);
+// 0 auto, 1 4:3, 2 16:9, 3 stretch
 void SetAspectRatio(int ratio);
+// Scales a decoded sourceWidth x sourceHeight frame into its letterbox on
+// the framebuffer for currentFilter.aspect_ratio and the console's TV
+// shape, bars included. Returns -1 (frame untouched) if it can't.
+int ScaleVideoFrame(const void* source, int sourceWidth, int sourceHeight, int sourceStride,
+                    void* frameBuffer, int width, int height);
 void SetPlaybackSpeed(float speed);
 void EnableSlowMotion(int enable);
 void EnableFastForward(int enable);
@@ -80,6 +109,7 @@ void ApplySepiaEffect(void* frameBuffer, int width, int height);
 void ApplyGrayscaleEffect(void* frameBuffer, int width, int height);
 void ApplyInvertEffect(void* frameBuffer, int width, int height);
 void ApplyBlurEffect(void* frameBuffer, int width, int height, int radius);
+void ApplyGaussianBlurEffect(void* frameBuffer, int width, int height, int radius);
 
 // Global variables (extern declarations)
 extern VideoFilter currentFilter;
@@ -0,0 +1,1732 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mp3.h"
+#include "sidecar.h"
+#include "mp3_tables.h"
+
+// Largest Layer III frame: 160 kbps MPEG-2.5 at 8 kHz or 320 kbps at 32 kHz
+#define MP3_MAX_FRAME_SIZE 1441
+// main_data_begin reaches back at most 511 bytes; the rest is this frame's
+// main data plus slack for a corrupt granule overrunning its bit count
+#define MP3_RESERVOIR_SIZE 4096
+#define MP3_SCAN_SIZE 8192
+// Give up looking for a frame header after this many bytes
+#define MP3_MAX_RESYNC (256 * 1024)
+// Seeks this close past the end of the index scan headers (exact) instead
+// of jumping by table of contents or bitrate (approximate)
+#define MP3_SCAN_SEEK_FRAMES 1024
+#define MP3_MAX_RESERVOIR_FRAMES 16
+// Samples the synthesis filterbank delays the output by
+#define MP3_DECODER_DELAY 529
+// Frame table deltas in a sidecar are 16-bit; this one means 32 follow
+#define MP3_INDEX_ESCAPE 0xFFFF
+
+#define MP3_Q30(x) ((s32)floor((x) * 1073741824.0 + 0.5))
+#define MP3_ONE (1 << 30)
+
+typedef struct {
+    int version;        // 0 MPEG-1, 1 MPEG-2, 2 MPEG-2.5
+    int crc;
+    int bitrate;
+    int sampleRate;
+    int rateIndex;      // row of the band width tables
+    int padding;
+    int mode;           // 0 stereo, 1 joint stereo, 2 dual channel, 3 mono
+    int modeExtension;
+    int channels;
+    int frameSize;
+    int sideInfoSize;
+    int granules;
+} Mp3Header;
+
+typedef struct {
+    int part23Length;
+    int bigValues;
+    int globalGain;
+    int scalefacCompress;
+    int blockType;
+    int mixedBlock;
+    int tableSelect[3];
+    int subblockGain[3];
+    int region1Start;   // in lines
+    int region2Start;
+    int preflag;
+    int scalefacScale;
+    int count1Table;
+} Mp3Granule;
+
+typedef struct {
+    int mainDataBegin;
+    int scfsi[2];
+    Mp3Granule gr[2][2];
+} Mp3SideInfo;
+
+typedef struct {
+    u8 l[22];
+    u8 s[13][3];
+    // Intensity stereo position that means "not coded" per band: always 7
+    // for MPEG-1, the largest value of the partition's bit length for MPEG-2
+    u8 illegalL[22];
+    u8 illegalS[13];
+} Mp3Scalefactors;
+
+typedef struct {
+    u32 frame;
+    u32 offset;         // relative to dataStart
+} Mp3SeekPoint;
+
+struct Mp3Decoder {
+    MediaIO* io;
+    Mp3Info info;
+    Mp3Header first;    // fields every frame of the stream must share
+    s64 dataStart;      // after ID3v2
+    s64 dataEnd;        // before ID3v1/APE
+    s64 audioStart;     // first audio frame, after a Xing/VBRI frame
+    s64 totalFrames;
+    int samplesPerFrame;
+    int frameOverhead;  // header, CRC and side info bytes per frame
+    int startSkip;      // encoder plus decoder delay
+
+    // Frame index: offset of frame n relative to dataStart
+    u32* frameOffsets;
+    int indexCount;
+    int indexCapacity;
+    int indexComplete;
+    s64 indexEnd;       // byte after the last indexed frame
+
+    // Coarse table of contents from a Xing or VBRI header
+    Mp3SeekPoint* toc;
+    int tocCount;
+
+    // Stream position
+    s64 frame;          // number of the next frame read
+    int frameExact;     // frame is known, not estimated after a jump
+    s64 feedBefore;     // frames before this only fill the reservoir
+    s64 position;       // output samples delivered since the start
+    int discard;        // decoded samples still to drop
+
+    s16 pcm[MP3_SAMPLES_PER_FRAME_MPEG1 * 2];
+    int pcmFrames;
+    int pcmRead;
+
+    u8 frameData[MP3_MAX_FRAME_SIZE + 8];
+    u8 reservoir[MP3_RESERVOIR_SIZE];
+    int reservoirSize;
+    u8 scanBuffer[MP3_SCAN_SIZE];
+
+    Mp3Scalefactors scalefactors[2];
+    s32 xr[2][576];
+    s32 reorder[576];
+    int nonzero[2];
+    s32 overlap[2][576];
+    s32 synthV[2][16][64];
+    int synthSlot[2];
+};
+
+typedef struct {
+    const u8* data;
+    int pos;            // in bits
+} Mp3Bits;
+
+// Tables built once by InitMp3Tables()
+static int tablesReady = 0;
+static u16 huffPool[4096];
+static int huffPoolUsed;
+static const u16* huffTables[32];
+static u8 huffRootBits[32];
+static const u16* count1Tables[2];
+static u8 count1RootBits[2];
+static u16 longBandStart[9][23];
+static u16 shortBandStart[9][14];
+static s32 pow43Mantissa[8207];     // Q30, in [0.5, 1)
+static s8 pow43Exponent[8207];
+static s32 quarterRoot[4];
+static s32 imdctLong[18][18];       // the 18 outputs that are not mirrors
+static s32 imdctShort[6][6];
+static s32 imdctWindow[4][36];
+static s32 shortWindow[12];
+static s32 aliasCs[8];
+static s32 aliasCa[8];
+static s32 dctOdd32[16][16];
+static s32 dctOdd16[8][8];
+static s32 dctEven8[8][8];
+static s32 synthWindow[512];
+static s32 isRatio[7][2];           // MPEG-1 intensity stereo left/right gains
+static s32 lsfIsRatio[2][16];       // MPEG-2 powers of 2^-1/4 and 2^-1/2
+static s32 msScale;
+
+static inline s32 MulQ30(s32 a, s32 b) {
+    return (s32)(((s64)a * b) >> 30);
+}
+
+// Bit reader: peeks a big-endian word, so up to 25 bits at any position
+static inline u32 PeekBits(const Mp3Bits* b, int n) {
+    const u8* p = b->data + (b->pos >> 3);
+    u32 w = ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+    return (w << (b->pos & 7)) >> (32 - n);
+}
+
+static inline u32 GetBits(Mp3Bits* b, int n) {
+    if(n == 0) return 0;
+    u32 v = PeekBits(b, n);
+    b->pos += n;
+    return v;
+}
+
+// Huffman tables are lookup levels of at most 7 bits. A leaf entry is
+// 0x8000 | (bits used in this level << 8) | symbol, any other entry is
+// (width of the next level << 12) | offset of the next level.
+static int BuildHuffLevel(int base, const u16* code, const u8* len, int count, int xlen,
+                          u32 prefix, int prefixLen, int width) {
+    int level = huffPoolUsed;
+    int size = 1 << width;
+    int subLen[128];
+
+    huffPoolUsed += size;
+    memset(&huffPool[level], 0, size * sizeof(u16));
+    memset(subLen, 0, sizeof(subLen));
+
+    for(int i = 0; i < count; i++) {
+        int rem = len[i] - prefixLen;
+        if(len[i] == 0 || rem <= 0 || ((u32)code[i] >> rem) != prefix) continue;
+
+        u32 bits = code[i] & ((1u << rem) - 1);
+        int symbol = xlen ? (((i / xlen) << 4) | (i % xlen)) : i;
+
+        if(rem <= width) {
+            int start = bits << (width - rem);
+            for(int j = 0; j < (1 << (width - rem)); j++) {
+                huffPool[level + start + j] = 0x8000 | (rem << 8) | symbol;
+            }
+        } else {
+            int index = bits >> (rem - width);
+            if(rem - width > subLen[index]) subLen[index] = rem - width;
+        }
+    }
+
+    for(int i = 0; i < size; i++) {
+        if(!subLen[i]) continue;
+        int subWidth = subLen[i] < 7 ? subLen[i] : 7;
+        int sub = BuildHuffLevel(base, code, len, count, xlen,
+                                 (prefix << width) | i, prefixLen + width, subWidth);
+        huffPool[level + i] = (subWidth << 12) | (sub - base);
+    }
+
+    return level;
+}
+
+static const u16* BuildHuffTable(const u16* code, const u8* len, int count, int xlen, u8* rootBits) {
+    int maxLen = 0;
+    for(int i = 0; i < count; i++) {
+        if(len[i] > maxLen) maxLen = len[i];
+    }
+
+    *rootBits = maxLen < 7 ? maxLen : 7;
+
+    int base = huffPoolUsed;
+    BuildHuffLevel(base, code, len, count, xlen, 0, 0, *rootBits);
+    return &huffPool[base];
+}
+
+static inline int DecodeHuff(Mp3Bits* b, const u16* table, int rootBits) {
+    u32 e = table[PeekBits(b, rootBits)];
+
+    if(!(e & 0x8000)) {
+        int width = rootBits;
+        do {
+            b->pos += width;
+            width = e >> 12;
+            e = table[(e & 0xFFF) + PeekBits(b, width)];
+        } while(!(e & 0x8000));
+    }
+
+    b->pos += (e >> 8) & 0xF;
+    return e & 0xFF;
+}
+
+static void InitMp3Tables() {
+    if(tablesReady) return;
+
+    // Huffman lookup levels
+    huffPoolUsed = 0;
+    for(int i = 0; i < 32; i++) {
+        const Mp3HuffSpec* spec = &mp3HuffSpecs[i];
+        if(!spec->code) continue;
+
+        // Tables 17-23 and 25-31 only differ in linbits
+        if(i > 0 && spec->code == mp3HuffSpecs[i - 1].code) {
+            huffTables[i] = huffTables[i - 1];
+            huffRootBits[i] = huffRootBits[i - 1];
+            continue;
+        }
+        huffTables[i] = BuildHuffTable(spec->code, spec->len, spec->xlen * spec->xlen,
+                                       spec->xlen, &huffRootBits[i]);
+    }
+    count1Tables[0] = BuildHuffTable(mp3HuffCodeA, mp3HuffLenA, 16, 0, &count1RootBits[0]);
+    count1Tables[1] = BuildHuffTable(mp3HuffCodeB, mp3HuffLenB, 16, 0, &count1RootBits[1]);
+
+    // Band start lines
+    for(int r = 0; r < 9; r++) {
+        longBandStart[r][0] = 0;
+        for(int i = 0; i < 22; i++) {
+            longBandStart[r][i + 1] = longBandStart[r][i] + mp3LongBandWidths[r][i];
+        }
+        shortBandStart[r][0] = 0;
+        for(int i = 0; i < 13; i++) {
+            shortBandStart[r][i + 1] = shortBandStart[r][i] + mp3ShortBandWidths[r][i];
+        }
+    }
+
+    // n^(4/3) split into mantissa and exponent so it stays exact in 32 bits
+    pow43Mantissa[0] = 0;
+    pow43Exponent[0] = 0;
+    for(int n = 1; n < 8207; n++) {
+        int e;
+        double m = frexp(pow(n, 4.0 / 3.0), &e);
+        pow43Mantissa[n] = MP3_Q30(m);
+        pow43Exponent[n] = (s8)e;
+        if(pow43Mantissa[n] == (1 << 30)) {
+            pow43Mantissa[n] >>= 1;
+            pow43Exponent[n]++;
+        }
+    }
+    for(int r = 0; r < 4; r++) {
+        quarterRoot[r] = MP3_Q30(pow(2.0, r / 4.0));
+    }
+
+    // IMDCT: outputs 0-8 and 18-26, the others mirror them
+    for(int i = 0; i < 18; i++) {
+        int n = i < 9 ? i : i + 9;
+        for(int k = 0; k < 18; k++) {
+            imdctLong[i][k] = MP3_Q30(cos(M_PI / 72.0 * (2 * n + 19) * (2 * k + 1)));
+        }
+    }
+    for(int i = 0; i < 6; i++) {
+        int n = i < 3 ? i : i + 3;
+        for(int k = 0; k < 6; k++) {
+            imdctShort[i][k] = MP3_Q30(cos(M_PI / 24.0 * (2 * n + 7) * (2 * k + 1)));
+        }
+    }
+
+    // Windows for block types 0, 1 and 3 (type 2 uses shortWindow)
+    for(int i = 0; i < 36; i++) {
+        double normal = sin(M_PI / 36.0 * (i + 0.5));
+        imdctWindow[0][i] = MP3_Q30(normal);
+
+        if(i < 18) imdctWindow[1][i] = MP3_Q30(normal);
+        else if(i < 24) imdctWindow[1][i] = MP3_Q30(1.0);
+        else if(i < 30) imdctWindow[1][i] = MP3_Q30(sin(M_PI / 12.0 * (i - 18 + 0.5)));
+        else imdctWindow[1][i] = 0;
+
+        if(i < 6) imdctWindow[3][i] = 0;
+        else if(i < 12) imdctWindow[3][i] = MP3_Q30(sin(M_PI / 12.0 * (i - 6 + 0.5)));
+        else if(i < 18) imdctWindow[3][i] = MP3_Q30(1.0);
+        else imdctWindow[3][i] = MP3_Q30(normal);
+    }
+    for(int i = 0; i < 12; i++) {
+        shortWindow[i] = MP3_Q30(sin(M_PI / 12.0 * (i + 0.5)));
+    }
+
+    static const double aliasCoefs[8] = {
+        -0.6, -0.535, -0.33, -0.185, -0.095, -0.041, -0.0142, -0.0037
+    };
+    for(int i = 0; i < 8; i++) {
+        double d = sqrt(1.0 + aliasCoefs[i] * aliasCoefs[i]);
+        aliasCs[i] = MP3_Q30(1.0 / d);
+        aliasCa[i] = MP3_Q30(aliasCoefs[i] / d);
+    }
+
+    // 32-point DCT-II split into even and odd halves twice
+    for(int m = 0; m < 16; m++) {
+        for(int n = 0; n < 16; n++) {
+            dctOdd32[m][n] = MP3_Q30(cos(M_PI * (2 * n + 1) * (2 * m + 1) / 64.0));
+        }
+    }
+    for(int p = 0; p < 8; p++) {
+        for(int n = 0; n < 8; n++) {
+            dctOdd16[p][n] = MP3_Q30(cos(M_PI * (2 * n + 1) * (2 * p + 1) / 32.0));
+            dctEven8[p][n] = MP3_Q30(cos(M_PI * (2 * n + 1) * p / 16.0));
+        }
+    }
+
+    // Synthesis window: 2^-16 units to Q30, odd blocks of 64 negated
+    for(int i = 0; i < 512; i++) {
+        s32 w = (i <= 256) ? mp3SynthWindow[i] : mp3SynthWindow[512 - i];
+        synthWindow[i] = ((i >> 6) & 1) ? -(w << 14) : (w << 14);
+    }
+
+    for(int i = 0; i < 7; i++) {
+        if(i == 6) {
+            isRatio[i][0] = MP3_Q30(1.0);
+            isRatio[i][1] = 0;
+        } else {
+            double t = tan(i * M_PI / 12.0);
+            isRatio[i][0] = MP3_Q30(t / (1.0 + t));
+            isRatio[i][1] = MP3_Q30(1.0 / (1.0 + t));
+        }
+    }
+    for(int i = 0; i < 16; i++) {
+        lsfIsRatio[0][i] = MP3_Q30(pow(2.0, -0.25 * i));
+        lsfIsRatio[1][i] = MP3_Q30(pow(2.0, -0.5 * i));
+    }
+    msScale = MP3_Q30(sqrt(0.5));
+
+    tablesReady = 1;
+}
+
+static int ParseHeader(const u8* p, Mp3Header* h) {
+    if(p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) return -1;
+
+    int versionBits = (p[1] >> 3) & 3;
+    int layer = (p[1] >> 1) & 3;
+    int bitrateIndex = p[2] >> 4;
+    int rateIndex = (p[2] >> 2) & 3;
+
+    // Layer III only, no free format
+    if(versionBits == 1 || layer != 1) return -1;
+    if(bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return -1;
+
+    h->version = (versionBits == 3) ? 0 : (versionBits == 2) ? 1 : 2;
+    h->crc = !(p[1] & 1);
+    h->bitrate = mp3Bitrates[h->version ? 1 : 0][bitrateIndex];
+    h->sampleRate = mp3SampleRates[h->version][rateIndex];
+    h->rateIndex = h->version * 3 + rateIndex;
+    h->padding = (p[2] >> 1) & 1;
+    h->mode = p[3] >> 6;
+    h->modeExtension = (p[3] >> 4) & 3;
+    h->channels = (h->mode == 3) ? 1 : 2;
+    h->granules = h->version ? 1 : 2;
+    h->frameSize = (h->version ? 72 : 144) * h->bitrate * 1000 / h->sampleRate + h->padding;
+
+    if(h->version == 0) {
+        h->sideInfoSize = (h->channels == 1) ? 17 : 32;
+    } else {
+        h->sideInfoSize = (h->channels == 1) ? 9 : 17;
+    }
+
+    return 0;
+}
+
+static int SameStream(const Mp3Header* a, const Mp3Header* b) {
+    return a->rateIndex == b->rateIndex && a->channels == b->channels;
+}
+
+static int ReadSideInfo(Mp3Bits* b, const Mp3Header* h, Mp3SideInfo* si) {
+    int nch = h->channels;
+
+    if(h->version == 0) {
+        si->mainDataBegin = GetBits(b, 9);
+        GetBits(b, nch == 1 ? 5 : 3);
+        for(int ch = 0; ch < nch; ch++) {
+            si->scfsi[ch] = GetBits(b, 4);
+        }
+    } else {
+        si->mainDataBegin = GetBits(b, 8);
+        GetBits(b, nch == 1 ? 1 : 2);
+        si->scfsi[0] = si->scfsi[1] = 0;
+    }
+
+    const u16* longStart = longBandStart[h->rateIndex];
+    const u16* shortStart = shortBandStart[h->rateIndex];
+
+    for(int gr = 0; gr < h->granules; gr++) {
+        for(int ch = 0; ch < nch; ch++) {
+            Mp3Granule* gi = &si->gr[gr][ch];
+
+            gi->part23Length = GetBits(b, 12);
+            gi->bigValues = GetBits(b, 9);
+            gi->globalGain = GetBits(b, 8);
+            gi->scalefacCompress = GetBits(b, h->version ? 9 : 4);
+
+            if(gi->bigValues > 288) return -1;
+
+            if(GetBits(b, 1)) {
+                // Window switching: regions are implicit
+                gi->blockType = GetBits(b, 2);
+                gi->mixedBlock = GetBits(b, 1);
+                gi->tableSelect[0] = GetBits(b, 5);
+                gi->tableSelect[1] = GetBits(b, 5);
+                gi->tableSelect[2] = 0;
+                for(int w = 0; w < 3; w++) {
+                    gi->subblockGain[w] = GetBits(b, 3);
+                }
+
+                if(gi->blockType == 0) return -1;
+
+                if(gi->blockType == 2 && !gi->mixedBlock) {
+                    gi->region1Start = 3 * shortStart[3];
+                } else {
+                    gi->region1Start = longStart[8];
+                }
+                gi->region2Start = 576;
+            } else {
+                gi->blockType = 0;
+                gi->mixedBlock = 0;
+                for(int i = 0; i < 3; i++) {
+                    gi->tableSelect[i] = GetBits(b, 5);
+                }
+                gi->subblockGain[0] = gi->subblockGain[1] = gi->subblockGain[2] = 0;
+
+                int region0 = GetBits(b, 4);
+                int region1 = GetBits(b, 3);
+                int region2 = region0 + region1 + 2;
+                gi->region1Start = longStart[region0 + 1];
+                gi->region2Start = longStart[region2 < 22 ? region2 : 22];
+            }
+
+            gi->preflag = h->version ? 0 : GetBits(b, 1);
+            gi->scalefacScale = GetBits(b, 1);
+            gi->count1Table = GetBits(b, 1);
+        }
+    }
+
+    return 0;
+}
+
+static void ReadScalefactors(Mp3Decoder* dec, const Mp3Header* h, const Mp3SideInfo* si,
+                             Mp3Granule* gi, int gr, int ch, Mp3Bits* b) {
+    Mp3Scalefactors* sf = &dec->scalefactors[ch];
+
+    if(h->version == 0) {
+        int slen1 = mp3Slen[0][gi->scalefacCompress];
+        int slen2 = mp3Slen[1][gi->scalefacCompress];
+
+        memset(sf->illegalL, 7, sizeof(sf->illegalL));
+        memset(sf->illegalS, 7, sizeof(sf->illegalS));
+
+        if(gi->blockType == 2) {
+            int sfb = 0;
+            if(gi->mixedBlock) {
+                for(; sfb < 8; sfb++) {
+                    sf->l[sfb] = GetBits(b, slen1);
+                }
+                sfb = 3;
+            }
+            for(; sfb < 12; sfb++) {
+                int n = sfb < 6 ? slen1 : slen2;
+                for(int w = 0; w < 3; w++) {
+                    sf->s[sfb][w] = GetBits(b, n);
+                }
+            }
+            sf->s[12][0] = sf->s[12][1] = sf->s[12][2] = 0;
+        } else {
+            // Bands 0-5, 6-10, 11-15 and 16-20; the second granule may reuse
+            // the first one's values (scfsi)
+            static const u8 groupEnd[4] = {6, 11, 16, 21};
+            int sfb = 0;
+            for(int g = 0; g < 4; g++) {
+                int n = g < 2 ? slen1 : slen2;
+                if(gr == 1 && (si->scfsi[ch] & (8 >> g))) {
+                    sfb = groupEnd[g];
+                    continue;
+                }
+                for(; sfb < groupEnd[g]; sfb++) {
+                    sf->l[sfb] = GetBits(b, n);
+                }
+            }
+            sf->l[21] = 0;
+        }
+        return;
+    }
+
+    // MPEG-2: bit lengths and partition sizes come from scalefac_compress
+    int sfc = gi->scalefacCompress;
+    int slen[4] = {0, 0, 0, 0};
+    int table;
+
+    if(ch == 1 && (h->modeExtension & 1) && h->mode == 1) {
+        int isc = sfc >> 1;
+        if(isc < 180) {
+            slen[0] = isc / 36; slen[1] = (isc % 36) / 6; slen[2] = isc % 6;
+            table = 3;
+        } else if(isc < 244) {
+            isc -= 180;
+            slen[0] = (isc & 63) >> 4; slen[1] = (isc & 15) >> 2; slen[2] = isc & 3;
+            table = 4;
+        } else {
+            isc -= 244;
+            slen[0] = isc / 3; slen[1] = isc % 3;
+            table = 5;
+        }
+        gi->preflag = 0;
+    } else if(sfc < 400) {
+        slen[0] = (sfc >> 4) / 5; slen[1] = (sfc >> 4) % 5;
+        slen[2] = (sfc & 15) >> 2; slen[3] = sfc & 3;
+        gi->preflag = 0;
+        table = 0;
+    } else if(sfc < 500) {
+        sfc -= 400;
+        slen[0] = (sfc >> 2) / 5; slen[1] = (sfc >> 2) % 5; slen[2] = sfc & 3;
+        gi->preflag = 0;
+        table = 1;
+    } else {
+        sfc -= 500;
+        slen[0] = sfc / 3; slen[1] = sfc % 3;
+        gi->preflag = 1;
+        table = 2;
+    }
+
+    int blockIndex = (gi->blockType == 2) ? (gi->mixedBlock ? 2 : 1) : 0;
+    const u8* counts = mp3LsfBandCounts[table][blockIndex];
+    u8 values[39];
+    u8 illegal[39];
+    int n = 0;
+
+    for(int p = 0; p < 4; p++) {
+        for(int i = 0; i < counts[p]; i++) {
+            values[n] = GetBits(b, slen[p]);
+            illegal[n] = (1 << slen[p]) - 1;
+            n++;
+        }
+    }
+    for(; n < 39; n++) {
+        values[n] = 0;
+        illegal[n] = 0;
+    }
+
+    n = 0;
+    if(gi->blockType == 2) {
+        int sfb = 0;
+        if(gi->mixedBlock) {
+            for(; sfb < 6; sfb++, n++) {
+                sf->l[sfb] = values[n];
+                sf->illegalL[sfb] = illegal[n];
+            }
+            sfb = 3;
+        }
+        for(; sfb < 12; sfb++) {
+            for(int w = 0; w < 3; w++, n++) {
+                sf->s[sfb][w] = values[n];
+            }
+            sf->illegalS[sfb] = illegal[n - 1];
+        }
+        sf->s[12][0] = sf->s[12][1] = sf->s[12][2] = 0;
+        sf->illegalS[12] = sf->illegalS[11];
+    } else {
+        for(int sfb = 0; sfb < 21; sfb++, n++) {
+            sf->l[sfb] = values[n];
+            sf->illegalL[sfb] = illegal[n];
+        }
+        sf->l[21] = 0;
+        sf->illegalL[21] = sf->illegalL[20];
+    }
+}
+
+// Huffman decode the big values and count1 regions into integers. Returns
+// the number of lines that may be nonzero.
+static int DecodeSpectrum(const Mp3Granule* gi, Mp3Bits* b, int end, s32* x) {
+    int big = gi->bigValues * 2;
+    int i = 0;
+
+    for(int region = 0; region < 3; region++) {
+        int regionEnd = (region == 0) ? gi->region1Start :
+                        (region == 1) ? gi->region2Start : big;
+        if(regionEnd > big) regionEnd = big;
+        if(i >= regionEnd) continue;
+
+        int select = gi->tableSelect[region];
+        const u16* table = huffTables[select];
+
+        if(!table) {
+            // Table 0 (and the unused 4 and 14) code nothing
+            memset(x + i, 0, (regionEnd - i) * sizeof(s32));
+            i = regionEnd;
+            continue;
+        }
+
+        int rootBits = huffRootBits[select];
+        int linbits = mp3HuffSpecs[select].linbits;
+
+        for(; i < regionEnd; i += 2) {
+            int symbol = DecodeHuff(b, table, rootBits);
+            int vx = symbol >> 4;
+            int vy = symbol & 15;
+
+            if(vx == 15 && linbits) vx += GetBits(b, linbits);
+            if(vx && GetBits(b, 1)) vx = -vx;
+            if(vy == 15 && linbits) vy += GetBits(b, linbits);
+            if(vy && GetBits(b, 1)) vy = -vy;
+
+            x[i] = vx;
+            x[i + 1] = vy;
+        }
+    }
+
+    // Quadruples of -1/0/1 until the granule's bits run out
+    const u16* table = count1Tables[gi->count1Table];
+    int rootBits = count1RootBits[gi->count1Table];
+
+    while(i + 4 <= 576 && b->pos < end) {
+        int symbol = DecodeHuff(b, table, rootBits);
+        s32 v[4];
+
+        for(int k = 0; k < 4; k++) {
+            v[k] = (symbol >> (3 - k)) & 1;
+            if(v[k] && GetBits(b, 1)) v[k] = -1;
+        }
+
+        // The last quadruple may run past part2_3_length: it is stuffing
+        if(b->pos > end) break;
+
+        x[i] = v[0];
+        x[i + 1] = v[1];
+        x[i + 2] = v[2];
+        x[i + 3] = v[3];
+        i += 4;
+    }
+
+    if(i < 576) {
+        memset(x + i, 0, (576 - i) * sizeof(s32));
+    }
+
+    return i;
+}
+
+// |x|^(4/3) * 2^(exponent/4) into Q24
+static void RequantizeBand(s32* x, int count, int exponent) {
+    int shift = (exponent >> 2) - 6;
+    s32 root = quarterRoot[exponent & 3];
+
+    for(int i = 0; i < count; i++) {
+        s32 v = x[i];
+        if(!v) continue;
+
+        int neg = v < 0;
+        if(neg) v = -v;
+        if(v > 8206) v = 8206;
+
+        s32 m = MulQ30(pow43Mantissa[v], root);
+        int s = shift + pow43Exponent[v];
+
+        if(s >= 0) {
+            m = (s > 30 || m > (0x7FFFFFFF >> s)) ? 0x7FFFFFFF : (m << s);
+        } else {
+            m = (s < -31) ? 0 : (m >> -s);
+        }
+
+        x[i] = neg ? -m : m;
+    }
+}
+
+static void Requantize(Mp3Decoder* dec, const Mp3Header* h, const Mp3Granule* gi, int ch) {
+    const Mp3Scalefactors* sf = &dec->scalefactors[ch];
+    const u8* longWidth = mp3LongBandWidths[h->rateIndex];
+    const u8* shortWidth = mp3ShortBandWidths[h->rateIndex];
+    s32* x = dec->xr[ch];
+    int end = dec->nonzero[ch];
+    int shift = 1 + gi->scalefacScale;
+    int gain = gi->globalGain - 210;
+    int i = 0;
+
+    if(gi->blockType != 2 || gi->mixedBlock) {
+        int longEnd = (gi->blockType == 2) ? 3 * shortBandStart[h->rateIndex][3] : 576;
+
+        for(int sfb = 0; sfb < 22 && i < longEnd && i < end; sfb++) {
+            int n = longWidth[sfb];
+            int exponent = gain - ((sf->l[sfb] + gi->preflag * mp3Pretab[sfb]) << shift);
+
+            RequantizeBand(x + i, (i + n < end) ? n : end - i, exponent);
+            i += n;
+        }
+    }
+
+    if(gi->blockType == 2) {
+        for(int sfb = gi->mixedBlock ? 3 : 0; sfb < 13 && i < end; sfb++) {
+            int n = shortWidth[sfb];
+            for(int w = 0; w < 3; w++, i += n) {
+                if(i >= end) break;
+                int exponent = gain - 8 * gi->subblockGain[w] - (sf->s[sfb][w] << shift);
+                RequantizeBand(x + i, (i + n < end) ? n : end - i, exponent);
+            }
+        }
+    }
+}
+
+static void MidSideBand(s32* left, s32* right, int count) {
+    for(int i = 0; i < count; i++) {
+        s32 m = left[i];
+        s32 s = right[i];
+        left[i] = MulQ30(m + s, msScale);
+        right[i] = MulQ30(m - s, msScale);
+    }
+}
+
+// Apply intensity stereo to one band if its position is coded, otherwise
+// mid/side when that is on
+static void StereoBand(const Mp3Header* h, s32* left, s32* right, int count,
+                       int isPos, int illegal, int intensityScale, int midSide) {
+    if(isPos >= 0 && isPos != illegal && (h->version || isPos < 7)) {
+        s32 kl, kr;
+
+        if(h->version == 0) {
+            kl = isRatio[isPos][0];
+            kr = isRatio[isPos][1];
+        } else if(isPos & 1) {
+            kl = lsfIsRatio[intensityScale][(isPos + 1) >> 1];
+            kr = MP3_ONE;
+        } else {
+            kl = MP3_ONE;
+            kr = lsfIsRatio[intensityScale][isPos >> 1];
+        }
+
+        for(int i = 0; i < count; i++) {
+            s32 v = left[i];
+            left[i] = MulQ30(v, kl);
+            right[i] = MulQ30(v, kr);
+        }
+    } else if(midSide) {
+        MidSideBand(left, right, count);
+    }
+}
+
+static int LastNonzero(const s32* x, int start, int count) {
+    for(int i = count - 1; i >= 0; i--) {
+        if(x[start + i]) return i;
+    }
+    return -1;
+}
+
+static void ProcessStereo(Mp3Decoder* dec, const Mp3Header* h, const Mp3Granule* gi) {
+    s32* left = dec->xr[0];
+    s32* right = dec->xr[1];
+    int midSide = h->modeExtension & 2;
+    int lines = dec->nonzero[0] > dec->nonzero[1] ? dec->nonzero[0] : dec->nonzero[1];
+
+    if(!(h->modeExtension & 1)) {
+        if(midSide) MidSideBand(left, right, lines);
+        dec->nonzero[0] = dec->nonzero[1] = lines;
+        return;
+    }
+
+    // Intensity stereo: bands above the last nonzero line of the right
+    // channel carry a position instead of data. The layout follows the
+    // right channel's block type.
+    const Mp3Scalefactors* sf = &dec->scalefactors[1];
+    const u16* longStart = longBandStart[h->rateIndex];
+    const u16* shortStart = shortBandStart[h->rateIndex];
+    int intensityScale = gi->scalefacCompress & 1;
+    int longEnd = 576;
+
+    if(gi->blockType == 2) {
+        int firstShort = gi->mixedBlock ? 3 : 0;
+        int shortHasData = 0;
+
+        longEnd = 3 * shortStart[firstShort];
+
+        for(int w = 0; w < 3; w++) {
+            // Bands above the last band of this window with data
+            int isStart = firstShort;
+            for(int sfb = 12; sfb >= firstShort; sfb--) {
+                int width = shortStart[sfb + 1] - shortStart[sfb];
+                if(LastNonzero(right, 3 * shortStart[sfb] + w * width, width) >= 0) {
+                    isStart = sfb + 1;
+                    shortHasData = 1;
+                    break;
+                }
+            }
+
+            for(int sfb = firstShort; sfb < 13; sfb++) {
+                int width = shortStart[sfb + 1] - shortStart[sfb];
+                int start = 3 * shortStart[sfb] + w * width;
+                int band = (sfb == 12) ? 11 : sfb;
+                int isPos = (sfb >= isStart) ? sf->s[band][w] : -1;
+
+                StereoBand(h, left + start, right + start, width, isPos,
+                           sf->illegalS[band], intensityScale, midSide);
+            }
+        }
+
+        // The long bands of a mixed block only carry intensity when the
+        // whole short part is intensity coded
+        if(shortHasData) {
+            if(midSide && longEnd) MidSideBand(left, right, longEnd);
+            longEnd = 0;
+        }
+    }
+
+    if(longEnd) {
+        int last = LastNonzero(right, 0, longEnd);
+        int isStart = 0;
+
+        while(isStart < 22 && longStart[isStart] <= last) isStart++;
+
+        for(int sfb = 0; sfb < 22 && longStart[sfb] < longEnd; sfb++) {
+            int width = longStart[sfb + 1] - longStart[sfb];
+            int band = (sfb == 21) ? 20 : sfb;
+            int isPos = (sfb >= isStart) ? sf->l[band] : -1;
+
+            StereoBand(h, left + longStart[sfb], right + longStart[sfb], width, isPos,
+                       sf->illegalL[band], intensityScale, midSide);
+        }
+    }
+
+    dec->nonzero[0] = dec->nonzero[1] = 576;
+}
+
+// Short block lines arrive band by band, window by window. The IMDCT wants
+// them interleaved per frequency: line (band, window, j) goes to
+// 3 * (bandStart + j) + window.
+static void ReorderShort(Mp3Decoder* dec, const Mp3Header* h, const Mp3Granule* gi, int ch) {
+    const u16* shortStart = shortBandStart[h->rateIndex];
+    s32* x = dec->xr[ch];
+    s32* tmp = dec->reorder;
+    int first = gi->mixedBlock ? 3 : 0;
+    int base = 3 * shortStart[first];
+
+    for(int sfb = first; sfb < 13; sfb++) {
+        int start = shortStart[sfb];
+        int width = shortStart[sfb + 1] - start;
+        const s32* src = x + 3 * start;
+
+        for(int w = 0; w < 3; w++) {
+            for(int j = 0; j < width; j++) {
+                tmp[3 * (start + j) + w] = src[w * width + j];
+            }
+        }
+    }
+
+    memcpy(x + base, tmp + base, (576 - base) * sizeof(s32));
+}
+
+// Returns the number of subbands that may hold data afterwards
+static int Antialias(s32* x, const Mp3Granule* gi, int nonzero) {
+    int subbands = (nonzero + 17) / 18;
+    int limit;
+
+    if(gi->blockType == 2) {
+        if(!gi->mixedBlock) return subbands;
+        limit = 1;
+    } else {
+        limit = subbands < 31 ? subbands : 31;
+    }
+
+    for(int sb = 1; sb <= limit; sb++) {
+        s32* lo = x + 18 * sb - 1;
+        s32* hi = x + 18 * sb;
+
+        for(int i = 0; i < 8; i++) {
+            s32 a = lo[-i];
+            s32 b = hi[i];
+            lo[-i] = MulQ30(a, aliasCs[i]) - MulQ30(b, aliasCa[i]);
+            hi[i] = MulQ30(b, aliasCs[i]) + MulQ30(a, aliasCa[i]);
+        }
+    }
+
+    return (limit + 1 > subbands) ? limit + 1 : subbands;
+}
+
+static void ImdctLong(const s32* in, s32* out, s32* overlap, const s32* window) {
+    s32 z[36];
+
+    for(int i = 0; i < 18; i++) {
+        s64 acc = 0;
+        for(int k = 0; k < 18; k++) {
+            acc += (s64)in[k] * imdctLong[i][k];
+        }
+        s32 v = (s32)(acc >> 30);
+
+        // x[17 - n] = -x[n] and x[53 - n] = x[n]
+        if(i < 9) {
+            z[i] = v;
+            z[17 - i] = -v;
+        } else {
+            z[i + 9] = v;
+            z[44 - i] = v;
+        }
+    }
+
+    for(int i = 0; i < 18; i++) {
+        out[i] = MulQ30(z[i], window[i]) + overlap[i];
+        overlap[i] = MulQ30(z[i + 18], window[i + 18]);
+    }
+}
+
+static void ImdctShort(const s32* in, s32* out, s32* overlap) {
+    s32 z[36];
+
+    memset(z, 0, sizeof(z));
+
+    for(int w = 0; w < 3; w++) {
+        s32 y[12];
+
+        for(int i = 0; i < 6; i++) {
+            s64 acc = 0;
+            for(int k = 0; k < 6; k++) {
+                acc += (s64)in[3 * k + w] * imdctShort[i][k];
+            }
+            s32 v = (s32)(acc >> 30);
+
+            if(i < 3) {
+                y[i] = v;
+                y[5 - i] = -v;
+            } else {
+                y[i + 3] = v;
+                y[14 - i] = v;
+            }
+        }
+
+        // The three windows overlap by half inside the long block
+        for(int i = 0; i < 12; i++) {
+            z[6 + 6 * w + i] += MulQ30(y[i], shortWindow[i]);
+        }
+    }
+
+    for(int i = 0; i < 18; i++) {
+        out[i] = z[i] + overlap[i];
+        overlap[i] = z[i + 18];
+    }
+}
+
+static void Hybrid(Mp3Decoder* dec, const Mp3Granule* gi, int ch, int subbands) {
+    s32* x = dec->xr[ch];
+    s32* overlap = dec->overlap[ch];
+
+    for(int sb = 0; sb < 32; sb++) {
+        s32* band = x + sb * 18;
+        s32* prev = overlap + sb * 18;
+
+        if(sb >= subbands) {
+            // No data: only the tail of the previous granule comes out
+            memcpy(band, prev, 18 * sizeof(s32));
+            memset(prev, 0, 18 * sizeof(s32));
+        } else {
+            int type = (gi->mixedBlock && sb < 2) ? 0 : gi->blockType;
+            s32 in[18];
+
+            memcpy(in, band, sizeof(in));
+            if(type == 2) {
+                ImdctShort(in, band, prev);
+            } else {
+                ImdctLong(in, band, prev, imdctWindow[type]);
+            }
+        }
+
+        // Frequency inversion for the polyphase filterbank
+        if(sb & 1) {
+            for(int i = 1; i < 18; i += 2) {
+                band[i] = -band[i];
+            }
+        }
+    }
+}
+
+// One time slot of the polyphase synthesis: 32 subband samples in, 32 PCM
+// samples out at the given stride
+static void Synthesize(Mp3Decoder* dec, int ch, const s32* x, int slot, s16* out, int stride) {
+    s32 (*ring)[64] = dec->synthV[ch];
+    int newest = dec->synthSlot[ch] = (dec->synthSlot[ch] - 1) & 15;
+    s32* v = ring[newest];
+    s32 s[32], a[16], d[16], a2[8], d2[8], y[32];
+
+    for(int n = 0; n < 32; n++) {
+        s[n] = x[n * 18 + slot];
+    }
+
+    // y[k] = sum S[n] cos(pi (2n + 1) k / 64)
+    for(int n = 0; n < 16; n++) {
+        a[n] = s[n] + s[31 - n];
+        d[n] = s[n] - s[31 - n];
+    }
+    for(int m = 0; m < 16; m++) {
+        s64 acc = 0;
+        for(int n = 0; n < 16; n++) {
+            acc += (s64)d[n] * dctOdd32[m][n];
+        }
+        y[2 * m + 1] = (s32)(acc >> 30);
+    }
+    for(int n = 0; n < 8; n++) {
+        a2[n] = a[n] + a[15 - n];
+        d2[n] = a[n] - a[15 - n];
+    }
+    for(int p = 0; p < 8; p++) {
+        s64 even = 0;
+        s64 odd = 0;
+        for(int n = 0; n < 8; n++) {
+            even += (s64)a2[n] * dctEven8[p][n];
+            odd += (s64)d2[n] * dctOdd16[p][n];
+        }
+        y[4 * p] = (s32)(even >> 30);
+        y[4 * p + 2] = (s32)(odd >> 30);
+    }
+
+    // V[i] = sum S[k] cos((16 + i)(2k + 1) pi / 64) from the DCT symmetries
+    for(int i = 0; i < 16; i++) {
+        v[i] = y[i + 16];
+    }
+    v[16] = 0;
+    for(int i = 17; i <= 48; i++) {
+        v[i] = -y[48 - i];
+    }
+    for(int i = 49; i < 64; i++) {
+        v[i] = -y[i - 48];
+    }
+
+    for(int j = 0; j < 32; j++) {
+        s64 acc = 0;
+        for(int i = 0; i < 8; i++) {
+            acc += (s64)ring[(newest + 2 * i) & 15][j] * synthWindow[64 * i + j];
+            acc += (s64)ring[(newest + 2 * i + 1) & 15][32 + j] * synthWindow[64 * i + 32 + j];
+        }
+
+        // Q24 * Q30 down to 16 bits
+        s32 sample = (s32)((acc + ((s64)1 << 38)) >> 39);
+        if(sample > 32767) sample = 32767;
+        if(sample < -32768) sample = -32768;
+        out[j * stride] = (s16)sample;
+    }
+}
+
+// Move the last 511 bytes of main data to the front and append this
+// frame's. Returns how many bytes of earlier frames are available.
+static int FillReservoir(Mp3Decoder* dec, const u8* data, int size) {
+    if(dec->reservoirSize > 511) {
+        memmove(dec->reservoir, dec->reservoir + dec->reservoirSize - 511, 511);
+        dec->reservoirSize = 511;
+    }
+
+    int available = dec->reservoirSize;
+    if(size > 0) {
+        memcpy(dec->reservoir + available, data, size);
+        dec->reservoirSize += size;
+    }
+
+    return available;
+}
+
+// Feed the reservoir without decoding, for frames before a seek target
+static void FeedFrame(Mp3Decoder* dec, const Mp3Header* h) {
+    int offset = 4 + (h->crc ? 2 : 0) + h->sideInfoSize;
+    FillReservoir(dec, dec->frameData + offset, h->frameSize - offset);
+}
+
+static void DecodeFrame(Mp3Decoder* dec, const Mp3Header* h) {
+    int nch = h->channels;
+    int samples = h->granules * 576 * nch;
+    const u8* p = dec->frameData + 4 + (h->crc ? 2 : 0);
+    Mp3SideInfo si;
+    Mp3Bits bits = {p, 0};
+
+    dec->pcmFrames = h->granules * 576;
+    dec->pcmRead = 0;
+
+    if(ReadSideInfo(&bits, h, &si) != 0) {
+        memset(dec->pcm, 0, samples * sizeof(s16));
+        return;
+    }
+
+    int offset = (int)(p - dec->frameData) + h->sideInfoSize;
+    int mainSize = h->frameSize - offset;
+    int available = FillReservoir(dec, dec->frameData + offset, mainSize);
+
+    // Right after a jump the bits this frame refers back to are missing
+    if(si.mainDataBegin > available) {
+        memset(dec->pcm, 0, samples * sizeof(s16));
+        return;
+    }
+
+    Mp3Bits main = {dec->reservoir + available - si.mainDataBegin, 0};
+    int mainBits = (si.mainDataBegin + mainSize) * 8;
+
+    for(int gr = 0; gr < h->granules; gr++) {
+        for(int ch = 0; ch < nch; ch++) {
+            Mp3Granule* gi = &si.gr[gr][ch];
+            int start = main.pos;
+            int end = start + gi->part23Length;
+
+            if(end > mainBits) end = mainBits;
+
+            ReadScalefactors(dec, h, &si, gi, gr, ch, &main);
+            dec->nonzero[ch] = DecodeSpectrum(gi, &main, end, dec->xr[ch]);
+            Requantize(dec, h, gi, ch);
+
+            main.pos = start + gi->part23Length;
+        }
+
+        if(h->mode == 1 && nch == 2) {
+            ProcessStereo(dec, h, &si.gr[gr][1]);
+        }
+
+        for(int ch = 0; ch < nch; ch++) {
+            const Mp3Granule* gi = &si.gr[gr][ch];
+            s16* out = dec->pcm + gr * 576 * nch + ch;
+
+            if(gi->blockType == 2) {
+                ReorderShort(dec, h, gi, ch);
+            }
+
+            int subbands = Antialias(dec->xr[ch], gi, dec->nonzero[ch]);
+            Hybrid(dec, gi, ch, subbands);
+
+            for(int slot = 0; slot < 18; slot++) {
+                Synthesize(dec, ch, dec->xr[ch], slot, out + slot * 32 * nch, nch);
+            }
+        }
+    }
+}
+
+static void AppendIndex(Mp3Decoder* dec, s64 offset, int size) {
+    if(dec->indexCount == dec->indexCapacity) {
+        int capacity = dec->indexCapacity ? dec->indexCapacity * 2 : 4096;
+        u32* grown = realloc(dec->frameOffsets, capacity * sizeof(u32));
+        if(!grown) return;
+        dec->frameOffsets = grown;
+        dec->indexCapacity = capacity;
+    }
+
+    dec->frameOffsets[dec->indexCount++] = (u32)(offset - dec->dataStart);
+    dec->indexEnd = offset + size;
+}
+
+// Once every frame is indexed the length no longer needs a header
+static void FinishIndex(Mp3Decoder* dec) {
+    dec->indexComplete = 1;
+
+    if(!dec->info.exactLength) {
+        dec->totalFrames = dec->indexCount;
+        dec->info.totalSamples = dec->totalFrames * dec->samplesPerFrame -
+                                 dec->startSkip - dec->info.encoderPadding;
+        if(dec->info.totalSamples < 0) dec->info.totalSamples = 0;
+        dec->info.exactLength = 1;
+    }
+}
+
+// A candidate header counts when the frame after it starts with a
+// matching header too (or the data ends there)
+static int CheckNextHeader(Mp3Decoder* dec, s64 offset, const Mp3Header* h) {
+    s64 next = offset + h->frameSize;
+    u8 buf[4];
+    Mp3Header nh;
+
+    if(next > dec->dataEnd) return 0;
+    if(next + 4 > dec->dataEnd) return 1;
+    if(SeekMediaIO(dec->io, next) != 0 || ReadMediaIO(dec->io, buf, 4) != 4) return 0;
+
+    return ParseHeader(buf, &nh) == 0 && SameStream(&nh, h);
+}
+
+static s64 FindFrame(Mp3Decoder* dec, s64 from, const Mp3Header* ref) {
+    s64 limit = from + MP3_MAX_RESYNC;
+
+    if(limit > dec->dataEnd) limit = dec->dataEnd;
+
+    while(from + 4 <= limit) {
+        int want = (limit - from) < MP3_SCAN_SIZE ? (int)(limit - from) : MP3_SCAN_SIZE;
+
+        if(SeekMediaIO(dec->io, from) != 0) return -1;
+        int n = ReadMediaIO(dec->io, dec->scanBuffer, want);
+        if(n < 4) return -1;
+
+        for(int i = 0; i + 4 <= n; i++) {
+            Mp3Header h;
+            if(dec->scanBuffer[i] != 0xFF) continue;
+            if(ParseHeader(dec->scanBuffer + i, &h) != 0) continue;
+            if(ref && !SameStream(&h, ref)) continue;
+
+            // CheckNextHeader moves the file position, the buffer stays valid
+            if(CheckNextHeader(dec, from + i, &h)) return from + i;
+        }
+
+        from += n - 3;
+    }
+
+    return -1;
+}
+
+static int ReadFrame(Mp3Decoder* dec, Mp3Header* h, s64* frameOffset) {
+    MediaIO* io = dec->io;
+
+    for(;;) {
+        s64 offset = io->position;
+
+        if(offset + 4 > dec->dataEnd) return -1;
+        if(ReadMediaIO(io, dec->frameData, 4) != 4) return -1;
+
+        if(ParseHeader(dec->frameData, h) == 0 && SameStream(h, &dec->first) &&
+           offset + h->frameSize <= dec->dataEnd) {
+            int rest = h->frameSize - 4;
+            if(ReadMediaIO(io, dec->frameData + 4, rest) != rest) return -1;
+
+            // Keep the bit reader's look-ahead inside known bytes
+            memset(dec->frameData + h->frameSize, 0, 8);
+            *frameOffset = offset;
+            return 0;
+        }
+
+        // Lost sync: garbage or a damaged frame, look for the next good one
+        s64 found = FindFrame(dec, offset + 1, &dec->first);
+        if(found < 0 || SeekMediaIO(io, found) != 0) return -1;
+    }
+}
+
+static void ResetMp3State(Mp3Decoder* dec) {
+    memset(dec->overlap, 0, sizeof(dec->overlap));
+    memset(dec->synthV, 0, sizeof(dec->synthV));
+    dec->synthSlot[0] = dec->synthSlot[1] = 0;
+    dec->reservoirSize = 0;
+    dec->pcmFrames = dec->pcmRead = 0;
+}
+
+static int DecodeNextFrame(Mp3Decoder* dec) {
+    Mp3Header h;
+    s64 offset;
+
+    if(ReadFrame(dec, &h, &offset) != 0) {
+        if(dec->frameExact && !dec->indexComplete) FinishIndex(dec);
+        return -1;
+    }
+
+    if(dec->frameExact && dec->frame == dec->indexCount && !dec->indexComplete) {
+        AppendIndex(dec, offset, h.frameSize);
+    }
+
+    if(dec->frame++ < dec->feedBefore) {
+        FeedFrame(dec, &h);
+        return 0;
+    }
+
+    DecodeFrame(dec, &h);
+
+    if(dec->discard > 0) {
+        int skip = dec->discard < dec->pcmFrames ? dec->discard : dec->pcmFrames;
+        dec->pcmRead = skip;
+        dec->discard -= skip;
+    }
+
+    return 0;
+}
+
+static void ParseXing(Mp3Decoder* dec, const Mp3Header* h, s64 offset) {
+    const u8* f = dec->frameData;
+    const u8* x = f + 4 + h->sideInfoSize;
+    const u8* end = f + h->frameSize;
+
+    if(x + 8 <= end && (memcmp(x, "Xing", 4) == 0 || memcmp(x, "Info", 4) == 0)) {
+        u32 flags = GetBE32(x + 4);
+        u32 frames = 0;
+        u32 bytes = 0;
+        const u8* toc = NULL;
+        const u8* p = x + 8;
+
+        if(flags & 1) { if(p + 4 > end) return; frames = GetBE32(p); p += 4; }
+        if(flags & 2) { if(p + 4 > end) return; bytes = GetBE32(p); p += 4; }
+        if(flags & 4) { if(p + 100 > end) return; toc = p; p += 100; }
+        if(flags & 8) p += 4;
+
+        dec->info.vbr = (x[0] == 'X');
+        dec->audioStart = offset + h->frameSize;
+
+        // LAME (and ffmpeg) extension: encoder delay and padding for gapless
+        if(p + 24 <= end && (memcmp(p, "LAME", 4) == 0 || memcmp(p, "Lav", 3) == 0)) {
+            dec->info.encoderDelay = (p[21] << 4) | (p[22] >> 4);
+            dec->info.encoderPadding = ((p[22] & 15) << 8) | p[23];
+            dec->startSkip = dec->info.encoderDelay + MP3_DECODER_DELAY;
+        }
+
+        if(frames) {
+            dec->totalFrames = frames;
+            dec->info.exactLength = 1;
+            if(bytes) {
+                dec->info.bitrate = (int)((s64)bytes * 8 * h->sampleRate /
+                                          ((s64)frames * dec->samplesPerFrame * 1000));
+            }
+        }
+
+        if(toc && frames && bytes) {
+            dec->toc = malloc(100 * sizeof(Mp3SeekPoint));
+            if(!dec->toc) return;
+            for(int i = 0; i < 100; i++) {
+                dec->toc[i].frame = (u32)((s64)frames * i / 100);
+                dec->toc[i].offset = (u32)(offset - dec->dataStart + (s64)toc[i] * bytes / 256);
+            }
+            dec->tocCount = 100;
+        }
+        return;
+    }
+
+    // VBRI sits at a fixed offset after the side info of a stereo MPEG-1 frame
+    x = f + 4 + 32;
+    if(x + 26 <= end && memcmp(x, "VBRI", 4) == 0) {
+        u32 frames = GetBE32(x + 14);
+        int entries = GetBE16(x + 18);
+        int scale = GetBE16(x + 20);
+        int entrySize = GetBE16(x + 22);
+        int framesPerEntry = GetBE16(x + 24);
+        const u8* p = x + 26;
+
+        dec->info.vbr = 1;
+        dec->audioStart = offset + h->frameSize;
+
+        if(frames) {
+            dec->totalFrames = frames;
+            dec->info.exactLength = 1;
+        }
+
+        if(entrySize < 1 || entrySize > 4 || p + entries * entrySize > end) return;
+
+        dec->toc = malloc((entries + 1) * sizeof(Mp3SeekPoint));
+        if(!dec->toc) return;
+
+        s64 position = dec->audioStart - dec->dataStart;
+        for(int i = 0; i <= entries; i++) {
+            dec->toc[i].frame = (u32)i * framesPerEntry;
+            dec->toc[i].offset = (u32)position;
+            if(i == entries) break;
+
+            u32 size = 0;
+            for(int b = 0; b < entrySize; b++) {
+                size = (size << 8) | *p++;
+            }
+            position += (s64)size * scale;
+        }
+        dec->tocCount = entries + 1;
+    }
+}
+
+// Skip ID3v2 at the front, ID3v1 and APEv2 at the back
+static void FindAudioData(Mp3Decoder* dec) {
+    MediaIO* io = dec->io;
+    u8 buf[32];
+
+    dec->dataStart = 0;
+    dec->dataEnd = io->size;
+
+    while(SeekMediaIO(io, dec->dataStart) == 0 && ReadMediaIO(io, buf, 10) == 10 &&
+          memcmp(buf, "ID3", 3) == 0) {
+        s64 size = ((buf[6] & 0x7F) << 21) | ((buf[7] & 0x7F) << 14) |
+                   ((buf[8] & 0x7F) << 7) | (buf[9] & 0x7F);
+        dec->dataStart += 10 + size + ((buf[5] & 0x10) ? 10 : 0);
+    }
+
+    if(dec->dataEnd >= 128 && SeekMediaIO(io, dec->dataEnd - 128) == 0 &&
+       ReadMediaIO(io, buf, 3) == 3 && memcmp(buf, "TAG", 3) == 0) {
+        dec->dataEnd -= 128;
+    }
+
+    if(dec->dataEnd >= 32 && SeekMediaIO(io, dec->dataEnd - 32) == 0 &&
+       ReadMediaIO(io, buf, 32) == 32 && memcmp(buf, "APETAGEX", 8) == 0) {
+        s64 size = GetLE32(buf + 12) + ((GetLE32(buf + 20) & 0x80000000) ? 32 : 0);
+        if(size <= dec->dataEnd - dec->dataStart) dec->dataEnd -= size;
+    }
+}
+
+Mp3Decoder* OpenMp3Decoder(MediaIO* io) {
+    Mp3Decoder* dec = calloc(1, sizeof(Mp3Decoder));
+    if(!dec) return NULL;
+
+    InitMp3Tables();
+
+    dec->io = io;
+    FindAudioData(dec);
+
+    s64 offset = FindFrame(dec, dec->dataStart, NULL);
+    if(offset < 0 || SeekMediaIO(io, offset) != 0 ||
+       ReadMediaIO(io, dec->frameData, 4) != 4 ||
+       ParseHeader(dec->frameData, &dec->first) != 0) {
+        free(dec);
+        return NULL;
+    }
+
+    Mp3Header* h = &dec->first;
+    int rest = h->frameSize - 4;
+    if(ReadMediaIO(io, dec->frameData + 4, rest) != rest) {
+        free(dec);
+        return NULL;
+    }
+
+    dec->samplesPerFrame = h->version ? MP3_SAMPLES_PER_FRAME_MPEG2 : MP3_SAMPLES_PER_FRAME_MPEG1;
+    dec->frameOverhead = 4 + (h->crc ? 2 : 0) + h->sideInfoSize;
+    dec->info.sampleRate = h->sampleRate;
+    dec->info.channels = h->channels;
+    dec->info.bitrate = h->bitrate;
+    dec->audioStart = offset;
+
+    ParseXing(dec, h, offset);
+
+    if(!dec->info.exactLength) {
+        // Constant bitrate estimate until the index reaches the end
+        dec->totalFrames = (dec->dataEnd - dec->audioStart) * h->sampleRate /
+                           ((s64)dec->samplesPerFrame * h->bitrate * 125);
+    }
+    dec->info.totalSamples = dec->totalFrames * dec->samplesPerFrame -
+                             dec->startSkip - dec->info.encoderPadding;
+    if(dec->info.totalSamples < 0) dec->info.totalSamples = 0;
+
+    dec->indexEnd = dec->audioStart;
+    dec->frameExact = 1;
+    dec->discard = dec->startSkip;
+
+    if(SeekMediaIO(io, dec->audioStart) != 0) {
+        CloseMp3Decoder(dec);
+        return NULL;
+    }
+
+    return dec;
+}
+
+// Frame table as WriteMp3Index stored it. Returns 0, or -1 if it does
+// not fit this file.
+static int ReadIndex(Mp3Decoder* dec, SidecarBuffer* index) {
+    if((s64)GetSidecar64(index) != dec->dataStart || (s64)GetSidecar64(index) != dec->audioStart) return -1;
+
+    u32 count = GetSidecar32(index);
+    int complete = (int)GetSidecar32(index);
+    s64 indexEnd = (s64)GetSidecar64(index);
+    if(index->error || count == 0 || count > (u32)(index->size - index->at) / 2 ||
+       indexEnd > dec->dataEnd) return -1;
+
+    dec->frameOffsets = malloc(count * sizeof(u32));
+    if(!dec->frameOffsets) return -1;
+    dec->indexCapacity = count;
+
+    u32 offset = 0;
+    for(u32 i = 0; i < count; i++) {
+        u32 delta = GetSidecar16(index);
+        if(delta == MP3_INDEX_ESCAPE) delta = GetSidecar32(index);
+        offset += delta;
+        dec->frameOffsets[i] = offset;
+    }
+    if(index->error || dec->dataStart + offset >= indexEnd) return -1;
+
+    dec->indexCount = count;
+    dec->indexEnd = indexEnd;
+    if(complete) FinishIndex(dec);
+    return 0;
+}
+
+Mp3Decoder* OpenMp3DecoderWithIndex(MediaIO* io, SidecarBuffer* index) {
+    Mp3Decoder* dec = OpenMp3Decoder(io);
+    if(!dec) return NULL;
+
+    // A stale table is dropped and rebuilt while playing, as without one
+    if(ReadIndex(dec, index) != 0) {
+        free(dec->frameOffsets);
+        dec->frameOffsets = NULL;
+        dec->indexCount = 0;
+        dec->indexCapacity = 0;
+    }
+
+    return dec;
+}
+
+void CloseMp3Decoder(Mp3Decoder* dec) {
+    if(!dec) return;
+
+    free(dec->frameOffsets);
+    free(dec->toc);
+    free(dec);
+}
+
+const Mp3Info* GetMp3Info(const Mp3Decoder* dec) {
+    return &dec->info;
+}
+
+s64 GetMp3Position(const Mp3Decoder* dec) {
+    return dec->position;
+}
+
+int GetMp3IndexSize(const Mp3Decoder* dec) {
+    return dec->indexCount;
+}
+
+int ReadMp3Samples(Mp3Decoder* dec, s16* out, int maxFrames) {
+    int nch = dec->info.channels;
+    int done = 0;
+
+    while(done < maxFrames) {
+        if(dec->pcmRead >= dec->pcmFrames) {
+            if(DecodeNextFrame(dec) != 0) break;
+            continue;
+        }
+
+        int n = dec->pcmFrames - dec->pcmRead;
+        if(n > maxFrames - done) n = maxFrames - done;
+
+        // Drop the encoder padding at the end
+        if(dec->info.exactLength) {
+            s64 left = dec->info.totalSamples - dec->position;
+            if(left <= 0) break;
+            if(n > left) n = (int)left;
+        }
+
+        memcpy(out + done * nch, dec->pcm + dec->pcmRead * nch, n * nch * sizeof(s16));
+        dec->pcmRead += n;
+        dec->position += n;
+        done += n;
+    }
+
+    return done;
+}
+
+int ScanMp3Index(Mp3Decoder* dec, int maxFrames) {
+    MediaIO* io = dec->io;
+    s64 saved = io->position;
+    s64 pos = dec->indexEnd;
+    int scanned = 0;
+
+    while(!dec->indexComplete && scanned < maxFrames) {
+        if(pos + 4 > dec->dataEnd || SeekMediaIO(io, pos) != 0) {
+            FinishIndex(dec);
+            break;
+        }
+
+        int n = ReadMediaIO(io, dec->scanBuffer, MP3_SCAN_SIZE);
+        int p = 0;
+
+        // Walk the headers inside the buffer, one read covers several frames
+        while(p + 4 <= n && scanned < maxFrames) {
+            Mp3Header h;
+            if(ParseHeader(dec->scanBuffer + p, &h) != 0 || !SameStream(&h, &dec->first)) break;
+            if(pos + p + h.frameSize > dec->dataEnd) {
+                p = n;
+                pos = dec->dataEnd;
+                break;
+            }
+
+            AppendIndex(dec, pos + p, h.frameSize);
+            p += h.frameSize;
+            scanned++;
+        }
+
+        if(pos >= dec->dataEnd || n < 4) {
+            FinishIndex(dec);
+            break;
+        }
+
+        if(p + 4 <= n && scanned < maxFrames) {
+            s64 found = FindFrame(dec, pos + p + 1, &dec->first);
+            if(found < 0) {
+                FinishIndex(dec);
+                break;
+            }
+            pos = found;
+            continue;
+        }
+
+        pos += p;
+    }
+
+    SeekMediaIO(io, saved);
+    return dec->indexComplete;
+}
+
+int WriteMp3Index(Mp3Decoder* dec, SidecarBuffer* index, int complete) {
+    while(complete && !dec->indexComplete) {
+        int count = dec->indexCount;
+        if(ScanMp3Index(dec, 65536) == 0 && dec->indexCount == count) break;
+    }
+    if(dec->indexCount == 0) return -1;
+
+    PutSidecar64(index, dec->dataStart);
+    PutSidecar64(index, dec->audioStart);
+    PutSidecar32(index, dec->indexCount);
+    PutSidecar32(index, dec->indexComplete);
+    PutSidecar64(index, dec->indexEnd);
+
+    // Frames are back to back apart from the odd resync, so the gaps
+    // between offsets fit in 16 bits
+    u32 previous = 0;
+    for(int i = 0; i < dec->indexCount; i++) {
+        u32 delta = dec->frameOffsets[i] - previous;
+        if(delta < MP3_INDEX_ESCAPE) {
+            PutSidecar16(index, (u16)delta);
+        } else {
+            PutSidecar16(index, MP3_INDEX_ESCAPE);
+            PutSidecar32(index, delta);
+        }
+        previous = dec->frameOffsets[i];
+    }
+
+    return index->error ? -1 : 0;
+}
+
+// Frames before 'frame' whose main data the bit reservoir may reach into
+static int ReservoirFrames(const Mp3Decoder* dec, s64 frame) {
+    int wanted = dec->first.version ? 255 : 511;
+    int bytes = 0;
+    int count = 0;
+
+    for(s64 k = frame - 1; k >= 0 && bytes < wanted && count < MP3_MAX_RESERVOIR_FRAMES; k--) {
+        bytes += (int)(dec->frameOffsets[k + 1] - dec->frameOffsets[k]) - dec->frameOverhead;
+        count++;
+    }
+
+    return count;
+}
+
+static s64 EstimateFrameOffset(const Mp3Decoder* dec, s64 frame) {
+    if(dec->tocCount > 1) {
+        int lo = 0;
+        int hi = dec->tocCount - 1;
+
+        // Last entry at or before the frame, then interpolate to the next
+        while(lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if(dec->toc[mid].frame <= frame) lo = mid;
+            else hi = mid - 1;
+        }
+
+        const Mp3SeekPoint* a = &dec->toc[lo];
+        s64 offset = a->offset;
+        if(lo + 1 < dec->tocCount && dec->toc[lo + 1].frame > a->frame) {
+            const Mp3SeekPoint* b = &dec->toc[lo + 1];
+            offset += ((s64)b->offset - a->offset) * (frame - a->frame) / (b->frame - a->frame);
+        }
+        return dec->dataStart + offset;
+    }
+
+    if(dec->totalFrames <= 0) return dec->audioStart;
+    return dec->audioStart + (dec->dataEnd - dec->audioStart) * frame / dec->totalFrames;
+}
+
+int SeekMp3Sample(Mp3Decoder* dec, s64 sample) {
+    int spf = dec->samplesPerFrame;
+
+    if(sample < 0) sample = 0;
+    if(dec->info.exactLength && sample > dec->info.totalSamples) sample = dec->info.totalSamples;
+
+    s64 target = sample + dec->startSkip;
+    s64 frame = target / spf;
+
+    // The granule before the target is decoded and thrown away so the IMDCT
+    // overlap and the filterbank history are right. MPEG-2 frames hold one
+    // granule, which itself needs the overlap of the one before.
+    s64 prime = frame - (dec->first.granules == 1 ? 2 : 1);
+    if(prime < 0) prime = 0;
+
+    ResetMp3State(dec);
+    dec->discard = (int)(target - prime * spf);
+    dec->position = sample;
+
+    if(prime >= dec->indexCount && !dec->indexComplete &&
+       prime - dec->indexCount < MP3_SCAN_SEEK_FRAMES) {
+        ScanMp3Index(dec, (int)(prime - dec->indexCount) + 1);
+    }
+
+    if(prime < dec->indexCount) {
+        s64 start = prime - ReservoirFrames(dec, prime);
+
+        dec->frame = start;
+        dec->frameExact = 1;
+        dec->feedBefore = prime;
+        return SeekMediaIO(dec->io, dec->dataStart + dec->frameOffsets[start]);
+    }
+
+    dec->feedBefore = 0;
+
+    if(dec->indexComplete) {
+        // Past the last frame
+        dec->frame = dec->indexCount;
+        dec->frameExact = 1;
+        dec->position = dec->info.totalSamples;
+        return SeekMediaIO(dec->io, dec->dataEnd);
+    }
+
+    // Beyond the index: jump by the table of contents or the bitrate and
+    // take the first frame there. The frame number is an estimate from now on.
+    s64 found = FindFrame(dec, EstimateFrameOffset(dec, prime), &dec->first);
+
+    dec->frame = prime;
+    dec->frameExact = 0;
+    return SeekMediaIO(dec->io, found >= 0 ? found : dec->dataEnd);
+}
@@ -0,0 +1,52 @@
+#ifndef MP3_H
+#define MP3_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+// MPEG-1/2/2.5 Layer III decoder. Everything after table setup is integer
+// arithmetic: the sample path is Q24 and the transform coefficients Q30.
+//
+// The decoder keeps a dense table of frame offsets. It grows while frames
+// are decoded in order or scanned with ScanMp3Index(), so any position that
+// has been played or scanned once is one array lookup away. Positions past
+// the index fall back to the Xing/VBRI table of contents, then to bitrate.
+
+// Output samples per frame (per channel)
+#define MP3_SAMPLES_PER_FRAME_MPEG1 1152
+#define MP3_SAMPLES_PER_FRAME_MPEG2 576
+
+typedef struct {
+    int sampleRate;
+    int channels;
+    int bitrate;        // kbps, the average for VBR files
+    int vbr;
+    s64 totalSamples;   // per channel, with encoder delay and padding removed
+    int exactLength;    // totalSamples comes from a header or a full index
+    int encoderDelay;   // LAME tag values, 0 when absent
+    int encoderPadding;
+} Mp3Info;
+
+typedef struct Mp3Decoder Mp3Decoder;
+
+// Function prototypes
+Mp3Decoder* OpenMp3Decoder(MediaIO* io);
+void CloseMp3Decoder(Mp3Decoder* decoder);
+const Mp3Info* GetMp3Info(const Mp3Decoder* decoder);
+int ReadMp3Samples(Mp3Decoder* decoder, s16* out, int maxFrames);
+int SeekMp3Sample(Mp3Decoder* decoder, s64 sample);
+s64 GetMp3Position(const Mp3Decoder* decoder);
+
+// Extend the frame index by walking headers from where it stops, at most
+// maxFrames per call. Returns 1 once the whole file is indexed.
+int ScanMp3Index(Mp3Decoder* decoder, int maxFrames);
+int GetMp3IndexSize(const Mp3Decoder* decoder);
+
+// The frame index for a sidecar file (sidecar.h), scanned to the end
+// first if complete is set, and open with it so seeks are exact from the
+// start. A stale index is ignored.
+struct SidecarBuffer;
+int WriteMp3Index(Mp3Decoder* decoder, struct SidecarBuffer* index, int complete);
+Mp3Decoder* OpenMp3DecoderWithIndex(MediaIO* io, struct SidecarBuffer* index);
+
+#endif // MP3_H
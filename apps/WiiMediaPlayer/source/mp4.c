@@ -0,0 +1,651 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mp4.h"
+
+// Sample tables are read through a buffer of this size
+#define MP4_TABLE_BLOCK (16 * 1024)
+// Fixed-size boxes read whole at open are never larger than this
+#define MP4_SMALL_BOX 128
+// The start of stsd, enough for a visual entry's fixed fields and the
+// small boxes after them (avcC, pasp, fiel)
+#define MP4_SAMPLE_DESCRIPTION 512
+#define MP4_VISUAL_ENTRY 86     // entry header and fixed fields
+
+#define FOURCC(a, b, c, d) (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+
+typedef struct {
+    s64 offset;         // payload, 0 when the box is absent
+    s64 size;
+} Mp4Box;
+
+// Runs of samples with the same duration
+typedef struct {
+    u32 first;
+    u32 delta;
+    s64 start;          // decode time of the first sample
+} Mp4TimeRun;
+
+// Runs of chunks with the same number of samples
+typedef struct {
+    u32 firstChunk;     // 0-based
+    u32 perChunk;
+    u32 firstSample;
+} Mp4ChunkRun;
+
+typedef struct {
+    Mp4Box stts, stsc, stsz, stz2, stco, co64, stss;
+    int loaded;         // 1 once the tables are in memory, -1 if they are bad
+    u32 samples;
+
+    Mp4TimeRun* timeRuns;
+    int timeRunCount;
+    Mp4ChunkRun* chunkRuns;
+    int chunkRunCount;
+    u32 sampleSize;     // when every sample has the same size
+    u32* sizes;         // otherwise one per sample
+    u64* chunkOffsets;
+    u32 chunks;
+    u32* sync;          // 0-based sync samples; NULL when all are
+    u32 syncCount;
+
+    // Where ReadMp4Packet() continues
+    u32 sample;
+    u32 chunk;
+    u32 chunkSample;    // first sample of chunk
+    int chunkRun;
+    int timeRun;
+    u32 nextSync;       // first entry of sync at or after sample
+    s64 offset;
+    s64 time;
+} Mp4TrackState;
+
+struct Mp4Demuxer {
+    MediaIO* io;
+    Mp4Info info;
+    Mp4TrackState state[MP4_MAX_TRACKS];
+    int seekTrack;      // the video track, else track 0
+};
+
+typedef struct {
+    MediaIO* io;
+    s64 pos;            // file offset of block[fill]
+    s64 end;
+    u8* block;
+    int fill;
+    int at;
+} TableReader;
+
+// Reads a box header at offset. Sizes of 1 (64-bit size follows) and 0
+// (box runs to the end) are handled; boxes are clamped to end.
+static int ReadBoxHeader(MediaIO* io, s64 offset, s64 end, u32* type, s64* payload, s64* boxEnd) {
+    u8 header[16];
+
+    if(offset + 8 > end) return -1;
+    if(SeekMediaIO(io, offset) != 0 || ReadMediaIO(io, header, 8) != 8) return -1;
+
+    s64 size = GetBE32(header);
+    *type = GetBE32(header + 4);
+    *payload = offset + 8;
+
+    if(size == 1) {
+        if(offset + 16 > end || ReadMediaIO(io, header + 8, 8) != 8) return -1;
+        size = (s64)GetBE64(header + 8);
+        *payload = offset + 16;
+    } else if(size == 0) {
+        size = end - offset;
+    }
+
+    if(size < *payload - offset) return -1;
+    *boxEnd = offset + size > end ? end : offset + size;
+    return 0;
+}
+
+// Up to max bytes of the payload, the rest of data zeroed
+static int ReadBoxStart(MediaIO* io, s64 payload, s64 boxEnd, u8* data, int max) {
+    s64 size = boxEnd - payload;
+    int n = size < max ? (int)size : max;
+
+    memset(data, 0, max);
+    if(SeekMediaIO(io, payload) != 0 || ReadMediaIO(io, data, n) != n) return -1;
+    return n;
+}
+
+static int ReadSmallBox(MediaIO* io, s64 payload, s64 boxEnd, u8* data) {
+    return ReadBoxStart(io, payload, boxEnd, data, MP4_SMALL_BOX);
+}
+
+static void ParseSampleDescription(const u8* p, int n, Mp4Track* track) {
+    // Full box header and entry count, then the first entry
+    if(n < 16 || GetBE32(p + 4) == 0) return;
+
+    const u8* entry = p + 8;
+    track->codec = GetBE32(entry + 4);
+
+    if(track->type == MP4_TRACK_VIDEO && n >= 8 + 36) {
+        if(GetBE16(entry + 32) && GetBE16(entry + 34)) {
+            track->width = GetBE16(entry + 32);
+            track->height = GetBE16(entry + 34);
+        }
+
+        // The boxes after the fixed fields of a visual entry; 'fiel' holds
+        // the field count and, for two, their order
+        int entryEnd = 8 + (int)GetBE32(entry);
+        if(entryEnd > n) entryEnd = n;
+        for(int at = 8 + MP4_VISUAL_ENTRY; at + 8 <= entryEnd;) {
+            u32 size = GetBE32(p + at);
+            if(size < 8 || size > (u32)(entryEnd - at)) break;
+            if(GetBE32(p + at + 4) == FOURCC('f', 'i', 'e', 'l') && size >= 10) {
+                track->fieldOrder = p[at + 8] == 1 ? MEDIA_FIELDS_PROGRESSIVE : GetMediaFieldOrder(p[at + 9]);
+            }
+            at += size;
+        }
+    } else if(track->type == MP4_TRACK_AUDIO && n >= 8 + 36) {
+        track->channels = GetBE16(entry + 24);
+        track->sampleRate = (int)(GetBE32(entry + 32) >> 16);
+    }
+}
+
+// Walks moov and the boxes inside it. Only the small boxes are read;
+// the sample table boxes are just located.
+static int ParseBoxes(Mp4Demuxer* demux, s64 offset, s64 end, int track) {
+    MediaIO* io = demux->io;
+    Mp4Info* info = &demux->info;
+    u8 data[MP4_SMALL_BOX];
+
+    while(offset + 8 <= end) {
+        u32 type;
+        s64 payload, boxEnd;
+        if(ReadBoxHeader(io, offset, end, &type, &payload, &boxEnd) != 0) return -1;
+
+        Mp4Track* t = track >= 0 ? &info->track[track] : NULL;
+        Mp4TrackState* s = track >= 0 ? &demux->state[track] : NULL;
+        Mp4Box box = {payload, boxEnd - payload};
+        int n;
+
+        switch(type) {
+            case FOURCC('t', 'r', 'a', 'k'):
+                if(info->tracks < MP4_MAX_TRACKS) {
+                    if(ParseBoxes(demux, payload, boxEnd, info->tracks++) != 0) return -1;
+                }
+                break;
+            case FOURCC('m', 'd', 'i', 'a'):
+            case FOURCC('m', 'i', 'n', 'f'):
+            case FOURCC('s', 't', 'b', 'l'):
+                if(t && ParseBoxes(demux, payload, boxEnd, track) != 0) return -1;
+                break;
+            case FOURCC('m', 'v', 'h', 'd'):
+                if((n = ReadSmallBox(io, payload, boxEnd, data)) < 0) return -1;
+                if(data[0] == 1 && n >= 32) {
+                    info->timescale = GetBE32(data + 20);
+                    info->duration = (s64)GetBE64(data + 24);
+                } else if(n >= 20) {
+                    info->timescale = GetBE32(data + 12);
+                    info->duration = GetBE32(data + 16);
+                }
+                break;
+            case FOURCC('t', 'k', 'h', 'd'):
+                // Presentation size in 16.16, the fallback for the coded size
+                if(!t || (n = ReadSmallBox(io, payload, boxEnd, data)) < 0) break;
+                if(data[0] == 1 && n >= 96) {
+                    t->width = (int)(GetBE32(data + 88) >> 16);
+                    t->height = (int)(GetBE32(data + 92) >> 16);
+                } else if(n >= 84) {
+                    t->width = (int)(GetBE32(data + 76) >> 16);
+                    t->height = (int)(GetBE32(data + 80) >> 16);
+                }
+                break;
+            case FOURCC('m', 'd', 'h', 'd'):
+                if(!t || (n = ReadSmallBox(io, payload, boxEnd, data)) < 0) break;
+                if(data[0] == 1 && n >= 32) {
+                    t->timescale = GetBE32(data + 20);
+                    t->duration = (s64)GetBE64(data + 24);
+                } else if(n >= 20) {
+                    t->timescale = GetBE32(data + 12);
+                    t->duration = GetBE32(data + 16);
+                }
+                break;
+            case FOURCC('h', 'd', 'l', 'r'):
+                if(!t || (n = ReadSmallBox(io, payload, boxEnd, data)) < 12) break;
+                if(GetBE32(data + 8) == FOURCC('v', 'i', 'd', 'e')) t->type = MP4_TRACK_VIDEO;
+                if(GetBE32(data + 8) == FOURCC('s', 'o', 'u', 'n')) t->type = MP4_TRACK_AUDIO;
+                break;
+            case FOURCC('s', 't', 's', 'd'): {
+                // hdlr comes before minf, so the track type is known here
+                u8 entries[MP4_SAMPLE_DESCRIPTION];
+                if(!t || (n = ReadBoxStart(io, payload, boxEnd, entries, sizeof(entries))) < 0) break;
+                ParseSampleDescription(entries, n, t);
+                break;
+            }
+            case FOURCC('s', 't', 't', 's'): if(s) s->stts = box; break;
+            case FOURCC('s', 't', 's', 'c'): if(s) s->stsc = box; break;
+            case FOURCC('s', 't', 's', 'z'): if(s) s->stsz = box; break;
+            case FOURCC('s', 't', 'z', '2'): if(s) s->stz2 = box; break;
+            case FOURCC('s', 't', 'c', 'o'): if(s) s->stco = box; break;
+            case FOURCC('c', 'o', '6', '4'): if(s) s->co64 = box; break;
+            case FOURCC('s', 't', 's', 's'): if(s) s->stss = box; break;
+        }
+
+        offset = boxEnd;
+    }
+
+    return 0;
+}
+
+static void OpenTable(TableReader* r, MediaIO* io, const Mp4Box* box, u8* block) {
+    r->io = io;
+    r->pos = box->offset;
+    r->end = box->offset + box->size;
+    r->block = block;
+    r->fill = 0;
+    r->at = 0;
+}
+
+// Next size bytes of the table, NULL past its end
+static const u8* NextEntry(TableReader* r, int size) {
+    if(r->at + size > r->fill) {
+        int keep = r->fill - r->at;
+        memmove(r->block, r->block + r->at, keep);
+
+        s64 left = r->end - r->pos;
+        int n = MP4_TABLE_BLOCK - keep;
+        if(n > left) n = (int)left;
+        if(n > 0) {
+            if(SeekMediaIO(r->io, r->pos) != 0 || ReadMediaIO(r->io, r->block + keep, n) != n) return NULL;
+            r->pos += n;
+        }
+
+        r->fill = keep + (n > 0 ? n : 0);
+        r->at = 0;
+        if(size > r->fill) return NULL;
+    }
+
+    const u8* p = r->block + r->at;
+    r->at += size;
+    return p;
+}
+
+// An entry count that fits in the rest of the box
+static u32 ReadCount(TableReader* r, int entrySize) {
+    const u8* p = NextEntry(r, 4);
+    if(!p) return 0;
+
+    u32 count = GetBE32(p);
+    s64 room = (r->end - r->pos + r->fill - r->at) / entrySize;
+    return count > room ? (u32)room : count;
+}
+
+static inline u32 SampleSize(const Mp4TrackState* s, u32 sample) {
+    return s->sizes ? s->sizes[sample] : s->sampleSize;
+}
+
+// Put the cursor of a track with loaded tables on sample
+static void LocateSample(Mp4TrackState* s, u32 sample) {
+    int lo = 0, hi = s->chunkRunCount - 1;
+    while(lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if(s->chunkRuns[mid].firstSample <= sample) lo = mid;
+        else hi = mid - 1;
+    }
+
+    const Mp4ChunkRun* run = &s->chunkRuns[lo];
+    u32 inRun = (sample - run->firstSample) / run->perChunk;
+    s->chunkRun = lo;
+    s->chunk = run->firstChunk + inRun;
+    s->chunkSample = run->firstSample + inRun * run->perChunk;
+    s->sample = sample;
+
+    s->offset = s->chunk < s->chunks ? (s64)s->chunkOffsets[s->chunk] : 0;
+    for(u32 i = s->chunkSample; i < sample && i < s->samples; i++) {
+        s->offset += SampleSize(s, i);
+    }
+
+    lo = 0;
+    hi = s->timeRunCount - 1;
+    while(lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if(s->timeRuns[mid].first <= sample) lo = mid;
+        else hi = mid - 1;
+    }
+    s->timeRun = lo;
+    s->time = s->timeRuns[lo].start + (s64)(sample - s->timeRuns[lo].first) * s->timeRuns[lo].delta;
+
+    // First sync sample at or after sample
+    u32 a = 0, b = s->syncCount;
+    while(a < b) {
+        u32 mid = a + (b - a) / 2;
+        if(s->sync[mid] < sample) a = mid + 1;
+        else b = mid;
+    }
+    s->nextSync = a;
+}
+
+static int LoadTables(Mp4Demuxer* demux, int track) {
+    Mp4TrackState* s = &demux->state[track];
+    MediaIO* io = demux->io;
+    TableReader r;
+    const u8* p;
+
+    if(s->loaded) return s->loaded > 0 ? 0 : -1;
+    s->loaded = -1;
+
+    if(!s->stts.offset || !s->stsc.offset || !(s->stco.offset || s->co64.offset) ||
+       !(s->stsz.offset || s->stz2.offset)) return -1;
+
+    u8* block = malloc(MP4_TABLE_BLOCK);
+    if(!block) return -1;
+
+    // Sample sizes
+    if(s->stsz.offset) {
+        OpenTable(&r, io, &s->stsz, block);
+        if(!(p = NextEntry(&r, 8))) goto fail;
+        s->sampleSize = GetBE32(p + 4);
+        if(s->sampleSize) {
+            if(!(p = NextEntry(&r, 4))) goto fail;
+            s->samples = GetBE32(p);
+        } else {
+            s->samples = ReadCount(&r, 4);
+            s->sizes = malloc((s->samples + 1) * sizeof(u32));
+            if(!s->sizes) goto fail;
+            for(u32 i = 0; i < s->samples; i++) {
+                if(!(p = NextEntry(&r, 4))) goto fail;
+                s->sizes[i] = GetBE32(p);
+            }
+        }
+    } else {
+        // Compact sizes of 4, 8 or 16 bits
+        OpenTable(&r, io, &s->stz2, block);
+        if(!(p = NextEntry(&r, 8))) goto fail;
+        int bits = p[7];
+        if(bits != 4 && bits != 8 && bits != 16) goto fail;
+        s->samples = ReadCount(&r, 1);
+        if(bits == 4 && s->samples > (u32)(r.end - r.pos + r.fill - r.at) * 2) goto fail;
+        s->sizes = malloc((s->samples + 1) * sizeof(u32));
+        if(!s->sizes) goto fail;
+        for(u32 i = 0; i < s->samples; i++) {
+            if(bits == 16) {
+                if(!(p = NextEntry(&r, 2))) goto fail;
+                s->sizes[i] = GetBE16(p);
+            } else if(bits == 8 || !(i & 1)) {
+                if(!(p = NextEntry(&r, 1))) goto fail;
+                s->sizes[i] = bits == 8 ? p[0] : p[0] >> 4;
+            } else {
+                s->sizes[i] = p[0] & 15;
+            }
+        }
+    }
+
+    // Chunk offsets, 32 or 64 bit
+    int wide = s->co64.offset != 0;
+    OpenTable(&r, io, wide ? &s->co64 : &s->stco, block);
+    if(!NextEntry(&r, 4)) goto fail;
+    s->chunks = ReadCount(&r, wide ? 8 : 4);
+    s->chunkOffsets = malloc((s->chunks + 1) * sizeof(u64));
+    if(!s->chunkOffsets) goto fail;
+    for(u32 i = 0; i < s->chunks; i++) {
+        if(!(p = NextEntry(&r, wide ? 8 : 4))) goto fail;
+        s->chunkOffsets[i] = wide ? GetBE64(p) : GetBE32(p);
+    }
+
+    // Sample to chunk runs, with the first sample of each worked out
+    OpenTable(&r, io, &s->stsc, block);
+    if(!NextEntry(&r, 4)) goto fail;
+    u32 count = ReadCount(&r, 12);
+    s->chunkRuns = malloc((count + 1) * sizeof(Mp4ChunkRun));
+    if(!s->chunkRuns) goto fail;
+    for(u32 i = 0; i < count; i++) {
+        if(!(p = NextEntry(&r, 12))) goto fail;
+
+        Mp4ChunkRun run = {GetBE32(p) - 1, GetBE32(p + 4), 0};
+        if(run.firstChunk >= s->chunks || run.perChunk == 0) break;
+
+        if(s->chunkRunCount > 0) {
+            const Mp4ChunkRun* last = &s->chunkRuns[s->chunkRunCount - 1];
+            if(run.firstChunk <= last->firstChunk) goto fail;
+            run.firstSample = last->firstSample + (run.firstChunk - last->firstChunk) * last->perChunk;
+        } else if(run.firstChunk != 0) {
+            goto fail;
+        }
+        s->chunkRuns[s->chunkRunCount++] = run;
+    }
+    if(s->chunkRunCount == 0) goto fail;
+
+    // Decode time runs
+    OpenTable(&r, io, &s->stts, block);
+    if(!NextEntry(&r, 4)) goto fail;
+    count = ReadCount(&r, 8);
+    s->timeRuns = malloc((count + 1) * sizeof(Mp4TimeRun));
+    if(!s->timeRuns) goto fail;
+    u32 first = 0;
+    s64 start = 0;
+    for(u32 i = 0; i < count; i++) {
+        if(!(p = NextEntry(&r, 8))) goto fail;
+
+        u32 samples = GetBE32(p);
+        if(samples == 0) continue;
+
+        Mp4TimeRun run = {first, GetBE32(p + 4), start};
+        s->timeRuns[s->timeRunCount++] = run;
+        first += samples;
+        start += (s64)samples * run.delta;
+    }
+    if(s->timeRunCount == 0) goto fail;
+
+    // Sync samples; without stss every sample is one
+    if(s->stss.offset) {
+        OpenTable(&r, io, &s->stss, block);
+        if(!NextEntry(&r, 4)) goto fail;
+        count = ReadCount(&r, 4);
+        s->sync = malloc((count + 1) * sizeof(u32));
+        if(!s->sync) goto fail;
+        for(u32 i = 0; i < count; i++) {
+            if(!(p = NextEntry(&r, 4))) goto fail;
+            if(GetBE32(p) > 0) s->sync[s->syncCount++] = GetBE32(p) - 1;
+        }
+        if(s->syncCount == 0) {
+            free(s->sync);
+            s->sync = NULL;
+        }
+    }
+
+    free(block);
+    demux->info.track[track].samples = s->samples;
+    LocateSample(s, 0);
+    s->loaded = 1;
+    return 0;
+
+fail:
+    free(block);
+    return -1;
+}
+
+static void NextSample(Mp4TrackState* s) {
+    s->offset += SampleSize(s, s->sample);
+    s->sample++;
+
+    // Chunks are not contiguous; the next one starts at its own offset
+    if(s->sample - s->chunkSample == s->chunkRuns[s->chunkRun].perChunk) {
+        s->chunk++;
+        s->chunkSample = s->sample;
+        if(s->chunkRun + 1 < s->chunkRunCount && s->chunk >= s->chunkRuns[s->chunkRun + 1].firstChunk) {
+            s->chunkRun++;
+        }
+        s->offset = s->chunk < s->chunks ? (s64)s->chunkOffsets[s->chunk] : 0;
+    }
+
+    s->time += s->timeRuns[s->timeRun].delta;
+    if(s->timeRun + 1 < s->timeRunCount && s->sample >= s->timeRuns[s->timeRun + 1].first) {
+        s->timeRun++;
+    }
+
+    if(s->nextSync < s->syncCount && s->sync[s->nextSync] < s->sample) s->nextSync++;
+}
+
+// Sample playing at time
+static u32 SampleAtTime(const Mp4TrackState* s, s64 time) {
+    int lo = 0, hi = s->timeRunCount - 1;
+    while(lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if(s->timeRuns[mid].start <= time) lo = mid;
+        else hi = mid - 1;
+    }
+
+    const Mp4TimeRun* run = &s->timeRuns[lo];
+    s64 sample = run->first;
+    if(time > run->start && run->delta > 0) sample += (time - run->start) / run->delta;
+
+    return sample < s->samples ? (u32)sample : (s->samples > 0 ? s->samples - 1 : 0);
+}
+
+Mp4Demuxer* OpenMp4Demuxer(MediaIO* io) {
+    Mp4Demuxer* demux = calloc(1, sizeof(Mp4Demuxer));
+    if(!demux) return NULL;
+
+    demux->io = io;
+    Mp4Info* info = &demux->info;
+    info->videoTrack = -1;
+    info->audioTrack = -1;
+
+    // Top-level boxes: only their headers are read on the way to moov
+    s64 offset = 0;
+    int haveMoov = 0;
+    int sawMdat = 0;
+    while(!haveMoov && offset + 8 <= io->size) {
+        u32 type;
+        s64 payload, boxEnd;
+        if(ReadBoxHeader(io, offset, io->size, &type, &payload, &boxEnd) != 0) break;
+
+        if(type == FOURCC('m', 'o', 'o', 'v')) {
+            if(ParseBoxes(demux, payload, boxEnd, -1) != 0) break;
+            haveMoov = 1;
+            info->moovFirst = !sawMdat;
+        } else if(type == FOURCC('m', 'd', 'a', 't')) {
+            sawMdat = 1;
+        }
+
+        offset = boxEnd;
+    }
+
+    if(!haveMoov || info->tracks == 0) {
+        CloseMp4Demuxer(demux);
+        return NULL;
+    }
+
+    for(int i = 0; i < info->tracks; i++) {
+        Mp4Track* t = &info->track[i];
+        Mp4TrackState* s = &demux->state[i];
+
+        // The sample count is in the fixed part of stsz/stz2
+        const Mp4Box* sizes = s->stsz.offset ? &s->stsz : &s->stz2;
+        u8 header[12];
+        if(sizes->offset && sizes->size >= 12 && SeekMediaIO(io, sizes->offset) == 0 &&
+           ReadMediaIO(io, header, 12) == 12) {
+            t->samples = GetBE32(header + 8);
+        }
+        if(t->samples == 0) continue;
+
+        if(t->type == MP4_TRACK_VIDEO && info->videoTrack < 0) info->videoTrack = i;
+        if(t->type == MP4_TRACK_AUDIO && info->audioTrack < 0) info->audioTrack = i;
+    }
+
+    if(info->videoTrack >= 0) {
+        const Mp4Track* v = &info->track[info->videoTrack];
+        info->width = v->width;
+        info->height = v->height;
+    }
+    if(info->timescale) {
+        info->seconds = (int)(info->duration / info->timescale);
+    }
+
+    demux->seekTrack = info->videoTrack >= 0 ? info->videoTrack : 0;
+    return demux;
+}
+
+void CloseMp4Demuxer(Mp4Demuxer* demux) {
+    if(!demux) return;
+
+    for(int i = 0; i < MP4_MAX_TRACKS; i++) {
+        Mp4TrackState* s = &demux->state[i];
+        free(s->timeRuns);
+        free(s->chunkRuns);
+        free(s->sizes);
+        free(s->chunkOffsets);
+        free(s->sync);
+    }
+    free(demux);
+}
+
+const Mp4Info* GetMp4Info(const Mp4Demuxer* demux) {
+    return &demux->info;
+}
+
+int ReadMp4Packet(Mp4Demuxer* demux, int track, Mp4Packet* packet, u8* buffer, int bufferSize) {
+    if(track < 0 || track >= demux->info.tracks || LoadTables(demux, track) != 0) return 0;
+
+    Mp4TrackState* s = &demux->state[track];
+    if(s->sample >= s->samples || s->chunk >= s->chunks) return 0;
+
+    packet->track = track;
+    packet->number = s->sample;
+    packet->offset = s->offset;
+    packet->size = (int)SampleSize(s, s->sample);
+    packet->time = s->time;
+    packet->keyframe = !s->sync ||
+                       (s->nextSync < s->syncCount && s->sync[s->nextSync] == s->sample);
+
+    NextSample(s);
+
+    int n = packet->size < bufferSize ? packet->size : bufferSize;
+    if(n > 0) {
+        if(SeekMediaIO(demux->io, packet->offset) != 0) return 0;
+        if(ReadMediaIO(demux->io, buffer, n) != n) return 0;
+    }
+
+    return 1;
+}
+
+s64 SeekMp4Time(Mp4Demuxer* demux, s64 ms) {
+    int track = demux->seekTrack;
+    Mp4TrackState* seek = &demux->state[track];
+    u32 timescale = demux->info.track[track].timescale;
+
+    if(!timescale || LoadTables(demux, track) != 0 || seek->samples == 0) return -1;
+    if(ms < 0) ms = 0;
+
+    // Last sync sample at or before the sample playing at ms
+    u32 sample = SampleAtTime(seek, ms * timescale / 1000);
+    if(seek->sync) {
+        int lo = 0, hi = (int)seek->syncCount - 1;
+        while(lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            if(seek->sync[mid] <= sample) lo = mid;
+            else hi = mid - 1;
+        }
+        sample = seek->sync[lo];
+    }
+
+    LocateSample(seek, sample);
+    s64 landed = seek->time * 1000 / timescale;
+
+    for(int i = 0; i < demux->info.tracks; i++) {
+        Mp4TrackState* s = &demux->state[i];
+        u32 scale = demux->info.track[i].timescale;
+        if(i == track || !scale || LoadTables(demux, i) != 0 || s->samples == 0) continue;
+
+        LocateSample(s, SampleAtTime(s, landed * scale / 1000));
+    }
+
+    return landed;
+}
+
+s64 GetMp4Position(const Mp4Demuxer* demux) {
+    return demux->state[demux->seekTrack].sample;
+}
+
+int ReadMp4Info(MediaIO* io, Mp4Info* info) {
+    Mp4Demuxer* demux = OpenMp4Demuxer(io);
+    if(!demux) return -1;
+
+    *info = demux->info;
+    CloseMp4Demuxer(demux);
+    return 0;
+}
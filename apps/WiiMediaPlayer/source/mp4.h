@@ -0,0 +1,84 @@
+#ifndef MP4_H
+#define MP4_H
+
+#include "platform.h"
+#include "mediaio.h"
+#include "registry.h"
+
+// ISO base media (MP4/MOV) demuxer. Opening reads box headers and the
+// small fixed-size boxes only (mvhd, tkhd, mdhd, hdlr, the first sample
+// description); the sample tables of a track are loaded the first time
+// the track is read or seeked. They stay in their packed form: stts and
+// stsc runs, one u32 per sample size, one u64 per chunk offset and the
+// sync sample list. A moov after the mdat costs one header read per
+// top-level box to reach it. Fragmented files (moof) are not supported.
+
+#define MP4_MAX_TRACKS 8
+
+typedef enum {
+    MP4_TRACK_OTHER,
+    MP4_TRACK_VIDEO,
+    MP4_TRACK_AUDIO
+} Mp4TrackType;
+
+typedef struct {
+    Mp4TrackType type;
+    u32 codec;          // sample entry type, e.g. 'avc1', 'mp4a'
+    u32 timescale;      // units per second of the track's times
+    s64 duration;       // in timescale units
+    s64 samples;
+
+    // Video
+    int width;
+    int height;
+    MediaFieldOrder fieldOrder;     // from the sample entry's 'fiel'
+
+    // Audio
+    int channels;
+    int sampleRate;
+} Mp4Track;
+
+typedef struct {
+    int tracks;
+    Mp4Track track[MP4_MAX_TRACKS];
+    int videoTrack;     // -1 when there is none
+    int audioTrack;
+    int width;
+    int height;
+    u32 timescale;      // of the movie header
+    s64 duration;       // in movie timescale units
+    int seconds;
+    int moovFirst;      // moov stored before mdat
+} Mp4Info;
+
+typedef struct {
+    int track;
+    int keyframe;
+    s64 number;         // sample number within the track
+    s64 offset;
+    int size;           // full sample size, even if the buffer was smaller
+    s64 time;           // decode time in track timescale units
+} Mp4Packet;
+
+typedef struct Mp4Demuxer Mp4Demuxer;
+
+// Function prototypes
+Mp4Demuxer* OpenMp4Demuxer(MediaIO* io);
+void CloseMp4Demuxer(Mp4Demuxer* demuxer);
+const Mp4Info* GetMp4Info(const Mp4Demuxer* demuxer);
+
+// Next sample of one track, each track keeps its own place. Copies at
+// most bufferSize bytes. Returns 1 for a sample, 0 at the end or on error.
+int ReadMp4Packet(Mp4Demuxer* demuxer, int track, Mp4Packet* packet, u8* buffer, int bufferSize);
+
+// Move the video track (else track 0) to the last sync sample at or
+// before ms, and the other tracks to the same decode time. Returns the
+// time landed on in ms, or -1.
+s64 SeekMp4Time(Mp4Demuxer* demuxer, s64 ms);
+// Sample number of the next video sample
+s64 GetMp4Position(const Mp4Demuxer* demuxer);
+
+// Track and movie headers only; the same cost as opening
+int ReadMp4Info(MediaIO* io, Mp4Info* info);
+
+#endif // MP4_H
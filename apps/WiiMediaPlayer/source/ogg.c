@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <string.h>
+#include "ogg.h"
+
+#define OGG_HEADER_SIZE 27
+// Bytes read per step while looking for a capture pattern
+#define OGG_SCAN_SIZE 1024
+// Give up looking backwards for the last page after this many bytes
+#define OGG_MAX_TAIL_SCAN (1024 * 1024)
+
+static u32 crcTable[256];
+static int crcReady = 0;
+
+// CRC-32 with polynomial 0x04C11DB7, not reflected, initial value 0
+static void InitOggCrc() {
+    if(crcReady) return;
+
+    for(int i = 0; i < 256; i++) {
+        u32 r = (u32)i << 24;
+        for(int j = 0; j < 8; j++) {
+            r = (r & 0x80000000) ? (r << 1) ^ 0x04C11DB7 : r << 1;
+        }
+        crcTable[i] = r;
+    }
+
+    crcReady = 1;
+}
+
+static u32 UpdateCrc(u32 crc, const u8* p, int size) {
+    for(int i = 0; i < size; i++) {
+        crc = (crc << 8) ^ crcTable[(crc >> 24) ^ p[i]];
+    }
+    return crc;
+}
+
+int ReadOggPage(MediaIO* io, s64 offset, OggPage* page, u8* body) {
+    u8 header[OGG_HEADER_SIZE];
+
+    InitOggCrc();
+
+    if(SeekMediaIO(io, offset) != 0) return -1;
+    if(ReadMediaIO(io, header, OGG_HEADER_SIZE) != OGG_HEADER_SIZE) return -1;
+    if(memcmp(header, "OggS", 4) != 0 || header[4] != 0) return -1;
+
+    page->offset = offset;
+    page->flags = header[5];
+    page->granule = (s64)GetLE64(header + 6);
+    page->serial = GetLE32(header + 14);
+    page->sequence = GetLE32(header + 18);
+    page->segments = header[26];
+
+    if(ReadMediaIO(io, page->lacing, page->segments) != page->segments) return -1;
+
+    int bodySize = 0;
+    for(int i = 0; i < page->segments; i++) {
+        bodySize += page->lacing[i];
+    }
+    if(ReadMediaIO(io, body, bodySize) != bodySize) return -1;
+
+    page->size = OGG_HEADER_SIZE + page->segments + bodySize;
+
+    // The checksum covers the whole page with its own field zeroed
+    u32 expected = GetLE32(header + 22);
+    memset(header + 22, 0, 4);
+
+    u32 crc = UpdateCrc(0, header, OGG_HEADER_SIZE);
+    crc = UpdateCrc(crc, page->lacing, page->segments);
+    crc = UpdateCrc(crc, body, bodySize);
+
+    return crc == expected ? 0 : -1;
+}
+
+s64 FindOggPage(MediaIO* io, s64 from, s64 end, OggPage* page, u8* body) {
+    u8 buf[OGG_SCAN_SIZE];
+    s64 pos = from;
+
+    while(pos < end) {
+        s64 left = io->size - pos;
+        int n = left < OGG_SCAN_SIZE ? (int)left : OGG_SCAN_SIZE;
+        if(n < 4 || SeekMediaIO(io, pos) != 0 || ReadMediaIO(io, buf, n) != n) break;
+
+        for(int i = 0; i + 4 <= n; i++) {
+            if(buf[i] != 'O' || memcmp(buf + i, "OggS", 4) != 0) continue;
+            if(pos + i >= end) return -1;
+            if(ReadOggPage(io, pos + i, page, body) == 0) return pos + i;
+        }
+
+        // Keep three bytes of overlap for a pattern split across reads
+        pos += n - 3;
+    }
+
+    return -1;
+}
+
+int OpenOggStream(OggStream* s, MediaIO* io, s64 start, s64 end, int packetLimit) {
+    memset(s, 0, sizeof(OggStream));
+
+    s->io = io;
+    s->end = end;
+    s->packetLimit = packetLimit;
+    s->body = malloc(OGG_MAX_PAGE_BODY);
+    s->packetCapacity = 4096;
+    s->packet = malloc(s->packetCapacity + 8);
+    if(!s->body || !s->packet) {
+        CloseOggStream(s);
+        return -1;
+    }
+
+    // The first page decides which logical stream is followed
+    s64 offset = FindOggPage(io, start, end, &s->page, s->body);
+    if(offset < 0 || !(s->page.flags & OGG_PAGE_BOS)) {
+        CloseOggStream(s);
+        return -1;
+    }
+
+    s->serial = s->page.serial;
+    s->nextPage = offset + s->page.size;
+    s->havePage = 1;
+    s->granule = -1;
+
+    return 0;
+}
+
+void CloseOggStream(OggStream* s) {
+    free(s->body);
+    free(s->packet);
+    s->body = NULL;
+    s->packet = NULL;
+}
+
+// Grow the packet buffer to size and keep it there. Later packets that
+// are longer are cut, which the decoder sees as an early end of packet.
+int SetOggPacketLimit(OggStream* s, int size) {
+    if(size > s->packetCapacity) {
+        u8* grown = realloc(s->packet, size + 8);
+        if(!grown) return -1;
+        s->packet = grown;
+        s->packetCapacity = size;
+    }
+
+    s->packetLimit = s->packetCapacity;
+    return 0;
+}
+
+static int NextPage(OggStream* s) {
+    for(;;) {
+        s64 offset = FindOggPage(s->io, s->nextPage, s->end, &s->page, s->body);
+        if(offset < 0) return -1;
+
+        s->nextPage = offset + s->page.size;
+
+        // Pages of other multiplexed streams are skipped
+        if(s->page.serial != s->serial) continue;
+
+        s->segment = 0;
+        s->bodyPos = 0;
+        s->havePage = 1;
+
+        // A page continuing a packet we never saw the start of
+        if(s->page.flags & OGG_PAGE_CONTINUED) {
+            if(s->packetSize == 0) s->dropPacket = 1;
+        } else if(s->packetSize > 0) {
+            // The previous packet was cut off by a missing page
+            s->packetSize = 0;
+            s->dropPacket = 0;
+        }
+
+        return 0;
+    }
+}
+
+int ReadOggPacket(OggStream* s) {
+    if(s->packetReady) {
+        s->packetSize = 0;
+        s->packetReady = 0;
+    }
+
+    for(;;) {
+        if(!s->havePage || s->segment >= s->page.segments) {
+            if(s->eos || NextPage(s) != 0) return 0;
+            continue;
+        }
+
+        // Gather lacing values up to the end of a packet or of the page
+        int size = 0;
+        int complete = 0;
+        while(s->segment < s->page.segments) {
+            int lace = s->page.lacing[s->segment++];
+            size += lace;
+            if(lace < 255) {
+                complete = 1;
+                break;
+            }
+        }
+
+        int keep = size;
+        if(s->packetSize + keep > s->packetCapacity) {
+            int want = s->packetSize + keep;
+            if(want > s->packetLimit) want = s->packetLimit;
+
+            if(want > s->packetCapacity) {
+                u8* grown = realloc(s->packet, want + 8);
+                if(grown) {
+                    s->packet = grown;
+                    s->packetCapacity = want;
+                }
+            }
+            keep = s->packetCapacity - s->packetSize;
+            if(keep < 0) keep = 0;
+        }
+
+        memcpy(s->packet + s->packetSize, s->body + s->bodyPos, keep);
+        s->packetSize += keep;
+        s->bodyPos += size;
+
+        if(!complete) continue;
+
+        int drop = s->dropPacket;
+        s->dropPacket = 0;
+
+        // Only the last packet finishing on a page owns its granule
+        int last = 1;
+        for(int i = s->segment; i < s->page.segments; i++) {
+            if(s->page.lacing[i] < 255) {
+                last = 0;
+                break;
+            }
+        }
+        s->granule = last ? s->page.granule : -1;
+        if(last && (s->page.flags & OGG_PAGE_EOS)) s->eos = 1;
+
+        if(drop) {
+            s->packetSize = 0;
+            continue;
+        }
+
+        memset(s->packet + s->packetSize, 0, 8);
+        s->packetReady = 1;
+        return 1;
+    }
+}
+
+void SeekOggStream(OggStream* s, s64 pageOffset) {
+    s->nextPage = pageOffset;
+    s->havePage = 0;
+    s->packetSize = 0;
+    s->packetReady = 0;
+    s->dropPacket = 0;
+    s->granule = -1;
+    s->eos = 0;
+}
+
+s64 FindOggGranulePage(OggStream* s, s64 from, s64 end, OggPage* page) {
+    s->havePage = 0;
+
+    while(from < end) {
+        s64 offset = FindOggPage(s->io, from, end, page, s->body);
+        if(offset < 0) return -1;
+
+        if(page->serial == s->serial && page->granule >= 0) return offset;
+        from = offset + page->size;
+    }
+
+    return -1;
+}
+
+s64 FindLastOggGranule(OggStream* s) {
+    OggPage page;
+    s64 end = s->end;
+    s64 chunk = 64 * 1024;
+
+    s->havePage = 0;
+
+    // Walk back in growing steps and take the last page found in the step
+    while(end > 0 && s->end - end < OGG_MAX_TAIL_SCAN) {
+        s64 from = end - chunk > 0 ? end - chunk : 0;
+        s64 granule = -1;
+        s64 pos = from;
+
+        while((pos = FindOggGranulePage(s, pos, end, &page)) >= 0) {
+            granule = page.granule;
+            pos += page.size;
+        }
+        if(granule >= 0) return granule;
+
+        end = from;
+        chunk *= 2;
+    }
+
+    return -1;
+}
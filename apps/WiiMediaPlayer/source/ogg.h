@@ -0,0 +1,67 @@
+#ifndef OGG_H
+#define OGG_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+// Ogg page reader. Pages are read whole and CRC checked, packets of one
+// logical stream are reassembled across pages. Nothing here allocates
+// after OpenOggStream() except while the stream is in its header phase.
+
+#define OGG_MAX_PAGE_BODY (255 * 255)
+#define OGG_MAX_PAGE_SIZE (27 + 255 + OGG_MAX_PAGE_BODY)
+
+// Header type flags
+#define OGG_PAGE_CONTINUED 0x01
+#define OGG_PAGE_BOS       0x02
+#define OGG_PAGE_EOS       0x04
+
+typedef struct {
+    s64 offset;         // of the "OggS" capture pattern
+    int size;           // header, lacing and body
+    int flags;
+    s64 granule;        // -1 when no packet ends on this page
+    u32 serial;
+    u32 sequence;
+    int segments;
+    u8 lacing[255];
+} OggPage;
+
+typedef struct {
+    MediaIO* io;
+    u32 serial;
+    s64 end;            // pages must start before this offset
+    s64 nextPage;       // where the next page is read from
+
+    OggPage page;
+    u8* body;
+    int segment;        // next lacing value of the current page
+    int bodyPos;
+    int havePage;
+    int dropPacket;     // the packet being assembled started before a seek
+
+    u8* packet;         // followed by 8 zero bytes for bit readers
+    int packetSize;
+    int packetReady;    // packet was returned, the next read starts over
+    int packetCapacity;
+    int packetLimit;    // capacity may grow up to this, then packets are cut
+    s64 granule;        // page granule if the packet ended that page, else -1
+    int eos;
+} OggStream;
+
+// Function prototypes
+int ReadOggPage(MediaIO* io, s64 offset, OggPage* page, u8* body);
+s64 FindOggPage(MediaIO* io, s64 from, s64 end, OggPage* page, u8* body);
+
+int OpenOggStream(OggStream* s, MediaIO* io, s64 start, s64 end, int packetLimit);
+void CloseOggStream(OggStream* s);
+int ReadOggPacket(OggStream* s);
+void SeekOggStream(OggStream* s, s64 pageOffset);
+int SetOggPacketLimit(OggStream* s, int size);
+
+// Next page of this stream at or after from that carries a granule
+s64 FindOggGranulePage(OggStream* s, s64 from, s64 end, OggPage* page);
+// Granule of the last page of this stream, -1 if none is found
+s64 FindLastOggGranule(OggStream* s);
+
+#endif // OGG_H
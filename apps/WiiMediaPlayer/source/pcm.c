@@ -0,0 +1,98 @@
+#include <string.h>
+#include <stdint.h>
+#include "pcm.h"
+
+// Word access that is allowed to alias the s16 sample buffers
+typedef u32 __attribute__((may_alias)) AliasU32;
+
+// Reverse the bytes inside both 16-bit lanes of a word. On Broadway this is
+// a byte-reversed load plus one rotate, so two samples cost two instructions.
+static inline u32 SwapLanes16(u32 w) {
+    w = __builtin_bswap32(w);
+    return (w >> 16) | (w << 16);
+}
+
+void SwapSamples16(s16* dst, const s16* src, int count) {
+    int i = 0;
+
+    // The word path needs both pointers at the same alignment
+    if((((uintptr_t)dst ^ (uintptr_t)src) & 3) == 0) {
+        // Scalar head up to a 4-byte boundary
+        if(((uintptr_t)src & 3) && count > 0) {
+            u16 s = (u16)src[0];
+            dst[0] = (s16)((s >> 8) | (s << 8));
+            i = 1;
+        }
+
+        const AliasU32* in = (const AliasU32*)(src + i);
+        AliasU32* out = (AliasU32*)(dst + i);
+        int words = (count - i) >> 1;
+        int w = 0;
+
+        // Four words (eight samples) per iteration keeps the load/store
+        // units busy and hides the load latency
+        for(; w + 4 <= words; w += 4) {
+            u32 a = in[w];
+            u32 b = in[w + 1];
+            u32 c = in[w + 2];
+            u32 d = in[w + 3];
+            out[w] = SwapLanes16(a);
+            out[w + 1] = SwapLanes16(b);
+            out[w + 2] = SwapLanes16(c);
+            out[w + 3] = SwapLanes16(d);
+        }
+        for(; w < words; w++) {
+            out[w] = SwapLanes16(in[w]);
+        }
+
+        i += words << 1;
+    }
+
+    // Scalar tail (or the whole buffer when alignments differ)
+    for(; i < count; i++) {
+        u16 s = (u16)src[i];
+        dst[i] = (s16)((s >> 8) | (s << 8));
+    }
+}
+
+void ConvertSamplesS16LE(s16* dst, const s16* src, int count) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    SwapSamples16(dst, src, count);
+#else
+    if(dst != src) {
+        memmove(dst, src, count * sizeof(s16));
+    }
+#endif
+}
+
+void ConvertSamplesU8(s16* dst, const u8* src, int count) {
+    // Back to front so the conversion can run in place
+    for(int i = count - 1; i >= 0; i--) {
+        dst[i] = (s16)((src[i] - 128) << 8);
+    }
+}
+
+void ConvertSamplesS24LE(s16* dst, const u8* src, int count) {
+    // Keep the top 16 bits of each sample
+    for(int i = 0; i < count; i++) {
+        dst[i] = (s16)(src[1] | (src[2] << 8));
+        src += 3;
+    }
+}
+
+void ConvertSamplesS32LE(s16* dst, const u8* src, int count) {
+    for(int i = 0; i < count; i++) {
+        dst[i] = (s16)(src[2] | (src[3] << 8));
+        src += 4;
+    }
+}
+
+int PadSamples32(void* buffer, int size) {
+    int padded = (size + 31) & ~31;
+
+    if(padded > size) {
+        memset((u8*)buffer + size, 0, padded - size);
+    }
+
+    return padded;
+}
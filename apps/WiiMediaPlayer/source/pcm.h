@@ -0,0 +1,28 @@
+#ifndef PCM_H
+#define PCM_H
+
+#include "platform.h"
+
+// Sample conversion kernels. Everything the decoders hand to ASND is
+// interleaved signed 16-bit PCM in native (big-endian on Broadway) order.
+
+// Reverse the byte order of 16-bit samples. dst may equal src.
+void SwapSamples16(s16* dst, const s16* src, int count);
+
+// Little-endian 16-bit to native order: the swap kernel on the Wii, a copy
+// on little-endian hosts. dst may equal src.
+void ConvertSamplesS16LE(s16* dst, const s16* src, int count);
+
+// Unsigned 8-bit (WAV) to signed 16-bit. dst may equal src when the
+// output is written back to front, which this kernel does.
+void ConvertSamplesU8(s16* dst, const u8* src, int count);
+
+// Little-endian 24-bit and 32-bit integer PCM down to 16 bits.
+void ConvertSamplesS24LE(s16* dst, const u8* src, int count);
+void ConvertSamplesS32LE(s16* dst, const u8* src, int count);
+
+// Zero the tail of a buffer up to the next 32-byte boundary and return
+// the padded size. ASND and the DSP DMA want 32-byte multiples.
+int PadSamples32(void* buffer, int size);
+
+#endif // PCM_H
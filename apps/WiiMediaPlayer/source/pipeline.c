@@ -0,0 +1,526 @@
+#include <string.h>
+#include "mem2.h"
+#include "pipeline.h"
+
+#ifdef GEKKO
+static lwp_t decodeThread = LWP_THREAD_NULL;
+static mutex_t decodeMutex = LWP_MUTEX_NULL;
+static cond_t wakeCond = LWP_COND_NULL;     // the decode thread waits for work
+static cond_t seekCond = LWP_COND_NULL;     // SeekPipeline waits for the decoder
+static u8 decodeStack[32768] ATTRIBUTE_ALIGN(8);
+
+#define Lock()           LWP_MutexLock(decodeMutex)
+#define Unlock()         LWP_MutexUnlock(decodeMutex)
+#define Wait(cond)       LWP_CondWait(cond, decodeMutex)
+#define Signal(cond)     LWP_CondSignal(cond)
+#else
+#include <pthread.h>
+
+static pthread_t decodeThread;
+static pthread_mutex_t decodeMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t seekCond = PTHREAD_COND_INITIALIZER;
+
+#define Lock()           pthread_mutex_lock(&decodeMutex)
+#define Unlock()         pthread_mutex_unlock(&decodeMutex)
+#define Wait(cond)       pthread_cond_wait(&cond, &decodeMutex)
+#define Signal(cond)     pthread_cond_signal(&cond)
+#endif
+
+// The frames and packets never need the mutex, only sleeping does: the
+// counters below are touched under it
+static Pipeline* threadPipeline = NULL;
+static volatile int decodeRunning = 0;
+static u32 wakeups = 0;         // pokes from the UI so far
+static u32 seeksAsked = 0;
+static u32 seeksDone = 0;
+
+// Raw 4:2:2 is the XFB layout already, or one byte swap from it
+static int DecodeYUY2(const u8* packet, int size, u8* frame, int width, int height) {
+    int frameSize = width * height * 2;
+    if(size < frameSize) return -1;
+
+    memcpy(frame, packet, frameSize);
+    return 0;
+}
+
+static int DecodeUYVY(const u8* packet, int size, u8* frame, int width, int height) {
+    int frameSize = width * height * 2;
+    if(size < frameSize) return -1;
+
+    for(int i = 0; i < frameSize; i += 2) {
+        frame[i] = packet[i + 1];
+        frame[i + 1] = packet[i];
+    }
+    return 0;
+}
+
+static const struct {
+    const char* codec;
+    PipelineDecodeFunc decode;
+} decoders[] = {
+    {"YUY2", DecodeYUY2},
+    {"YUYV", DecodeYUY2},
+    {"YUNV", DecodeYUY2},
+    {"UYVY", DecodeUYVY},
+    {"2vuy", DecodeUYVY},       // QuickTime's name for it
+};
+
+PipelineDecodeFunc FindPipelineDecoder(const char* codec) {
+    for(int i = 0; i < (int)(sizeof(decoders) / sizeof(decoders[0])); i++) {
+        if(strcmp(codec, decoders[i].codec) == 0) return decoders[i].decode;
+    }
+    return NULL;
+}
+
+static void CountItem(PipelineStageStats* stage, u32 work) {
+    stage->count++;
+    stage->averageMicroseconds = stage->count == 1 ? work
+                                 : stage->averageMicroseconds + ((s32)work - (s32)stage->averageMicroseconds) / 8;
+    if(work > stage->worstMicroseconds) stage->worstMicroseconds = work;
+}
+
+static void CountLatency(PipelineStageStats* stage, u32 latency) {
+    stage->averageLatency += ((s32)latency - (s32)stage->averageLatency) / 8;
+}
+
+static void SetDepth(PipelineStageStats* stage, u32 depth) {
+    stage->depth = depth;
+    if(depth > stage->peak) stage->peak = depth;
+}
+
+int OpenPipeline(Pipeline* pipeline, VideoDecoder* decoder) {
+    memset(pipeline, 0, sizeof(Pipeline));
+    if(!decoder || decoder->width <= 0 || decoder->height <= 0) return -1;
+
+    // Nothing could be shown, and the thread would read the whole file
+    pipeline->decode = FindPipelineDecoder(decoder->info.codec);
+    if(!pipeline->decode) return -1;
+
+    pipeline->decoder = decoder;
+    pipeline->width = decoder->width & ~1;
+    pipeline->height = decoder->height;
+    pipeline->frameNanoseconds = decoder->info.frameNanoseconds;
+    if(!pipeline->frameNanoseconds) pipeline->frameNanoseconds = 1000000000 / (decoder->fps > 0 ? decoder->fps : 25);
+    pipeline->nextFrame = decoder->currentPosition;
+    pipeline->keyframeWanted = -1;
+    pipeline->keyframeDecoded = -1;
+    pipeline->keyframeLanded = -1;
+
+    InitSpscQueue(&pipeline->ready, pipeline->readySlots, sizeof(PipelineFrame*), PIPELINE_FRAMES);
+    InitSpscQueue(&pipeline->returned, pipeline->returnedSlots, sizeof(PipelineFrame*), PIPELINE_FRAMES);
+    InitSpscQueue(&pipeline->commands, pipeline->commandSlots, sizeof(PipelineCommand), PIPELINE_COMMANDS);
+
+    // A raw frame is the largest packet there can be
+    u32 frameSize = pipeline->width * pipeline->height * 2;
+    pipeline->packetMax = (frameSize + 31) & ~31;
+    if(pipeline->packetMax < PIPELINE_MIN_PACKET) pipeline->packetMax = PIPELINE_MIN_PACKET;
+    pipeline->ringSize = pipeline->packetMax * PIPELINE_RING_PACKETS;
+
+    pipeline->ring = Mem2Alloc(pipeline->ringSize);
+    int failed = !pipeline->ring;
+    for(int i = 0; i < PIPELINE_FRAMES; i++) {
+        pipeline->frames[i].data = Mem2Alloc(frameSize);
+        if(!pipeline->frames[i].data) failed = 1;
+        pipeline->spare[pipeline->spareCount++] = &pipeline->frames[i];
+    }
+    if(failed) {
+        ClosePipeline(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+static void StopPipelineThread() {
+    Lock();
+    decodeRunning = 0;
+    Signal(wakeCond);
+    Unlock();
+
+#ifdef GEKKO
+    LWP_JoinThread(decodeThread, NULL);
+    decodeThread = LWP_THREAD_NULL;
+#else
+    pthread_join(decodeThread, NULL);
+#endif
+    threadPipeline->threaded = 0;
+    threadPipeline = NULL;
+}
+
+void ClosePipeline(Pipeline* pipeline) {
+    if(threadPipeline == pipeline) StopPipelineThread();
+
+    Mem2Free(pipeline->ring);
+    for(int i = 0; i < PIPELINE_FRAMES; i++) Mem2Free(pipeline->frames[i].data);
+    memset(pipeline, 0, sizeof(Pipeline));
+}
+
+static void ClearPackets(Pipeline* pipeline) {
+    pipeline->taken = pipeline->queued;
+    pipeline->ringHead = 0;
+    pipeline->ringTail = 0;
+}
+
+static void AnswerKeyframe(Pipeline* pipeline, s64 keyframe) {
+    pipeline->keyframeWanted = -1;
+    pipeline->keyframeLanded = keyframe;
+    __atomic_store_n(&pipeline->keyframesAnswered, pipeline->keyframesAnswered + 1, __ATOMIC_RELEASE);
+}
+
+// Decoder side. Frames decoded before a seek are left in the ready queue
+// for the presenter to hand back, since only the UI may pop it.
+static int RunCommands(Pipeline* pipeline) {
+    VideoDecoder* decoder = pipeline->decoder;
+    PipelineCommand command;
+    int ran = 0;
+
+    while(PopSpscQueue(&pipeline->commands, &command) == 0) {
+        ran = 1;
+        if(command.type == PIPELINE_KEYFRAME) {
+            // What was read in order is no use from here
+            if(!pipeline->trick || command.generation != pipeline->generation) {
+                ClearPackets(pipeline);
+                pipeline->trick = 1;
+                pipeline->drained = 0;
+                pipeline->generation = command.generation;
+                pipeline->keyframeDecoded = -1;
+            }
+            pipeline->keyframeWanted = command.target;
+            continue;
+        }
+
+        // A request the seek overtook still gets its answer
+        if(pipeline->keyframeWanted >= 0) AnswerKeyframe(pipeline, -1);
+
+        s64 landed = -1;
+        if(command.type == PIPELINE_SEEK_FRAME) landed = SeekVideoKeyframe(decoder, command.target);
+        else if(SeekVideoDecoder(decoder, (int)command.target) == 0) landed = decoder->currentPosition;
+
+        pipeline->seekResult = -1;
+        if(landed >= 0) {
+            ClearPackets(pipeline);
+            pipeline->nextFrame = decoder->currentPosition;
+            pipeline->ended = 0;
+            pipeline->drained = 0;
+            pipeline->trick = 0;
+            pipeline->generation = command.generation;
+            pipeline->seekResult = GetPipelineFrameTime(pipeline, pipeline->nextFrame);
+        }
+        if(pipeline->threaded) {
+            Lock();
+            seeksDone++;
+            Signal(seekCond);
+            Unlock();
+        }
+    }
+    return ran;
+}
+
+static s64 SeekPipelineTo(Pipeline* pipeline, PipelineCommandType type, s64 target) {
+    if(!pipeline->decoder) return -1;
+
+    PipelineCommand command = {type, target, pipeline->presentGeneration + 1};
+    if(PushSpscQueue(&pipeline->commands, &command) != 0) return -1;
+
+    if(pipeline->threaded) {
+        Lock();
+        u32 asked = ++seeksAsked;
+        wakeups++;
+        Signal(wakeCond);
+        while(seeksDone != asked) Wait(seekCond);
+        Unlock();
+    } else {
+        RunCommands(pipeline);
+    }
+
+    // From here the presenter skips whatever was decoded before. The
+    // decoder only changes these for commands, and has none left.
+    pipeline->presentGeneration = pipeline->generation;
+    pipeline->trickRequested = pipeline->trick;
+    return pipeline->seekResult;
+}
+
+s64 SeekPipeline(Pipeline* pipeline, int seconds) {
+    return SeekPipelineTo(pipeline, PIPELINE_SEEK, seconds);
+}
+
+s64 SeekPipelineFrame(Pipeline* pipeline, s64 frame) {
+    return SeekPipelineTo(pipeline, PIPELINE_SEEK_FRAME, frame);
+}
+
+// Where the next packet can go, -1 if the ring has no packetMax in one
+// piece. Used bytes run from the tail to the head, or from the tail to
+// the end and then from 0 to the head once a packet has wrapped; the
+// head never catches the tail from behind, so equal means empty.
+static s64 FindRoom(const Pipeline* pipeline) {
+    u32 head = pipeline->ringHead, tail = pipeline->ringTail, need = pipeline->packetMax;
+
+    if(pipeline->queued == pipeline->taken) return 0;
+    if(head > tail) {
+        if(pipeline->ringSize - head >= need) return head;
+        if(tail > need) return 0;
+    } else if(tail - head > need) {
+        return head;
+    }
+    return -1;
+}
+
+static int DemuxPacket(Pipeline* pipeline) {
+    if(pipeline->ended || pipeline->queued - pipeline->taken >= PIPELINE_PACKETS) return 0;
+
+    s64 offset = FindRoom(pipeline);
+    if(offset < 0) return 0;
+
+    u64 start = NowMicroseconds();
+    int size = ReadVideoFrame(pipeline->decoder, pipeline->ring + offset, pipeline->packetMax);
+    if(size == MEDIA_FRAME_TOO_BIG) {
+        // Gone whole, so the frames after it keep their times
+        pipeline->stats.oversized++;
+        pipeline->nextFrame++;
+        return 1;
+    }
+    if(size <= 0) {
+        pipeline->ended = 1;
+        return 0;
+    }
+
+    PipelinePacket* packet = &pipeline->packets[pipeline->queued % PIPELINE_PACKETS];
+    packet->offset = (u32)offset;
+    packet->size = size;
+    packet->pts = GetPipelineFrameTime(pipeline, pipeline->nextFrame);
+    packet->queuedAt = NowMicroseconds();
+    pipeline->nextFrame++;
+
+    pipeline->ringHead = (u32)offset + ((size + 31) & ~31);
+    pipeline->queued++;
+
+    CountItem(&pipeline->stats.demux, (u32)(packet->queuedAt - start));
+    return 1;
+}
+
+// Takes back what the presenter has finished with
+static int HaveSpareFrame(Pipeline* pipeline) {
+    PipelineFrame* frame;
+    while(PopSpscQueue(&pipeline->returned, &frame) == 0) pipeline->spare[pipeline->spareCount++] = frame;
+    return pipeline->spareCount > 0;
+}
+
+static int DecodePacket(Pipeline* pipeline) {
+    if(!HaveSpareFrame(pipeline)) return 0;
+    if(pipeline->taken == pipeline->queued) {
+        if(!pipeline->ended) pipeline->stats.starved++;
+        return 0;
+    }
+
+    PipelineFrame* frame = pipeline->spare[pipeline->spareCount - 1];
+    const PipelinePacket* packet = &pipeline->packets[pipeline->taken % PIPELINE_PACKETS];
+    u64 start = NowMicroseconds();
+    CountLatency(&pipeline->stats.demux, (u32)(start - packet->queuedAt));
+    int decoded = pipeline->decode(pipeline->ring + packet->offset, packet->size, frame->data,
+                                   pipeline->width, pipeline->height) == 0;
+    u64 end = NowMicroseconds();
+    s64 pts = packet->pts;
+
+    // The packet's bytes are free now; the tail moves to the next one
+    pipeline->taken++;
+    if(pipeline->taken == pipeline->queued) ClearPackets(pipeline);
+    else pipeline->ringTail = pipeline->packets[pipeline->taken % PIPELINE_PACKETS].offset;
+
+    if(!decoded) {
+        pipeline->stats.undecodable++;
+        return 1;
+    }
+
+    frame->pts = pts;
+    frame->generation = pipeline->generation;
+    frame->readyAt = end;
+    pipeline->spareCount--;
+    PushSpscQueue(&pipeline->ready, &frame);    // never full: it has a slot per frame
+    CountItem(&pipeline->stats.decode, (u32)(end - start));
+    return 1;
+}
+
+// Trick play: the keyframe asked for, read and decoded on its own
+static void FetchKeyframe(Pipeline* pipeline) {
+    u64 start = NowMicroseconds();
+    s64 keyframe = SeekVideoKeyframe(pipeline->decoder, pipeline->keyframeWanted);
+
+    if(keyframe >= 0 && keyframe != pipeline->keyframeDecoded) {
+        PipelineFrame* frame = pipeline->spare[pipeline->spareCount - 1];
+        int size = ReadVideoFrame(pipeline->decoder, pipeline->ring, pipeline->packetMax);
+        if(size > 0 && pipeline->decode(pipeline->ring, size, frame->data, pipeline->width, pipeline->height) == 0) {
+            u64 end = NowMicroseconds();
+            frame->pts = GetPipelineFrameTime(pipeline, keyframe);
+            frame->generation = pipeline->generation;
+            frame->readyAt = end;
+            pipeline->spareCount--;
+            PushSpscQueue(&pipeline->ready, &frame);
+            pipeline->keyframeDecoded = keyframe;
+            CountItem(&pipeline->stats.decode, (u32)(end - start));
+        } else if(size == MEDIA_FRAME_TOO_BIG) {
+            pipeline->stats.oversized++;
+        } else {
+            pipeline->stats.undecodable++;
+        }
+    }
+    // After the frame is in the ready queue
+    AnswerKeyframe(pipeline, keyframe);
+}
+
+// Seeks, then demux and decode as far as they go; 1 if anything moved
+static int StepPipeline(Pipeline* pipeline) {
+    int moved = RunCommands(pipeline);
+
+    if(pipeline->trick) {
+        if(pipeline->keyframeWanted < 0 || !HaveSpareFrame(pipeline)) return moved;
+        FetchKeyframe(pipeline);
+        return 1;
+    }
+
+    while(DemuxPacket(pipeline)) moved = 1;
+    while(DecodePacket(pipeline)) moved = 1;
+
+    SetDepth(&pipeline->stats.demux, pipeline->queued - pipeline->taken);
+    // After the last frame is in the ready queue, so the UI never sees it
+    // drained with one still to come
+    __atomic_store_n(&pipeline->drained, pipeline->ended && pipeline->taken == pipeline->queued, __ATOMIC_RELEASE);
+    return moved;
+}
+
+static void* DecodeThread(void* arg) {
+    Pipeline* pipeline = arg;
+    u32 seen = 0;
+
+    for(;;) {
+        Lock();
+        while(decodeRunning && wakeups == seen) Wait(wakeCond);
+        seen = wakeups;
+        Unlock();
+        if(!decodeRunning) break;
+
+        while(StepPipeline(pipeline)) {}
+    }
+    return NULL;
+}
+
+int StartPipelineThread(Pipeline* pipeline, int priority) {
+    if(!pipeline->decoder || threadPipeline) return -1;
+
+    threadPipeline = pipeline;
+    pipeline->threaded = 1;
+    decodeRunning = 1;
+    wakeups = 1;                // so it starts with a pass
+    seeksAsked = seeksDone = 0;
+
+#ifdef GEKKO
+    if(decodeMutex == LWP_MUTEX_NULL) {
+        LWP_MutexInit(&decodeMutex, false);
+        LWP_CondInit(&wakeCond);
+        LWP_CondInit(&seekCond);
+    }
+
+    if(LWP_CreateThread(&decodeThread, DecodeThread, pipeline, decodeStack, sizeof(decodeStack), priority) < 0) {
+        decodeThread = LWP_THREAD_NULL;
+#else
+    (void)priority;
+    if(pthread_create(&decodeThread, NULL, DecodeThread, pipeline) != 0) {
+#endif
+        decodeRunning = 0;
+        pipeline->threaded = 0;
+        threadPipeline = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void RunPipeline(Pipeline* pipeline) {
+    if(!pipeline->decoder || pipeline->threaded) return;
+
+    StepPipeline(pipeline);
+    SetDepth(&pipeline->stats.decode, GetSpscQueueDepth(&pipeline->ready));
+}
+
+static void WakeDecoder(Pipeline* pipeline) {
+    if(!pipeline->threaded) return;
+
+    Lock();
+    wakeups++;
+    Signal(wakeCond);
+    Unlock();
+}
+
+// The decode thread may be waiting for a frame to reuse
+static void ReturnFrame(Pipeline* pipeline, PipelineFrame* frame) {
+    PushSpscQueue(&pipeline->returned, &frame);
+    WakeDecoder(pipeline);
+}
+
+int RequestPipelineKeyframe(Pipeline* pipeline, s64 frame) {
+    if(!pipeline->decoder || !PollPipelineKeyframe(pipeline, NULL)) return -1;
+
+    // Frames decoded in order go back unseen
+    if(!pipeline->trickRequested) {
+        pipeline->presentGeneration++;
+        pipeline->trickRequested = 1;
+    }
+    PipelineCommand command = {PIPELINE_KEYFRAME, frame, pipeline->presentGeneration};
+    if(PushSpscQueue(&pipeline->commands, &command) != 0) return -1;
+
+    pipeline->keyframesAsked++;
+    WakeDecoder(pipeline);
+    return 0;
+}
+
+int PollPipelineKeyframe(Pipeline* pipeline, s64* keyframe) {
+    if(pipeline->keyframesAsked != __atomic_load_n(&pipeline->keyframesAnswered, __ATOMIC_ACQUIRE)) return 0;
+
+    if(keyframe) *keyframe = pipeline->keyframeLanded;
+    return 1;
+}
+
+const PipelineFrame* PresentPipelineFrame(Pipeline* pipeline, s64 clock) {
+    PipelineFrame* due = NULL;
+    PipelineFrame* const* next;
+
+    // The ready queue is in pts order; take everything that's due
+    while((next = PeekSpscQueue(&pipeline->ready))) {
+        PipelineFrame* frame = *next;
+        int stale = frame->generation != pipeline->presentGeneration;
+        if(!stale && frame->pts > clock) break;
+
+        PopSpscQueue(&pipeline->ready, NULL);
+        if(stale) {
+            ReturnFrame(pipeline, frame);
+            continue;
+        }
+        // Anything older was never shown in time
+        if(due) {
+            ReturnFrame(pipeline, due);
+            pipeline->stats.dropped++;
+        }
+        due = frame;
+    }
+    if(!due) {
+        pipeline->stats.repeated++;
+        return NULL;
+    }
+
+    if(pipeline->shown) ReturnFrame(pipeline, pipeline->shown);
+    pipeline->shown = due;
+
+    PipelineStageStats* present = &pipeline->stats.present;
+    CountItem(present, 0);
+    CountLatency(&pipeline->stats.decode, (u32)(NowMicroseconds() - due->readyAt));
+    CountLatency(present, (u32)((clock - due->pts) * 1000));
+    SetDepth(present, 1);
+    SetDepth(&pipeline->stats.decode, GetSpscQueueDepth(&pipeline->ready));
+    return due;
+}
+
+s64 GetPipelineFrameTime(const Pipeline* pipeline, s64 frame) {
+    return frame * pipeline->frameNanoseconds / 1000000;
+}
+
+int IsPipelineFinished(const Pipeline* pipeline) {
+    return __atomic_load_n(&pipeline->drained, __ATOMIC_ACQUIRE) && GetSpscQueueDepth(&pipeline->ready) == 0;
+}
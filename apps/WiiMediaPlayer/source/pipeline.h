@@ -0,0 +1,187 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "platform.h"
+#include "decoder.h"
+#include "spsc.h"
+
+// Video playback in three stages: the demuxer's packets go into a bounded
+// queue, the decoder turns them into frames from a fixed pool, and the
+// presenter picks the frame due at the playback clock. Everything is
+// allocated when the file is opened (the packet ring and the frame pool
+// in MEM2, mem2.h) and reused, so steady playback allocates nothing.
+//
+// Packets are copied into a ring, each taking its size rounded up to 32
+// bytes; a read is only started with packetMax bytes free in one piece,
+// so no packet is ever cut short. Descriptors are handed over through
+// counters that only increase (slot n % count), as in the audio stream.
+//
+// Demux and decode can run on a thread of their own (StartPipelineThread)
+// so a slow picture never holds up the UI. It then owns the packets and
+// the frames not yet decoded; decoded frames go to the UI through the
+// ready queue and come back through returned, and seeks go the other way
+// through commands, all single-producer single-consumer (spsc.h). A seek
+// bumps the generation, and frames decoded before it are handed back
+// unseen. Without the thread RunPipeline does the same work in the
+// caller, as the benches do.
+//
+// For trick play the decoder stops reading in order and fetches single
+// keyframes on request, found through the container's index
+// (SeekVideoKeyframe); one request is out at a time, so how many it
+// fetches follows how fast it can decode them.
+//
+// Timestamps are milliseconds from the frame number (the decoder's
+// position after a seek, counting up from there) times the stream's
+// exact frame duration, so they don't wander from the audio on files
+// whose rate isn't a whole number.
+#define PIPELINE_PACKETS        16     // queued packets
+#define PIPELINE_FRAMES         4      // decoded frames, the one on screen included
+#define PIPELINE_RING_PACKETS   4      // ring size in largest packets
+#define PIPELINE_MIN_PACKET     (64 << 10)
+#define PIPELINE_COMMANDS       4      // seeks waiting for the decode thread
+#define PIPELINE_PRIORITY       64     // under audio (80) and read-ahead (72)
+
+// Decodes one packet into a width x height YCbYCr frame. Returns 0, or
+// -1 if the packet gave no picture.
+typedef int (*PipelineDecodeFunc)(const u8* packet, int size, u8* frame, int width, int height);
+
+typedef struct {
+    u32 depth;              // items waiting in the stage's output now
+    u32 peak;               // most at once
+    u32 count;              // items out of the stage
+    u32 averageMicroseconds;    // work per item, running average
+    u32 worstMicroseconds;
+    u32 averageLatency;     // microseconds an item waited for the next stage;
+                            // for present, how late against the clock
+} PipelineStageStats;
+
+typedef struct {
+    PipelineStageStats demux;       // packets queued
+    PipelineStageStats decode;      // frames decoded
+    PipelineStageStats present;     // frames shown, no work of its own
+    u32 dropped;            // decoded, then too late to show
+    u32 repeated;           // presenter calls with nothing new
+    u32 undecodable;        // packets the decoder failed on
+    u32 oversized;          // frames over packetMax, skipped by the demuxer
+    u32 starved;            // decode passes with a free frame but no packet
+} PipelineStats;
+
+typedef struct {
+    u8* data;
+    s64 pts;
+    u32 generation;         // the seek it was decoded after
+    u64 readyAt;            // microseconds
+} PipelineFrame;
+
+typedef enum {
+    PIPELINE_SEEK,          // to target seconds, and play on
+    PIPELINE_SEEK_FRAME,    // to the keyframe at or before frame target, and play on
+    PIPELINE_KEYFRAME       // trick play: that keyframe alone
+} PipelineCommandType;
+
+typedef struct {
+    PipelineCommandType type;
+    s64 target;
+    u32 generation;         // the frames it gives belong to
+} PipelineCommand;
+
+typedef struct {
+    u32 offset;
+    u32 size;
+    s64 pts;
+    u64 queuedAt;
+} PipelinePacket;
+
+typedef struct {
+    VideoDecoder* decoder;
+    PipelineDecodeFunc decode;
+    int width;
+    int height;
+    u32 frameNanoseconds;   // the stream's, or 1/fps when it has none
+
+    u8* ring;
+    u32 ringSize;
+    u32 packetMax;
+    u32 ringHead;           // where the next packet goes
+    u32 ringTail;           // start of the oldest queued packet
+    PipelinePacket packets[PIPELINE_PACKETS];
+    u32 queued;             // packets in so far
+    u32 taken;              // and out to the decoder
+    s64 nextFrame;          // frame number of the next packet
+    int ended;
+
+    PipelineFrame frames[PIPELINE_FRAMES];
+    PipelineFrame* spare[PIPELINE_FRAMES];     // the decoder's free frames
+    int spareCount;
+    u32 generation;         // decoder's
+    int drained;            // demux ended and every packet decoded
+    s64 seekResult;
+    int trick;              // fetching keyframes instead of playing
+    s64 keyframeWanted;     // -1 when none
+    s64 keyframeDecoded;    // the last one, -1 for none this generation
+    s64 keyframeLanded;     // for the last request answered
+    u32 keyframesAnswered;
+
+    // Decoder to UI, UI to decoder
+    SpscQueue ready;
+    SpscQueue returned;
+    SpscQueue commands;
+    PipelineFrame* readySlots[PIPELINE_FRAMES];
+    PipelineFrame* returnedSlots[PIPELINE_FRAMES];
+    PipelineCommand commandSlots[PIPELINE_COMMANDS];
+
+    PipelineFrame* shown;
+    u32 presentGeneration;  // UI's
+    u32 keyframesAsked;
+    int trickRequested;
+    int threaded;
+
+    PipelineStats stats;
+} Pipeline;
+
+// Function prototypes
+
+// The decoder is kept open by the caller. Returns 0, or -1 if the video
+// has no size, there is no decoder for its codec (FindPipelineDecoder) or
+// MEM2 is short; nothing is left allocated then.
+int OpenPipeline(Pipeline* pipeline, VideoDecoder* decoder);
+void ClosePipeline(Pipeline* pipeline);
+// Moves demux and decode onto a thread at priority (PIPELINE_PRIORITY on
+// the Wii; ignored on the host). One pipeline at a time. Returns 0, or -1
+// if it could not start, and the pipeline stays in the caller's thread.
+int StartPipelineThread(Pipeline* pipeline, int priority);
+// Seeks the decoder and drops everything queued and decoded, but not the
+// frame on screen; with the thread running, waits for it to get there.
+// Returns the ms it landed on, -1 if the seek failed. Either seek ends
+// trick play.
+s64 SeekPipeline(Pipeline* pipeline, int seconds);
+// The same to the last keyframe at or before a frame number
+s64 SeekPipelineFrame(Pipeline* pipeline, s64 frame);
+
+// Trick play, UI side. Asks for the keyframe at or before frame alone,
+// dropping what was decoded in order; it comes to PresentPipelineFrame
+// with that keyframe's time. Returns -1 while the last request is out.
+int RequestPipelineKeyframe(Pipeline* pipeline, s64 frame);
+// 1 once the last request has been answered, with the keyframe it landed
+// on (-1 if the seek failed); the picture is only decoded if it differs
+// from the last one. 0 while it's still out.
+int PollPipelineKeyframe(Pipeline* pipeline, s64* keyframe);
+
+// Without the thread: demuxes until the queue or the ring is full, then
+// decodes while there are packets and free frames. Call it every pass of
+// the main loop; it does nothing while the thread is running.
+void RunPipeline(Pipeline* pipeline);
+// UI side. The latest frame due at clock (ms), retiring the ones it
+// passes, or NULL if nothing new is due; the frame stays valid until the
+// next call.
+const PipelineFrame* PresentPipelineFrame(Pipeline* pipeline, s64 clock);
+// 1 once everything demuxed has been decoded and shown
+int IsPipelineFinished(const Pipeline* pipeline);
+// When a frame number is due, in ms
+s64 GetPipelineFrameTime(const Pipeline* pipeline, s64 frame);
+
+// The decoder for a codec name (MediaStreamInfo.codec), NULL if none.
+// Uncompressed YUY2 and UYVY only so far.
+PipelineDecodeFunc FindPipelineDecoder(const char* codec);
+
+#endif // PIPELINE_H
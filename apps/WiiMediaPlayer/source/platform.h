@@ -0,0 +1,38 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Basic types and the clock for the modules that also build with the
+// host compiler ("make host"). On the Wii everything comes from libogc.
+#ifdef GEKKO
+#include <gccore.h>
+#include <ogc/lwp_watchdog.h>
+
+static inline u64 NowMicroseconds() {
+    return ticks_to_microsecs(gettime());
+}
+#else
+#include <stdint.h>
+#include <time.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+#ifndef ATTRIBUTE_ALIGN
+#define ATTRIBUTE_ALIGN(v) __attribute__((aligned(v)))
+#endif
+
+// Monotonic, for timing work and waits
+static inline u64 NowMicroseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+#endif // PLATFORM_H
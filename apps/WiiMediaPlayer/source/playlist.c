@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fat.h>
+#include "registry.h"
 
 // Playlist structures
 typedef struct PlaylistItem {
@@ -164,8 +165,8 @@ void LoadM3UPlaylist(const char* filename) {
                 if(!filename) filename = (char*)line;
                 else filename++;
                 
-                int isVideo = (strstr(filename, ".mp4") || strstr(filename, ".avi") || 
-                              strstr(filename, ".mkv") || strstr(filename, ".mov"));
+                const MediaFormat* format = FindMediaFormatByName(filename);
+                int isVideo = format && format->type == MEDIA_TYPE_VIDEO;
                 
                 AddToPlaylist(playlist, currentName[0] ? currentName : filename, line, isVideo);
                 
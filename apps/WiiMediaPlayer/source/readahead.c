@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "readahead.h"
+
+#ifndef GEKKO
+#include <pthread.h>
+#endif
+
+// Returned by CopyFromWindow besides a byte count
+#define WINDOW_WAIT     0
+#define WINDOW_RESTART -1
+#define WINDOW_FAILED  -2
+
+struct MediaReadAhead {
+    MediaIO* io;
+    u8* blocks;
+    int window;
+
+    // Slot tags, written by the I/O thread before it publishes the slot
+    s64 slotOffset[MEDIA_READAHEAD_MAX];
+    int slotLength[MEDIA_READAHEAD_MAX];
+    u32 slotGeneration[MEDIA_READAHEAD_MAX];
+
+    volatile u32 filled;        // I/O thread
+    volatile u32 consumed;      // reader
+
+    // A seek outside the window bumps generation; the I/O thread then
+    // restarts at seekOffset and the reader drops the older blocks
+    volatile u32 generation;    // reader
+    volatile s64 seekOffset;    // reader, before generation
+    s64 horizon;                // reader: end of the newest block it has seen
+
+    // I/O thread only
+    u32 fillGeneration;
+    s64 fillOffset;
+    s64 filePosition;
+    int busy;                   // under ioMutex
+
+    // A read error ends the stream at failedOffset for that generation
+    volatile s64 failedOffset;
+    volatile u32 failedGeneration;
+
+    volatile u64 bytesPrefetched;
+    MediaIOStats stats;         // reader side
+};
+
+static MediaReadAhead* streams[MEDIA_READAHEAD_STREAMS];
+static int streamCount = 0;
+static volatile int ioRunning = 0;
+
+// Queued by the main loop, cleared by the I/O thread once it has run;
+// both under ioMutex
+static MediaIOJob pendingJob = NULL;
+static void* pendingArg = NULL;
+
+#ifdef GEKKO
+static lwp_t ioThread = LWP_THREAD_NULL;
+static mutex_t ioMutex = LWP_MUTEX_NULL;
+static cond_t workCond = LWP_COND_NULL;   // the I/O thread waits for free slots
+static cond_t dataCond = LWP_COND_NULL;   // readers wait for blocks
+static u8 ioStack[32768] ATTRIBUTE_ALIGN(8);    // jobs probe headers on it
+
+#define Lock()           LWP_MutexLock(ioMutex)
+#define Unlock()         LWP_MutexUnlock(ioMutex)
+#define Wait(cond)       LWP_CondWait(cond, ioMutex)
+#define Signal(cond)     LWP_CondSignal(cond)
+#define Broadcast(cond)  LWP_CondBroadcast(cond)
+#else
+// Host builds (make host) run the same code on pthreads
+static pthread_t ioThread;
+static pthread_mutex_t ioMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dataCond = PTHREAD_COND_INITIALIZER;
+
+#define Lock()           pthread_mutex_lock(&ioMutex)
+#define Unlock()         pthread_mutex_unlock(&ioMutex)
+#define Wait(cond)       pthread_cond_wait(&cond, &ioMutex)
+#define Signal(cond)     pthread_cond_signal(&cond)
+#define Broadcast(cond)  pthread_cond_broadcast(&cond)
+#endif
+
+// Stream with the fewest blocks ready that has a free slot and something
+// left to read. Called with ioMutex held.
+static MediaReadAhead* PickStream() {
+    MediaReadAhead* best = NULL;
+    u32 bestReady = MEDIA_READAHEAD_MAX;
+
+    for(int i = 0; i < streamCount; i++) {
+        MediaReadAhead* ahead = streams[i];
+        u32 ready = ahead->filled - ahead->consumed;
+        if(ready >= (u32)ahead->window) continue;
+
+        if(ahead->generation == ahead->fillGeneration) {
+            if(ahead->fillOffset >= ahead->io->size) continue;
+            if(ahead->failedGeneration == ahead->fillGeneration) continue;
+        } else {
+            ready = 0; // everything it holds is stale
+        }
+
+        if(!best || ready < bestReady) {
+            best = ahead;
+            bestReady = ready;
+        }
+    }
+
+    return best;
+}
+
+// Reads the next block into slot filled % window and publishes it
+static void FillBlock(MediaReadAhead* ahead) {
+    u32 generation = ahead->generation;
+    if(generation != ahead->fillGeneration) {
+        __sync_synchronize();
+        ahead->fillGeneration = generation;
+        ahead->fillOffset = ahead->seekOffset;
+    }
+
+    FILE* file = ahead->io->file;
+    s64 offset = ahead->fillOffset;
+    int slot = ahead->filled % ahead->window;
+    int wanted = MEDIA_READAHEAD_BLOCK;
+    if(offset + wanted > ahead->io->size) wanted = (int)(ahead->io->size - offset);
+
+    int length = 0;
+    if(ahead->filePosition == offset || fseeko(file, (off_t)offset, SEEK_SET) == 0) {
+        length = fread(ahead->blocks + slot * MEDIA_READAHEAD_BLOCK, 1, wanted, file);
+        ahead->filePosition = offset + length;
+    } else {
+        ahead->filePosition = -1;
+    }
+
+    ahead->slotOffset[slot] = offset;
+    ahead->slotLength[slot] = length;
+    ahead->slotGeneration[slot] = generation;
+    ahead->fillOffset = offset + MEDIA_READAHEAD_BLOCK;
+    ahead->bytesPrefetched += length;
+
+    if(length < wanted) {
+        ahead->failedOffset = offset + length;
+        __sync_synchronize();
+        ahead->failedGeneration = generation;
+    }
+
+    __sync_synchronize();
+    ahead->filled++;
+}
+
+static void* IoThread(void* arg) {
+    Lock();
+    while(ioRunning) {
+        MediaReadAhead* ahead = PickStream();
+        if(!ahead) {
+            // Streams first, jobs when they are all topped up
+            if(pendingJob) {
+                MediaIOJob job = pendingJob;
+                Unlock();
+
+                job(pendingArg);
+
+                Lock();
+                pendingJob = NULL;
+                Broadcast(dataCond);
+                continue;
+            }
+            Wait(workCond);
+            continue;
+        }
+
+        // The stream cannot be stopped while its block is in flight
+        ahead->busy = 1;
+        Unlock();
+
+        FillBlock(ahead);
+
+        Lock();
+        ahead->busy = 0;
+        Broadcast(dataCond);
+    }
+    Unlock();
+
+    return NULL;
+}
+
+static int StartIoThread() {
+    ioRunning = 1;
+
+#ifdef GEKKO
+    if(ioMutex == LWP_MUTEX_NULL) {
+        LWP_MutexInit(&ioMutex, false);
+        LWP_CondInit(&workCond);
+        LWP_CondInit(&dataCond);
+    }
+
+    if(LWP_CreateThread(&ioThread, IoThread, NULL, ioStack, sizeof(ioStack),
+                        MEDIA_READAHEAD_PRIORITY) < 0) {
+        ioThread = LWP_THREAD_NULL;
+        ioRunning = 0;
+        return -1;
+    }
+#else
+    if(pthread_create(&ioThread, NULL, IoThread, NULL) != 0) {
+        ioRunning = 0;
+        return -1;
+    }
+#endif
+
+    return 0;
+}
+
+static void StopIoThread() {
+    Lock();
+    ioRunning = 0;
+    Signal(workCond);
+    Unlock();
+
+#ifdef GEKKO
+    LWP_JoinThread(ioThread, NULL);
+    ioThread = LWP_THREAD_NULL;
+#else
+    pthread_join(ioThread, NULL);
+#endif
+}
+
+int StartMediaReadAhead(MediaIO* io, int window) {
+    if(!io->file || io->ahead) return -1;
+    if(window < 2) window = 2;
+    if(window > MEDIA_READAHEAD_MAX) window = MEDIA_READAHEAD_MAX;
+    if(streamCount >= MEDIA_READAHEAD_STREAMS) return -1;
+
+    MediaReadAhead* ahead = malloc(sizeof(MediaReadAhead));
+    if(!ahead) return -1;
+    memset(ahead, 0, sizeof(MediaReadAhead));
+
+    ahead->blocks = malloc(window * MEDIA_READAHEAD_BLOCK);
+    if(!ahead->blocks) {
+        free(ahead);
+        return -1;
+    }
+
+    ahead->io = io;
+    ahead->window = window;
+    ahead->seekOffset = io->position & ~(s64)(MEDIA_READAHEAD_BLOCK - 1);
+    ahead->horizon = ahead->seekOffset;
+    ahead->generation = 1;
+    ahead->failedGeneration = 0;
+    ahead->filePosition = -1;
+
+    if(!ioRunning && StartIoThread() != 0) {
+        free(ahead->blocks);
+        free(ahead);
+        return -1;
+    }
+
+    io->ahead = ahead;
+
+    Lock();
+    streams[streamCount++] = ahead;
+    Signal(workCond);
+    Unlock();
+
+    return 0;
+}
+
+void StopMediaReadAhead(MediaIO* io) {
+    MediaReadAhead* ahead = io->ahead;
+    if(!ahead) return;
+
+    Lock();
+    for(int i = 0; i < streamCount; i++) {
+        if(streams[i] == ahead) {
+            streams[i] = streams[--streamCount];
+            break;
+        }
+    }
+    while(ahead->busy) {
+        Wait(dataCond);
+    }
+    int idle = streamCount == 0 && !pendingJob;
+    Unlock();
+
+    // A job still to run keeps the thread; the next stop ends it
+    if(idle) StopIoThread();
+
+    // The file is wherever the I/O thread left it
+    if(io->file) fseeko(io->file, (off_t)io->position, SEEK_SET);
+
+    io->ahead = NULL;
+    free(ahead->blocks);
+    free(ahead);
+}
+
+// Copies what the window holds at position. Blocks that ended more than
+// a block behind the reader are released, so short steps back (headers
+// read twice, probes) stay in the window.
+static int CopyFromWindow(MediaReadAhead* ahead, s64 position, u8* buffer, int size) {
+    u32 generation = ahead->generation;
+    u32 filled = ahead->filled;
+    __sync_synchronize();
+
+    s64 lowest = -1;
+    int released = 0;
+    int result = WINDOW_WAIT;
+
+    for(u32 i = ahead->consumed; i != filled; i++) {
+        int slot = i % ahead->window;
+        s64 offset = ahead->slotOffset[slot];
+        s64 end = offset + ahead->slotLength[slot];
+
+        if(ahead->slotGeneration[slot] == generation && end > ahead->horizon) {
+            ahead->horizon = end;
+        }
+
+        if(ahead->slotGeneration[slot] != generation || end + MEDIA_READAHEAD_BLOCK <= position) {
+            if(i == ahead->consumed) {
+                ahead->consumed = i + 1;
+                released = 1;
+            }
+            continue;
+        }
+
+        if(lowest < 0) lowest = offset;
+
+        if(position >= offset && position < end) {
+            int count = (int)(end - position);
+            if(count > size) count = size;
+            memcpy(buffer, ahead->blocks + slot * MEDIA_READAHEAD_BLOCK + (position - offset), count);
+            result = count;
+            break;
+        }
+    }
+
+    if(released) {
+        Lock();
+        Signal(workCond);
+        Unlock();
+    }
+
+    if(result > 0) return result;
+
+    if(ahead->failedGeneration == generation) {
+        __sync_synchronize();
+        if(position >= ahead->failedOffset) return WINDOW_FAILED;
+    }
+
+    // Behind the window, or further ahead than it will reach soon
+    if(lowest < 0) lowest = ahead->horizon;
+    if(position < lowest || position >= ahead->horizon + ahead->window * MEDIA_READAHEAD_BLOCK) {
+        return WINDOW_RESTART;
+    }
+
+    return WINDOW_WAIT;
+}
+
+static void RestartWindow(MediaReadAhead* ahead, s64 position) {
+    ahead->seekOffset = position & ~(s64)(MEDIA_READAHEAD_BLOCK - 1);
+    ahead->horizon = ahead->seekOffset;
+    __sync_synchronize();
+
+    Lock();
+    ahead->generation++;
+    Signal(workCond);
+    Unlock();
+}
+
+int ReadAheadMediaIO(MediaIO* io, void* buffer, int size) {
+    MediaReadAhead* ahead = io->ahead;
+    u8* dest = buffer;
+    int total = 0;
+    u64 waitStart = 0;
+
+    if(size > io->size - io->position) size = (int)(io->size - io->position);
+
+    while(total < size) {
+        u32 filled = ahead->filled;
+        int count = CopyFromWindow(ahead, io->position, dest + total, size - total);
+
+        if(count > 0) {
+            total += count;
+            io->position += count;
+            continue;
+        }
+        if(count == WINDOW_FAILED) break;
+
+        if(!waitStart) waitStart = NowMicroseconds();
+
+        // Scan again straight away: that drops the blocks the restart made
+        // stale, which may be all that keeps the I/O thread from starting
+        if(count == WINDOW_RESTART) {
+            RestartWindow(ahead, io->position);
+            continue;
+        }
+
+        // Sleep until the I/O thread publishes another block
+        Lock();
+        if(ahead->filled == filled) {
+            Wait(dataCond);
+        }
+        Unlock();
+    }
+
+    if(waitStart) {
+        ahead->stats.misses++;
+        ahead->stats.stallMicroseconds += NowMicroseconds() - waitStart;
+    } else {
+        ahead->stats.hits++;
+    }
+
+    return total;
+}
+
+int QueueMediaIOJob(MediaIOJob job, void* arg) {
+    if(!ioRunning && StartIoThread() != 0) return -1;
+
+    Lock();
+    int busy = pendingJob != NULL;
+    if(!busy) {
+        pendingJob = job;
+        pendingArg = arg;
+        Signal(workCond);
+    }
+    Unlock();
+
+    return busy ? -1 : 0;
+}
+
+int IsMediaIOJobDone() {
+    if(!ioRunning) return 1;
+
+    Lock();
+    int done = pendingJob == NULL;
+    Unlock();
+    return done;
+}
+
+void WaitMediaIOJob() {
+    if(!ioRunning) return;
+
+    Lock();
+    while(pendingJob) {
+        Wait(dataCond);
+    }
+    Unlock();
+}
+
+void GetMediaIOStats(const MediaIO* io, MediaIOStats* stats) {
+    memset(stats, 0, sizeof(MediaIOStats));
+
+    if(io->ahead) {
+        *stats = io->ahead->stats;
+        stats->bytesPrefetched = io->ahead->bytesPrefetched;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+// Asynchronous read-ahead behind MediaIO. One I/O thread serves every
+// stream that asks for it, keeping a window of cluster-aligned blocks
+// read ahead of the reader. Blocks are handed over through counters that
+// each side only ever increases:
+//   consumed <= filled <= consumed + window
+// the I/O thread owns slot filled % window, the reader everything in
+// [consumed, filled). The reader only waits when it runs past the
+// window, and that time is counted as stall.
+#define MEDIA_READAHEAD_BLOCK    32768 // one FAT32 cluster on most SD cards
+#define MEDIA_READAHEAD_WINDOW   8     // default blocks per stream
+#define MEDIA_READAHEAD_MAX      32
+#define MEDIA_READAHEAD_STREAMS  4
+#define MEDIA_READAHEAD_PRIORITY 72    // above the UI, below the audio fill thread
+
+typedef struct {
+    u64 bytesPrefetched;    // read by the I/O thread
+    u32 hits;               // reads served from the window
+    u32 misses;             // reads that had to wait
+    u64 stallMicroseconds;  // time spent waiting
+} MediaIOStats;
+
+typedef void (*MediaIOJob)(void* arg);
+
+// Function prototypes
+
+// Hands the file over to the I/O thread; window is in blocks (2 to
+// MEDIA_READAHEAD_MAX). Returns 0, or -1 and the stream stays synchronous.
+// Start and stop streams from one thread (the main loop).
+int StartMediaReadAhead(MediaIO* io, int window);
+// Waits for the block in flight and gives the file back. CloseMediaIO
+// calls this.
+void StopMediaReadAhead(MediaIO* io);
+// Runs job(arg) on the I/O thread when no stream wants a block, for slow
+// calls the render loop must not make (probing files for the browser).
+// One at a time, from the main loop. Returns 0, or -1 while one is still
+// queued or the thread can't start.
+int QueueMediaIOJob(MediaIOJob job, void* arg);
+// 1 once the last job queued has returned
+int IsMediaIOJobDone();
+// Blocks until it has
+void WaitMediaIOJob();
+void GetMediaIOStats(const MediaIO* io, MediaIOStats* stats);
+
+// Called by ReadMediaIO for streams with read-ahead
+int ReadAheadMediaIO(MediaIO* io, void* buffer, int size);
+
+#endif // READAHEAD_H
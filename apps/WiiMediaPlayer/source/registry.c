@@ -0,0 +1,121 @@
+#include <string.h>
+#include <strings.h>
+#include "registry.h"
+
+typedef struct {
+    char path[256];
+    s64 size;
+    s64 mtime;
+    const MediaFormat* format; // NULL is remembered too
+} ProbeCacheEntry;
+
+static const MediaFormat* formats[MEDIA_MAX_FORMATS];
+static int formatCount = 0;
+static int builtinsRegistered = 0;
+
+static ProbeCacheEntry probeCache[MEDIA_PROBE_CACHE];
+static int probeCacheNext = 0;
+
+static void EnsureFormats() {
+    if(!builtinsRegistered) {
+        builtinsRegistered = 1;
+        RegisterBuiltinFormats();
+    }
+}
+
+int RegisterMediaFormat(const MediaFormat* format) {
+    if(formatCount >= MEDIA_MAX_FORMATS) return -1;
+
+    formats[formatCount++] = format;
+
+    // Earlier answers may have been different with this format around
+    memset(probeCache, 0, sizeof(probeCache));
+    return 0;
+}
+
+// Whole-word match of ext in a space separated list
+static int HasExtension(const MediaFormat* format, const char* filename) {
+    const char* ext = strrchr(filename, '.');
+    if(!ext || !format->extensions) return 0;
+    ext++;
+
+    int length = strlen(ext);
+    const char* p = format->extensions;
+    while(*p) {
+        const char* end = strchr(p, ' ');
+        int n = end ? (int)(end - p) : (int)strlen(p);
+        if(n == length && strncasecmp(p, ext, n) == 0) return 1;
+        if(!end) break;
+        p = end + 1;
+    }
+    return 0;
+}
+
+const MediaFormat* ProbeMediaFormat(MediaIO* io, const char* path) {
+    EnsureFormats();
+
+    for(int i = 0; i < MEDIA_PROBE_CACHE; i++) {
+        ProbeCacheEntry* entry = &probeCache[i];
+        if(entry->path[0] && entry->size == io->size && entry->mtime == io->mtime && strcmp(entry->path, path) == 0) {
+            SeekMediaIO(io, 0);
+            return entry->format;
+        }
+    }
+
+    u8 data[MEDIA_PROBE_SIZE];
+    int size = 0;
+    if(SeekMediaIO(io, 0) == 0) size = ReadMediaIO(io, data, sizeof(data));
+    SeekMediaIO(io, 0);
+
+    // Content first; a matching extension wins ties and is enough on
+    // its own when no probe recognises anything
+    const MediaFormat* best = NULL;
+    int bestScore = 0;
+    for(int i = 0; i < formatCount; i++) {
+        int score = formats[i]->probe && size > 0 ? formats[i]->probe(data, size) * 2 : 0;
+        if(HasExtension(formats[i], path)) score++;
+
+        if(score > bestScore) {
+            best = formats[i];
+            bestScore = score;
+        }
+    }
+
+    if(strlen(path) < sizeof(probeCache[0].path)) {
+        ProbeCacheEntry* entry = &probeCache[probeCacheNext];
+        probeCacheNext = (probeCacheNext + 1) % MEDIA_PROBE_CACHE;
+        strcpy(entry->path, path);
+        entry->size = io->size;
+        entry->mtime = io->mtime;
+        entry->format = best;
+    }
+
+    return best;
+}
+
+const MediaFormat* FindMediaFormatByName(const char* filename) {
+    EnsureFormats();
+
+    for(int i = 0; i < formatCount; i++) {
+        if(HasExtension(formats[i], filename)) return formats[i];
+    }
+    return NULL;
+}
+
+const MediaFormat* FindMediaFormat(const char* name) {
+    EnsureFormats();
+
+    for(int i = 0; i < formatCount; i++) {
+        if(strcmp(formats[i]->name, name) == 0) return formats[i];
+    }
+    return NULL;
+}
+
+MediaFieldOrder GetMediaFieldOrder(int code) {
+    switch(code) {
+        case 0: return MEDIA_FIELDS_PROGRESSIVE;
+        case 1: case 14: return MEDIA_FIELDS_TOP_FIRST;
+        case 6: case 9: return MEDIA_FIELDS_BOTTOM_FIRST;
+        default: return MEDIA_FIELDS_UNKNOWN;
+    }
+}
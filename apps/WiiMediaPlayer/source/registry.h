@@ -0,0 +1,112 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+struct SidecarBuffer;
+
+// Demuxer and decoder registry. Every format registers a probe that
+// scores the first bytes of a file, plus the entry points the decoders
+// call through. Probing reads MEDIA_PROBE_SIZE bytes once; the winner is
+// remembered per path, file size and mtime, the metadata LRU's key, so
+// opening the same file again costs no read at all and one replaced in
+// place is probed afresh. The file extension only breaks ties and lets
+// files be listed without opening them.
+
+#define MEDIA_PROBE_SIZE  4096
+#define MEDIA_MAX_FORMATS 16
+#define MEDIA_PROBE_CACHE 32
+#define MEDIA_FRAME_TOO_BIG (-1)    // video read: frame over bufferSize, skipped
+
+typedef enum {
+    MEDIA_TYPE_UNKNOWN,
+    MEDIA_TYPE_AUDIO,
+    MEDIA_TYPE_VIDEO
+} MediaType;
+
+// Which field of an interlaced frame comes first in time, as far as the
+// container says
+typedef enum {
+    MEDIA_FIELDS_UNKNOWN,
+    MEDIA_FIELDS_PROGRESSIVE,
+    MEDIA_FIELDS_TOP_FIRST,
+    MEDIA_FIELDS_BOTTOM_FIRST
+} MediaFieldOrder;
+
+// Filled in by open and info
+typedef struct {
+    int duration;       // seconds
+    int bitrate;        // bits per second, 0 when unknown
+    char codec[24];     // e.g. "mp3", "avc1", "V_MPEG4/ISO/AVC"
+
+    // Audio, as decoded: native-endian s16
+    int sampleRate;
+    int channels;
+
+    // Video
+    int width;
+    int height;
+    int fps;
+    u32 frameNanoseconds;   // exact frame duration, 0 when unknown; fps is rounded
+    MediaFieldOrder fieldOrder;
+} MediaStreamInfo;
+
+typedef struct MediaFormat {
+    const char* name;
+    MediaType type;
+    const char* extensions; // space separated, lower case
+
+    // 0 (not this format) to 100 (certain). size is less than
+    // MEDIA_PROBE_SIZE for short files.
+    int (*probe)(const u8* data, int size);
+
+    // Returns the stream state, or NULL. io is at offset 0.
+    void* (*open)(MediaIO* io, MediaStreamInfo* info);
+    void (*close)(void* stream);
+    // Audio: interleaved s16 frames. Video: one frame; one bigger than
+    // bufferSize is skipped whole and MEDIA_FRAME_TOO_BIG returned, never
+    // a cut-down payload. Returns bytes, 0 at the end.
+    int (*read)(void* stream, void* buffer, int bufferSize);
+    // Returns 0, or -1 if the stream cannot seek there
+    int (*seek)(void* stream, int seconds);
+    // Sample frames (audio) or video frames into the stream
+    s64 (*position)(void* stream);
+    // Headers only, for listings. Returns 0 or -1.
+    int (*info)(MediaIO* io, MediaStreamInfo* info);
+
+    // Optional seek index for sidecar files (sidecar.h). saveIndex writes
+    // what the stream has indexed so far, building the rest first if
+    // complete is set, and refreshes info. openIndexed is open with that
+    // index instead of reading or scanning for one; NULL if it does not fit.
+    int (*saveIndex)(void* stream, struct SidecarBuffer* index, MediaStreamInfo* info, int complete);
+    void* (*openIndexed)(MediaIO* io, MediaStreamInfo* info, struct SidecarBuffer* index);
+
+    // Optional: moves the video to the last keyframe at or before a frame
+    // number, found in the container's index. Returns that keyframe's
+    // number, or -1. Without it, frame seeks go by whole seconds.
+    s64 (*seekFrame)(void* stream, s64 frame);
+
+    // Optional: a video format's sound track, an audio format (not
+    // registered, never probed) opened on a second handle to the same
+    // file. Its open returns NULL when the file has no track it decodes.
+    const struct MediaFormat* soundTrack;
+} MediaFormat;
+
+// Function prototypes
+int RegisterMediaFormat(const MediaFormat* format);
+void RegisterBuiltinFormats();
+
+// Best match for the file's content, NULL if nothing claims it. Leaves
+// io at offset 0.
+const MediaFormat* ProbeMediaFormat(MediaIO* io, const char* path);
+// From the extension alone, without any I/O
+const MediaFormat* FindMediaFormatByName(const char* filename);
+// By the format's own name, e.g. "mp3"
+const MediaFormat* FindMediaFormat(const char* name);
+// The field order codes QuickTime's 'fiel' box and Matroska's FieldOrder
+// share: 0 progressive, 1 and 14 top first, 6 and 9 bottom first (in time;
+// 9 and 14 store the other field first)
+MediaFieldOrder GetMediaFieldOrder(int code);
+
+#endif // REGISTRY_H
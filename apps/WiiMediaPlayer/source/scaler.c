@@ -0,0 +1,336 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scaler.h"
+#include "videofilter.h"
+
+// Pixel pairs repeated either side of the line buffer, as far as a tap
+// reaches past the edge: 2 luma samples (1 pair) or 2 chroma (2 pairs)
+#define LINE_PAD 2
+
+typedef struct {
+    s16 first;              // source sample under tap 0, may be off the edge
+    u16 phase;
+} ScaleTap;
+
+typedef struct {
+    s16 weights[VIDEO_SCALE_PHASES][4];
+} ScaleBank;
+
+typedef struct {
+    int sourceWidth;        // the key
+    int sourceHeight;
+    int width;
+    int height;
+    VideoScaleMode mode;
+    int taps;
+    ScaleBank across;       // luma and chroma, the ratio is the same
+    ScaleBank down;
+    ScaleTap* luma;         // width entries
+    ScaleTap* chroma;       // width / 2
+    ScaleTap* rows;         // height
+    u32 lastUsed;           // 0 for an empty slot
+} ScalePlan;
+
+static ScalePlan plans[VIDEO_SCALE_PLANS];
+static u32 planClock = 0;
+static VideoScaleStats scaleStats;
+
+static u8* lineBuffer = NULL;
+static int lineBufferSize = 0;
+
+static inline int ClampByte(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static double Sinc(double x) {
+    return x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+}
+
+// Weights for each phase, normalized so they sum to exactly one; the
+// rounding left over goes to the largest. Shrinking by ratio stretches
+// the Lanczos kernel by as much, within its 4 taps.
+static void BuildBank(ScaleBank* bank, int taps, double ratio) {
+    double stretch = ratio > 1.0 ? ratio : 1.0;
+
+    memset(bank, 0, sizeof(ScaleBank));
+    for(int p = 0; p < VIDEO_SCALE_PHASES; p++) {
+        double offset = (double)p / VIDEO_SCALE_PHASES;
+        double weights[4], sum = 0;
+
+        for(int t = 0; t < taps; t++) {
+            double x = t - (taps / 2 - 1) - offset;
+            if(taps == 2) {
+                weights[t] = 1.0 - fabs(x);
+            } else {
+                double u = x / stretch;
+                weights[t] = fabs(u) < 2.0 ? Sinc(u) * Sinc(u / 2) : 0.0;
+            }
+            sum += weights[t];
+        }
+
+        int total = 0, largest = 0;
+        for(int t = 0; t < taps; t++) {
+            bank->weights[p][t] = (s16)lrint(weights[t] / sum * (1 << VIDEO_SCALE_SHIFT));
+            total += bank->weights[p][t];
+            if(bank->weights[p][t] > bank->weights[p][largest]) largest = t;
+        }
+        bank->weights[p][largest] += (1 << VIDEO_SCALE_SHIFT) - total;
+    }
+}
+
+// Output sample o is centered on source position (o + 0.5) * ratio - 0.5
+static void BuildTaps(ScaleTap* taps, int count, int sourceCount, int tapCount) {
+    double ratio = (double)sourceCount / count;
+
+    for(int o = 0; o < count; o++) {
+        double position = (o + 0.5) * ratio - 0.5;
+        int base = (int)floor(position);
+        int phase = (int)lrint((position - base) * VIDEO_SCALE_PHASES);
+        if(phase == VIDEO_SCALE_PHASES) {
+            base++;
+            phase = 0;
+        }
+
+        taps[o].first = base - (tapCount / 2 - 1);
+        taps[o].phase = phase;
+    }
+}
+
+static void FreePlan(ScalePlan* plan) {
+    free(plan->luma);
+    memset(plan, 0, sizeof(ScalePlan));
+}
+
+static ScalePlan* GetPlan(int sourceWidth, int sourceHeight, int width, int height, VideoScaleMode mode) {
+    ScalePlan* oldest = &plans[0];
+    planClock++;
+
+    for(int i = 0; i < VIDEO_SCALE_PLANS; i++) {
+        ScalePlan* plan = &plans[i];
+        if(plan->lastUsed && plan->sourceWidth == sourceWidth && plan->sourceHeight == sourceHeight &&
+           plan->width == width && plan->height == height && plan->mode == mode) {
+            plan->lastUsed = planClock;
+            scaleStats.planHits++;
+            return plan;
+        }
+        if(plan->lastUsed < oldest->lastUsed) oldest = plan;
+    }
+
+    ScalePlan* plan = oldest;
+    FreePlan(plan);
+
+    // One block for the three tables
+    ScaleTap* taps = malloc((width + width / 2 + height) * sizeof(ScaleTap));
+    if(!taps) return NULL;
+
+    plan->sourceWidth = sourceWidth;
+    plan->sourceHeight = sourceHeight;
+    plan->width = width;
+    plan->height = height;
+    plan->mode = mode;
+    plan->taps = mode == VIDEO_SCALE_BILINEAR ? 2 : 4;
+    plan->luma = taps;
+    plan->chroma = taps + width;
+    plan->rows = taps + width + width / 2;
+
+    BuildBank(&plan->across, plan->taps, (double)sourceWidth / width);
+    BuildBank(&plan->down, plan->taps, (double)sourceHeight / height);
+    BuildTaps(plan->luma, width, sourceWidth, plan->taps);
+    BuildTaps(plan->chroma, width / 2, sourceWidth / 2, plan->taps);
+    BuildTaps(plan->rows, height, sourceHeight, plan->taps);
+
+    plan->lastUsed = planClock;
+    scaleStats.planMisses++;
+    return plan;
+}
+
+// Every byte of one output line's worth of source, down through the rows
+static void FilterDown(u8* dst, const u8* const* rows, const s16* weights, int taps, int bytes) {
+    const int round = 1 << (VIDEO_SCALE_SHIFT - 1);
+
+    // A phase that lands on a source line is a copy
+    for(int t = 0; t < taps; t++) {
+        if(weights[t] == 1 << VIDEO_SCALE_SHIFT) {
+            memcpy(dst, rows[t], bytes);
+            return;
+        }
+    }
+
+    if(taps == 2) {
+        int w0 = weights[0], w1 = weights[1];
+        const u8 *r0 = rows[0], *r1 = rows[1];
+        for(int i = 0; i < bytes; i++) dst[i] = (w0 * r0[i] + w1 * r1[i] + round) >> VIDEO_SCALE_SHIFT;
+        return;
+    }
+
+    int w0 = weights[0], w1 = weights[1], w2 = weights[2], w3 = weights[3];
+    const u8 *r0 = rows[0], *r1 = rows[1], *r2 = rows[2], *r3 = rows[3];
+    for(int i = 0; i < bytes; i++) {
+        dst[i] = ClampByte((w0 * r0[i] + w1 * r1[i] + w2 * r2[i] + w3 * r3[i] + round) >> VIDEO_SCALE_SHIFT);
+    }
+}
+
+// The padding: the first pair's Y0 and chroma to the left, the last
+// pair's Y1 and chroma to the right
+static void PadLine(u8* line, int pairs) {
+    u8* first = line;
+    u8* last = line + (pairs - 1) * 4;
+
+    for(int k = 1; k <= LINE_PAD; k++) {
+        u8* left = first - k * 4;
+        u8* right = last + k * 4;
+        left[0] = left[2] = first[0];
+        left[1] = first[1];
+        left[3] = first[3];
+        right[0] = right[2] = last[2];
+        right[1] = last[1];
+        right[3] = last[3];
+    }
+}
+
+// Across from the line into one framebuffer line: Y every 2 bytes, Cb
+// and Cr every 4
+static void FilterAcross(u8* out, const u8* line, const ScalePlan* plan) {
+    const int round = 1 << (VIDEO_SCALE_SHIFT - 1);
+    const ScaleBank* bank = &plan->across;
+
+    if(plan->taps == 2) {
+        for(int x = 0; x < plan->width; x++) {
+            const s16* w = bank->weights[plan->luma[x].phase];
+            const u8* s = line + plan->luma[x].first * 2;
+            out[x * 2] = (w[0] * s[0] + w[1] * s[2] + round) >> VIDEO_SCALE_SHIFT;
+        }
+        for(int k = 0; k < plan->width / 2; k++) {
+            const s16* w = bank->weights[plan->chroma[k].phase];
+            const u8* s = line + plan->chroma[k].first * 4;
+            out[k * 4 + 1] = (w[0] * s[1] + w[1] * s[5] + round) >> VIDEO_SCALE_SHIFT;
+            out[k * 4 + 3] = (w[0] * s[3] + w[1] * s[7] + round) >> VIDEO_SCALE_SHIFT;
+        }
+        return;
+    }
+
+    for(int x = 0; x < plan->width; x++) {
+        const s16* w = bank->weights[plan->luma[x].phase];
+        const u8* s = line + plan->luma[x].first * 2;
+        out[x * 2] = ClampByte((w[0] * s[0] + w[1] * s[2] + w[2] * s[4] + w[3] * s[6] + round)
+                               >> VIDEO_SCALE_SHIFT);
+    }
+    for(int k = 0; k < plan->width / 2; k++) {
+        const s16* w = bank->weights[plan->chroma[k].phase];
+        const u8* s = line + plan->chroma[k].first * 4;
+        out[k * 4 + 1] = ClampByte((w[0] * s[1] + w[1] * s[5] + w[2] * s[9] + w[3] * s[13] + round)
+                                   >> VIDEO_SCALE_SHIFT);
+        out[k * 4 + 3] = ClampByte((w[0] * s[3] + w[1] * s[7] + w[2] * s[11] + w[3] * s[15] + round)
+                                   >> VIDEO_SCALE_SHIFT);
+    }
+}
+
+static void FillBlack(u8* p, int pairs) {
+    for(int i = 0; i < pairs; i++, p += 4) {
+        p[0] = p[2] = VIDEO_LUMA_BLACK;
+        p[1] = p[3] = VIDEO_CHROMA_ZERO;
+    }
+}
+
+void GetVideoLetterbox(int sourceWidth, int sourceHeight, int aspect, int wideScreen,
+                       int frameWidth, int frameHeight, VideoRect* rect) {
+    double screen = wideScreen ? 16.0 / 9.0 : 4.0 / 3.0;
+    double picture;
+
+    switch(aspect) {
+        case 1: picture = 4.0 / 3.0; break;
+        case 2: picture = 16.0 / 9.0; break;
+        case 3: picture = screen; break;
+        default:
+            if((sourceWidth == 704 || sourceWidth == 720) && (sourceHeight == 480 || sourceHeight == 576)) {
+                picture = 4.0 / 3.0;
+            } else {
+                picture = sourceHeight > 0 ? (double)sourceWidth / sourceHeight : screen;
+            }
+            break;
+    }
+
+    // Bars top and bottom for a wider picture, at the sides for a
+    // narrower one
+    int width = frameWidth, height = frameHeight;
+    if(picture > screen) height = (int)lrint(frameHeight * screen / picture);
+    else width = (int)lrint(frameWidth * picture / screen);
+
+    width &= ~1;
+    if(width < 2) width = 2;
+    if(height < 1) height = 1;
+
+    rect->width = width;
+    rect->height = height;
+    rect->x = ((frameWidth - width) / 2) & ~1;
+    rect->y = (frameHeight - height) / 2;
+}
+
+int ScaleYUYV(const u8* source, int sourceWidth, int sourceHeight, int sourceStride,
+              u8* frame, int frameWidth, int frameHeight, const VideoRect* rect, VideoScaleMode mode) {
+    if(!source || !frame || sourceWidth < VIDEO_SCALE_MIN_WIDTH || sourceHeight < VIDEO_SCALE_MIN_HEIGHT) return -1;
+    if(rect->x < 0 || rect->y < 0 || (rect->x & 1) || (rect->width & 1) || rect->width < 2 || rect->height < 1 ||
+       rect->x + rect->width > frameWidth || rect->y + rect->height > frameHeight) return -1;
+
+    sourceWidth &= ~1;
+    ScalePlan* plan = GetPlan(sourceWidth, sourceHeight, rect->width, rect->height, mode);
+    if(!plan) return -1;
+
+    int lineBytes = sourceWidth * 2;
+    int size = lineBytes + 2 * LINE_PAD * 4;
+    if(size > lineBufferSize) {
+        u8* grown = realloc(lineBuffer, size);
+        if(!grown) return -1;
+        lineBuffer = grown;
+        lineBufferSize = size;
+    }
+    u8* line = lineBuffer + LINE_PAD * 4;
+
+    scaleStats.frames++;
+    int frameStride = frameWidth * 2;
+    int lastFirst = -(1 << 30), lastPhase = -1;
+
+    for(int y = 0; y < frameHeight; y++) {
+        u8* out = frame + y * frameStride;
+        if(y < rect->y || y >= rect->y + rect->height) {
+            FillBlack(out, frameWidth / 2);
+            continue;
+        }
+
+        // Enlarging, neighbouring output lines often want the same mix
+        const ScaleTap* tap = &plan->rows[y - rect->y];
+        if(tap->first != lastFirst || tap->phase != lastPhase) {
+            const u8* rows[4];
+            for(int t = 0; t < plan->taps; t++) {
+                int row = tap->first + t;
+                row = row < 0 ? 0 : row >= sourceHeight ? sourceHeight - 1 : row;
+                rows[t] = source + row * sourceStride;
+            }
+
+            FilterDown(line, rows, plan->down.weights[tap->phase], plan->taps, lineBytes);
+            PadLine(line, sourceWidth / 2);
+            lastFirst = tap->first;
+            lastPhase = tap->phase;
+        } else {
+            scaleStats.linesReused++;
+        }
+
+        FillBlack(out, rect->x / 2);
+        FilterAcross(out + rect->x * 2, line, plan);
+        FillBlack(out + (rect->x + rect->width) * 2, (frameWidth - rect->x - rect->width) / 2);
+    }
+
+    return 0;
+}
+
+void GetVideoScaleStats(VideoScaleStats* stats) {
+    *stats = scaleStats;
+}
+
+void FreeVideoScalePlans() {
+    for(int i = 0; i < VIDEO_SCALE_PLANS; i++) FreePlan(&plans[i]);
+    free(lineBuffer);
+    lineBuffer = NULL;
+    lineBufferSize = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include "platform.h"
+
+// Scaling of decoded YCbYCr frames (videofilter.h) into their letterbox
+// on the external framebuffer, straight from the source: each output line
+// is filtered down the source into one line buffer, then across into the
+// framebuffer. Nothing frame-sized is allocated.
+//
+// Both modes are polyphase: a bank of VIDEO_SCALE_PHASES weight sets per
+// direction (2 taps for bilinear, 4 for a Lanczos-2 whose cutoff follows
+// the scale when shrinking) and, per output column and line, the first
+// source sample and a phase. Chroma, at half the horizontal resolution,
+// has its own column table. The tables are built once per source and
+// letterbox geometry; the last VIDEO_SCALE_PLANS are kept.
+#define VIDEO_SCALE_PHASES     64
+#define VIDEO_SCALE_SHIFT      14    // weights sum to 1 << VIDEO_SCALE_SHIFT
+#define VIDEO_SCALE_PLANS      4
+#define VIDEO_SCALE_MIN_WIDTH  8
+#define VIDEO_SCALE_MIN_HEIGHT 4
+
+typedef enum {
+    VIDEO_SCALE_BILINEAR,
+    VIDEO_SCALE_POLYPHASE
+} VideoScaleMode;
+
+typedef struct {
+    int x, y;               // x and width even, whole pixel pairs
+    int width, height;
+} VideoRect;
+
+typedef struct {
+    u32 frames;
+    u32 planHits;
+    u32 planMisses;         // tables built
+    u32 linesReused;        // output lines that needed no new vertical pass
+} VideoScaleStats;
+
+// Function prototypes
+
+// Where a sourceWidth x sourceHeight picture goes in the frame. aspect is
+// VideoFilter.aspect_ratio: 0 auto (square pixels, except 704 and 720
+// wide SD which is 4:3), 1 4:3, 2 16:9, 3 stretch over the whole frame.
+// wideScreen is the TV's shape, which the frame fills.
+void GetVideoLetterbox(int sourceWidth, int sourceHeight, int aspect, int wideScreen,
+                       int frameWidth, int frameHeight, VideoRect* rect);
+
+// Scales the source (sourceStride bytes per line) into rect and paints
+// the rest of the frame black. Returns 0, or -1 for a source smaller than
+// VIDEO_SCALE_MIN_WIDTH x VIDEO_SCALE_MIN_HEIGHT, a rect outside the
+// frame or no memory for the tables, and leaves the frame alone.
+int ScaleYUYV(const u8* source, int sourceWidth, int sourceHeight, int sourceStride,
+              u8* frame, int frameWidth, int frameHeight, const VideoRect* rect, VideoScaleMode mode);
+
+void GetVideoScaleStats(VideoScaleStats* stats);
+// Frees the kept tables and line buffer
+void FreeVideoScalePlans();
+
+#endif // SCALER_H
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "sidecar.h"
+
+static char sidecarDirectory[256] = SIDECAR_DIRECTORY;
+static char sidecarRoot[256] = "";
+
+static int Reserve(SidecarBuffer* buffer, int bytes) {
+    if(buffer->error) return -1;
+    if(buffer->size + bytes <= buffer->capacity) return 0;
+
+    int capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+    while(capacity < buffer->size + bytes) capacity *= 2;
+    if(capacity > SIDECAR_MAX_INDEX) {
+        buffer->error = 1;
+        return -1;
+    }
+
+    u8* grown = realloc(buffer->data, capacity);
+    if(!grown) {
+        buffer->error = 1;
+        return -1;
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static void PutBE(u8* p, u64 value, int bytes) {
+    for(int i = bytes - 1; i >= 0; i--) {
+        p[i] = (u8)value;
+        value >>= 8;
+    }
+}
+
+void PutSidecar16(SidecarBuffer* buffer, u16 value) {
+    if(Reserve(buffer, 2) != 0) return;
+    PutBE(buffer->data + buffer->size, value, 2);
+    buffer->size += 2;
+}
+
+void PutSidecar32(SidecarBuffer* buffer, u32 value) {
+    if(Reserve(buffer, 4) != 0) return;
+    PutBE(buffer->data + buffer->size, value, 4);
+    buffer->size += 4;
+}
+
+void PutSidecar64(SidecarBuffer* buffer, u64 value) {
+    if(Reserve(buffer, 8) != 0) return;
+    PutBE(buffer->data + buffer->size, value, 8);
+    buffer->size += 8;
+}
+
+static const u8* Take(SidecarBuffer* buffer, int bytes) {
+    if(buffer->error || buffer->at + bytes > buffer->size) {
+        buffer->error = 1;
+        return NULL;
+    }
+
+    const u8* p = buffer->data + buffer->at;
+    buffer->at += bytes;
+    return p;
+}
+
+u16 GetSidecar16(SidecarBuffer* buffer) {
+    const u8* p = Take(buffer, 2);
+    return p ? GetBE16(p) : 0;
+}
+
+u32 GetSidecar32(SidecarBuffer* buffer) {
+    const u8* p = Take(buffer, 4);
+    return p ? GetBE32(p) : 0;
+}
+
+u64 GetSidecar64(SidecarBuffer* buffer) {
+    const u8* p = Take(buffer, 8);
+    return p ? GetBE64(p) : 0;
+}
+
+void FreeSidecarBuffer(SidecarBuffer* buffer) {
+    free(buffer->data);
+    memset(buffer, 0, sizeof(SidecarBuffer));
+}
+
+void SetSidecarDirectory(const char* directory) {
+    strncpy(sidecarDirectory, directory, sizeof(sidecarDirectory) - 1);
+    sidecarDirectory[sizeof(sidecarDirectory) - 1] = 0;
+}
+
+void SetSidecarRoot(const char* root) {
+    strncpy(sidecarRoot, root, sizeof(sidecarRoot) - 1);
+    sidecarRoot[sizeof(sidecarRoot) - 1] = 0;
+
+    int length = strlen(sidecarRoot);
+    while(length > 0 && sidecarRoot[length - 1] == '/') sidecarRoot[--length] = 0;
+}
+
+static const char* BaseName(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// The path from the root of its volume: "sd:/movies/a.avi" on the Wii and
+// "<root>/movies/a.avi" on a PC both give "/movies/a.avi"
+static const char* VolumePath(const char* path) {
+    int length = strlen(sidecarRoot);
+    if(length && strncmp(path, sidecarRoot, length) == 0 && path[length] == '/') return path + length;
+
+    const char* colon = strchr(path, ':');
+    const char* slash = strchr(path, '/');
+    return colon && (!slash || colon < slash) ? colon + 1 : path;
+}
+
+// FNV-1a over the volume path and size
+static void SidecarPath(const char* path, s64 size, char* out, int outSize) {
+    u64 hash = 14695981039346656037ull;
+    for(const char* p = VolumePath(path); *p; p++) {
+        hash ^= (u8)*p;
+        hash *= 1099511628211ull;
+    }
+    for(int i = 0; i < 8; i++) {
+        hash ^= (u8)(size >> (i * 8));
+        hash *= 1099511628211ull;
+    }
+
+    snprintf(out, outSize, "%s/%08x%08x.idx", sidecarDirectory, (u32)(hash >> 32), (u32)hash);
+}
+
+static u32 Checksum(const u8* data, int size) {
+    u32 hash = 2166136261u;
+    for(int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Header fields in file order
+static void PutHeader(u8* h, s64 size, s64 mtime, const char* format, const MediaStreamInfo* info,
+                      const char* name, const SidecarBuffer* index) {
+    memset(h, 0, SIDECAR_HEADER_SIZE);
+    memcpy(h, SIDECAR_MAGIC, 4);
+    PutBE(h + 4, SIDECAR_VERSION, 4);
+    PutBE(h + 8, (u64)size, 8);
+    PutBE(h + 16, (u64)mtime, 8);
+    strncpy((char*)h + 24, format, SIDECAR_FORMAT_SIZE);
+
+    PutBE(h + 32, (u32)info->duration, 4);
+    PutBE(h + 36, (u32)info->bitrate, 4);
+    PutBE(h + 40, (u32)info->sampleRate, 4);
+    PutBE(h + 44, (u32)info->channels, 4);
+    PutBE(h + 48, (u32)info->width, 4);
+    PutBE(h + 52, (u32)info->height, 4);
+    PutBE(h + 56, (u32)info->fps, 4);
+    memcpy(h + 60, info->codec, sizeof(info->codec));
+    strncpy((char*)h + 84, name, SIDECAR_NAME_SIZE - 1);
+
+    PutBE(h + 148, (u32)index->size, 4);
+    PutBE(h + 152, Checksum(index->data, index->size), 4);
+    PutBE(h + 156, info->frameNanoseconds, 4);
+    PutBE(h + 160, (u32)info->fieldOrder, 4);
+    PutBE(h + 164, SIDECAR_ORIGIN, 4);
+}
+
+// The same write, seen through a different timezone only if the other
+// side stored it (sidecar.h)
+static int SameModification(s64 stored, s64 mtime, u32 origin) {
+    if(origin == SIDECAR_ORIGIN) return stored == mtime;
+    s64 gap = stored > mtime ? stored - mtime : mtime - stored;
+    return gap <= SIDECAR_ZONE_MAX && gap % SIDECAR_ZONE_STEP == 0;
+}
+
+// Checks the header against the file and fills format and info. Returns
+// the index size, or -1.
+static int GetHeader(const u8* h, const char* path, s64 size, s64 mtime, char* format,
+                     MediaStreamInfo* info) {
+    if(memcmp(h, SIDECAR_MAGIC, 4) != 0 || GetBE32(h + 4) != SIDECAR_VERSION) return -1;
+    if((s64)GetBE64(h + 8) != size || !SameModification((s64)GetBE64(h + 16), mtime, GetBE32(h + 164))) return -1;
+    if(strncmp((const char*)h + 84, BaseName(path), SIDECAR_NAME_SIZE - 1) != 0) return -1;
+
+    memcpy(format, h + 24, SIDECAR_FORMAT_SIZE);
+    format[SIDECAR_FORMAT_SIZE - 1] = 0;
+
+    memset(info, 0, sizeof(MediaStreamInfo));
+    info->duration = (int)GetBE32(h + 32);
+    info->bitrate = (int)GetBE32(h + 36);
+    info->sampleRate = (int)GetBE32(h + 40);
+    info->channels = (int)GetBE32(h + 44);
+    info->width = (int)GetBE32(h + 48);
+    info->height = (int)GetBE32(h + 52);
+    info->fps = (int)GetBE32(h + 56);
+    memcpy(info->codec, h + 60, sizeof(info->codec));
+    info->codec[sizeof(info->codec) - 1] = 0;
+    info->frameNanoseconds = GetBE32(h + 156);
+    info->fieldOrder = (MediaFieldOrder)GetBE32(h + 160);
+    if(info->fieldOrder > MEDIA_FIELDS_BOTTOM_FIRST) info->fieldOrder = MEDIA_FIELDS_UNKNOWN;
+
+    u32 indexSize = GetBE32(h + 148);
+    return indexSize <= SIDECAR_MAX_INDEX ? (int)indexSize : -1;
+}
+
+int ReadSidecarInfo(const char* path, s64 size, s64 mtime, char* format, MediaStreamInfo* info) {
+    char sidecar[320];
+    SidecarPath(path, size, sidecar, sizeof(sidecar));
+
+    FILE* file = fopen(sidecar, "rb");
+    if(!file) return -1;
+
+    u8 h[SIDECAR_HEADER_SIZE];
+    int ok = fread(h, 1, sizeof(h), file) == sizeof(h) &&
+             GetHeader(h, path, size, mtime, format, info) >= 0;
+    fclose(file);
+
+    return ok ? 0 : -1;
+}
+
+int LoadSidecar(const char* path, s64 size, s64 mtime, char* format, MediaStreamInfo* info,
+                SidecarBuffer* index) {
+    memset(index, 0, sizeof(SidecarBuffer));
+
+    char sidecar[320];
+    SidecarPath(path, size, sidecar, sizeof(sidecar));
+
+    FILE* file = fopen(sidecar, "rb");
+    if(!file) return -1;
+
+    u8 h[SIDECAR_HEADER_SIZE];
+    int indexSize = -1;
+    if(fread(h, 1, sizeof(h), file) == sizeof(h)) {
+        indexSize = GetHeader(h, path, size, mtime, format, info);
+    }
+
+    // A sidecar cut short while it was written fails the checksum
+    if(indexSize >= 0 && Reserve(index, indexSize) == 0 &&
+       (int)fread(index->data, 1, indexSize, file) == indexSize &&
+       Checksum(index->data, indexSize) == GetBE32(h + 152)) {
+        index->size = indexSize;
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+    FreeSidecarBuffer(index);
+    return -1;
+}
+
+// Every directory along the way; the ones that exist fail harmlessly
+static void MakeDirectories(const char* directory) {
+    char path[256];
+    strncpy(path, directory, sizeof(path) - 1);
+    path[sizeof(path) - 1] = 0;
+
+    for(char* p = path + 1; *p; p++) {
+        if(*p != '/' || p[-1] == ':') continue;
+        *p = 0;
+        mkdir(path, 0777);
+        *p = '/';
+    }
+    mkdir(path, 0777);
+}
+
+int SaveSidecar(const char* path, s64 size, s64 mtime, const char* format,
+                const MediaStreamInfo* info, const SidecarBuffer* index) {
+    if(index->error) return -1;
+
+    char sidecar[320];
+    SidecarPath(path, size, sidecar, sizeof(sidecar));
+
+    FILE* file = fopen(sidecar, "wb");
+    if(!file) {
+        MakeDirectories(sidecarDirectory);
+        file = fopen(sidecar, "wb");
+        if(!file) return -1;
+    }
+
+    u8 h[SIDECAR_HEADER_SIZE];
+    PutHeader(h, size, mtime, format, info, BaseName(path), index);
+
+    int ok = fwrite(h, 1, sizeof(h), file) == sizeof(h) &&
+             (int)fwrite(index->data, 1, index->size, file) == index->size;
+    if(fclose(file) != 0) ok = 0;
+
+    if(!ok) remove(sidecar);
+    return ok ? 0 : -1;
+}
+
+int SaveStreamSidecar(const char* path, MediaIO* io, const MediaFormat* format, void* stream,
+                      MediaStreamInfo* info, int minSize, int complete) {
+    if(!format->saveIndex) return -1;
+
+    SidecarBuffer index;
+    memset(&index, 0, sizeof(index));
+
+    int result = -1;
+    if(format->saveIndex(stream, &index, info, complete) == 0 && index.size > minSize) {
+        result = SaveSidecar(path, io->size, io->mtime, format->name, info, &index);
+    }
+
+    FreeSidecarBuffer(&index);
+    return result;
+}
+
+int BuildMediaSidecar(const char* path) {
+    MediaIO io;
+    if(OpenMediaIO(&io, path) != 0) return -1;
+
+    int result = -1;
+    const MediaFormat* format = ProbeMediaFormat(&io, path);
+    if(format && format->saveIndex) {
+        MediaStreamInfo info;
+        memset(&info, 0, sizeof(info));
+
+        void* stream = format->open(&io, &info);
+        if(stream) {
+            result = SaveStreamSidecar(path, &io, format, stream, &info, 0, 1);
+            format->close(stream);
+        }
+    }
+
+    CloseMediaIO(&io);
+    return result;
+}
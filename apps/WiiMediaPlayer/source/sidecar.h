@@ -0,0 +1,87 @@
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include "platform.h"
+#include "mediaio.h"
+#include "registry.h"
+
+// Seek index sidecar files. Building an index (AVI chunk lists, the MP3
+// frame table, Matroska cue points from a cluster walk) is what makes a
+// big file slow to open, so the result is written next to nothing in
+// the media folder but to SIDECAR_DIRECTORY/<hash>.idx and read back on
+// the next open. The hash is of the file's path on its volume ("sd:" or
+// the card's mount point on a PC taken off, see SetSidecarRoot) and its
+// size, so sidecars built on a PC for a mounted card are found on the Wii
+// and same-named files in different folders don't share one.
+//
+// Layout, big-endian: a fixed header with the format name, the stream
+// info and the file's size and mtime (a mismatch means the file changed
+// and the sidecar is ignored), then the format's own index payload with
+// a checksum. FAT keeps mtimes in local time, which a PC converts with
+// its timezone and libfat takes as UTC, so for a sidecar written on the
+// other side (the header records which) mtimes a whole number of quarter
+// hours apart, up to SIDECAR_ZONE_MAX, count as the same. One written on
+// this side needs the exact mtime.
+
+#define SIDECAR_MAGIC       "WMZI"
+#define SIDECAR_VERSION     4   // 2: exact frame duration, 3: field order, 4: origin
+#define SIDECAR_HEADER_SIZE 168
+#define SIDECAR_FORMAT_SIZE 8   // registry name, NUL padded
+#define SIDECAR_NAME_SIZE   64  // file name, for collisions of the hash
+#define SIDECAR_MAX_INDEX   (32 * 1024 * 1024)
+#define SIDECAR_ZONE_STEP   (15 * 60)       // seconds
+#define SIDECAR_ZONE_MAX    (14 * 60 * 60)
+
+#define SIDECAR_ORIGIN_WII  1
+#define SIDECAR_ORIGIN_PC   2
+
+#ifdef GEKKO
+#define SIDECAR_DIRECTORY "sd:/wmz/index"
+#define SIDECAR_ORIGIN    SIDECAR_ORIGIN_WII
+#else
+#define SIDECAR_DIRECTORY "wmz/index"
+#define SIDECAR_ORIGIN    SIDECAR_ORIGIN_PC
+#endif
+
+// Growing byte buffer the formats write their index into and read it
+// back from. Reads past the end return 0 and set error.
+typedef struct SidecarBuffer {
+    u8* data;
+    int size;
+    int capacity;
+    int at;             // read position
+    int error;
+} SidecarBuffer;
+
+// Function prototypes
+void PutSidecar16(SidecarBuffer* buffer, u16 value);
+void PutSidecar32(SidecarBuffer* buffer, u32 value);
+void PutSidecar64(SidecarBuffer* buffer, u64 value);
+u16 GetSidecar16(SidecarBuffer* buffer);
+u32 GetSidecar32(SidecarBuffer* buffer);
+u64 GetSidecar64(SidecarBuffer* buffer);
+void FreeSidecarBuffer(SidecarBuffer* buffer);
+
+void SetSidecarDirectory(const char* directory);
+// Where the card is mounted on a PC (e.g. "/media/sd"); paths under it are
+// hashed as the Wii sees them. "" for none, the default.
+void SetSidecarRoot(const char* root);
+
+// Header only, for listings. Returns 0 when a sidecar matches the file.
+int ReadSidecarInfo(const char* path, s64 size, s64 mtime, char* format, MediaStreamInfo* info);
+// Header and index. format has SIDECAR_FORMAT_SIZE bytes. Returns 0 or -1.
+int LoadSidecar(const char* path, s64 size, s64 mtime, char* format, MediaStreamInfo* info,
+                SidecarBuffer* index);
+int SaveSidecar(const char* path, s64 size, s64 mtime, const char* format,
+                const MediaStreamInfo* info, const SidecarBuffer* index);
+
+// Asks the stream's format for its index and writes the sidecar if it is
+// larger than minSize bytes (what the stream was opened with). complete
+// builds what is still missing first, which can read the whole file.
+// Returns 0 if a sidecar was written.
+int SaveStreamSidecar(const char* path, MediaIO* io, const MediaFormat* format, void* stream,
+                      MediaStreamInfo* info, int minSize, int complete);
+// Probe, open, complete the index and save, for pre-generating sidecars
+int BuildMediaSidecar(const char* path);
+
+#endif // SIDECAR_H
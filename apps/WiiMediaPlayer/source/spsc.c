@@ -0,0 +1,52 @@
+#include <string.h>
+#include "spsc.h"
+
+// A thread reads its own counter plainly; the other side's with acquire,
+// so the slot contents written before it was released are visible
+static inline u32 Acquire(const u32* counter) {
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+}
+
+static inline void Release(u32* counter, u32 value) {
+    __atomic_store_n(counter, value, __ATOMIC_RELEASE);
+}
+
+int InitSpscQueue(SpscQueue* queue, void* storage, u32 slotSize, u32 count) {
+    if(count == 0 || (count & (count - 1)) != 0) return -1;
+
+    queue->slots = storage;
+    queue->slotSize = slotSize;
+    queue->mask = count - 1;
+    queue->pushed = 0;
+    queue->popped = 0;
+    return 0;
+}
+
+int PushSpscQueue(SpscQueue* queue, const void* item) {
+    u32 pushed = queue->pushed;
+    if(pushed - Acquire(&queue->popped) > queue->mask) return -1;
+
+    memcpy(queue->slots + (pushed & queue->mask) * queue->slotSize, item, queue->slotSize);
+    Release(&queue->pushed, pushed + 1);
+    return 0;
+}
+
+int PopSpscQueue(SpscQueue* queue, void* item) {
+    u32 popped = queue->popped;
+    if(popped == Acquire(&queue->pushed)) return -1;
+
+    if(item) memcpy(item, queue->slots + (popped & queue->mask) * queue->slotSize, queue->slotSize);
+    Release(&queue->popped, popped + 1);
+    return 0;
+}
+
+const void* PeekSpscQueue(const SpscQueue* queue) {
+    u32 popped = queue->popped;
+    if(popped == Acquire(&queue->pushed)) return NULL;
+
+    return queue->slots + (popped & queue->mask) * queue->slotSize;
+}
+
+u32 GetSpscQueueDepth(const SpscQueue* queue) {
+    return Acquire(&queue->pushed) - Acquire(&queue->popped);
+}
@@ -0,0 +1,42 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include "platform.h"
+
+// Lock-free queue between exactly one producer thread and one consumer
+// thread. Items are copied into fixed slots in storage the caller owns;
+// as in the audio stream the two counters only ever increase, item n
+// lives in slot n % count, and each side writes only its own counter:
+//   popped <= pushed <= popped + count
+// The producer publishes an item with a release store of pushed after
+// writing the slot, the consumer frees it with one of popped after
+// reading, so neither ever sees a half-written slot. count is a power of
+// two so the counters can wrap.
+
+typedef struct {
+    u8* slots;
+    u32 slotSize;
+    u32 mask;               // count - 1
+    u32 pushed;             // producer
+    u32 popped;             // consumer
+} SpscQueue;
+
+// Function prototypes
+
+// storage holds count * slotSize bytes. Returns 0, or -1 if count is not
+// a power of two.
+int InitSpscQueue(SpscQueue* queue, void* storage, u32 slotSize, u32 count);
+
+// Producer: copies item in. Returns 0, or -1 if the queue is full.
+int PushSpscQueue(SpscQueue* queue, const void* item);
+
+// Consumer: copies the oldest item out (item may be NULL to drop it).
+// Returns 0, or -1 if the queue is empty.
+int PopSpscQueue(SpscQueue* queue, void* item);
+// Consumer: the oldest item in place, NULL if empty; valid until popped
+const void* PeekSpscQueue(const SpscQueue* queue);
+
+// Either side; from the other thread's view it may already be stale
+u32 GetSpscQueueDepth(const SpscQueue* queue);
+
+#endif // SPSC_H
@@ -0,0 +1,281 @@
+#include <stdint.h>
+#include <string.h>
+#include "timestretch.h"
+
+// Products of two mono samples summed over the overlap stay inside 32
+// bits when the samples are scaled into 12 bits (384 * 2048 * 2048)
+#define MONO_PEAK   2047
+#define COARSE_STEP 4
+#define FINE_SPAN   (COARSE_STEP - 1)
+
+int InitTimeStretch(TimeStretch* stretch, int sampleRate, int channels, TimeStretchSource source, void* userdata) {
+    if(!source || sampleRate <= 0 || sampleRate > TIME_STRETCH_RATE_MAX || channels < 1 || channels > 2) return -1;
+
+    memset(stretch, 0, sizeof(TimeStretch));
+    stretch->source = source;
+    stretch->userdata = userdata;
+    stretch->channels = channels;
+    stretch->sequence = sampleRate * TIME_STRETCH_SEQUENCE_MS / 1000;
+    stretch->overlap = sampleRate * TIME_STRETCH_OVERLAP_MS / 1000;
+    stretch->window = sampleRate * TIME_STRETCH_WINDOW_MS / 1000;
+    if(stretch->overlap < 1) return -1;
+
+    for(int i = 0; i < stretch->overlap; i++) {
+        stretch->fade[i] = (s16)((i * 32768 + stretch->overlap / 2) / stretch->overlap);
+    }
+    stretch->requestedSpeed = TIME_STRETCH_UNITY;
+    stretch->speed = TIME_STRETCH_UNITY;
+    return 0;
+}
+
+void ResetTimeStretch(TimeStretch* stretch) {
+    stretch->available = 0;
+    stretch->padding = 0;
+    stretch->discard = 0;
+    stretch->ended = 0;
+    stretch->outputFrames = 0;
+    stretch->outputRead = 0;
+    stretch->hasTail = 0;
+    stretch->skipFraction = 0;
+}
+
+void SetTimeStretchSpeed(TimeStretch* stretch, int speed) {
+    if(speed < TIME_STRETCH_MIN) speed = TIME_STRETCH_MIN;
+    if(speed > TIME_STRETCH_MAX) speed = TIME_STRETCH_MAX;
+    stretch->requestedSpeed = speed;
+}
+
+// Tops the input up to need sample frames, taking any skip still owed off
+// what arrives first. Past the end it pads with silence, so the last
+// segments run as usual. Returns 0 once there is nothing real left.
+static int Refill(TimeStretch* stretch, int need) {
+    int channels = stretch->channels;
+    int frameBytes = channels * 2;
+
+    while(stretch->available < need && !stretch->ended) {
+        s16* at = stretch->input + stretch->available * channels;
+        int bytes = stretch->source(stretch->userdata, at, (TIME_STRETCH_BUFFER - stretch->available) * frameBytes);
+        if(bytes <= 0) {
+            stretch->ended = 1;
+            break;
+        }
+
+        int frames = bytes / frameBytes;
+        if(stretch->discard) {
+            int drop = frames < stretch->discard ? frames : stretch->discard;
+            memmove(at, at + drop * channels, (frames - drop) * frameBytes);
+            stretch->discard -= drop;
+            frames -= drop;
+        }
+        stretch->available += frames;
+    }
+
+    if(stretch->available - stretch->padding <= 0 && stretch->ended) return 0;
+    if(stretch->available < need) {
+        memset(stretch->input + stretch->available * channels, 0, (need - stretch->available) * frameBytes);
+        stretch->padding += need - stretch->available;
+        stretch->available = need;
+    }
+    return 1;
+}
+
+// Drops frames off the front; a skip past the end is owed to the next refill
+static void Advance(TimeStretch* stretch, int frames) {
+    if(frames >= stretch->available) {
+        stretch->discard += frames - stretch->available;
+        stretch->available = 0;
+        stretch->padding = 0;
+        return;
+    }
+
+    stretch->available -= frames;
+    memmove(stretch->input, stretch->input + frames * stretch->channels,
+            stretch->available * stretch->channels * sizeof(s16));
+    if(stretch->padding > stretch->available) stretch->padding = stretch->available;
+}
+
+static u32 Root(u32 value) {
+    u32 root = 0;
+    for(u32 bit = 1u << 30; bit; bit >>= 2) {
+        if(value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+    }
+    return root;
+}
+
+// How alike a candidate's start is to the tail: the correlation over the
+// candidate's own level, so a loud stretch doesn't win on volume alone
+static s64 Score(const s16* candidate, const s16* tail, int count, int step) {
+    s32 correlation = 0;
+    u32 energy = 0;
+
+    for(int i = 0; i < count; i += step) {
+        correlation += candidate[i] * tail[i];
+        energy += candidate[i] * candidate[i];
+    }
+    return ((s64)correlation << 16) / (Root(energy) + 1);
+}
+
+static s16 Mono(const s16* frame, int channels) {
+    return channels == 2 ? (s16)((frame[0] + frame[1]) >> 1) : frame[0];
+}
+
+// The offset into the input, below window, where a segment carries on
+// best from the last one's tail
+static int FindOffset(TimeStretch* stretch) {
+    int channels = stretch->channels;
+    int overlap = stretch->overlap;
+    int span = stretch->window + overlap;
+    s16* mono = stretch->mono;
+    s16* tail = stretch->monoTail;
+    int peak = 1;
+
+    for(int i = 0; i < span; i++) {
+        mono[i] = Mono(stretch->input + i * channels, channels);
+        if(mono[i] > peak) peak = mono[i];
+        if(-mono[i] > peak) peak = -mono[i];
+    }
+    for(int i = 0; i < overlap; i++) {
+        tail[i] = Mono(stretch->tail + i * channels, channels);
+        if(tail[i] > peak) peak = tail[i];
+        if(-tail[i] > peak) peak = -tail[i];
+    }
+
+    int shift = 0;
+    while((peak >> shift) > MONO_PEAK) shift++;
+    if(shift) {
+        for(int i = 0; i < span; i++) mono[i] >>= shift;
+        for(int i = 0; i < overlap; i++) tail[i] >>= shift;
+    }
+
+    // Every fourth offset on every other sample, then each one around
+    // the best on all of them
+    int best = 0;
+    s64 bestScore = INT64_MIN;
+    for(int offset = 0; offset < stretch->window; offset += COARSE_STEP) {
+        s64 score = Score(mono + offset, tail, overlap, 2);
+        if(score > bestScore) {
+            bestScore = score;
+            best = offset;
+        }
+    }
+
+    int from = best > FINE_SPAN ? best - FINE_SPAN : 0;
+    int to = best + FINE_SPAN < stretch->window ? best + FINE_SPAN : stretch->window - 1;
+    bestScore = INT64_MIN;
+    for(int offset = from; offset <= to; offset++) {
+        s64 score = Score(mono + offset, tail, overlap, 1);
+        if(score > bestScore) {
+            bestScore = score;
+            best = offset;
+        }
+    }
+
+    stretch->stats.searched += (stretch->window + COARSE_STEP - 1) / COARSE_STEP + to - from + 1;
+    return best;
+}
+
+// out = tail fading out under in fading in, over the overlap
+static void Crossfade(s16* out, const s16* tail, const s16* in, const s16* fade, int frames, int channels) {
+    for(int i = 0; i < frames; i++) {
+        s32 up = fade[i];
+        s32 down = 32768 - up;
+        for(int c = 0; c < channels; c++) {
+            out[c] = (s16)((tail[c] * down + in[c] * up) >> 15);
+        }
+        out += channels;
+        tail += channels;
+        in += channels;
+    }
+}
+
+static void RunSegment(TimeStretch* stretch) {
+    int channels = stretch->channels;
+    int frameBytes = channels * 2;
+    int overlap = stretch->overlap;
+    int length = stretch->sequence - overlap;
+    const s16* in = stretch->input;
+    int offset = 0;
+
+    if(stretch->hasTail) {
+        offset = FindOffset(stretch);
+        Crossfade(stretch->output, stretch->tail, in + offset * channels, stretch->fade, overlap, channels);
+        memcpy(stretch->output + overlap * channels, in + (offset + overlap) * channels,
+               (length - overlap) * frameBytes);
+        stretch->stats.segments++;
+    } else {
+        memcpy(stretch->output, in, length * frameBytes);
+    }
+    memcpy(stretch->tail, in + (offset + length) * channels, overlap * frameBytes);
+    stretch->hasTail = 1;
+
+    // The silence padding the end doesn't go out
+    int real = stretch->available - stretch->padding - offset;
+    stretch->outputFrames = real < length ? (real > 0 ? real : 0) : length;
+    stretch->outputRead = 0;
+    stretch->stats.stretchedFrames += stretch->outputFrames;
+
+    u32 step = (u32)length * stretch->speed + stretch->skipFraction;
+    stretch->skipFraction = step % TIME_STRETCH_UNITY;
+    Advance(stretch, (int)(step / TIME_STRETCH_UNITY));
+}
+
+// Back to 1.0x: one last crossfade onto the input where it has got to,
+// then all of it goes out as it is and the stage is empty again
+static int Unwind(TimeStretch* stretch) {
+    int channels = stretch->channels;
+    int overlap = stretch->overlap;
+
+    if(!Refill(stretch, stretch->hasTail ? overlap : 1)) return 0;
+
+    int frames = stretch->available - stretch->padding;
+    int from = 0;
+    if(stretch->hasTail) {
+        Crossfade(stretch->output, stretch->tail, stretch->input, stretch->fade, overlap, channels);
+        if(frames < overlap) frames = overlap;
+        from = overlap;
+    }
+    memcpy(stretch->output + from * channels, stretch->input + from * channels, (frames - from) * channels * 2);
+    stretch->outputFrames = frames;
+    stretch->outputRead = 0;
+    stretch->stats.stretchedFrames += frames;
+
+    stretch->available = 0;
+    stretch->padding = 0;
+    stretch->hasTail = 0;
+    stretch->skipFraction = 0;
+    return 1;
+}
+
+int ReadTimeStretch(TimeStretch* stretch, void* buffer, int size) {
+    int channels = stretch->channels;
+    int frameBytes = channels * 2;
+
+    for(;;) {
+        if(stretch->outputRead < stretch->outputFrames) {
+            int frames = size / frameBytes;
+            if(frames > stretch->outputFrames - stretch->outputRead) frames = stretch->outputFrames - stretch->outputRead;
+            memcpy(buffer, stretch->output + stretch->outputRead * channels, frames * frameBytes);
+            stretch->outputRead += frames;
+            return frames * frameBytes;
+        }
+
+        stretch->speed = stretch->requestedSpeed;
+        if(stretch->speed == TIME_STRETCH_UNITY) {
+            // Nothing held: the decoder writes where the stream wants it
+            if(!stretch->hasTail && !stretch->available && !stretch->discard) {
+                int bytes = stretch->source(stretch->userdata, buffer, size);
+                if(bytes > 0) stretch->stats.bypassedFrames += bytes / frameBytes;
+                return bytes;
+            }
+            if(!Unwind(stretch)) return 0;
+        } else {
+            if(!Refill(stretch, stretch->window + stretch->sequence)) return 0;
+            RunSegment(stretch);
+        }
+    }
+}
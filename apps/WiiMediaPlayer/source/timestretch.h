@@ -0,0 +1,86 @@
+#ifndef TIMESTRETCH_H
+#define TIMESTRETCH_H
+
+#include "platform.h"
+
+// Pitch-preserving time-stretch (WSOLA) between the audio decoder and the
+// stream, in fixed point, on the fill thread.
+//
+// Output is built from overlapping segments of the input: each one is
+// taken from near where the input should be at this speed, at the offset
+// within TIME_STRETCH_WINDOW_MS whose start looks most like the end of
+// the last one, and crossfaded into it over TIME_STRETCH_OVERLAP_MS. The
+// waveform carries on in phase, so the pitch stays where it was and only
+// the pace changes. The search is coarse (every fourth offset on every
+// other sample, of a mono copy) and then refined around the best, so a
+// segment costs the same whatever the sound: the stage's work per output
+// sample has a fixed ceiling at any speed.
+//
+// At exactly 1.0x the stage gets out of the way: once what it holds has
+// played out (crossfaded back into the plain input) the decoder writes
+// straight into the caller's buffer.
+#define TIME_STRETCH_UNITY          256     // speeds are in 1/256ths
+#define TIME_STRETCH_MIN            128     // 0.5x
+#define TIME_STRETCH_MAX            512     // 2.0x
+#define TIME_STRETCH_SEQUENCE_MS    40
+#define TIME_STRETCH_OVERLAP_MS     8
+#define TIME_STRETCH_WINDOW_MS      15
+#define TIME_STRETCH_RATE_MAX       48000
+#define TIME_STRETCH_OVERLAP_MAX    (TIME_STRETCH_RATE_MAX * TIME_STRETCH_OVERLAP_MS / 1000)
+#define TIME_STRETCH_WINDOW_MAX     (TIME_STRETCH_RATE_MAX * TIME_STRETCH_WINDOW_MS / 1000)
+#define TIME_STRETCH_BUFFER         4096    // sample frames of input held
+
+// Same contract as the stream's fill callback: up to size bytes of native
+// s16 PCM, the number written, 0 at the end
+typedef int (*TimeStretchSource)(void* userdata, void* buffer, int size);
+
+typedef struct {
+    u32 segments;               // crossfaded in
+    u32 searched;               // offsets scored, coarse and fine
+    u64 stretchedFrames;        // sample frames out of the segments
+    u64 bypassedFrames;         // straight from the source at 1.0x
+} TimeStretchStats;
+
+typedef struct {
+    TimeStretchSource source;
+    void* userdata;
+    int channels;
+    int sequence;               // sample frames per segment, overlap included
+    int overlap;
+    int window;                 // offsets searched
+    volatile int requestedSpeed;    // set from the UI, taken per segment
+    int speed;
+    u32 skipFraction;           // 1/256ths of a frame the input is behind
+
+    s16 input[TIME_STRETCH_BUFFER * 2];
+    int available;              // sample frames in input
+    int padding;                // of which silence past the end
+    int discard;                // frames still to skip as they arrive
+    int ended;                  // the source has returned 0
+
+    s16 output[TIME_STRETCH_BUFFER * 2];
+    int outputFrames;
+    int outputRead;
+
+    s16 tail[TIME_STRETCH_OVERLAP_MAX * 2];    // what follows the last segment
+    int hasTail;
+    s16 mono[TIME_STRETCH_WINDOW_MAX + TIME_STRETCH_OVERLAP_MAX];
+    s16 monoTail[TIME_STRETCH_OVERLAP_MAX];
+    s16 fade[TIME_STRETCH_OVERLAP_MAX];    // Q15, rising over the overlap
+    TimeStretchStats stats;
+} TimeStretch;
+
+// Function prototypes
+
+// For 1 or 2 channels at up to TIME_STRETCH_RATE_MAX Hz, reading from
+// source; starts at 1.0x. Returns 0, or -1 for a format it can't take.
+int InitTimeStretch(TimeStretch* stretch, int sampleRate, int channels, TimeStretchSource source, void* userdata);
+// Drops everything held, for a seek; the speed stays
+void ResetTimeStretch(TimeStretch* stretch);
+// Any thread; clamped to TIME_STRETCH_MIN..MAX and taken up at the next
+// segment
+void SetTimeStretchSpeed(TimeStretch* stretch, int speed);
+// The fill callback: up to size bytes of stretched PCM, 0 at the end
+int ReadTimeStretch(TimeStretch* stretch, void* buffer, int size);
+
+#endif // TIMESTRETCH_H
@@ -0,0 +1,83 @@
+#include <string.h>
+#include "trickplay.h"
+
+void StartTrickPlay(TrickPlay* trick, int speed, s64 position, s64 end, u64 now) {
+    if(!trick->speed) {
+        memset(trick, 0, sizeof(TrickPlay));
+        trick->position = position * 1000;
+        trick->end = end * 1000;
+        trick->lastTick = now;
+        trick->keyframe = -1;
+        trick->onScreen = -1;
+    }
+    trick->speed = speed;
+}
+
+// The frame a keyframe's time came from: pts is rounded down from it
+static s64 FrameAt(const Pipeline* pipeline, s64 pts) {
+    return (pts * 1000000 + pipeline->frameNanoseconds - 1) / pipeline->frameNanoseconds;
+}
+
+const PipelineFrame* RunTrickPlay(TrickPlay* trick, Pipeline* pipeline, u64 now) {
+    TrickPlayStats* stats = &trick->stats;
+
+    trick->position += (s64)(now - trick->lastTick) * trick->speed;
+    if(trick->position < 0) trick->position = 0;
+    if(trick->position > trick->end) trick->position = trick->end;
+    trick->lastTick = now;
+
+    s64 keyframe;
+    if(trick->asking && PollPipelineKeyframe(pipeline, &keyframe)) {
+        u32 took = (u32)(now - trick->askedAt);
+        stats->averageMicroseconds = stats->requested == 1 ? took
+                                     : stats->averageMicroseconds + ((s32)took - (s32)stats->averageMicroseconds) / 4;
+        if(keyframe >= 0 && keyframe == trick->keyframe) stats->repeated++;
+        trick->keyframe = keyframe;
+        trick->asking = 0;
+    }
+
+    // Aim where the scan will be when the answer comes
+    if(!trick->asking) {
+        s64 target = trick->position + (s64)stats->averageMicroseconds * trick->speed;
+        if(target < 0) target = 0;
+        if(target > trick->end) target = trick->end;
+        if(RequestPipelineKeyframe(pipeline, target * 1000 / pipeline->frameNanoseconds) == 0) {
+            trick->asking = 1;
+            trick->askedAt = now;
+            stats->requested++;
+        }
+    }
+
+    // Forwards a keyframe waits for the scan to get to it; backwards the
+    // scan may be past it by the time it comes, so it goes straight up
+    s64 clock = trick->speed > 0 ? trick->position : trick->end;
+    const PipelineFrame* frame = PresentPipelineFrame(pipeline, clock / 1000);
+    if(frame) {
+        trick->onScreen = FrameAt(pipeline, frame->pts);
+        stats->shown++;
+    }
+    return frame;
+}
+
+int IsTrickPlayAtEnd(const TrickPlay* trick) {
+    return trick->speed < 0 ? trick->position <= 0 : trick->position >= trick->end;
+}
+
+s64 StopTrickPlay(TrickPlay* trick, Pipeline* pipeline) {
+    s64 frame = trick->onScreen >= 0 ? trick->onScreen : trick->position * 1000 / pipeline->frameNanoseconds;
+
+    // The seek answers a request still out
+    trick->speed = 0;
+    trick->asking = 0;
+    return SeekPipelineFrame(pipeline, frame);
+}
+
+int StepTrickSpeed(int speed, int direction) {
+    if(speed >= -1 && speed <= 1) return 2 * direction;
+
+    // Faster the same way, slower down to normal play the other
+    if((speed > 0) == (direction > 0)) {
+        return speed * 2 > TRICK_SPEED_MAX || speed * 2 < -TRICK_SPEED_MAX ? speed : speed * 2;
+    }
+    return speed == 2 || speed == -2 ? 1 : speed / 2;
+}
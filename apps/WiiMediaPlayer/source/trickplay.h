@@ -0,0 +1,55 @@
+#ifndef TRICKPLAY_H
+#define TRICKPLAY_H
+
+#include "platform.h"
+#include "pipeline.h"
+
+// Fast forward and rewind at 2x to 32x on keyframes alone. The scan moves
+// at speed times real time whatever the decoder manages; whenever the
+// decoder is free it is sent for the keyframe at or before where the
+// scan will be once that keyframe is decoded, going by how long the last
+// ones took. Keyframes it has no time for are never asked for, so a slow
+// decoder thins them out instead of falling behind, and backwards is the
+// same walk towards the start. Leaving picks normal play up at the
+// keyframe on screen.
+#define TRICK_SPEED_MAX     32
+
+typedef struct {
+    u32 requested;          // keyframes asked for
+    u32 shown;              // new pictures up
+    u32 repeated;           // answered with the one decoded last
+    u32 averageMicroseconds;    // asking to answer
+} TrickPlayStats;
+
+typedef struct {
+    int speed;              // 2 to 32, -2 to -32 backwards, 0 when off
+    s64 position;           // microseconds the scan has reached
+    s64 end;                // microseconds, the length of the file
+    u64 lastTick;           // microseconds
+    u64 askedAt;
+    int asking;             // a request is out
+    s64 keyframe;           // the last one answered, -1 for none
+    s64 onScreen;           // frame number of the last picture up, -1 for none
+    TrickPlayStats stats;
+} TrickPlay;
+
+// Function prototypes
+
+// Starts the scan at position ms, or only changes the speed when it is
+// already going. end is the file's length in ms; now is in microseconds.
+void StartTrickPlay(TrickPlay* trick, int speed, s64 position, s64 end, u64 now);
+// Once per refresh: moves the scan on to now, asks for the next keyframe
+// when none is out and returns a new picture due, or NULL.
+const PipelineFrame* RunTrickPlay(TrickPlay* trick, Pipeline* pipeline, u64 now);
+// 1 once the scan has run into the start or the end
+int IsTrickPlayAtEnd(const TrickPlay* trick);
+// Normal play again, from the keyframe on screen (the scan position if
+// none came up). Returns the ms it landed on, or -1.
+s64 StopTrickPlay(TrickPlay* trick, Pipeline* pipeline);
+
+// The speed after a press towards direction (1 forward, -1 back) at
+// speed (1 for normal play): doubling up to TRICK_SPEED_MAX that way,
+// halving back to normal play from the other.
+int StepTrickSpeed(int speed, int direction);
+
+#endif // TRICKPLAY_H
@@ -0,0 +1,324 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "videofilter.h"
+#include "colorkernels.h"
+
+static float Clamp(float value, float low, float high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+static inline int ClampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+void CompileVideoFilter(const VideoFilter* filter, CompiledVideoFilter* compiled) {
+    float brightness = Clamp(filter->brightness, 0.0f, 4.0f);
+    float contrast = Clamp(filter->contrast, 0.0f, 4.0f);
+    float gamma = Clamp(filter->gamma, 0.1f, 10.0f);
+    float saturation = Clamp(filter->saturation, 0.0f, 4.0f);
+    int sharpness = filter->sharpness < 0 ? 0 : filter->sharpness > 10 ? 10 : filter->sharpness;
+
+    // The curve is the one the sliders always meant, on 0-255 levels;
+    // Y is stretched to that and back
+    compiled->lumaIdentity = brightness == 1.0f && contrast == 1.0f && gamma == 1.0f;
+
+    for(int y = 0; y < 256; y++) {
+        if(compiled->lumaIdentity) {
+            compiled->luma[y] = y;
+            continue;
+        }
+
+        float level = ClampInt(y, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE) - VIDEO_LUMA_BLACK;
+        level *= 255.0f / 219.0f;
+        level = (level * brightness - 128.0f) * contrast + 128.0f;
+        if(level < 0) level = 0; // contrast can push below black, where pow() has no answer
+
+        level = powf(level / 255.0f, 1.0f / gamma) * 255.0f;
+        int out = (int)lrintf(VIDEO_LUMA_BLACK + level * (219.0f / 255.0f));
+        compiled->luma[y] = ClampInt(out, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+    }
+
+    // Rotation by the hue angle scaled by the saturation
+    float k = saturation;
+    float angle = filter->hue * (float)M_PI / 180.0f;
+    float one = 1 << VIDEO_FILTER_MATRIX_SHIFT;
+    s32 c = (s32)lrintf(k * cosf(angle) * one);
+    s32 s = (s32)lrintf(k * sinf(angle) * one);
+
+    compiled->chroma[0][0] = c;
+    compiled->chroma[0][1] = s;
+    compiled->chroma[1][0] = -s;
+    compiled->chroma[1][1] = c;
+    compiled->chromaIdentity = c == (s32)one && s == 0;
+
+    compiled->sharpenAmount = sharpness * (1 << VIDEO_SHARPEN_SHIFT) / 5;
+    compiled->sharpenThreshold = VIDEO_SHARPEN_THRESHOLD;
+}
+
+void RunVideoFilter(const CompiledVideoFilter* compiled, u8* frame, int pairs) {
+    const u8* luma = compiled->luma;
+
+    if(compiled->chromaIdentity) {
+        if(compiled->lumaIdentity) return;
+
+        for(int i = 0; i < pairs; i++, frame += 4) {
+            frame[0] = luma[frame[0]];
+            frame[2] = luma[frame[2]];
+        }
+        return;
+    }
+
+    FilterPairs(frame, pairs, luma, compiled->chroma);
+}
+
+static void RunVideoFilterHook(const void* compiled, u8* frame, int pairs) {
+    RunVideoFilter(compiled, frame, pairs);
+}
+
+void RunVideoFilterFrame(const CompiledVideoFilter* compiled, u8* frame, int width, int height) {
+    if(compiled->sharpenAmount <= 0) {
+        RunVideoFilter(compiled, frame, width * height / 2);
+        return;
+    }
+
+    VideoPointHook before = {RunVideoFilterHook, compiled};
+    int points = !compiled->lumaIdentity || !compiled->chromaIdentity;
+    SharpenLumaYUYVFused(frame, width, height, compiled->sharpenAmount, compiled->sharpenThreshold,
+                         points ? &before : NULL, NULL);
+}
+
+// Sepia of a gray input as the RGB sepia matrix gives it, per luma level
+static u8 sepiaLuma[256];
+static u8 sepiaCb[256];
+static u8 sepiaCr[256];
+static int sepiaReady = 0;
+
+static void BuildSepiaTables() {
+    for(int y = 0; y < 256; y++) {
+        float gray = ClampInt(y, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE) - VIDEO_LUMA_BLACK;
+        gray *= 255.0f / 219.0f;
+        float r = Clamp(gray * (0.393f + 0.769f + 0.189f), 0.0f, 255.0f);
+        float g = Clamp(gray * (0.349f + 0.686f + 0.168f), 0.0f, 255.0f);
+        float b = Clamp(gray * (0.272f + 0.534f + 0.131f), 0.0f, 255.0f);
+
+        // BT.601, video range
+        float outY = 0.299f * r + 0.587f * g + 0.114f * b;
+        sepiaLuma[y] = (u8)lrintf(VIDEO_LUMA_BLACK + outY * (219.0f / 255.0f));
+        sepiaCb[y] = (u8)lrintf(VIDEO_CHROMA_ZERO + (b - outY) * (0.564f * 224.0f / 255.0f));
+        sepiaCr[y] = (u8)lrintf(VIDEO_CHROMA_ZERO + (r - outY) * (0.713f * 224.0f / 255.0f));
+    }
+    sepiaReady = 1;
+}
+
+void GetSepiaTables(const u8** luma, const u8** cb, const u8** cr) {
+    if(!sepiaReady) BuildSepiaTables();
+
+    *luma = sepiaLuma;
+    *cb = sepiaCb;
+    *cr = sepiaCr;
+}
+
+void SepiaYUYV(u8* frame, int pairs) {
+    if(!sepiaReady) BuildSepiaTables();
+
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        int y0 = frame[0], y1 = frame[2];
+        int mean = (y0 + y1 + 1) >> 1;
+
+        frame[0] = sepiaLuma[y0];
+        frame[1] = sepiaCb[mean];
+        frame[2] = sepiaLuma[y1];
+        frame[3] = sepiaCr[mean];
+    }
+}
+
+void GrayscaleYUYV(u8* frame, int pairs) {
+    for(int i = 0; i < pairs; i++, frame += 4) {
+        frame[1] = VIDEO_CHROMA_ZERO;
+        frame[3] = VIDEO_CHROMA_ZERO;
+    }
+}
+
+void InvertYUYV(u8* frame, int pairs) {
+    InvertPairs(frame, pairs);
+}
+
+// Blur scratch: two line buffers, or two column strips for the
+// vertical pass, kept from frame to frame. The unsharp mask borrows it.
+#define BLUR_STRIP 32   // bytes per column strip, one cache line
+
+static u8* blurScratch = NULL;
+static int blurScratchSize = 0;
+
+static u8* BlurScratch(int size) {
+    if(size > blurScratchSize) {
+        u8* grown = realloc(blurScratch, size);
+        if(!grown) return NULL;
+        blurScratch = grown;
+        blurScratchSize = size;
+    }
+    return blurScratch;
+}
+
+// Box average of count samples step bytes apart, edges repeated, as a
+// running sum: one add and one subtract per sample whatever the radius
+static void BlurSamples(u8* dst, int dstStep, const u8* src, int srcStep, int count, int radius) {
+    int last = count - 1;
+    int taps = 2 * radius + 1;
+    u32 reciprocal = (65536 + taps / 2) / taps;
+
+    u32 sum = 0;
+    for(int i = -radius; i <= radius; i++) {
+        sum += src[ClampInt(i, 0, last) * srcStep];
+    }
+
+    for(int i = 0; i < count; i++) {
+        dst[i * dstStep] = (sum * reciprocal + 32768) >> 16;
+
+        int enter = i + radius + 1;
+        int leave = i - radius;
+        sum += src[(enter > last ? last : enter) * srcStep];
+        sum -= src[(leave < 0 ? 0 : leave) * srcStep];
+    }
+}
+
+void BoxBlurYUYV(u8* frame, int width, int height, int radius, int passes) {
+    BoxBlurYUYVFused(frame, width, height, radius, passes, NULL, NULL);
+}
+
+void BoxBlurYUYVFused(u8* frame, int width, int height, int radius, int passes,
+                      const VideoPointHook* before, const VideoPointHook* after) {
+    if(radius <= 0 || passes <= 0) return;
+    if(radius > VIDEO_BLUR_MAX_RADIUS) radius = VIDEO_BLUR_MAX_RADIUS;
+
+    int stride = width * 2;
+    int lineSize = 2 * stride;
+    int stripSize = 2 * BLUR_STRIP * height;
+    u8* scratch = BlurScratch(lineSize > stripSize ? lineSize : stripSize);
+    if(!scratch) return;
+
+    int chromaRadius = (radius + 1) / 2;
+
+    // Across, a line at a time: Y every 2 bytes, Cb and Cr every 4. Each
+    // pass reads one buffer and writes the other, the last writes the line.
+    for(int y = 0; y < height; y++) {
+        u8* line = frame + y * stride;
+        u8* buffers[2] = {scratch, scratch + stride};
+        memcpy(buffers[0], line, stride);
+        if(before) before->run(before->stage, buffers[0], width / 2);
+
+        for(int pass = 0; pass < passes; pass++) {
+            const u8* src = buffers[pass & 1];
+            u8* dst = pass == passes - 1 ? line : buffers[(pass + 1) & 1];
+
+            BlurSamples(dst, 2, src, 2, width, radius);
+            BlurSamples(dst + 1, 4, src + 1, 4, width / 2, chromaRadius);
+            BlurSamples(dst + 3, 4, src + 3, 4, width / 2, chromaRadius);
+        }
+    }
+
+    // Down, in strips a cache line wide so the frame is read once in
+    // order; both strips of a 480 line frame fit the 32 KB data cache.
+    // With work to do after, the last pass stays in the strip for it.
+    for(int x = 0; x < stride; x += BLUR_STRIP) {
+        int columns = stride - x < BLUR_STRIP ? stride - x : BLUR_STRIP;
+        u8* strips[2] = {scratch, scratch + BLUR_STRIP * height};
+
+        for(int y = 0; y < height; y++) {
+            memcpy(strips[0] + y * BLUR_STRIP, frame + y * stride + x, columns);
+        }
+
+        for(int pass = 0; pass < passes; pass++) {
+            const u8* src = strips[pass & 1];
+            int direct = pass == passes - 1 && !after;
+            u8* dst = direct ? frame + x : strips[(pass + 1) & 1];
+
+            for(int c = 0; c < columns; c++) {
+                BlurSamples(dst + c, direct ? stride : BLUR_STRIP, src + c, BLUR_STRIP, height, radius);
+            }
+        }
+
+        if(after) {
+            u8* strip = strips[passes & 1];
+            if(columns == BLUR_STRIP) {
+                after->run(after->stage, strip, height * BLUR_STRIP / 4);
+            } else {
+                for(int y = 0; y < height; y++) after->run(after->stage, strip + y * BLUR_STRIP, columns / 4);
+            }
+
+            for(int y = 0; y < height; y++) {
+                memcpy(frame + y * stride + x, strip + y * BLUR_STRIP, columns);
+            }
+        }
+    }
+}
+
+// Y[x - 1] + 2 Y[x] + Y[x + 1] along a line, edges repeated
+static void BlurLumaAcross(u16* dst, const u8* line, int width) {
+    int last = (width - 1) * 2;
+
+    dst[0] = 3 * line[0] + line[width > 1 ? 2 : 0];
+    for(int x = 1; x < width - 1; x++) {
+        dst[x] = line[x * 2 - 2] + 2 * line[x * 2] + line[x * 2 + 2];
+    }
+    if(width > 1) dst[width - 1] = line[last - 2] + 3 * line[last];
+}
+
+void SharpenLumaYUYV(u8* frame, int width, int height, int amount, int threshold) {
+    SharpenLumaYUYVFused(frame, width, height, amount, threshold, NULL, NULL);
+}
+
+void SharpenLumaYUYVFused(u8* frame, int width, int height, int amount, int threshold,
+                          const VideoPointHook* before, const VideoPointHook* after) {
+    if(amount <= 0 || width <= 0 || height <= 0) return;
+
+    int stride = width * 2;
+    u16* rows = (u16*)BlurScratch(3 * width * sizeof(u16));
+    if(!rows) return;
+
+    // What the mask adds for each difference from the blur, -255 to 255
+    s16 boost[511];
+    for(int d = -255; d <= 255; d++) {
+        boost[d + 255] = abs(d) > threshold ? (d * amount + (1 << (VIDEO_SHARPEN_SHIFT - 1))) >> VIDEO_SHARPEN_SHIFT : 0;
+    }
+
+    // The lines above, at and below the one being written, blurred
+    // across; the one below is read before this one is overwritten
+    u16* above = rows;
+    u16* current = rows + width;
+    u16* below = rows + 2 * width;
+
+    if(before) before->run(before->stage, frame, width / 2);
+    BlurLumaAcross(current, frame, width);
+    memcpy(above, current, width * sizeof(u16));
+
+    for(int y = 0; y < height; y++) {
+        u8* line = frame + y * stride;
+        const u16* next = current;
+
+        if(y + 1 < height) {
+            if(before) before->run(before->stage, line + stride, width / 2);
+            BlurLumaAcross(below, line + stride, width);
+            next = below;
+        }
+
+        for(int x = 0; x < width; x++) {
+            int blurred = (above[x] + 2 * current[x] + next[x] + 8) >> 4;
+            int luma = line[x * 2];
+            int add = boost[luma - blurred + 255];
+
+            // A select rather than a branch: whether an edge crosses the
+            // threshold is as good as random
+            int sharpened = ClampInt(luma + add, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+            line[x * 2] = add ? sharpened : luma;
+        }
+
+        if(after) after->run(after->stage, line, width / 2);
+
+        u16* spare = above;
+        above = current;
+        current = below;
+        below = spare;
+    }
+}
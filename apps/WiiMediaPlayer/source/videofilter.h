@@ -0,0 +1,99 @@
+#ifndef VIDEOFILTER_H
+#define VIDEOFILTER_H
+
+#include "platform.h"
+
+// Picture adjustments and effects on the external framebuffer as the
+// video interface scans it out: YCbYCr 4:2:2, one Y0 Cb Y1 Cr quad per
+// pair of pixels, video range (Y 16-235, Cb/Cr 16-240). Everything works
+// on those bytes directly, touching each pair once; nothing converts to
+// RGB and back.
+
+#define VIDEO_LUMA_BLACK  16
+#define VIDEO_LUMA_WHITE  235
+#define VIDEO_CHROMA_MIN  16
+#define VIDEO_CHROMA_MAX  240
+#define VIDEO_CHROMA_ZERO 128
+
+// Picture adjustments as the Effects menu sets them
+typedef struct {
+    float brightness;
+    float contrast;
+    float saturation;
+    float hue;        // degrees
+    float gamma;
+    int sharpness;
+    int noise_reduction;
+    int deinterlace;  // a DeinterlaceMode (deinterlace.h)
+    int aspect_ratio; // 0=auto, 1=4:3, 2=16:9, 3=stretch
+} VideoFilter;
+
+// A VideoFilter compiled for the per-pair pass. Brightness, contrast and
+// gamma only act on Y and collapse into one 256-entry curve. Saturation
+// and hue are a Q12 2x2 matrix on Cb/Cr around the neutral 128.
+// Sharpness is the one setting that looks at neighbours: an unsharp mask
+// on Y after the rest, amount in 1/256 (up to 2x at 10), skipping
+// differences of VIDEO_SHARPEN_THRESHOLD or less so noise stays flat.
+#define VIDEO_FILTER_MATRIX_SHIFT 12
+#define VIDEO_SHARPEN_SHIFT       8
+#define VIDEO_SHARPEN_THRESHOLD   2
+
+typedef struct {
+    u8 luma[256];
+    s32 chroma[2][2];   // rows give Cb, Cr
+    int lumaIdentity;
+    int chromaIdentity;
+    int sharpenAmount;  // 0 for none
+    int sharpenThreshold;
+} CompiledVideoFilter;
+
+// Function prototypes
+
+// Builds the tables; the slow part (pow() per entry), so call it when a
+// setting changes, not per frame. Settings are clamped to what the menu
+// can reach in a few hundred presses.
+void CompileVideoFilter(const VideoFilter* filter, CompiledVideoFilter* compiled);
+// One pass over count pixel pairs (4 bytes each), without the sharpening
+void RunVideoFilter(const CompiledVideoFilter* compiled, u8* frame, int pairs);
+// All of it on a whole frame, the pairs pass folded into the sharpening
+// when there is any
+void RunVideoFilterFrame(const CompiledVideoFilter* compiled, u8* frame, int width, int height);
+
+// Fixed effects. Sepia maps luma to a fixed brown tone, grayscale clears
+// the chroma and invert flips luma and chroma within video range.
+void SepiaYUYV(u8* frame, int pairs);
+// Sepia's luma table, and its Cb and Cr tables indexed by the pair's
+// mean luma
+void GetSepiaTables(const u8** luma, const u8** cb, const u8** cr);
+void GrayscaleYUYV(u8* frame, int pairs);
+void InvertYUYV(u8* frame, int pairs);
+// Box blur of every component, radius in pixels, at the same cost for
+// any radius. Chroma, at half the horizontal resolution, uses half the
+// radius across. passes repeats it; three come close to a Gaussian with
+// sigma = radius. Works in place with a few lines of scratch that are
+// kept for the next frame.
+#define VIDEO_BLUR_MAX_RADIUS 64
+void BoxBlurYUYV(u8* frame, int width, int height, int radius, int passes);
+
+// Per-pair work the blur does on its own copies, so it costs no extra
+// sweep of the frame: before on each line as it is read, after on each
+// strip of output before it is written back (whole pairs, a multiple of
+// 4 bytes wide). Either may be NULL.
+typedef struct {
+    void (*run)(const void* stage, u8* frame, int pairs);
+    const void* stage;
+} VideoPointHook;
+
+void BoxBlurYUYVFused(u8* frame, int width, int height, int radius, int passes,
+                      const VideoPointHook* before, const VideoPointHook* after);
+
+// Unsharp mask on Y alone: each Y moves away from a [1 2 1] by [1 2 1]
+// blur of its neighbours by amount / 256 times the difference, if that is
+// more than threshold. Streams down the frame in place, keeping three
+// lines of Y blurred across. before runs on each line as it is first
+// read, after on each line once it is final.
+void SharpenLumaYUYV(u8* frame, int width, int height, int amount, int threshold);
+void SharpenLumaYUYVFused(u8* frame, int width, int height, int amount, int threshold,
+                          const VideoPointHook* before, const VideoPointHook* after);
+
+#endif // VIDEOFILTER_H
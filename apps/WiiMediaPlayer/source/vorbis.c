@@ -0,0 +1,1554 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vorbis.h"
+#include "ogg.h"
+
+// The player mixes to stereo through ASND
+#define VORBIS_MAX_CHANNELS 2
+#define VORBIS_MAX_CODEBOOK_ENTRIES (1 << 18)
+#define VORBIS_MAX_CODEBOOK_VALUES (1 << 22)
+#define VORBIS_FLOOR1_MAX_VALUES 65
+// Header packets may grow the packet buffer up to this size
+#define VORBIS_MAX_HEADER_PACKET (1024 * 1024)
+// Audio packets longer than this are cut short
+#define VORBIS_MAX_AUDIO_PACKET (64 * 1024)
+#define VORBIS_ARENA_CHUNK (64 * 1024)
+// Codebook lookup levels: the root is at most 10 bits, deeper levels 8
+#define VORBIS_ROOT_BITS 10
+#define VORBIS_LEVEL_BITS 8
+// Codebook values are Q16, the spectrum and IMDCT output Q20
+#define VORBIS_VALUE_BITS 16
+#define VORBIS_SPECTRUM_BITS 20
+// Bisection switches to a forward page scan below this window
+#define VORBIS_BISECT_LINEAR (32 * 1024)
+
+#define VORBIS_Q30(x) ((s32)floor((x) * 1073741824.0 + 0.5))
+
+typedef struct VorbisChunk {
+    struct VorbisChunk* next;
+    int size;
+    int used;
+} VorbisChunk;
+
+#define VORBIS_CHUNK_HEADER ((int)((sizeof(VorbisChunk) + 7) & ~7))
+
+typedef struct {
+    int dimensions;
+    int entries;
+    int rootBits;
+    // Lookup levels. A leaf entry is 0x80000000 | (bits used in this
+    // level << 24) | entry, any other non-zero entry is (width of the next
+    // level << 24) | offset of the next level. Zero marks an unused code.
+    u32* table;
+    s32* values;        // entries * dimensions, Q16; NULL for scalar books
+} VorbisCodebook;
+
+typedef struct {
+    int partitions;
+    u8 partitionClass[31];
+    u8 classDimensions[16];
+    u8 classSubclasses[16];
+    u8 classMasterbook[16];
+    s16 subclassBooks[16][8];
+    int multiplier;
+    int values;
+    u16 x[VORBIS_FLOOR1_MAX_VALUES];
+    u8 sorted[VORBIS_FLOOR1_MAX_VALUES];    // post numbers in x order
+    u8 lowNeighbor[VORBIS_FLOOR1_MAX_VALUES];
+    u8 highNeighbor[VORBIS_FLOOR1_MAX_VALUES];
+} VorbisFloor;
+
+typedef struct {
+    int type;
+    int begin;
+    int end;
+    int partitionSize;
+    int classifications;
+    int classbook;
+    s16 books[64][8];
+    u8* classWords;     // classbook entry split into its classifications
+} VorbisResidue;
+
+typedef struct {
+    int submaps;
+    int couplingSteps;
+    u8 magnitude[256];
+    u8 angle[256];
+    u8 mux[VORBIS_MAX_CHANNELS];
+    u8 submapFloor[16];
+    u8 submapResidue[16];
+} VorbisMapping;
+
+typedef struct {
+    int blockflag;
+    int mapping;
+} VorbisMode;
+
+// Tables for one block size. The IMDCT of n/2 coefficients runs as an
+// n/4 point complex FFT between a pre- and a post-twiddle.
+typedef struct {
+    int n;
+    s32* preTwiddle;    // cos, sin pairs of pi(4k+1)/(2n)
+    s32* postTwiddle;   // cos, sin pairs of 2 pi k/n
+    s32* fftTwiddle;    // cos, sin pairs of 8 pi k/n, first half only
+    u16* bitReverse;
+    s32* slope;         // rising half of the window, n/2 values
+} VorbisBlock;
+
+struct VorbisDecoder {
+    MediaIO* io;
+    VorbisInfo info;
+    OggStream ogg;
+    VorbisChunk* arena;
+    s64 audioStart;     // first page after the headers
+
+    int blocksize[2];
+    VorbisBlock block[2];
+
+    int bookCount;
+    VorbisCodebook* books;
+    int floorCount;
+    VorbisFloor* floors;
+    int residueCount;
+    VorbisResidue* residues;
+    int mappingCount;
+    VorbisMapping* mappings;
+    int modeCount;
+    int modeBits;
+    VorbisMode modes[64];
+
+    // Decode state
+    s32* spectrum[VORBIS_MAX_CHANNELS];
+    s32* overlap[VORBIS_MAX_CHANNELS];  // windowed right half of the last block
+    s32* imdct;
+    s32* fft;
+    u8* classes;
+    int classStride;
+    s32 floorY[VORBIS_MAX_CHANNELS][VORBIS_FLOOR1_MAX_VALUES];
+    int previousSize;   // 0 before the first block after a reset
+
+    s16* pcm;
+    int pcmFrames;
+    int pcmRead;
+    s64 position;       // sample number of pcm[pcmRead]
+    s64 discard;        // decoded samples still to drop
+};
+
+typedef struct {
+    const u8* data;
+    int pos;            // in bits
+    int end;
+} VorbisBits;
+
+// inverse_dB_table of the floor 1 curve, Q31
+static int tablesReady = 0;
+static s32 floorTable[256];
+
+static inline s32 MulQ30(s32 a, s32 b) {
+    return (s32)(((s64)a * b) >> 30);
+}
+
+// Bit reader: Vorbis packs bits from the least significant end of each
+// byte. Packets carry 8 zero bytes of padding, so a peek of up to 25 bits
+// just past the end is safe and end of packet is checked afterwards.
+static inline u32 PeekBits(const VorbisBits* b, int n) {
+    const u8* p = b->data + (b->pos >> 3);
+    u32 w = (u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24);
+    return (w >> (b->pos & 7)) & ((1u << n) - 1);
+}
+
+static u32 ReadBits(VorbisBits* b, int n) {
+    if(n == 0) return 0;
+
+    // Stop advancing once the end is passed so the padding holds
+    if(b->pos > b->end) return 0;
+
+    if(n > 24) {
+        u32 low = ReadBits(b, 16);
+        return low | (ReadBits(b, n - 16) << 16);
+    }
+
+    u32 v = PeekBits(b, n);
+    b->pos += n;
+    return b->pos > b->end ? 0 : v;
+}
+
+static int ilog(u32 v) {
+    int bits = 0;
+    while(v) {
+        bits++;
+        v >>= 1;
+    }
+    return bits;
+}
+
+static inline int DecodeEntry(VorbisBits* b, const VorbisCodebook* book) {
+    if(b->pos > b->end) return -1;
+
+    int width = book->rootBits;
+    u32 e = book->table[PeekBits(b, width)];
+
+    while(!(e & 0x80000000)) {
+        if(e == 0) {
+            b->pos = b->end + 1;
+            return -1;
+        }
+        b->pos += width;
+        width = e >> 24;
+        e = book->table[(e & 0xFFFFFF) + PeekBits(b, width)];
+    }
+
+    b->pos += (e >> 24) & 0x7F;
+    if(b->pos > b->end) return -1;
+
+    return e & 0xFFFFFF;
+}
+
+static void InitVorbisTables() {
+    if(tablesReady) return;
+
+    // The spec lists the table: 256 steps from 1.0649863e-07 up to 1.0
+    for(int i = 0; i < 256; i++) {
+        double v = pow(1.0649863e-07, (255 - i) / 255.0) * 2147483648.0;
+        floorTable[i] = v >= 2147483647.0 ? 0x7FFFFFFF : (s32)(v + 0.5);
+    }
+
+    tablesReady = 1;
+}
+
+// Setup memory comes from chunks that live as long as the decoder
+static void* ArenaAlloc(VorbisDecoder* dec, int size) {
+    VorbisChunk* c = dec->arena;
+
+    size = (size + 7) & ~7;
+    if(!c || c->used + size > c->size) {
+        int capacity = size > VORBIS_ARENA_CHUNK ? size : VORBIS_ARENA_CHUNK;
+        c = malloc(VORBIS_CHUNK_HEADER + capacity);
+        if(!c) return NULL;
+
+        c->next = dec->arena;
+        c->size = capacity;
+        c->used = 0;
+        dec->arena = c;
+    }
+
+    void* p = (u8*)c + VORBIS_CHUNK_HEADER + c->used;
+    c->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+static void FreeArena(VorbisDecoder* dec) {
+    while(dec->arena) {
+        VorbisChunk* next = dec->arena->next;
+        free(dec->arena);
+        dec->arena = next;
+    }
+}
+
+static double Float32Unpack(u32 x) {
+    double mantissa = x & 0x1FFFFF;
+    int exponent = (x >> 21) & 0x3FF;
+
+    if(x & 0x80000000) mantissa = -mantissa;
+    return ldexp(mantissa, exponent - 788);
+}
+
+// Largest r with r^dimensions <= entries
+static int Lookup1Values(int entries, int dimensions) {
+    int r = (int)floor(pow(entries, 1.0 / dimensions));
+
+    for(;;) {
+        s64 p = 1;
+        int i;
+        for(i = 0; i < dimensions && p <= entries; i++) p *= r + 1;
+        if(i < dimensions || p > entries) break;
+        r++;
+    }
+    for(;;) {
+        s64 p = 1;
+        for(int i = 0; i < dimensions && p <= entries; i++) p *= r;
+        if(r == 0 || p <= entries) break;
+        r--;
+    }
+
+    return r;
+}
+
+typedef struct {
+    u32 code;           // bits in stream order
+    int length;
+    int entry;
+} VorbisCode;
+
+typedef struct {
+    u32* data;
+    int used;
+    int capacity;
+} TableBuilder;
+
+static int BuildLevel(TableBuilder* t, const VorbisCode* codes, int count,
+                      u32 prefix, int depth, int width) {
+    int size = 1 << width;
+
+    // Offsets have 24 bits
+    if(t->used + size > 0xFFFFFF) return -1;
+
+    if(t->used + size > t->capacity) {
+        int capacity = t->capacity * 2 + size;
+        u32* grown = realloc(t->data, capacity * sizeof(u32));
+        if(!grown) return -1;
+        t->data = grown;
+        t->capacity = capacity;
+    }
+
+    int level = t->used;
+    t->used += size;
+    memset(&t->data[level], 0, size * sizeof(u32));
+
+    u8* subLen = calloc(size, 1);
+    if(!subLen) return -1;
+
+    u32 mask = depth ? (0xFFFFFFFFu >> (32 - depth)) : 0;
+    for(int i = 0; i < count; i++) {
+        const VorbisCode* c = &codes[i];
+        if(c->length <= depth || (c->code & mask) != prefix) continue;
+
+        int rem = c->length - depth;
+        u32 bits = c->code >> depth;
+
+        if(rem <= width) {
+            for(u32 j = bits; j < (u32)size; j += 1u << rem) {
+                t->data[level + j] = 0x80000000 | (rem << 24) | c->entry;
+            }
+        } else {
+            int index = bits & (size - 1);
+            if(rem - width > subLen[index]) subLen[index] = rem - width;
+        }
+    }
+
+    for(int i = 0; i < size; i++) {
+        if(!subLen[i]) continue;
+
+        int subWidth = subLen[i] < VORBIS_LEVEL_BITS ? subLen[i] : VORBIS_LEVEL_BITS;
+        int sub = BuildLevel(t, codes, count, prefix | ((u32)i << depth), depth + width, subWidth);
+        if(sub < 0) {
+            free(subLen);
+            return -1;
+        }
+        t->data[level + i] = ((u32)subWidth << 24) | sub;
+    }
+
+    free(subLen);
+    return level;
+}
+
+static u32 ReverseBits(u32 v) {
+    v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+    v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F) | ((v & 0x0F0F0F0F) << 4);
+    return __builtin_bswap32(v);
+}
+
+// Codewords go to entries in order, each taking the lowest free code of
+// its length, then the lookup levels are built on the bit-reversed codes
+static int BuildHuffman(VorbisDecoder* dec, VorbisCodebook* book, const u8* lengths) {
+    VorbisCode* codes = malloc(book->entries * sizeof(VorbisCode));
+    TableBuilder t = {NULL, 0, 0};
+    u32 available[33];
+    int count = 0;
+    int maxLen = 0;
+
+    if(!codes) return -1;
+    memset(available, 0, sizeof(available));
+
+    for(int i = 0; i < book->entries; i++) {
+        int len = lengths[i];
+        if(!len) continue;
+
+        u32 res;
+        if(count == 0) {
+            res = 0;
+            for(int j = 1; j <= len; j++) available[j] = 1u << (32 - j);
+        } else {
+            int z = len;
+            while(z > 0 && !available[z]) z--;
+            if(z == 0) {
+                // More codes than the lengths allow
+                free(codes);
+                return -1;
+            }
+            res = available[z];
+            available[z] = 0;
+            for(int y = len; y > z; y--) available[y] = res + (1u << (32 - y));
+        }
+
+        codes[count].code = ReverseBits(res);
+        codes[count].length = len;
+        codes[count].entry = i;
+        count++;
+        if(len > maxLen) maxLen = len;
+    }
+
+    book->rootBits = maxLen < VORBIS_ROOT_BITS ? maxLen : VORBIS_ROOT_BITS;
+
+    int ok;
+    if(count == 1) {
+        // A single used entry takes its length in bits whatever they are
+        t.capacity = 1 << book->rootBits;
+        t.data = malloc(t.capacity * sizeof(u32));
+        ok = t.data != NULL;
+        if(ok) {
+            t.used = t.capacity;
+            for(int i = 0; i < t.used; i++) {
+                t.data[i] = 0x80000000 | (codes[0].length << 24) | codes[0].entry;
+            }
+        }
+    } else {
+        ok = BuildLevel(&t, codes, count, 0, 0, book->rootBits) == 0;
+    }
+
+    free(codes);
+
+    if(ok) {
+        book->table = ArenaAlloc(dec, t.used * sizeof(u32));
+        ok = book->table != NULL;
+        if(ok) memcpy(book->table, t.data, t.used * sizeof(u32));
+    }
+
+    free(t.data);
+    return ok ? 0 : -1;
+}
+
+static int ReadCodebook(VorbisDecoder* dec, VorbisBits* b, VorbisCodebook* book) {
+    if(ReadBits(b, 24) != 0x564342) return -1;
+
+    book->dimensions = ReadBits(b, 16);
+    book->entries = ReadBits(b, 24);
+    if(book->dimensions == 0 || book->entries == 0 ||
+       book->entries > VORBIS_MAX_CODEBOOK_ENTRIES) return -1;
+
+    u8* lengths = malloc(book->entries);
+    u16* multiplicands = NULL;
+    int result = -1;
+    if(!lengths) return -1;
+
+    if(!ReadBits(b, 1)) {
+        int sparse = ReadBits(b, 1);
+        for(int i = 0; i < book->entries; i++) {
+            if(sparse && !ReadBits(b, 1)) {
+                lengths[i] = 0;
+            } else {
+                lengths[i] = ReadBits(b, 5) + 1;
+            }
+        }
+    } else {
+        // Ordered: runs of entries with increasing lengths
+        int current = 0;
+        int length = ReadBits(b, 5) + 1;
+        while(current < book->entries) {
+            int number = ReadBits(b, ilog(book->entries - current));
+            if(length > 32 || number > book->entries - current || b->pos > b->end) goto done;
+            memset(lengths + current, length, number);
+            current += number;
+            length++;
+        }
+    }
+
+    int lookupType = ReadBits(b, 4);
+    if(lookupType == 1 || lookupType == 2) {
+        double minimum = Float32Unpack(ReadBits(b, 32));
+        double delta = Float32Unpack(ReadBits(b, 32));
+        int valueBits = ReadBits(b, 4) + 1;
+        int sequence = ReadBits(b, 1);
+        s64 lookupValues = lookupType == 1 ? Lookup1Values(book->entries, book->dimensions) :
+                                             (s64)book->entries * book->dimensions;
+        s64 total = (s64)book->entries * book->dimensions;
+
+        if(lookupValues <= 0 || total > VORBIS_MAX_CODEBOOK_VALUES ||
+           lookupValues * valueBits > (s64)(b->end - b->pos)) goto done;
+
+        multiplicands = malloc(lookupValues * sizeof(u16));
+        book->values = ArenaAlloc(dec, (int)total * sizeof(s32));
+        if(!multiplicands || !book->values) goto done;
+
+        for(int i = 0; i < lookupValues; i++) {
+            multiplicands[i] = ReadBits(b, valueBits);
+        }
+
+        // Expand every vector to Q16 now so decoding is a plain lookup
+        for(int e = 0; e < book->entries; e++) {
+            s32* out = &book->values[e * book->dimensions];
+            double last = 0;
+            s64 divisor = 1;
+
+            for(int i = 0; i < book->dimensions; i++) {
+                int offset = lookupType == 1 ? (int)((e / divisor) % lookupValues) :
+                                               e * book->dimensions + i;
+                double v = multiplicands[offset] * delta + minimum + last;
+                if(sequence) last = v;
+
+                v = floor(v * (1 << VORBIS_VALUE_BITS) + 0.5);
+                if(v > 2147483647.0) v = 2147483647.0;
+                if(v < -2147483648.0) v = -2147483648.0;
+                out[i] = (s32)v;
+
+                if(lookupType == 1 && divisor <= book->entries) divisor *= lookupValues;
+            }
+        }
+    } else if(lookupType != 0) {
+        goto done;
+    }
+
+    if(b->pos > b->end) goto done;
+
+    result = BuildHuffman(dec, book, lengths);
+
+done:
+    free(multiplicands);
+    free(lengths);
+    return result;
+}
+
+static int ReadFloor(VorbisDecoder* dec, VorbisBits* b, VorbisFloor* f) {
+    int maxClass = -1;
+
+    f->partitions = ReadBits(b, 5);
+    for(int i = 0; i < f->partitions; i++) {
+        f->partitionClass[i] = ReadBits(b, 4);
+        if(f->partitionClass[i] > maxClass) maxClass = f->partitionClass[i];
+    }
+
+    for(int c = 0; c <= maxClass; c++) {
+        f->classDimensions[c] = ReadBits(b, 3) + 1;
+        f->classSubclasses[c] = ReadBits(b, 2);
+        if(f->classSubclasses[c]) {
+            f->classMasterbook[c] = ReadBits(b, 8);
+            if(f->classMasterbook[c] >= dec->bookCount) return -1;
+        }
+        for(int j = 0; j < (1 << f->classSubclasses[c]); j++) {
+            int book = (int)ReadBits(b, 8) - 1;
+            if(book >= dec->bookCount) return -1;
+            f->subclassBooks[c][j] = book;
+        }
+    }
+
+    f->multiplier = ReadBits(b, 2) + 1;
+    int rangeBits = ReadBits(b, 4);
+
+    f->x[0] = 0;
+    f->x[1] = 1 << rangeBits;
+    f->values = 2;
+    for(int i = 0; i < f->partitions; i++) {
+        int c = f->partitionClass[i];
+        for(int j = 0; j < f->classDimensions[c]; j++) {
+            if(f->values >= VORBIS_FLOOR1_MAX_VALUES) return -1;
+            f->x[f->values++] = ReadBits(b, rangeBits);
+        }
+    }
+
+    // Posts in x order for the curve, and each post's neighbours among
+    // the posts before it for the amplitude prediction
+    for(int i = 0; i < f->values; i++) {
+        int rank = 0;
+        for(int j = 0; j < f->values; j++) {
+            if(f->x[j] < f->x[i]) rank++;
+            else if(f->x[j] == f->x[i] && j != i) return -1;
+        }
+        f->sorted[rank] = i;
+    }
+
+    for(int i = 2; i < f->values; i++) {
+        int low = 0, high = 1;
+        for(int j = 0; j < i; j++) {
+            if(f->x[j] < f->x[i] && f->x[j] > f->x[low]) low = j;
+            if(f->x[j] > f->x[i] && f->x[j] < f->x[high]) high = j;
+        }
+        f->lowNeighbor[i] = low;
+        f->highNeighbor[i] = high;
+    }
+
+    return 0;
+}
+
+static int ReadResidue(VorbisDecoder* dec, VorbisBits* b, VorbisResidue* r) {
+    u8 cascade[64];
+
+    r->begin = ReadBits(b, 24);
+    r->end = ReadBits(b, 24);
+    r->partitionSize = ReadBits(b, 24) + 1;
+    r->classifications = ReadBits(b, 6) + 1;
+    r->classbook = ReadBits(b, 8);
+    if(r->classbook >= dec->bookCount) return -1;
+
+    for(int i = 0; i < r->classifications; i++) {
+        int low = ReadBits(b, 3);
+        int high = ReadBits(b, 1) ? ReadBits(b, 5) : 0;
+        cascade[i] = (high << 3) | low;
+    }
+
+    for(int i = 0; i < r->classifications; i++) {
+        for(int j = 0; j < 8; j++) {
+            r->books[i][j] = -1;
+            if(!(cascade[i] & (1 << j))) continue;
+
+            int book = ReadBits(b, 8);
+            if(book >= dec->bookCount || !dec->books[book].values) return -1;
+            r->books[i][j] = book;
+        }
+    }
+
+    // Split each classbook entry into its classifications once, instead
+    // of dividing for every codeword
+    const VorbisCodebook* classbook = &dec->books[r->classbook];
+    int words = classbook->dimensions;
+    if(words > 64 || (s64)classbook->entries * words > VORBIS_MAX_CODEBOOK_VALUES) return -1;
+
+    r->classWords = ArenaAlloc(dec, classbook->entries * words);
+    if(!r->classWords) return -1;
+
+    for(int e = 0; e < classbook->entries; e++) {
+        int temp = e;
+        for(int i = words - 1; i >= 0; i--) {
+            r->classWords[e * words + i] = temp % r->classifications;
+            temp /= r->classifications;
+        }
+    }
+
+    return 0;
+}
+
+static int ReadMapping(VorbisDecoder* dec, VorbisBits* b, VorbisMapping* m) {
+    int channels = dec->info.channels;
+
+    m->submaps = ReadBits(b, 1) ? ReadBits(b, 4) + 1 : 1;
+
+    if(ReadBits(b, 1)) {
+        m->couplingSteps = ReadBits(b, 8) + 1;
+        for(int i = 0; i < m->couplingSteps; i++) {
+            m->magnitude[i] = ReadBits(b, ilog(channels - 1));
+            m->angle[i] = ReadBits(b, ilog(channels - 1));
+            if(m->magnitude[i] == m->angle[i] || m->magnitude[i] >= channels ||
+               m->angle[i] >= channels) return -1;
+        }
+    }
+
+    if(ReadBits(b, 2) != 0) return -1;
+
+    for(int ch = 0; ch < channels; ch++) {
+        m->mux[ch] = m->submaps > 1 ? ReadBits(b, 4) : 0;
+        if(m->mux[ch] >= m->submaps) return -1;
+    }
+
+    for(int i = 0; i < m->submaps; i++) {
+        ReadBits(b, 8); // unused time configuration
+        m->submapFloor[i] = ReadBits(b, 8);
+        m->submapResidue[i] = ReadBits(b, 8);
+        if(m->submapFloor[i] >= dec->floorCount || m->submapResidue[i] >= dec->residueCount) return -1;
+    }
+
+    return 0;
+}
+
+static int InitBlock(VorbisDecoder* dec, VorbisBlock* blk, int n) {
+    int quarter = n / 4;
+    int eighth = n / 8;
+
+    blk->n = n;
+    blk->preTwiddle = ArenaAlloc(dec, quarter * 2 * sizeof(s32));
+    blk->postTwiddle = ArenaAlloc(dec, quarter * 2 * sizeof(s32));
+    blk->fftTwiddle = ArenaAlloc(dec, eighth * 2 * sizeof(s32));
+    blk->bitReverse = ArenaAlloc(dec, quarter * sizeof(u16));
+    blk->slope = ArenaAlloc(dec, n / 2 * sizeof(s32));
+    if(!blk->preTwiddle || !blk->postTwiddle || !blk->fftTwiddle ||
+       !blk->bitReverse || !blk->slope) return -1;
+
+    for(int k = 0; k < quarter; k++) {
+        double a = M_PI * (4 * k + 1) / (2.0 * n);
+        blk->preTwiddle[2 * k] = VORBIS_Q30(cos(a));
+        blk->preTwiddle[2 * k + 1] = VORBIS_Q30(sin(a));
+
+        a = 2.0 * M_PI * k / n;
+        blk->postTwiddle[2 * k] = VORBIS_Q30(cos(a));
+        blk->postTwiddle[2 * k + 1] = VORBIS_Q30(sin(a));
+    }
+
+    for(int k = 0; k < eighth; k++) {
+        double a = 8.0 * M_PI * k / n;
+        blk->fftTwiddle[2 * k] = VORBIS_Q30(cos(a));
+        blk->fftTwiddle[2 * k + 1] = VORBIS_Q30(sin(a));
+    }
+
+    int bits = ilog(quarter) - 1;
+    for(int k = 0; k < quarter; k++) {
+        blk->bitReverse[k] = (u16)(ReverseBits(k) >> (32 - bits));
+    }
+
+    // Vorbis window: sin(pi/2 * sin^2((i + 0.5) / half * pi/2))
+    int half = n / 2;
+    for(int i = 0; i < half; i++) {
+        double s = sin((i + 0.5) / half * M_PI / 2);
+        blk->slope[i] = VORBIS_Q30(sin(M_PI / 2 * s * s));
+    }
+
+    return 0;
+}
+
+static int ReadIdentification(const u8* p, int size, VorbisInfo* info, int* blocksize) {
+    if(size < 30 || p[0] != 1 || memcmp(p + 1, "vorbis", 6) != 0) return -1;
+    if(GetLE32(p + 7) != 0) return -1;
+
+    memset(info, 0, sizeof(VorbisInfo));
+    info->channels = p[11];
+    info->sampleRate = (int)GetLE32(p + 12);
+    info->bitrate = (s32)GetLE32(p + 20) > 0 ? (s32)GetLE32(p + 20) / 1000 : 0;
+
+    blocksize[0] = 1 << (p[28] & 15);
+    blocksize[1] = 1 << (p[28] >> 4);
+
+    if(info->channels < 1 || info->channels > VORBIS_MAX_CHANNELS || info->sampleRate <= 0) return -1;
+    if(blocksize[0] < 64 || blocksize[1] > 8192 || blocksize[0] > blocksize[1]) return -1;
+    if(!(p[29] & 1)) return -1;
+
+    return 0;
+}
+
+static int ReadSetup(VorbisDecoder* dec, const u8* p, int size) {
+    if(size < 7 || p[0] != 5 || memcmp(p + 1, "vorbis", 6) != 0) return -1;
+
+    VorbisBits bits = {p + 7, 0, (size - 7) * 8};
+    VorbisBits* b = &bits;
+
+    dec->bookCount = ReadBits(b, 8) + 1;
+    dec->books = ArenaAlloc(dec, dec->bookCount * sizeof(VorbisCodebook));
+    if(!dec->books) return -1;
+    for(int i = 0; i < dec->bookCount; i++) {
+        if(ReadCodebook(dec, b, &dec->books[i]) != 0) return -1;
+    }
+
+    // Time domain transforms are placeholders that must be zero
+    int times = ReadBits(b, 6) + 1;
+    for(int i = 0; i < times; i++) {
+        if(ReadBits(b, 16) != 0) return -1;
+    }
+
+    // Floor type 0 (LSP) has not been produced by any encoder since the
+    // 1.0 betas and is not supported
+    dec->floorCount = ReadBits(b, 6) + 1;
+    dec->floors = ArenaAlloc(dec, dec->floorCount * sizeof(VorbisFloor));
+    if(!dec->floors) return -1;
+    for(int i = 0; i < dec->floorCount; i++) {
+        if(ReadBits(b, 16) != 1 || ReadFloor(dec, b, &dec->floors[i]) != 0) return -1;
+    }
+
+    dec->residueCount = ReadBits(b, 6) + 1;
+    dec->residues = ArenaAlloc(dec, dec->residueCount * sizeof(VorbisResidue));
+    if(!dec->residues) return -1;
+    for(int i = 0; i < dec->residueCount; i++) {
+        dec->residues[i].type = ReadBits(b, 16);
+        if(dec->residues[i].type > 2 || ReadResidue(dec, b, &dec->residues[i]) != 0) return -1;
+    }
+
+    dec->mappingCount = ReadBits(b, 6) + 1;
+    dec->mappings = ArenaAlloc(dec, dec->mappingCount * sizeof(VorbisMapping));
+    if(!dec->mappings) return -1;
+    for(int i = 0; i < dec->mappingCount; i++) {
+        if(ReadBits(b, 16) != 0 || ReadMapping(dec, b, &dec->mappings[i]) != 0) return -1;
+    }
+
+    dec->modeCount = ReadBits(b, 6) + 1;
+    for(int i = 0; i < dec->modeCount; i++) {
+        VorbisMode* m = &dec->modes[i];
+        m->blockflag = ReadBits(b, 1);
+        int windowType = ReadBits(b, 16);
+        int transformType = ReadBits(b, 16);
+        m->mapping = ReadBits(b, 8);
+        if(windowType != 0 || transformType != 0 || m->mapping >= dec->mappingCount) return -1;
+    }
+    dec->modeBits = ilog(dec->modeCount - 1);
+
+    if(!ReadBits(b, 1) || b->pos > b->end) return -1;
+
+    return 0;
+}
+
+// Decode buffers, sized for the long block
+static int AllocateDecodeState(VorbisDecoder* dec) {
+    int channels = dec->info.channels;
+    int half = dec->blocksize[1] / 2;
+
+    for(int ch = 0; ch < channels; ch++) {
+        dec->spectrum[ch] = ArenaAlloc(dec, half * sizeof(s32));
+        dec->overlap[ch] = ArenaAlloc(dec, half * sizeof(s32));
+        if(!dec->spectrum[ch] || !dec->overlap[ch]) return -1;
+    }
+
+    dec->imdct = ArenaAlloc(dec, dec->blocksize[1] * sizeof(s32));
+    dec->fft = ArenaAlloc(dec, half * sizeof(s32));
+    dec->pcm = ArenaAlloc(dec, half * channels * sizeof(s16));
+    if(!dec->imdct || !dec->fft || !dec->pcm) return -1;
+
+    // Per-partition classifications of the widest residue, plus room for
+    // the last codeword running past the end
+    dec->classStride = 0;
+    for(int i = 0; i < dec->residueCount; i++) {
+        const VorbisResidue* r = &dec->residues[i];
+        int length = r->type == 2 ? half * channels : half;
+        int parts = length / r->partitionSize + dec->books[r->classbook].dimensions;
+        if(parts > dec->classStride) dec->classStride = parts;
+    }
+    dec->classes = ArenaAlloc(dec, dec->classStride * channels);
+    if(!dec->classes) return -1;
+
+    if(InitBlock(dec, &dec->block[0], dec->blocksize[0]) != 0) return -1;
+    if(dec->blocksize[1] == dec->blocksize[0]) {
+        dec->block[1] = dec->block[0];
+    } else if(InitBlock(dec, &dec->block[1], dec->blocksize[1]) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int DecodeFloor(VorbisDecoder* dec, VorbisBits* b, const VorbisFloor* f, s32* y) {
+    static const u16 ranges[4] = {256, 128, 86, 64};
+
+    if(!ReadBits(b, 1)) return 0;
+
+    int bits = ilog(ranges[f->multiplier - 1] - 1);
+    y[0] = ReadBits(b, bits);
+    y[1] = ReadBits(b, bits);
+
+    int offset = 2;
+    for(int i = 0; i < f->partitions; i++) {
+        int c = f->partitionClass[i];
+        int cbits = f->classSubclasses[c];
+        int csub = (1 << cbits) - 1;
+        int cval = 0;
+
+        if(cbits) {
+            cval = DecodeEntry(b, &dec->books[f->classMasterbook[c]]);
+            if(cval < 0) return 0;
+        }
+
+        for(int j = 0; j < f->classDimensions[c]; j++) {
+            int book = f->subclassBooks[c][cval & csub];
+            cval >>= cbits;
+            if(book >= 0) {
+                int v = DecodeEntry(b, &dec->books[book]);
+                if(v < 0) return 0;
+                y[offset + j] = v;
+            } else {
+                y[offset + j] = 0;
+            }
+        }
+        offset += f->classDimensions[c];
+    }
+
+    // Running out of packet inside the floor makes the channel silent
+    return b->pos <= b->end;
+}
+
+static inline s32 ApplyFloor(s32 v, int y) {
+    if(y < 0) y = 0;
+    if(y > 255) y = 255;
+    return (s32)(((s64)v * floorTable[y]) >> (31 + VORBIS_VALUE_BITS - VORBIS_SPECTRUM_BITS));
+}
+
+// Bresenham line of the floor curve, multiplied into v over [x0, x1)
+static void RenderLine(int x0, int y0, int x1, int y1, int n, s32* v) {
+    int dy = y1 - y0;
+    int adx = x1 - x0;
+    int ady = abs(dy);
+    int base = dy / adx;
+    int sy = dy < 0 ? base - 1 : base + 1;
+    int err = 0;
+    int y = y0;
+
+    ady -= abs(base) * adx;
+    if(x1 > n) x1 = n;
+
+    v[x0] = ApplyFloor(v[x0], y);
+    for(int x = x0 + 1; x < x1; x++) {
+        err += ady;
+        if(err >= adx) {
+            err -= adx;
+            y += sy;
+        } else {
+            y += base;
+        }
+        v[x] = ApplyFloor(v[x], y);
+    }
+}
+
+static int RenderPoint(int x0, int y0, int x1, int y1, int x) {
+    int dy = y1 - y0;
+    int off = abs(dy) * (x - x0) / (x1 - x0);
+    return dy < 0 ? y0 - off : y0 + off;
+}
+
+// Turn the decoded posts into the floor curve and multiply the residue
+// by it, turning Q16 residue into the Q20 spectrum
+static void ApplyFloorCurve(const VorbisFloor* f, const s32* y, int n, s32* v) {
+    static const u16 ranges[4] = {256, 128, 86, 64};
+    int range = ranges[f->multiplier - 1];
+    int finalY[VORBIS_FLOOR1_MAX_VALUES];
+    u8 used[VORBIS_FLOOR1_MAX_VALUES];
+
+    finalY[0] = y[0];
+    finalY[1] = y[1];
+    used[0] = used[1] = 1;
+
+    for(int i = 2; i < f->values; i++) {
+        int low = f->lowNeighbor[i];
+        int high = f->highNeighbor[i];
+        int predicted = RenderPoint(f->x[low], finalY[low], f->x[high], finalY[high], f->x[i]);
+        int val = y[i];
+        int highroom = range - predicted;
+        int lowroom = predicted;
+        int room = (highroom < lowroom ? highroom : lowroom) * 2;
+
+        if(val) {
+            used[low] = used[high] = used[i] = 1;
+            if(val >= room) {
+                finalY[i] = highroom > lowroom ? val - lowroom + predicted :
+                                                 predicted - val + highroom - 1;
+            } else {
+                finalY[i] = (val & 1) ? predicted - ((val + 1) >> 1) : predicted + (val >> 1);
+            }
+        } else {
+            used[i] = 0;
+            finalY[i] = predicted;
+        }
+    }
+
+    int lx = 0;
+    int ly = finalY[0] * f->multiplier;
+    for(int k = 1; k < f->values; k++) {
+        int i = f->sorted[k];
+        if(!used[i]) continue;
+
+        int hx = f->x[i];
+        int hy = finalY[i] * f->multiplier;
+        if(lx < n) RenderLine(lx, ly, hx, hy, n, v);
+        lx = hx;
+        ly = hy;
+    }
+    if(lx < n) RenderLine(lx, ly, n, ly, n, v);
+}
+
+static int DecodeResidue(VorbisDecoder* dec, VorbisBits* b, const VorbisResidue* r,
+                         const int* channels, const int* decode, int count, int half) {
+    int length = r->type == 2 ? half * count : half;
+    int begin = r->begin < length ? r->begin : length;
+    int end = r->end < length ? r->end : length;
+    int size = r->partitionSize;
+    int parts = (end - begin) / size;
+    int vectors = r->type == 2 ? 1 : count;
+    int active[VORBIS_MAX_CHANNELS];
+    int any = 0;
+
+    if(parts <= 0) return 0;
+
+    // Format 2 interleaves the channels into one vector that is decoded
+    // unless every channel in it is silent
+    for(int v = 0; v < count; v++) any |= decode[v];
+    for(int v = 0; v < vectors; v++) active[v] = r->type == 2 ? any : decode[v];
+
+    const VorbisCodebook* classbook = &dec->books[r->classbook];
+    int words = classbook->dimensions;
+
+    for(int pass = 0; pass < 8; pass++) {
+        int p = 0;
+        while(p < parts) {
+            if(pass == 0) {
+                for(int v = 0; v < vectors; v++) {
+                    if(!active[v]) continue;
+                    int e = DecodeEntry(b, classbook);
+                    if(e < 0) return -1;
+                    memcpy(&dec->classes[v * dec->classStride + p], &r->classWords[e * words], words);
+                }
+            }
+
+            for(int i = 0; i < words && p < parts; i++, p++) {
+                int offset = begin + p * size;
+
+                for(int v = 0; v < vectors; v++) {
+                    if(!active[v]) continue;
+
+                    int book = r->books[dec->classes[v * dec->classStride + p]][pass];
+                    if(book < 0) continue;
+
+                    const VorbisCodebook* vq = &dec->books[book];
+                    int dims = vq->dimensions;
+
+                    if(r->type == 0) {
+                        // Format 0 spreads each vector across the partition
+                        s32* out = dec->spectrum[channels[v]] + offset;
+                        int step = size / dims;
+                        for(int j = 0; j < step; j++) {
+                            int e = DecodeEntry(b, vq);
+                            if(e < 0) return -1;
+                            const s32* val = &vq->values[e * dims];
+                            for(int k = 0; k < dims; k++) out[j + k * step] += val[k];
+                        }
+                    } else if(r->type == 1 || count == 1) {
+                        s32* out = dec->spectrum[channels[v]] + offset;
+                        for(int j = 0; j < size;) {
+                            int e = DecodeEntry(b, vq);
+                            if(e < 0) return -1;
+                            const s32* val = &vq->values[e * dims];
+                            for(int k = 0; k < dims && j < size; k++) out[j++] += val[k];
+                        }
+                    } else {
+                        // Format 2: vector position t is channel t % count
+                        int t = offset;
+                        int stop = offset + size;
+                        while(t < stop) {
+                            int e = DecodeEntry(b, vq);
+                            if(e < 0) return -1;
+                            const s32* val = &vq->values[e * dims];
+                            for(int k = 0; k < dims && t < stop; k++, t++) {
+                                dec->spectrum[channels[t % count]][t / count] += val[k];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Decimation in time radix-2 FFT on interleaved complex values that are
+// already in bit-reversed order
+static void Fft(s32* z, int count, const s32* twiddle) {
+    // First pass: no multiplies
+    for(int i = 0; i < count; i += 2) {
+        s32 ar = z[2 * i], ai = z[2 * i + 1];
+        s32 br = z[2 * i + 2], bi = z[2 * i + 3];
+        z[2 * i] = ar + br;
+        z[2 * i + 1] = ai + bi;
+        z[2 * i + 2] = ar - br;
+        z[2 * i + 3] = ai - bi;
+    }
+
+    for(int size = 4; size <= count; size <<= 1) {
+        int half = size >> 1;
+        int step = count / size;
+
+        for(int k = 0; k < half; k++) {
+            s32 c = twiddle[2 * k * step];
+            s32 s = twiddle[2 * k * step + 1];
+
+            for(int a = k; a < count; a += size) {
+                int b = a + half;
+                s32 br = z[2 * b], bi = z[2 * b + 1];
+                s32 tr = MulQ30(br, c) + MulQ30(bi, s);
+                s32 ti = MulQ30(bi, c) - MulQ30(br, s);
+                z[2 * b] = z[2 * a] - tr;
+                z[2 * b + 1] = z[2 * a + 1] - ti;
+                z[2 * a] += tr;
+                z[2 * a + 1] += ti;
+            }
+        }
+    }
+}
+
+// Inverse MDCT of n/2 coefficients into n samples, through a DCT-IV of
+// the coefficients computed with an n/4 point complex FFT
+static void Imdct(VorbisDecoder* dec, const VorbisBlock* blk, const s32* x, s32* y) {
+    int n = blk->n;
+    int half = n / 2;
+    int quarter = n / 4;
+    s32* z = dec->fft;
+
+    for(int k = 0; k < quarter; k++) {
+        s32 re = x[2 * k];
+        s32 im = x[half - 1 - 2 * k];
+        s32 c = blk->preTwiddle[2 * k];
+        s32 s = blk->preTwiddle[2 * k + 1];
+        int j = blk->bitReverse[k];
+        z[2 * j] = MulQ30(re, c) + MulQ30(im, s);
+        z[2 * j + 1] = MulQ30(im, c) - MulQ30(re, s);
+    }
+
+    if(quarter > 1) Fft(z, quarter, blk->fftTwiddle);
+
+    // DCT-IV output u[2l] and u[half - 1 - 2l], each landing twice in
+    // the output with the IMDCT symmetries
+    for(int l = 0; l < quarter; l++) {
+        s32 vr = z[2 * l], vi = z[2 * l + 1];
+        s32 c = blk->postTwiddle[2 * l];
+        s32 s = blk->postTwiddle[2 * l + 1];
+        s32 even = MulQ30(vr, c) + MulQ30(vi, s);
+        s32 odd = MulQ30(vr, s) - MulQ30(vi, c);
+        int m;
+
+        m = 2 * l;
+        if(m >= quarter) {
+            y[m - quarter] = even;
+        } else {
+            y[m + 3 * quarter] = -even;
+        }
+        y[3 * quarter - 1 - m] = -even;
+
+        m = half - 1 - 2 * l;
+        if(m >= quarter) {
+            y[m - quarter] = odd;
+        } else {
+            y[m + 3 * quarter] = -odd;
+        }
+        y[3 * quarter - 1 - m] = -odd;
+    }
+}
+
+static inline s16 ClipSample(s32 v) {
+    v = (v + (1 << (VORBIS_SPECTRUM_BITS - 16))) >> (VORBIS_SPECTRUM_BITS - 15);
+    if(v > 32767) return 32767;
+    if(v < -32768) return -32768;
+    return (s16)v;
+}
+
+// Returns the number of sample frames put in pcm, or -1 for a packet that
+// is not audio and leaves the stream state alone
+static int DecodePacket(VorbisDecoder* dec) {
+    OggStream* s = &dec->ogg;
+    VorbisBits bits = {s->packet, 0, s->packetSize * 8};
+    VorbisBits* b = &bits;
+    int channels = dec->info.channels;
+
+    if(s->packetSize == 0 || ReadBits(b, 1) != 0) return -1;
+
+    int modeNumber = ReadBits(b, dec->modeBits);
+    if(modeNumber >= dec->modeCount) return -1;
+
+    const VorbisMode* mode = &dec->modes[modeNumber];
+    int flag = mode->blockflag;
+    int previousFlag = flag;
+    int nextFlag = flag;
+    if(flag) {
+        previousFlag = ReadBits(b, 1);
+        nextFlag = ReadBits(b, 1);
+    }
+    if(b->pos > b->end) return -1;
+
+    int n = dec->blocksize[flag];
+    int half = n / 2;
+    const VorbisMapping* map = &dec->mappings[mode->mapping];
+    int floorUsed[VORBIS_MAX_CHANNELS];
+    int decode[VORBIS_MAX_CHANNELS];
+
+    for(int ch = 0; ch < channels; ch++) {
+        const VorbisFloor* f = &dec->floors[map->submapFloor[map->mux[ch]]];
+        floorUsed[ch] = DecodeFloor(dec, b, f, dec->floorY[ch]);
+        decode[ch] = floorUsed[ch];
+        memset(dec->spectrum[ch], 0, half * sizeof(s32));
+    }
+
+    // Coupled channels are decoded if either of them has a floor
+    for(int i = 0; i < map->couplingSteps; i++) {
+        if(decode[map->magnitude[i]] || decode[map->angle[i]]) {
+            decode[map->magnitude[i]] = decode[map->angle[i]] = 1;
+        }
+    }
+
+    for(int i = 0; i < map->submaps; i++) {
+        int list[VORBIS_MAX_CHANNELS];
+        int flags[VORBIS_MAX_CHANNELS];
+        int count = 0;
+
+        for(int ch = 0; ch < channels; ch++) {
+            if(map->mux[ch] != i) continue;
+            list[count] = ch;
+            flags[count] = decode[ch];
+            count++;
+        }
+
+        // A short packet leaves the rest of the residue at zero
+        if(count) {
+            DecodeResidue(dec, b, &dec->residues[map->submapResidue[i]], list, flags, count, half);
+        }
+    }
+
+    // Undo the square polar channel coupling
+    for(int i = map->couplingSteps - 1; i >= 0; i--) {
+        s32* mag = dec->spectrum[map->magnitude[i]];
+        s32* ang = dec->spectrum[map->angle[i]];
+
+        for(int j = 0; j < half; j++) {
+            s32 m = mag[j], a = ang[j];
+            if(m > 0) {
+                if(a > 0) {
+                    ang[j] = m - a;
+                } else {
+                    ang[j] = m;
+                    mag[j] = m + a;
+                }
+            } else {
+                if(a > 0) {
+                    ang[j] = m + a;
+                } else {
+                    ang[j] = m;
+                    mag[j] = m - a;
+                }
+            }
+        }
+    }
+
+    // Window shape: slopes of the long window shrink to the short window's
+    // next to a short block
+    int leftStart = 0, leftSize = half;
+    int rightStart = half, rightSize = half;
+    const s32* leftSlope = dec->block[flag].slope;
+    const s32* rightSlope = dec->block[flag].slope;
+    if(flag && !previousFlag) {
+        leftSize = dec->blocksize[0] / 2;
+        leftStart = n / 4 - leftSize / 2;
+        leftSlope = dec->block[0].slope;
+    }
+    if(flag && !nextFlag) {
+        rightSize = dec->blocksize[0] / 2;
+        rightStart = 3 * n / 4 - rightSize / 2;
+        rightSlope = dec->block[0].slope;
+    }
+
+    int previous = dec->previousSize;
+    int frames = previous ? previous / 4 + n / 4 : 0;
+    s32* y = dec->imdct;
+
+    for(int ch = 0; ch < channels; ch++) {
+        if(floorUsed[ch]) {
+            const VorbisFloor* f = &dec->floors[map->submapFloor[map->mux[ch]]];
+            ApplyFloorCurve(f, dec->floorY[ch], half, dec->spectrum[ch]);
+            Imdct(dec, &dec->block[flag], dec->spectrum[ch], y);
+        } else {
+            memset(y, 0, n * sizeof(s32));
+        }
+
+        // Left half: zero, rising slope, then flat
+        for(int i = 0; i < leftStart; i++) y[i] = 0;
+        for(int i = 0; i < leftSize; i++) {
+            y[leftStart + i] = MulQ30(y[leftStart + i], leftSlope[i]);
+        }
+
+        // Overlap the previous block's right half, which ends a quarter
+        // block past where this block's left half starts
+        if(previous) {
+            const s32* prev = dec->overlap[ch];
+            int prevHalf = previous / 2;
+            int shift = previous / 4 - n / 4;
+            s16* out = dec->pcm + ch;
+
+            for(int j = 0; j < frames; j++) {
+                s32 v = j < prevHalf ? prev[j] : 0;
+                int k = j - shift;
+                if(k >= 0) v += y[k];
+                out[j * channels] = ClipSample(v);
+            }
+        }
+
+        // Right half: flat, falling slope, then zero. Kept for the next block.
+        s32* keep = dec->overlap[ch];
+        int rightEnd = rightStart + rightSize;
+        for(int i = half; i < rightStart; i++) keep[i - half] = y[i];
+        for(int i = 0; i < rightSize; i++) {
+            keep[rightStart - half + i] = MulQ30(y[rightStart + i], rightSlope[rightSize - 1 - i]);
+        }
+        for(int i = rightEnd; i < n; i++) keep[i - half] = 0;
+    }
+
+    dec->previousSize = n;
+    return frames;
+}
+
+static void ResetDecodeState(VorbisDecoder* dec, s64 offset, s64 position) {
+    SeekOggStream(&dec->ogg, offset);
+    dec->position = position;
+    dec->previousSize = 0;
+    dec->pcmFrames = 0;
+    dec->pcmRead = 0;
+}
+
+// Start decoding at the first page of the stream at or after offset. The
+// granule of the first page after it that ends a packet, less the samples
+// each packet adds from the first one started on the start page, gives
+// the sample at which that packet ends, which is where output starts once
+// it has primed the overlap.
+//
+// The last page's granule cuts the stream short instead of counting its
+// packets, so it can only be started from when it is also the first.
+static int StartAtPage(VorbisDecoder* dec, s64 offset) {
+    OggStream* s = &dec->ogg;
+    OggPage page;
+    s64 start = -1;
+    s64 span = 0;
+    int first = 0;      // block size of the first counted packet
+    int last = 0;       // and of the latest one
+    int pending = 0;    // block size of a packet still open at a page end
+    int skip = 0;
+
+    s->havePage = 0;
+
+    for(;;) {
+        offset = FindOggPage(s->io, offset, s->end, &page, s->body);
+        if(offset < 0) return -1;
+        if(page.serial != s->serial) {
+            offset += page.size;
+            continue;
+        }
+
+        int pos = 0;
+        int segment = 0;
+
+        if(start < 0) {
+            start = offset;
+            skip = (page.flags & OGG_PAGE_CONTINUED) != 0;
+        }
+
+        // Skip the tail of a packet begun before the start page
+        while(skip && segment < page.segments) {
+            int lace = page.lacing[segment++];
+            pos += lace;
+            if(lace < 255) skip = 0;
+        }
+
+        while(segment < page.segments) {
+            int size = pending;
+            int lace = page.lacing[segment];
+
+            // Audio packets: type bit clear, then the mode number
+            if(!pending && lace > 0 && !(s->body[pos] & 1)) {
+                int mode = (s->body[pos] >> 1) & ((1 << dec->modeBits) - 1);
+                if(mode < dec->modeCount) size = dec->blocksize[dec->modes[mode].blockflag];
+            }
+            pending = 0;
+
+            int complete = 0;
+            while(segment < page.segments) {
+                lace = page.lacing[segment++];
+                pos += lace;
+                if(lace < 255) {
+                    complete = 1;
+                    break;
+                }
+            }
+            if(!complete) {
+                pending = size;
+                break;
+            }
+            if(!size) continue;
+
+            if(last) span += last / 4 + size / 4;
+            if(!first) first = size;
+            last = size;
+        }
+
+        if(page.granule >= 0 && first) {
+            if(page.flags & OGG_PAGE_EOS) {
+                if(start != dec->audioStart) return -1;
+                ResetDecodeState(dec, start, 0);
+            } else {
+                ResetDecodeState(dec, start, page.granule - span);
+            }
+            return 0;
+        }
+
+        offset += page.size;
+    }
+}
+
+static int DecodeNextPacket(VorbisDecoder* dec) {
+    for(;;) {
+        if(!ReadOggPacket(&dec->ogg)) return -1;
+
+        int frames = DecodePacket(dec);
+        if(frames > 0) {
+            dec->pcmFrames = frames;
+            dec->pcmRead = 0;
+            return 0;
+        }
+    }
+}
+
+// Exact from the last page's granule; a stream cut before any page with
+// one gets an estimate from the nominal bitrate, or 128kbps
+static void ReadLength(OggStream* s, VorbisInfo* info) {
+    info->totalSamples = FindLastOggGranule(s);
+    info->exactLength = info->totalSamples >= 0;
+
+    if(!info->exactLength) {
+        int kbps = info->bitrate > 0 ? info->bitrate : 128;
+        info->totalSamples = s->io->size * 8 / kbps * info->sampleRate / 1000;
+    }
+}
+
+// Header packets are read with a growing buffer; audio decoding gets a
+// fixed one after that
+static int ReadHeaders(VorbisDecoder* dec) {
+    OggStream* s = &dec->ogg;
+
+    if(!ReadOggPacket(s) ||
+       ReadIdentification(s->packet, s->packetSize, &dec->info, dec->blocksize) != 0) return -1;
+
+    if(!ReadOggPacket(s) || s->packetSize < 7 || s->packet[0] != 3 ||
+       memcmp(s->packet + 1, "vorbis", 6) != 0) return -1;
+
+    if(!ReadOggPacket(s) || ReadSetup(dec, s->packet, s->packetSize) != 0) return -1;
+
+    // Audio begins on a fresh page
+    dec->audioStart = s->nextPage;
+
+    return SetOggPacketLimit(s, VORBIS_MAX_AUDIO_PACKET);
+}
+
+VorbisDecoder* OpenVorbisDecoder(MediaIO* io) {
+    VorbisDecoder* dec = calloc(1, sizeof(VorbisDecoder));
+    if(!dec) return NULL;
+
+    InitVorbisTables();
+
+    dec->io = io;
+    if(OpenOggStream(&dec->ogg, io, 0, io->size, VORBIS_MAX_HEADER_PACKET) != 0) {
+        free(dec);
+        return NULL;
+    }
+
+    if(ReadHeaders(dec) != 0 || AllocateDecodeState(dec) != 0) {
+        CloseVorbisDecoder(dec);
+        return NULL;
+    }
+
+    ReadLength(&dec->ogg, &dec->info);
+
+    if(SeekVorbisSample(dec, 0) != 0) {
+        CloseVorbisDecoder(dec);
+        return NULL;
+    }
+
+    return dec;
+}
+
+void CloseVorbisDecoder(VorbisDecoder* dec) {
+    if(!dec) return;
+
+    CloseOggStream(&dec->ogg);
+    FreeArena(dec);
+    free(dec);
+}
+
+const VorbisInfo* GetVorbisInfo(const VorbisDecoder* dec) {
+    return &dec->info;
+}
+
+s64 GetVorbisPosition(const VorbisDecoder* dec) {
+    return dec->position;
+}
+
+int ReadVorbisSamples(VorbisDecoder* dec, s16* out, int maxFrames) {
+    int nch = dec->info.channels;
+    int done = 0;
+
+    while(done < maxFrames) {
+        if(dec->pcmRead >= dec->pcmFrames) {
+            if(DecodeNextPacket(dec) != 0) break;
+            continue;
+        }
+
+        int n = dec->pcmFrames - dec->pcmRead;
+
+        // Samples before the seek target or the start of the stream
+        if(dec->discard > 0) {
+            if(n > dec->discard) n = (int)dec->discard;
+            dec->discard -= n;
+            dec->pcmRead += n;
+            dec->position += n;
+            continue;
+        }
+
+        if(n > maxFrames - done) n = maxFrames - done;
+
+        // The last page's granule cuts the final block short
+        if(dec->info.exactLength) {
+            s64 left = dec->info.totalSamples - dec->position;
+            if(left <= 0) break;
+            if(n > left) n = (int)left;
+        }
+
+        memcpy(out + done * nch, dec->pcm + dec->pcmRead * nch, n * nch * sizeof(s16));
+        dec->pcmRead += n;
+        dec->position += n;
+        done += n;
+    }
+
+    return done;
+}
+
+// Offset of the page after the last page whose granule is below target.
+// That page itself goes to previous, for when the one after it is the last.
+static s64 BisectPage(VorbisDecoder* dec, s64 target, s64* previous) {
+    OggStream* s = &dec->ogg;
+    OggPage page;
+    s64 lo = dec->audioStart;
+    s64 hi = s->end;
+    s64 best = dec->audioStart;
+
+    *previous = dec->audioStart;
+
+    while(hi - lo > VORBIS_BISECT_LINEAR) {
+        s64 mid = lo + (hi - lo) / 2;
+        s64 offset = FindOggGranulePage(s, mid, hi, &page);
+
+        if(offset >= 0 && page.granule < target) {
+            *previous = offset;
+            lo = best = offset + page.size;
+        } else {
+            hi = mid;
+        }
+    }
+
+    s64 offset = lo;
+    while((offset = FindOggGranulePage(s, offset, s->end, &page)) >= 0 && page.granule < target) {
+        *previous = offset;
+        offset += page.size;
+        best = offset;
+    }
+
+    return best;
+}
+
+int SeekVorbisSample(VorbisDecoder* dec, s64 sample) {
+    if(sample < 0) sample = 0;
+    if(dec->info.exactLength && sample > dec->info.totalSamples) sample = dec->info.totalSamples;
+
+    // The packets between the chosen page and the first one that starts
+    // on the next page can each return up to half a long block
+    s64 target = sample - dec->blocksize[1];
+    s64 previous = dec->audioStart;
+    s64 page = target > 0 ? BisectPage(dec, target, &previous) : dec->audioStart;
+
+    if(StartAtPage(dec, page) != 0 && StartAtPage(dec, previous) != 0 &&
+       StartAtPage(dec, dec->audioStart) != 0) return -1;
+
+    // Usually lands before the target; the difference is decoded and dropped
+    dec->discard = sample > dec->position ? sample - dec->position : 0;
+    return 0;
+}
+
+int ReadVorbisInfo(MediaIO* io, VorbisInfo* info) {
+    OggStream s;
+    int blocksize[2];
+    int result = -1;
+
+    if(OpenOggStream(&s, io, 0, io->size, 4096) != 0) return -1;
+
+    if(ReadOggPacket(&s) && ReadIdentification(s.packet, s.packetSize, info, blocksize) == 0) {
+        ReadLength(&s, info);
+        result = 0;
+    }
+
+    CloseOggStream(&s);
+    return result;
+}
@@ -0,0 +1,37 @@
+#ifndef VORBIS_H
+#define VORBIS_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+// Ogg Vorbis I decoder. Like Tremor it decodes in integer arithmetic only:
+// codebook values are Q16, the spectrum and IMDCT Q20, and floating point
+// is used once per file to build the codebook and transform tables.
+//
+// Everything the decoder needs is carved from one arena while the setup
+// header is read, so decoding a packet never allocates. Seeks bisect on
+// page granule positions and land on the exact sample.
+
+typedef struct {
+    int sampleRate;
+    int channels;
+    int bitrate;        // nominal kbps, 0 when the stream does not say
+    s64 totalSamples;   // per channel, from the granule of the last page
+                        // or estimated from the bitrate if there is none
+    int exactLength;
+} VorbisInfo;
+
+typedef struct VorbisDecoder VorbisDecoder;
+
+// Function prototypes
+VorbisDecoder* OpenVorbisDecoder(MediaIO* io);
+void CloseVorbisDecoder(VorbisDecoder* decoder);
+const VorbisInfo* GetVorbisInfo(const VorbisDecoder* decoder);
+int ReadVorbisSamples(VorbisDecoder* decoder, s16* out, int maxFrames);
+int SeekVorbisSample(VorbisDecoder* decoder, s64 sample);
+s64 GetVorbisPosition(const VorbisDecoder* decoder);
+
+// Identification header and length only, without building the decoder
+int ReadVorbisInfo(MediaIO* io, VorbisInfo* info);
+
+#endif // VORBIS_H
@@ -0,0 +1,106 @@
+#include <string.h>
+#include "wav.h"
+#include "pcm.h"
+
+int ParseWavHeader(MediaIO* io, WavInfo* info) {
+    u8 header[40];
+    int haveFormat = 0;
+
+    memset(info, 0, sizeof(WavInfo));
+
+    if(SeekMediaIO(io, 0) != 0) return -1;
+    if(ReadMediaIO(io, header, 12) != 12) return -1;
+    if(memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) return -1;
+
+    // Chunks can come in any order and "fmt " is not always first
+    while(io->position + 8 <= io->size) {
+        if(ReadMediaIO(io, header, 8) != 8) return -1;
+
+        u32 chunkSize = GetLE32(header + 4);
+        s64 chunkStart = io->position;
+
+        if(memcmp(header, "fmt ", 4) == 0) {
+            int n = chunkSize < sizeof(header) ? (int)chunkSize : (int)sizeof(header);
+            if(n < 16 || ReadMediaIO(io, header, n) != n) return -1;
+
+            int formatTag = GetLE16(header);
+            info->channels = GetLE16(header + 2);
+            info->sampleRate = (int)GetLE32(header + 4);
+            info->blockAlign = GetLE16(header + 12);
+            info->bitsPerSample = GetLE16(header + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub-format GUID
+            if(formatTag == WAVE_FORMAT_EXTENSIBLE && n >= 26) {
+                formatTag = GetLE16(header + 24);
+            }
+            if(formatTag != WAVE_FORMAT_PCM) return -1;
+
+            haveFormat = 1;
+        } else if(memcmp(header, "data", 4) == 0) {
+            if(!haveFormat) return -1;
+
+            info->dataOffset = chunkStart;
+            info->dataSize = chunkSize;
+
+            // Streaming writers leave the size at 0 or -1, trust the file
+            if(chunkSize == 0 || chunkSize == 0xFFFFFFFF ||
+               info->dataOffset + info->dataSize > io->size) {
+                info->dataSize = io->size - info->dataOffset;
+            }
+            break;
+        }
+
+        // Chunks are padded to an even size
+        if(SeekMediaIO(io, chunkStart + chunkSize + (chunkSize & 1)) != 0) return -1;
+    }
+
+    if(!haveFormat || info->dataOffset == 0) return -1;
+    if(info->channels < 1 || info->channels > 2 || info->sampleRate <= 0) return -1;
+    if(info->bitsPerSample != 8 && info->bitsPerSample != 16 &&
+       info->bitsPerSample != 24 && info->bitsPerSample != 32) return -1;
+    if(info->blockAlign != info->channels * (info->bitsPerSample / 8)) return -1;
+
+    info->totalFrames = info->dataSize / info->blockAlign;
+
+    return SeekMediaIO(io, info->dataOffset);
+}
+
+int ReadWavFrames(MediaIO* io, const WavInfo* info, s16* out, int maxFrames, u8* scratch) {
+    s64 dataEnd = info->dataOffset + info->totalFrames * info->blockAlign;
+    s64 remaining = (dataEnd - io->position) / info->blockAlign;
+
+    if(remaining <= 0 || maxFrames <= 0) return 0;
+    if(maxFrames > remaining) maxFrames = (int)remaining;
+
+    int samples;
+
+    switch(info->bitsPerSample) {
+        case 16:
+            // Same size in and out: read straight into the output and swap
+            samples = ReadMediaIO(io, out, maxFrames * info->blockAlign) / 2;
+            ConvertSamplesS16LE(out, out, samples);
+            break;
+        case 8:
+            samples = ReadMediaIO(io, out, maxFrames * info->blockAlign);
+            ConvertSamplesU8(out, (const u8*)out, samples);
+            break;
+        case 24:
+            samples = ReadMediaIO(io, scratch, maxFrames * info->blockAlign) / 3;
+            ConvertSamplesS24LE(out, scratch, samples);
+            break;
+        default:
+            samples = ReadMediaIO(io, scratch, maxFrames * info->blockAlign) / 4;
+            ConvertSamplesS32LE(out, scratch, samples);
+            break;
+    }
+
+    // Drop a partial frame at a truncated end of file
+    return samples / info->channels;
+}
+
+int SeekWavFrame(MediaIO* io, const WavInfo* info, s64 frame) {
+    if(frame < 0) frame = 0;
+    if(frame > info->totalFrames) frame = info->totalFrames;
+
+    return SeekMediaIO(io, info->dataOffset + frame * info->blockAlign);
+}
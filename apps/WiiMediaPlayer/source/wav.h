@@ -0,0 +1,33 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include "platform.h"
+#include "mediaio.h"
+
+#define WAVE_FORMAT_PCM        0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+// Parsed RIFF/WAVE stream description
+typedef struct {
+    int sampleRate;
+    int channels;
+    int bitsPerSample;
+    int blockAlign;
+    s64 dataOffset;   // first byte of the "data" chunk payload
+    s64 dataSize;     // payload size in bytes
+    s64 totalFrames;  // sample frames in the file
+} WavInfo;
+
+// Walk the RIFF chunk list. Returns 0 and leaves io at the start of the
+// sample data, or -1 if this is not integer PCM we can play.
+int ParseWavHeader(MediaIO* io, WavInfo* info);
+
+// Read up to maxFrames sample frames from the current position and convert
+// them to native-endian s16. scratch must hold maxFrames * blockAlign bytes
+// when the source is not 16-bit. Returns frames read.
+int ReadWavFrames(MediaIO* io, const WavInfo* info, s16* out, int maxFrames, u8* scratch);
+
+// Position the stream at the given sample frame
+int SeekWavFrame(MediaIO* io, const WavInfo* info, s64 frame);
+
+#endif // WAV_H
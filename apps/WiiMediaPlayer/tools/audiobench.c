@@ -0,0 +1,107 @@
+// Host benchmark for the audio decoders (make bench)
+//
+// Decodes a file start to end through the same AudioDecoder calls the
+// player uses, then times random seeks. The decode load is scaled to the
+// 729 MHz Broadway by the host clock given with -mhz; that ignores the
+// difference in instructions per clock, so read it as a lower bound and
+// keep well under 50% for the fill thread to have room.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "decoder.h"
+#include "readahead.h"
+
+#define BENCH_BUFFER_SIZE 8192
+#define BROADWAY_MHZ 729.0
+
+int main(int argc, char** argv) {
+    const char* filename = NULL;
+    double hostMhz = 0;
+    int seeks = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-mhz") == 0 && i + 1 < argc) {
+            hostMhz = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-seeks") == 0 && i + 1 < argc) {
+            seeks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            SetDecoderReadAhead(atoi(argv[++i]));
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if(!filename) {
+        fprintf(stderr, "usage: audiobench [-mhz host-clock] [-seeks count] [-window blocks] file\n");
+        return 1;
+    }
+
+    double start = Now();
+    AudioDecoder* decoder = InitAudioDecoder(filename);
+    if(!decoder) {
+        fprintf(stderr, "%s: cannot decode\n", filename);
+        return 1;
+    }
+    double openTime = Now() - start;
+
+    static u8 buffer[BENCH_BUFFER_SIZE];
+    int frameBytes = decoder->channels * 2;
+    s64 frames = 0;
+    int bytes;
+
+    start = Now();
+    while((bytes = ReadAudioFrame(decoder, buffer, sizeof(buffer))) > 0) {
+        frames += bytes / frameBytes;
+    }
+    double decodeTime = Now() - start;
+    double audioTime = (double)frames / decoder->sampleRate;
+
+    printf("%s: %d Hz, %d channels, %.1f s\n", filename, decoder->sampleRate,
+           decoder->channels, audioTime);
+    printf("open      %8.2f ms\n", openTime * 1000);
+    printf("decode    %8.2f ms, %.1fx real time\n", decodeTime * 1000,
+           decodeTime > 0 ? audioTime / decodeTime : 0);
+    if(hostMhz > 0 && audioTime > 0) {
+        printf("broadway  %8.1f%% of %.0f MHz (scaled by clock only)\n",
+               100.0 * decodeTime * hostMhz / (audioTime * BROADWAY_MHZ), BROADWAY_MHZ);
+    }
+
+    // Seek and decode one buffer, as the player does after a jump
+    int length = (int)audioTime;
+    if(length > 0 && seeks > 0) {
+        double total = 0, worst = 0;
+        int failed = 0;
+
+        srand(1);
+        for(int i = 0; i < seeks; i++) {
+            int target = rand() % length;
+
+            start = Now();
+            if(SeekAudioDecoder(decoder, target) != 0 ||
+               ReadAudioFrame(decoder, buffer, sizeof(buffer)) <= 0) failed++;
+            double t = Now() - start;
+
+            total += t;
+            if(t > worst) worst = t;
+        }
+
+        printf("seek      %8.2f ms average, %.2f ms worst over %d", total * 1000 / seeks,
+               worst * 1000, seeks);
+        if(failed) printf(", %d failed", failed);
+        printf("\n");
+    }
+
+    // Counters of the read-ahead thread, when it ran
+    MediaIOStats stats;
+    GetMediaIOStats(&decoder->io, &stats);
+    if(stats.hits + stats.misses > 0) {
+        printf("io        %8.1f KB prefetched, %u hits, %u misses, %.2f ms stalled\n",
+               stats.bytesPrefetched / 1024.0, stats.hits, stats.misses,
+               stats.stallMicroseconds / 1000.0);
+    }
+
+    CloseAudioDecoder(decoder);
+    return 0;
+}
@@ -0,0 +1,232 @@
+#ifndef AVIFIXTURE_H
+#define AVIFIXTURE_H
+
+// The AVI files the playback benches play (make bench): raw frames of one
+// video stream, optionally an idx1 with keyframes and a 16-bit stereo PCM
+// sound track interleaved, written to a scratch folder that is removed
+// again at the end.
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "platform.h"
+
+typedef struct {
+    const char* codec;      // fourcc of the frames, e.g. "YUY2"
+    int width;
+    int height;
+    u32 frameRate;          // frames per second as frameRate / frameScale
+    u32 frameScale;
+    int frames;
+    int keyframeInterval;   // idx1 marks every nth frame; 0 writes none and the demuxer scans
+    int big;                // frame written bigExtra bytes too long, -1 for none
+    int bigExtra;
+    int sampleRate;         // of the sound track, 0 for none
+
+    // Fills frame number's payload; NULL puts the number in the first
+    // four bytes and zeroes the rest
+    void (*picture)(u8* data, u32 size, int number, void* userdata);
+    void* userdata;
+} AviFixture;
+
+static inline void PutLE16(u8* p, u32 value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static inline void PutLE32(u8* p, u32 value) {
+    PutLE16(p, value);
+    PutLE16(p + 2, value >> 16);
+}
+
+static inline void PutChunk(FILE* file, const char* id, u32 size) {
+    u8 header[8];
+    memcpy(header, id, 4);
+    PutLE32(header + 4, size);
+    fwrite(header, 1, 8, file);
+}
+
+// The stereo sample frame n of the sound track: its number, and the
+// number inverted
+static inline void AviFixtureSample(s64 n, s16* left, s16* right) {
+    *left = (s16)n;
+    *right = (s16)~n;
+}
+
+// Sample frames of sound before video frame f. Each frame is followed by
+// the chunk up to the next one's time, so the chunks differ in size where
+// the rates don't divide.
+static inline s64 AviFixtureSamplesBefore(const AviFixture* fixture, s64 f) {
+    return f * fixture->frameScale * fixture->sampleRate / fixture->frameRate;
+}
+
+// The frame number AviFixture writes by default
+static inline u32 AviFixtureNumber(const u8* data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (u32)data[3] << 24;
+}
+
+// Returns 0, or -1 if the file can't be written
+static inline int WriteAviFixture(const char* path, const AviFixture* fixture) {
+    int sound = fixture->sampleRate > 0;
+    int entries = fixture->keyframeInterval ? fixture->frames * (sound ? 2 : 1) : 0;
+    u32 frameSize = fixture->width * fixture->height * 2;
+    u32 strl = 4 + 8 + 56 + 8 + 40;
+    u32 soundStrl = 4 + 8 + 56 + 8 + 16;
+    u32 hdrl = 4 + 8 + 56 + 8 + strl + (sound ? 8 + soundStrl : 0);
+    s64 samples = sound ? AviFixtureSamplesBefore(fixture, fixture->frames) : 0;
+    u32 soundMax = sound ? (u32)(AviFixtureSamplesBefore(fixture, 1) + 1) * 4 : 0;
+
+    FILE* file = fopen(path, "wb");
+    u8* frame = malloc(frameSize + (fixture->big >= 0 ? fixture->bigExtra : 0) + 1);
+    u8* pcm = malloc(soundMax + 1);
+    u8* index = malloc(entries * 16 + 1);
+    if(!file || !frame || !pcm || !index) {
+        if(file) fclose(file);
+        free(frame);
+        free(pcm);
+        free(index);
+        return -1;
+    }
+
+    u8 avih[56] = {0}, strh[56] = {0}, strf[40] = {0};
+    PutLE32(avih, (u32)((u64)fixture->frameScale * 1000000 / fixture->frameRate));
+    PutLE32(avih + 12, entries ? 0x10 : 0);
+    PutLE32(avih + 16, fixture->frames);
+    PutLE32(avih + 24, sound ? 2 : 1);
+    PutLE32(avih + 28, frameSize);
+    PutLE32(avih + 32, fixture->width);
+    PutLE32(avih + 36, fixture->height);
+
+    memcpy(strh, "vids", 4);
+    memcpy(strh + 4, fixture->codec, 4);
+    PutLE32(strh + 20, fixture->frameScale);
+    PutLE32(strh + 24, fixture->frameRate);
+    PutLE32(strh + 32, fixture->frames);
+    PutLE32(strh + 36, frameSize);
+
+    PutLE32(strf, 40);
+    PutLE32(strf + 4, fixture->width);
+    PutLE32(strf + 8, fixture->height);
+    PutLE16(strf + 12, 1);
+    PutLE16(strf + 14, 16);
+    memcpy(strf + 16, fixture->codec, 4);
+    PutLE32(strf + 20, frameSize);
+
+    // RIFF and movi sizes are put in once the chunks are written
+    PutChunk(file, "RIFF", 0);
+    fwrite("AVI ", 1, 4, file);
+    PutChunk(file, "LIST", hdrl);
+    fwrite("hdrl", 1, 4, file);
+    PutChunk(file, "avih", sizeof(avih));
+    fwrite(avih, 1, sizeof(avih), file);
+    PutChunk(file, "LIST", strl);
+    fwrite("strl", 1, 4, file);
+    PutChunk(file, "strh", sizeof(strh));
+    fwrite(strh, 1, sizeof(strh), file);
+    PutChunk(file, "strf", sizeof(strf));
+    fwrite(strf, 1, sizeof(strf), file);
+    if(sound) {
+        u8 auds[56] = {0}, wave[16] = {0};
+        memcpy(auds, "auds", 4);
+        PutLE32(auds + 20, 4);
+        PutLE32(auds + 24, fixture->sampleRate * 4);
+        PutLE32(auds + 32, (u32)samples);
+        PutLE16(wave, 1);
+        PutLE16(wave + 2, 2);
+        PutLE32(wave + 4, fixture->sampleRate);
+        PutLE32(wave + 8, fixture->sampleRate * 4);
+        PutLE16(wave + 12, 4);
+        PutLE16(wave + 14, 16);
+
+        PutChunk(file, "LIST", soundStrl);
+        fwrite("strl", 1, 4, file);
+        PutChunk(file, "strh", sizeof(auds));
+        fwrite(auds, 1, sizeof(auds), file);
+        PutChunk(file, "strf", sizeof(wave));
+        fwrite(wave, 1, sizeof(wave), file);
+    }
+    long moviList = ftell(file);
+    PutChunk(file, "LIST", 0);
+    fwrite("movi", 1, 4, file);
+
+    // idx1 offsets are from the movi list type to each chunk header
+    u8* entry = index;
+    for(int f = 0; f < fixture->frames; f++) {
+        u32 size = f == fixture->big ? frameSize + fixture->bigExtra : frameSize;
+        if(fixture->picture) {
+            fixture->picture(frame, size, f, fixture->userdata);
+        } else {
+            memset(frame, 0, size);
+            PutLE32(frame, f);
+        }
+        if(entries) {
+            memcpy(entry, "00dc", 4);
+            PutLE32(entry + 4, f % fixture->keyframeInterval == 0 ? 0x10 : 0);
+            PutLE32(entry + 8, (u32)(ftell(file) - moviList - 8));
+            PutLE32(entry + 12, size);
+            entry += 16;
+        }
+        frame[size] = 0;
+        PutChunk(file, "00dc", size);
+        fwrite(frame, 1, size + (size & 1), file);
+
+        if(sound) {
+            s64 from = AviFixtureSamplesBefore(fixture, f), to = AviFixtureSamplesBefore(fixture, f + 1);
+            for(s64 n = from; n < to; n++) {
+                s16 left, right;
+                AviFixtureSample(n, &left, &right);
+                PutLE16(pcm + (n - from) * 4, (u16)left);
+                PutLE16(pcm + (n - from) * 4 + 2, (u16)right);
+            }
+            if(entries) {
+                memcpy(entry, "01wb", 4);
+                PutLE32(entry + 4, 0x10);
+                PutLE32(entry + 8, (u32)(ftell(file) - moviList - 8));
+                PutLE32(entry + 12, (u32)(to - from) * 4);
+                entry += 16;
+            }
+            PutChunk(file, "01wb", (u32)(to - from) * 4);
+            fwrite(pcm, 1, (to - from) * 4, file);
+        }
+    }
+    long moviEnd = ftell(file);
+    if(entries) {
+        PutChunk(file, "idx1", entries * 16);
+        fwrite(index, 1, entries * 16, file);
+    }
+    long end = ftell(file);
+
+    u8 size[4];
+    fseek(file, 4, SEEK_SET);
+    PutLE32(size, (u32)(end - 8));
+    fwrite(size, 1, 4, file);
+    fseek(file, moviList + 4, SEEK_SET);
+    PutLE32(size, (u32)(moviEnd - moviList - 8));
+    fwrite(size, 1, 4, file);
+
+    free(frame);
+    free(pcm);
+    free(index);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+static inline void RemoveDirectory(const char* path) {
+    DIR* directory = opendir(path);
+    if(directory) {
+        struct dirent* entry;
+        char name[512];
+        while((entry = readdir(directory))) {
+            if(entry->d_name[0] == '.') continue;
+            if(snprintf(name, sizeof(name), "%s/%s", path, entry->d_name) >= (int)sizeof(name)) continue;
+            RemoveDirectory(name);
+        }
+        closedir(directory);
+        rmdir(path);
+    } else {
+        unlink(path);
+    }
+}
+
+#endif // AVIFIXTURE_H
@@ -0,0 +1,253 @@
+// Host check for the A/V clock (make bench)
+//
+// Plays a two hour raw AVI at 23.976 fps (frames of 8x2, so the file
+// stays small) through the pipeline on a 59.94Hz display, with the audio
+// master at 48kHz reporting its position a little late and unevenly as
+// the voice does, and a 25 fps one on 50Hz at 44.1kHz. Every frame must
+// go up within one frame of the audio all the way to the end, none may
+// be dropped, and the clock must still match the audio at the end. Then
+// checks the A/V offset moves the pictures and is clamped, and that a
+// change of audio speed doesn't move the clock. Last, a minute of each
+// with a 16-bit PCM sound track interleaved is played through the sound
+// track decoder: every sample must come out, and after a seek it must
+// start on the sample the time names.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avifixture.h"
+#include "avsync.h"
+#include "bench.h"
+#include "decoder.h"
+#include "pipeline.h"
+#include "sidecar.h"
+
+#define FRAME_WIDTH     8
+#define FRAME_HEIGHT    2
+#define SOUND_SECONDS   60
+
+typedef struct {
+    const char* name;
+    u32 frameRate;          // frames per second as frameRate / frameScale
+    u32 frameScale;
+    int sampleRate;
+    int refreshRate;        // refreshes per second as refreshRate / refreshScale
+    int refreshScale;
+    int seconds;
+} SyncCase;
+
+static const SyncCase cases[] = {
+    {"23.976 fps, 48kHz, 59.94Hz", 24000, 1001, 48000, 60000, 1001, 7200},
+    {"25 fps, 44.1kHz, 50Hz", 25, 1, 44100, 50, 1, 7200},
+};
+
+// Raw YUY2, every frame holding its number, with no index. With sound,
+// the PCM track is interleaved frame by frame.
+static AviFixture SyncFixture(const SyncCase* test, int frames, int sound) {
+    AviFixture fixture = {"YUY2", FRAME_WIDTH, FRAME_HEIGHT, test->frameRate, test->frameScale, frames, 0, -1, 0,
+                          sound ? test->sampleRate : 0, NULL, NULL};
+    return fixture;
+}
+
+typedef struct {
+    int shown;
+    int wrongFrame;         // picture not the one its pts names
+    s64 worstLate;          // ms, clock past the frame's time when it went up
+    s64 worstEarly;         // ms, clock short of it
+    s64 endError;           // ms, clock against the true audio time at the end
+} SyncResult;
+
+// One refresh after another until the pipeline runs dry; the audio's
+// position lags up to 10ms behind the truth, by a different amount every
+// time, and the pictures are checked against when they go up
+static void Play(Pipeline* pipeline, MediaClock* clock, const SyncCase* test, s64 limitMs, SyncResult* result) {
+    u32 seed = 1;
+    s64 frameNs = pipeline->frameNanoseconds;
+
+    memset(result, 0, sizeof(SyncResult));
+    ResetMediaClock(clock, test->sampleRate, 0);
+    for(s64 refresh = 0; !IsPipelineFinished(pipeline); refresh++) {
+        // True audio time, in samples, at this refresh
+        s64 samples = refresh * test->refreshScale * test->sampleRate / test->refreshRate;
+        seed = seed * 1103515245 + 12345;
+        s64 reported = samples - (s64)((seed >> 16) % (test->sampleRate / 100));
+        SetMediaClockPosition(clock, reported < 0 ? 0 : reported);
+
+        RunPipeline(pipeline);
+        const PipelineFrame* frame = PresentPipelineFrame(pipeline, GetVideoClock(clock));
+        if(frame) {
+            CountSyncedFrame(clock, frame->pts);
+            result->shown++;
+
+            // The frame's own number against the time it was given
+            u32 number = AviFixtureNumber(frame->data);
+            if(frame->pts != (s64)number * frameNs / 1000000) result->wrongFrame++;
+
+            // Against true time, not the clock: the clock's own error counts
+            s64 truth = samples * 1000 / test->sampleRate - clock->offset;
+            s64 late = truth - frame->pts;
+            if(late > result->worstLate) result->worstLate = late;
+            if(-late > result->worstEarly) result->worstEarly = -late;
+        }
+        if(limitMs && GetMediaClock(clock) >= limitMs) break;
+        result->endError = GetMediaClock(clock) - samples * 1000 / test->sampleRate;
+    }
+}
+
+// Reads the sound track from where it is; returns the sample frames that
+// came out, the first mismatch counted into bad
+static s64 CheckSound(AudioDecoder* sound, s64 first, s64 limit, int* bad) {
+    static s16 buffer[4096];
+    s64 n = first;
+
+    while(n - first < limit) {
+        int bytes = ReadAudioFrame(sound, buffer, sizeof(buffer));
+        if(bytes <= 0) break;
+        for(int i = 0; i < bytes / 4 && n - first < limit; i++, n++) {
+            s16 left, right;
+            AviFixtureSample(n, &left, &right);
+            if(buffer[i * 2] != left || buffer[i * 2 + 1] != right) (*bad)++;
+        }
+    }
+    return n - first;
+}
+
+// A minute with sound, through the decoder the player uses for it
+static int CheckSoundTrack(const char* path, const SyncCase* test) {
+    int frames = (int)((s64)SOUND_SECONDS * test->frameRate / test->frameScale);
+    AviFixture fixture = SyncFixture(test, frames, 1);
+    s64 samples = AviFixtureSamplesBefore(&fixture, frames);
+    VideoDecoder* video = NULL;
+    AudioDecoder* sound = NULL;
+    int failures = 0;
+
+    if(WriteAviFixture(path, &fixture) != 0 || !(video = InitVideoDecoder(path)) ||
+       !(sound = InitSoundTrackDecoder(video))) {
+        printf("  sound track did not open\n");
+        CloseVideoDecoder(video);
+        return 1;
+    }
+
+    int bad = 0;
+    s64 played = CheckSound(sound, 0, samples + 1, &bad);
+    printf("  sound track: %d Hz, %d channels, %d s, %lld of %lld samples, %d wrong\n", sound->sampleRate,
+           sound->channels, sound->duration, (long long)played, (long long)samples, bad);
+    if(sound->sampleRate != test->sampleRate || sound->channels != 2 || played != samples || bad) failures++;
+
+    // Seeks land on the sample the second starts with, mid-chunk
+    static const int seeks[] = {17, 0, SOUND_SECONDS - 1, 31};
+    for(int i = 0; i < 4; i++) {
+        s64 at = (s64)seeks[i] * test->sampleRate;
+        bad = 0;
+        if(SeekAudioDecoder(sound, seeks[i]) != 0 || sound->currentPosition != at ||
+           CheckSound(sound, at, test->sampleRate / 2, &bad) != test->sampleRate / 2 || bad) {
+            printf("  sound track seek to %d s went wrong\n", seeks[i]);
+            failures++;
+        }
+    }
+    if(SeekAudioDecoder(sound, SOUND_SECONDS + 1) == 0) {
+        printf("  sound track seek past the end succeeded\n");
+        failures++;
+    }
+
+    CloseAudioDecoder(sound);
+    CloseVideoDecoder(video);
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        fprintf(stderr, "usage: avsyncbench\n");
+        return 1;
+    }
+
+    char directory[] = "/tmp/avsyncbenchXXXXXX";
+    if(!mkdtemp(directory)) return 1;
+    char path[64], sidecars[64];
+    snprintf(path, sizeof(path), "%s/sync.avi", directory);
+    snprintf(sidecars, sizeof(sidecars), "%s/index", directory);
+    SetSidecarDirectory(sidecars);
+
+    int failures = 0;
+    for(int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+        const SyncCase* test = &cases[c];
+        int frames = (int)((s64)test->seconds * test->frameRate / test->frameScale);
+        VideoDecoder* decoder = NULL;
+        Pipeline pipeline;
+        MediaClock clock = {0};
+        SyncResult result;
+        AviFixture fixture = SyncFixture(test, frames, 0);
+
+        if(WriteAviFixture(path, &fixture) != 0 || !(decoder = InitVideoDecoder(path)) ||
+           OpenPipeline(&pipeline, decoder) != 0) {
+            printf("%s: did not open\n", test->name);
+            CloseVideoDecoder(decoder);
+            failures++;
+            continue;
+        }
+
+        double start = Now();
+        Play(&pipeline, &clock, test, 0, &result);
+        double seconds = Now() - start;
+
+        s64 frameMs = (s64)test->frameScale * 1000 / test->frameRate;
+        printf("%s, %d s: %d of %d frames, %u dropped, %.1f s to run\n", test->name, test->seconds, result.shown,
+               frames, pipeline.stats.dropped, seconds);
+        printf("  on screen up to %lld ms late, %lld ms early; drift avg %d, worst %d ms; clock %+lld ms at "
+               "the end\n", (long long)result.worstLate, (long long)result.worstEarly, (int)clock.stats.averageDrift,
+               (int)clock.stats.worstDrift, (long long)result.endError);
+
+        // Whole frames per second, as fps rounds them, would be this far
+        // off by the last frame
+        int fps = (int)((test->frameRate + test->frameScale / 2) / test->frameScale);
+        s64 exact = (s64)(frames - 1) * test->frameScale * 1000 / test->frameRate;
+        printf("  (at a whole %d fps the last frame would be %lld ms off)\n", fps,
+               (long long)(exact - (s64)(frames - 1) * 1000 / fps));
+
+        if(result.shown != frames || pipeline.stats.dropped || result.wrongFrame || result.worstLate >= frameMs ||
+           result.worstEarly >= frameMs || result.endError < -10 || result.endError > 0) {
+            printf("  out of sync (%d wrong pictures)\n", result.wrongFrame);
+            failures++;
+        }
+
+        // An offset holds the pictures back by that much
+        SetMediaClockOffset(&clock, 200);
+        if(SeekPipeline(&pipeline, 0) != 0) {
+            printf("  seek failed\n");
+            failures++;
+        }
+        Play(&pipeline, &clock, test, 5000, &result);
+        if(result.worstLate >= frameMs || result.worstEarly >= frameMs) {
+            printf("  with a 200 ms offset, %lld ms late, %lld ms early\n", (long long)result.worstLate,
+                   (long long)result.worstEarly);
+            failures++;
+        }
+        SetMediaClockOffset(&clock, -5000);
+        if(clock.offset != -AVSYNC_OFFSET_MAX) {
+            printf("  offset not clamped: %d\n", (int)clock.offset);
+            failures++;
+        }
+
+        // Audio stretched to half speed: the clock carries on from where
+        // it was and then runs at half the voice's pace
+        ResetMediaClock(&clock, test->sampleRate, 60000);
+        SetMediaClockPosition(&clock, test->sampleRate * 10);
+        SetMediaClockRate(&clock, test->sampleRate * 2);
+        s64 changed = GetMediaClock(&clock);
+        SetMediaClockPosition(&clock, test->sampleRate * 14);
+        if(changed != 70000 || GetMediaClock(&clock) != 72000) {
+            printf("  at half speed %lld then %lld ms, expected 70000 then 72000\n", (long long)changed,
+                   (long long)GetMediaClock(&clock));
+            failures++;
+        }
+
+        ClosePipeline(&pipeline);
+        CloseVideoDecoder(decoder);
+
+        failures += CheckSoundTrack(path, test);
+    }
+
+    RemoveDirectory(directory);
+    printf("av sync: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// What every host tool (make bench) times itself with
+
+#include <time.h>
+
+// Monotonic seconds
+static inline double Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif // BENCH_H
@@ -0,0 +1,146 @@
+// Host benchmark for the deinterlacer (make bench)
+//
+// Builds interlaced clips at 480i and 576i from a progressive scene
+// sampled at field rate: fine line detail that stands still and a box
+// that moves. Reports frames/s for each mode, then how far each mode's
+// frames are from the progressive scene at the first field's time, on a
+// still clip and a moving one, both field orders. The adaptive mode has
+// to give back a still clip exactly, do better than bob on it and better
+// than weave on the moving one.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "deinterlace.h"
+
+#define CLIP_FRAMES 8
+
+static const char* modeNames[] = {"off", "bob", "weave", "adaptive"};
+
+// The scene at field time t: alternating light and dark lines on the
+// left, a gradient on the right, and a box crossing 8 pixels per field
+// unless still
+static u8 Scene(int x, int y, int stride, int height, int t, int still) {
+    int left = x < stride / 2;
+    int boxStart = still ? stride / 4 : (t * 16) % stride;
+    int inBox = x >= boxStart && x < boxStart + 128 && y >= height / 3 && y < height * 2 / 3;
+
+    if(x & 1) {
+        if(inBox) return (x & 2) ? 170 : 90;
+        return 128;
+    }
+    if(inBox) return 200 + (y & 3) * 8;
+    return left ? 60 + (y & 1) * 120 : 16 + x * 200 / stride;
+}
+
+// Frame n: the first field from time 2n, the second from 2n + 1
+static void MakeFrame(u8* frame, int width, int height, int n, int bottomFirst, int still) {
+    int stride = width * 2;
+    for(int y = 0; y < height; y++) {
+        int second = (y & 1) != bottomFirst;
+        int t = 2 * n + second;
+        for(int x = 0; x < stride; x++) frame[y * stride + x] = Scene(x, y, stride, height, t, still);
+    }
+}
+
+static void MakeTruth(u8* frame, int width, int height, int n, int still) {
+    int stride = width * 2;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < stride; x++) frame[y * stride + x] = Scene(x, y, stride, height, 2 * n, still);
+    }
+}
+
+// Mean absolute difference per byte over a clip, the first frame left out
+// so the adaptive mode is measured with its history
+static double ClipError(DeinterlaceMode mode, int width, int height, int bottomFirst, int still,
+                        u8* frame, u8* truth) {
+    int size = width * height * 2;
+    double total = 0;
+    Deinterlacer deinterlacer;
+    InitDeinterlacer(&deinterlacer, mode, bottomFirst);
+
+    for(int n = 0; n < CLIP_FRAMES; n++) {
+        MakeFrame(frame, width, height, n, bottomFirst, still);
+        DeinterlaceYUYV(&deinterlacer, frame, width, height);
+        if(n == 0) continue;
+
+        MakeTruth(truth, width, height, n, still);
+        for(int i = 0; i < size; i++) total += abs(frame[i] - truth[i]);
+    }
+
+    CloseDeinterlacer(&deinterlacer);
+    return total / ((double)size * (CLIP_FRAMES - 1));
+}
+
+int main(int argc, char** argv) {
+    static const int sizes[][2] = {{720, 480}, {720, 576}};
+    int frames = 120;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: deinterlacebench [-frames count]\n");
+            return 1;
+        }
+    }
+    if(frames < 1) return 1;
+
+    int failures = 0;
+    for(int s = 0; s < 2; s++) {
+        int width = sizes[s][0], height = sizes[s][1];
+        int size = width * height * 2;
+        u8* clip = malloc(size * CLIP_FRAMES);
+        u8* frame = malloc(size);
+        u8* truth = malloc(size);
+        if(!clip || !frame || !truth) return 1;
+
+        for(int n = 0; n < CLIP_FRAMES; n++) MakeFrame(clip + n * size, width, height, n, 0, 0);
+
+        // The frame copy is in every loop and is left in; the clip loops,
+        // so the adaptive mode sees a jump every CLIP_FRAMES frames
+        printf("%dx%di, %d frames\n", width, height, frames);
+        printf("mode        frames/s   still error  moving error (top / bottom first)\n");
+
+        double error[4][2][2];
+        for(int mode = DEINTERLACE_OFF; mode <= DEINTERLACE_ADAPTIVE; mode++) {
+            Deinterlacer deinterlacer;
+            InitDeinterlacer(&deinterlacer, mode, 0);
+
+            double start = Now();
+            for(int n = 0; n < frames; n++) {
+                memcpy(frame, clip + (n % CLIP_FRAMES) * size, size);
+                DeinterlaceYUYV(&deinterlacer, frame, width, height);
+            }
+            double rate = frames / (Now() - start);
+            CloseDeinterlacer(&deinterlacer);
+
+            for(int still = 0; still < 2; still++) {
+                for(int order = 0; order < 2; order++) {
+                    error[mode][still][order] = ClipError(mode, width, height, order, still, frame, truth);
+                }
+            }
+
+            printf("%-9s %9.1f   %5.2f / %5.2f  %5.2f / %5.2f\n", modeNames[mode], rate,
+                   error[mode][1][0], error[mode][1][1], error[mode][0][0], error[mode][0][1]);
+        }
+
+        for(int order = 0; order < 2; order++) {
+            double adaptive = error[DEINTERLACE_ADAPTIVE][1][order];
+            if(adaptive != 0.0 || adaptive >= error[DEINTERLACE_BOB][1][order] ||
+               error[DEINTERLACE_ADAPTIVE][0][order] >= error[DEINTERLACE_WEAVE][0][order]) {
+                printf("  adaptive mode FAILS (%s first)\n", order ? "bottom" : "top");
+                failures++;
+            }
+        }
+        printf("\n");
+
+        free(clip);
+        free(frame);
+        free(truth);
+    }
+
+    printf("adaptive: %s\n", failures ? "FAIL" : "still exact, ahead of bob and weave");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+// Host benchmark for the noise reduction (make bench)
+//
+// Adds noise to a scene with a still background and a moving box, then
+// runs it through each level and reports the cost per frame and how far
+// the result is from the clean scene, on the background and on the box.
+// Temporal has to take most of the noise off the background without
+// leaving a trail behind the box, and spatial has to help at all. Then
+// runs the stepping with a budget no frame can meet and checks it drops
+// to spatial, to off, and tries again on schedule, printing the counters.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "denoise.h"
+
+static int Clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+static int InBox(int x, int y, int stride, int height, int n) {
+    int boxStart = (n * 12) % stride & ~3;
+    return x >= boxStart && x < boxStart + 96 && y >= height / 3 && y < height * 2 / 3;
+}
+
+// Frame n of the scene, and with noise about 4 levels wide (sum of four
+// uniforms) when noisy
+static void MakeFrame(u8* frame, int width, int height, int n, u32* seed) {
+    int stride = width * 2;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < stride; x++) {
+            int value;
+            if(InBox(x, y, stride, height, n)) value = (x & 1) ? ((x & 2) ? 170 : 90) : 190;
+            else if(x & 1) value = (x & 2) ? 120 : 136;
+            else value = 40 + x * 120 / stride + ((x / 16 + y / 16) & 1) * 30;
+
+            if(seed) {
+                int noise = 0;
+                for(int k = 0; k < 4; k++) {
+                    *seed = *seed * 1103515245 + 12345;
+                    noise += (*seed >> 16) & 7;
+                }
+                value += noise - 14;
+            }
+            frame[y * stride + x] = Clamp(value, 0, 255);
+        }
+    }
+}
+
+typedef enum { LEVEL_NONE, LEVEL_SPATIAL, LEVEL_TEMPORAL } Level;
+static const char* levelNames[] = {"none", "spatial", "temporal"};
+
+int main(int argc, char** argv) {
+    int width = 640, height = 480, frames = 60;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: denoisebench [-size WxH] [-frames count]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    if(width <= 0 || height <= 0 || frames < 12) {
+        fprintf(stderr, "denoisebench: needs a size and at least 12 frames\n");
+        return 1;
+    }
+
+    int stride = width * 2;
+    int size = stride * height;
+    u8* clean = malloc(size);
+    u8* frame = malloc(size);
+    if(!clean || !frame) {
+        fprintf(stderr, "denoisebench: cannot allocate two %dx%d frames\n", width, height);
+        return 1;
+    }
+
+    // Error per byte, background and box, from frame 8 on once temporal
+    // has settled
+    printf("frame     %dx%d, %d frames\n", width, height, frames);
+    printf("level     us/frame   background  box\n");
+
+    double background[3], box[3];
+    for(int level = LEVEL_NONE; level <= LEVEL_TEMPORAL; level++) {
+        Denoiser denoiser;
+        InitDenoiser(&denoiser, 0);
+        u32 seed = 1;
+        double seconds = 0, stillError = 0, boxError = 0;
+        long stillCount = 0, boxCount = 0;
+
+        for(int n = 0; n < frames; n++) {
+            MakeFrame(frame, width, height, n, &seed);
+
+            double start = Now();
+            if(level == LEVEL_SPATIAL) DenoiseSpatialYUYV(frame, width, height);
+            if(level == LEVEL_TEMPORAL) DenoiseTemporalYUYV(&denoiser, frame, width, height);
+            seconds += Now() - start;
+
+            if(n < 8) continue;
+            MakeFrame(clean, width, height, n, NULL);
+            for(int y = 0; y < height; y++) {
+                for(int x = 0; x < stride; x++) {
+                    int error = abs(frame[y * stride + x] - clean[y * stride + x]);
+                    if(InBox(x, y, stride, height, n)) {
+                        boxError += error;
+                        boxCount++;
+                    } else {
+                        stillError += error;
+                        stillCount++;
+                    }
+                }
+            }
+        }
+
+        background[level] = stillError / stillCount;
+        box[level] = boxError / boxCount;
+        printf("%-9s %8.0f   %9.2f  %5.2f\n", levelNames[level], seconds * 1e6 / frames,
+               background[level], box[level]);
+        CloseDenoiser(&denoiser);
+    }
+
+    int failures = 0;
+    if(background[LEVEL_TEMPORAL] > background[LEVEL_NONE] * 0.7) {
+        printf("  temporal leaves too much noise\n");
+        failures++;
+    }
+    if(box[LEVEL_TEMPORAL] > box[LEVEL_NONE] + 1.0) {
+        printf("  temporal smears the moving box\n");
+        failures++;
+    }
+    if(background[LEVEL_SPATIAL] >= background[LEVEL_NONE]) {
+        printf("  spatial does not help\n");
+        failures++;
+    }
+
+    // 1 microsecond: every measured frame is over
+    Denoiser denoiser;
+    InitDenoiser(&denoiser, 1);
+    DenoiseLevel levels[DENOISE_RETRY + 12];
+    for(int n = 0; n < DENOISE_RETRY + 12; n++) {
+        MakeFrame(frame, width, height, n, NULL);
+        DenoiseYUYV(&denoiser, frame, width, height);
+        levels[n] = denoiser.level;
+    }
+
+    const DenoiseStats* stats = &denoiser.stats;
+    printf("\nbudget 1 us: temporal %u, spatial %u, skipped %u frames, %u step downs\n",
+           stats->temporalFrames, stats->spatialFrames, stats->skippedFrames, stats->stepDowns);
+    printf("cost last %u us, average %u us, worst %u us\n",
+           stats->lastMicroseconds, stats->averageMicroseconds, stats->worstMicroseconds);
+
+    // Three frames each at temporal and spatial, off until the retry
+    // (counted from the step down to off), three more at spatial, off
+    // again. levels[n] is the level after frame n.
+    int retry = 2 * DENOISE_OVER_BUDGET - 1 + DENOISE_RETRY - 1;
+    int expected = levels[DENOISE_OVER_BUDGET - 1] == DENOISE_SPATIAL &&
+                   levels[2 * DENOISE_OVER_BUDGET - 1] == DENOISE_OFF &&
+                   levels[retry - 1] == DENOISE_OFF && levels[retry] == DENOISE_SPATIAL &&
+                   levels[retry + DENOISE_OVER_BUDGET] == DENOISE_OFF && stats->stepDowns == 3;
+    if(!expected) {
+        printf("  stepping is off schedule\n");
+        failures++;
+    }
+    CloseDenoiser(&denoiser);
+
+    printf("noise reduction: %s\n", failures ? "FAIL" : "ok");
+    free(clean);
+    free(frame);
+    return failures ? 1 : 0;
+}
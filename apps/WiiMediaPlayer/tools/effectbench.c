@@ -0,0 +1,162 @@
+// Host check and benchmark for the fused effect chain (make bench)
+//
+// Runs a set of effect stacks both ways: compiled and fused
+// (effectchain.h), and one whole-frame pass per effect as the player did
+// before. The two must give the same bytes; the frame covers every byte
+// value, out-of-range ones included. Then reports the throughput of each.
+// The LUT stacks use a made-up grade: a gamma lift and a warm shift.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "effectchain.h"
+
+typedef struct {
+    const char* name;
+    int sharpness;      // the filter's
+    int count;
+    VideoEffect effects[VIDEO_MAX_EFFECTS];
+} EffectStack;
+
+static ColorLut grade;
+
+#define FILTER      {VIDEO_EFFECT_FILTER, 0, 0, 0, 0, NULL}
+#define SEPIA       {VIDEO_EFFECT_SEPIA, 0, 0, 0, 0, NULL}
+#define GRAYSCALE   {VIDEO_EFFECT_GRAYSCALE, 0, 0, 0, 0, NULL}
+#define INVERT      {VIDEO_EFFECT_INVERT, 0, 0, 0, 0, NULL}
+#define BLUR(r, p)  {VIDEO_EFFECT_BLUR, r, p, 0, 0, NULL}
+#define LUT         {VIDEO_EFFECT_LUT, 0, 0, 0, 0, &grade}
+
+static const EffectStack stacks[] = {
+    {"filter", 0, 1, {FILTER}},
+    {"filter invert", 0, 2, {FILTER, INVERT}},
+    {"filter sepia invert", 0, 3, {FILTER, SEPIA, INVERT}},
+    {"grayscale filter", 0, 2, {GRAYSCALE, FILTER}},
+    {"invert sepia filter", 0, 3, {INVERT, SEPIA, FILTER}},
+    {"filter blur", 0, 2, {FILTER, BLUR(2, 1)}},
+    {"sepia blur invert", 0, 3, {SEPIA, BLUR(4, 3), INVERT}},
+    {"filter blur grayscale blur", 0, 4, {FILTER, BLUR(2, 1), GRAYSCALE, BLUR(8, 2)}},
+    {"sharp filter", 5, 1, {FILTER}},
+    {"sepia sharp filter invert", 10, 3, {SEPIA, FILTER, INVERT}},
+    {"sharp filter blur", 3, 2, {FILTER, BLUR(2, 1)}},
+    {"lut", 0, 1, {LUT}},
+    {"filter lut invert", 0, 3, {FILTER, LUT, INVERT}},
+    {"sepia lut blur lut", 0, 4, {SEPIA, LUT, BLUR(2, 1), LUT}},
+    {"sharp filter lut grayscale", 5, 3, {FILTER, LUT, GRAYSCALE}},
+};
+#define STACK_COUNT ((int)(sizeof(stacks) / sizeof(stacks[0])))
+
+static void Grade(const void* context, const float in[3], float out[3]) {
+    float y = (in[0] - 16.0f) / 219.0f;
+    out[0] = 16.0f + 219.0f * powf(y < 0.0f ? 0.0f : y > 1.0f ? 1.0f : y, 0.8f);
+    out[1] = 128.0f + (in[1] - 128.0f) * 0.9f - 6.0f;
+    out[2] = 128.0f + (in[2] - 128.0f) * 1.1f + 8.0f;
+}
+
+static void FillFrame(u8* frame, int size) {
+    u32 seed = 12345;
+    for(int i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        frame[i] = seed >> 24;
+    }
+}
+
+// The stack one effect at a time over the whole frame
+static void RunSequential(const EffectStack* stack, const CompiledVideoFilter* filter,
+                          u8* frame, int width, int height) {
+    int pairs = width * height / 2;
+
+    for(int i = 0; i < stack->count; i++) {
+        const VideoEffect* effect = &stack->effects[i];
+        switch(effect->type) {
+            case VIDEO_EFFECT_FILTER:
+                RunVideoFilter(filter, frame, pairs);
+                SharpenLumaYUYV(frame, width, height, filter->sharpenAmount, filter->sharpenThreshold);
+                break;
+            case VIDEO_EFFECT_SEPIA: SepiaYUYV(frame, pairs); break;
+            case VIDEO_EFFECT_GRAYSCALE: GrayscaleYUYV(frame, pairs); break;
+            case VIDEO_EFFECT_INVERT: InvertYUYV(frame, pairs); break;
+            case VIDEO_EFFECT_BLUR: BoxBlurYUYV(frame, width, height, effect->radius, effect->passes); break;
+            case VIDEO_EFFECT_SHARPEN:
+                SharpenLumaYUYV(frame, width, height, effect->amount, effect->threshold);
+                break;
+            case VIDEO_EFFECT_LUT: ColorLutYUYV(effect->lut, frame, pairs); break;
+        }
+    }
+}
+
+static double Rate(int width, int height, int frames, double seconds) {
+    return width * (double)height * frames / seconds / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int width = 640, height = 480, frames = 20;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: effectbench [-size WxH] [-frames count]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    int size = width * height * 2;
+    u8* source = malloc(size);
+    u8* frame = malloc(size);
+    u8* expect = malloc(size);
+    if(!source || !frame || !expect || frames < 1 || size <= 0) return 1;
+    if(BuildColorLut(&grade, COLOR_LUT_LARGE, Grade, NULL) != 0) return 1;
+    FillFrame(source, size);
+
+    printf("frame   %dx%d, %d frames, Mpixels/s\n", width, height, frames);
+    printf("%-28s %8s %8s  result\n", "stack", "separate", "fused");
+
+    int failures = 0;
+    for(int s = 0; s < STACK_COUNT; s++) {
+        const EffectStack* stack = &stacks[s];
+        VideoFilter setting = {1.1f, 1.2f, 1.3f, 10.0f, 0.9f, stack->sharpness, 0, 0, 0};
+        CompiledVideoFilter filter;
+        CompileVideoFilter(&setting, &filter);
+
+        CompiledVideoEffects compiled;
+        CompileVideoEffects(stack->effects, stack->count, &filter, &compiled);
+
+        double start = Now();
+        for(int f = 0; f < frames; f++) {
+            memcpy(expect, source, size);
+            RunSequential(stack, &filter, expect, width, height);
+        }
+        double separate = Now() - start;
+
+        start = Now();
+        for(int f = 0; f < frames; f++) {
+            memcpy(frame, source, size);
+            RunVideoEffects(&compiled, frame, width, height);
+        }
+        double fused = Now() - start;
+
+        int mismatches = 0, first = -1;
+        for(int i = 0; i < size; i++) {
+            if(frame[i] != expect[i] && mismatches++ == 0) first = i;
+        }
+        if(mismatches) {
+            printf("  byte %d is %d, separately %d\n", first, frame[first], expect[first]);
+            failures++;
+        }
+
+        printf("%-28s %8.1f %8.1f  %s\n", stack->name, Rate(width, height, frames, separate),
+               Rate(width, height, frames, fused), mismatches ? "DIFFERS" : "exact");
+    }
+
+    FreeColorLut(&grade);
+    free(source);
+    free(frame);
+    free(expect);
+    return failures ? 1 : 0;
+}
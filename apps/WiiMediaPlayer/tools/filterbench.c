@@ -0,0 +1,192 @@
+// Host benchmark for the picture adjustments and effects (make bench)
+//
+// Times the per-pixel float loop ApplyVideoFilter used to run on 32-bit
+// pixels against the compiled pass on the YCbYCr frame the Wii actually
+// displays, plus the fixed effects. Then checks the compiled pass against
+// a float reference over a sweep of settings: the same chain in double
+// precision with one rounding at the end, which the compiled pass has to
+// stay within 1 LSB of everywhere.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "videofilter.h"
+
+// The loop ApplyVideoFilter used to run on 0xAARRGGBB pixels, with a
+// clamp before pow() so it does not time NaN handling
+static void OldVideoFilter(const VideoFilter* filter, u32* pixels, int count) {
+    for(int i = 0; i < count; i++) {
+        u32 pixel = pixels[i];
+        int c[3] = {(pixel >> 16) & 0xFF, (pixel >> 8) & 0xFF, pixel & 0xFF};
+
+        for(int k = 0; k < 3; k++) {
+            c[k] = (int)(c[k] * filter->brightness);
+            c[k] = (int)((c[k] - 128) * filter->contrast + 128);
+            if(c[k] < 0) c[k] = 0;
+            c[k] = (int)(pow(c[k] / 255.0f, 1.0f / filter->gamma) * 255);
+        }
+
+        int gray = (c[0] + c[1] + c[2]) / 3;
+        for(int k = 0; k < 3; k++) {
+            c[k] = (int)(gray + (c[k] - gray) * filter->saturation);
+            if(filter->sharpness > 0) c[k] = c[k] + (c[k] - gray) * filter->sharpness / 10;
+            c[k] = c[k] < 0 ? 0 : c[k] > 255 ? 255 : c[k];
+        }
+
+        pixels[i] = (c[0] << 16) | (c[1] << 8) | c[2] | 0xFF000000;
+    }
+}
+
+static double ClampDouble(double value, double low, double high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// Stages at their defaults leave the bytes alone, out of range or not
+static void ReferencePair(const VideoFilter* filter, const u8* in, u8* out) {
+    memcpy(out, in, 4);
+
+    int lumaIdentity = filter->brightness == 1.0f && filter->contrast == 1.0f && filter->gamma == 1.0f;
+    for(int k = 0; k < 4 && !lumaIdentity; k += 2) {
+        double level = (ClampDouble(in[k], 16, 235) - 16) * 255.0 / 219.0;
+        level = (level * filter->brightness - 128.0) * filter->contrast + 128.0;
+        if(level < 0) level = 0;
+        level = pow(level / 255.0, 1.0 / filter->gamma) * 255.0;
+        out[k] = (u8)ClampDouble(floor(16 + level * 219.0 / 255.0 + 0.5), 16, 235);
+    }
+
+    double scale = filter->saturation;
+    double angle = filter->hue * M_PI / 180.0;
+    if(scale == 1.0 && filter->hue == 0.0f) return;
+
+    double cb = in[1] - 128.0, cr = in[3] - 128.0;
+    double outCb = scale * (cos(angle) * cb + sin(angle) * cr);
+    double outCr = scale * (cos(angle) * cr - sin(angle) * cb);
+    out[1] = (u8)ClampDouble(floor(128 + outCb + 0.5), 16, 240);
+    out[3] = (u8)ClampDouble(floor(128 + outCr + 0.5), 16, 240);
+}
+
+// Gradients with some noise, so the branches see real data
+static void FillFrame(u8* frame, int width, int height) {
+    u32 seed = 12345;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x += 2) {
+            seed = seed * 1103515245 + 12345;
+            int noise = (seed >> 16) & 15;
+            u8* pair = frame + (y * width + x) * 2;
+            pair[0] = 16 + (x * 219 / width + noise) % 220;
+            pair[1] = 16 + (y * 224 / height + noise) % 225;
+            pair[2] = 16 + ((x + 1) * 219 / width + noise) % 220;
+            pair[3] = 16 + ((x + y) * 224 / (width + height) + noise) % 225;
+        }
+    }
+}
+
+typedef enum { EFFECT_FILTER, EFFECT_SEPIA, EFFECT_GRAYSCALE, EFFECT_INVERT, EFFECT_BLUR } Effect;
+
+static double TimeEffect(Effect effect, const CompiledVideoFilter* compiled, const u8* source,
+                         u8* frame, int width, int height, int frames) {
+    int size = width * height * 2;
+    double start = Now();
+
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        switch(effect) {
+            case EFFECT_FILTER: RunVideoFilter(compiled, frame, width * height / 2); break;
+            case EFFECT_SEPIA: SepiaYUYV(frame, width * height / 2); break;
+            case EFFECT_GRAYSCALE: GrayscaleYUYV(frame, width * height / 2); break;
+            case EFFECT_INVERT: InvertYUYV(frame, width * height / 2); break;
+            case EFFECT_BLUR: BoxBlurYUYV(frame, width, height, 2, 1); break;
+        }
+    }
+
+    return width * (double)height * frames / (Now() - start) / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int width = 640, height = 480, frames = 30;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: filterbench [-size WxH] [-frames count]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    int count = width * height;
+    u32* pixels = malloc(count * sizeof(u32));
+    u8* source = malloc(count * 2);
+    u8* frame = malloc(count * 2);
+    if(!pixels || !source || !frame || frames < 1 || count <= 0) return 1;
+    FillFrame(source, width, height);
+
+    // Every stage active, as with the sliders moved off their defaults
+    VideoFilter filter = {1.1f, 1.2f, 1.3f, 10.0f, 0.9f, 2, 0, 0, 0};
+
+    double start = Now();
+    for(int f = 0; f < frames; f++) {
+        for(int i = 0; i < count; i++) pixels[i] = 0xFF000000 | (i * 2654435761u >> 8);
+        OldVideoFilter(&filter, pixels, count);
+    }
+    double oldRate = count * (double)frames / (Now() - start) / 1e6;
+
+    CompiledVideoFilter compiled;
+    CompileVideoFilter(&filter, &compiled);
+
+    // The frame copy is in every loop and is left in
+    printf("frame         %dx%d, %d frames\n", width, height, frames);
+    printf("float loop    %8.1f Mpixels/s (32-bit pixels)\n", oldRate);
+    printf("filter        %8.1f Mpixels/s\n", TimeEffect(EFFECT_FILTER, &compiled, source, frame, width, height, frames));
+    printf("sepia         %8.1f Mpixels/s\n", TimeEffect(EFFECT_SEPIA, &compiled, source, frame, width, height, frames));
+    printf("grayscale     %8.1f Mpixels/s\n", TimeEffect(EFFECT_GRAYSCALE, &compiled, source, frame, width, height, frames));
+    printf("invert        %8.1f Mpixels/s\n", TimeEffect(EFFECT_INVERT, &compiled, source, frame, width, height, frames));
+    printf("blur r2       %8.1f Mpixels/s\n", TimeEffect(EFFECT_BLUR, &compiled, source, frame, width, height, frames));
+
+    // All 2^32 pairs would take a while, a fixed sample does not
+    static const float levels[] = {0.5f, 0.9f, 1.0f, 1.3f, 2.0f};
+    static const float hues[] = {0.0f, 30.0f, -120.0f};
+    static const int sharpnesses[] = {0, 3, 10};
+    int worst = 0, settings = 0;
+    u32 seed = 1;
+
+    for(int b = 0; b < 5; b++)
+    for(int c = 0; c < 5; c++)
+    for(int s = 0; s < 5; s++)
+    for(int g = 0; g < 5; g++)
+    for(int h = 0; h < 3; h++) {
+        VideoFilter sweep = {levels[b], levels[c], levels[s], hues[h], levels[g], sharpnesses[h], 0, 0, 0};
+        CompileVideoFilter(&sweep, &compiled);
+        settings++;
+
+        for(int i = 0; i < 2048; i++) {
+            seed = seed * 1103515245 + 12345;
+            u8 in[4] = {seed >> 24, seed >> 16, seed >> 8, seed};
+            u8 out[4], expect[4];
+            memcpy(out, in, 4);
+            RunVideoFilter(&compiled, out, 1);
+            ReferencePair(&sweep, in, expect);
+
+            for(int k = 0; k < 4; k++) {
+                int error = abs(out[k] - expect[k]);
+                if(error > worst) worst = error;
+                if(error > 1) {
+                    printf("  %02x%02x%02x%02x -> byte %d %d, reference %d\n",
+                           in[0], in[1], in[2], in[3], k, out[k], expect[k]);
+                }
+            }
+        }
+    }
+
+    printf("accuracy      %d LSB worst over %d settings: %s\n", worst, settings, worst <= 1 ? "ok" : "FAIL");
+
+    free(pixels);
+    free(source);
+    free(frame);
+    return worst <= 1 ? 0 : 1;
+}
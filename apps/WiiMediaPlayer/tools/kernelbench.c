@@ -0,0 +1,157 @@
+// Host check and benchmark for the color kernels (make bench)
+//
+// Runs every form of each kernel in colorkernels.h over every input that
+// matters and requires the same bytes as the fixed-point reference: all
+// 65536 (Cb, Cr) pairs and 256 Y values through a spread of filter
+// matrices, all 256 values of each byte through invert. Then reports the
+// throughput of each form on a 640x480 frame. On a host the float forms
+// stand in for the paired-single code and prove its arithmetic exact.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "colorkernels.h"
+#include "videofilter.h"
+
+typedef void (*FilterKernel)(u8* frame, int pairs, const u8* luma, const s32 matrix[2][2]);
+typedef void (*PairKernel)(u8* frame, int pairs);
+
+typedef struct {
+    const char* name;
+    FilterKernel filter;
+    PairKernel invert;
+} KernelForm;
+
+static const KernelForm forms[] = {
+    {"fixed", FilterPairsRef, InvertPairsRef},
+    {"float", FilterPairsFloat, InvertPairsFloat},
+#if COLOR_KERNELS_PS
+    {"paired", FilterPairsPS, InvertPairsPS},
+#endif
+};
+#define FORM_COUNT ((int)(sizeof(forms) / sizeof(forms[0])))
+
+// Every (Cb, Cr) pair once, Y cycling through all values
+static void FillAllPairs(u8* frame) {
+    for(int i = 0; i < 65536; i++) {
+        frame[i * 4] = i & 0xFF;
+        frame[i * 4 + 1] = i >> 8;
+        frame[i * 4 + 2] = (i * 7) & 0xFF;
+        frame[i * 4 + 3] = i & 0xFF;
+    }
+}
+
+static int CheckFilter(const KernelForm* form, u8* expect, u8* actual) {
+    static const VideoFilter settings[] = {
+        {1.0f, 1.0f, 1.0f, 0.0f, 1.0f, 0, 0, 0, 0},
+        {1.2f, 1.1f, 0.0f, 0.0f, 0.8f, 0, 0, 0, 0},
+        {0.8f, 1.5f, 1.4f, 15.0f, 1.2f, 0, 0, 0, 0},
+        {1.0f, 1.0f, 2.5f, -90.0f, 1.0f, 5, 0, 0, 0},
+        {1.0f, 0.5f, 4.0f, 180.0f, 2.0f, 10, 0, 0, 0},
+        {1.0f, 1.0f, 0.3f, 45.0f, 1.0f, 0, 0, 0, 0},
+        {1.0f, 1.0f, 1.0f, 359.0f, 1.0f, 0, 0, 0, 0},
+    };
+    int count = (int)(sizeof(settings) / sizeof(settings[0]));
+    int mismatches = 0;
+
+    for(int s = 0; s < count; s++) {
+        CompiledVideoFilter compiled;
+        CompileVideoFilter(&settings[s], &compiled);
+
+        FillAllPairs(expect);
+        FillAllPairs(actual);
+        FilterPairsRef(expect, 65536, compiled.luma, compiled.chroma);
+        form->filter(actual, 65536, compiled.luma, compiled.chroma);
+
+        for(int i = 0; i < 65536 * 4; i++) {
+            if(expect[i] != actual[i] && mismatches++ < 8) {
+                printf("  %s filter, setting %d: byte %d is %d, reference %d\n",
+                       form->name, s, i, actual[i], expect[i]);
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+static int CheckInvert(const KernelForm* form, u8* expect, u8* actual) {
+    int mismatches = 0;
+
+    FillAllPairs(expect);
+    FillAllPairs(actual);
+    InvertPairsRef(expect, 65536);
+    form->invert(actual, 65536);
+
+    for(int i = 0; i < 65536 * 4; i++) {
+        if(expect[i] != actual[i] && mismatches++ < 8) {
+            printf("  %s invert: byte %d is %d, reference %d\n", form->name, i, actual[i], expect[i]);
+        }
+    }
+
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    int frames = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: kernelbench [-frames count]\n");
+            return 1;
+        }
+    }
+
+    u8* expect = malloc(65536 * 4);
+    u8* actual = malloc(65536 * 4);
+    if(!expect || !actual || frames < 1) return 1;
+
+    int failures = 0;
+    for(int f = 0; f < FORM_COUNT; f++) {
+        int filter = CheckFilter(&forms[f], expect, actual);
+        int invert = CheckInvert(&forms[f], expect, actual);
+        printf("%-7s filter %s, invert %s\n", forms[f].name, filter ? "DIFFERS" : "exact",
+               invert ? "DIFFERS" : "exact");
+        failures += filter + invert;
+    }
+
+    // A 640x480 frame is 153600 pairs; the source is reloaded each time
+    // and that copy is left in
+    const int pairs = 640 * 480 / 2;
+    u8* source = malloc(pairs * 4);
+    u8* frame = malloc(pairs * 4);
+    if(!source || !frame) return 1;
+    for(int i = 0; i < pairs * 4; i++) source[i] = 16 + (i * 2654435761u >> 24) % 225;
+
+    VideoFilter setting = {1.1f, 1.2f, 1.3f, 10.0f, 0.9f, 0, 0, 0, 0};
+    CompiledVideoFilter compiled;
+    CompileVideoFilter(&setting, &compiled);
+
+    printf("\n640x480, %d frames, Mpixels/s\n", frames);
+    for(int f = 0; f < FORM_COUNT; f++) {
+        double start = Now();
+        for(int n = 0; n < frames; n++) {
+            memcpy(frame, source, pairs * 4);
+            forms[f].filter(frame, pairs, compiled.luma, compiled.chroma);
+        }
+        double filter = Now() - start;
+
+        start = Now();
+        for(int n = 0; n < frames; n++) {
+            memcpy(frame, source, pairs * 4);
+            forms[f].invert(frame, pairs);
+        }
+        double invert = Now() - start;
+
+        printf("%-7s filter %8.1f  invert %8.1f\n", forms[f].name,
+               pairs * 2.0 * frames / filter / 1e6, pairs * 2.0 * frames / invert / 1e6);
+    }
+
+    free(expect);
+    free(actual);
+    free(source);
+    free(frame);
+    return failures ? 1 : 0;
+}
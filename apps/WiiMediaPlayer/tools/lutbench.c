@@ -0,0 +1,278 @@
+// Host check and benchmark for the color LUTs (make bench)
+//
+// Checks the interpolation against what it stands for: an identity table
+// over the video range, sepia rebuilt as a table against SepiaYUYV, and
+// .cube files written here (identity and a warm grade) against the same
+// grade done in float per pixel. Also feeds the reader files it has to
+// turn down. Then times both sizes against the fixed effects, and a
+// .cube named on the command line if there is one.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "colorlut.h"
+#include "videofilter.h"
+
+static float Clamp01(float value) {
+    return value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+}
+
+static void Identity(const void* context, const float in[3], float out[3]) {
+    memcpy(out, in, sizeof(float) * 3);
+}
+
+// Sepia's tables, chroma by the luma coming in
+static void Sepia(const void* context, const float in[3], float out[3]) {
+    const u8 *luma, *cb, *cr;
+    GetSepiaTables(&luma, &cb, &cr);
+    int y = (int)lrintf(in[0]);
+    out[0] = luma[y];
+    out[1] = cb[y];
+    out[2] = cr[y];
+}
+
+// The warm grade the .cube below holds, in RGB 0-1
+static void Warm(const float in[3], float out[3]) {
+    out[0] = Clamp01(in[0] * 1.1f + 0.02f);
+    out[1] = Clamp01(in[1]);
+    out[2] = Clamp01(in[2] * 0.85f);
+}
+
+static void ToRGB(const int yuv[3], float rgb[3]) {
+    float y = (yuv[0] - 16) / 219.0f, cb = (yuv[1] - 128) / 224.0f, cr = (yuv[2] - 128) / 224.0f;
+    rgb[0] = y + 1.402f * cr;
+    rgb[1] = y - 0.344136f * cb - 0.714136f * cr;
+    rgb[2] = y + 1.772f * cb;
+}
+
+static void ToYUV(const float rgb[3], int yuv[3]) {
+    yuv[0] = (int)lrintf(16 + 219.0f * (0.299f * rgb[0] + 0.587f * rgb[1] + 0.114f * rgb[2]));
+    yuv[1] = (int)lrintf(128 + 224.0f * (-0.168736f * rgb[0] - 0.331264f * rgb[1] + 0.5f * rgb[2]));
+    yuv[2] = (int)lrintf(128 + 224.0f * (0.5f * rgb[0] - 0.418688f * rgb[1] - 0.081312f * rgb[2]));
+}
+
+static int WriteCube(const char* path, int size, int warm) {
+    FILE* file = fopen(path, "w");
+    if(!file) return -1;
+
+    fprintf(file, "# written by lutbench\nTITLE \"%s\"\nLUT_3D_SIZE %d\n\n", warm ? "warm" : "identity", size);
+    for(int b = 0; b < size; b++) {
+        for(int g = 0; g < size; g++) {
+            for(int r = 0; r < size; r++) {
+                float in[3] = {r / (size - 1.0f), g / (size - 1.0f), b / (size - 1.0f)}, out[3];
+                if(warm) Warm(in, out);
+                else memcpy(out, in, sizeof(out));
+                fprintf(file, "%.6f %.6f %.6f\n", out[0], out[1], out[2]);
+            }
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int WriteText(const char* path, const char* text) {
+    FILE* file = fopen(path, "w");
+    if(!file) return -1;
+    fputs(text, file);
+    fclose(file);
+    return 0;
+}
+
+// Largest difference over pairs of equal luma (so the chroma mean is the
+// pixel's own), inputs in the video range; rgb says the input must also
+// be a real RGB color, and warm which grade the reference applies
+static int MaxError(const ColorLut* lut, int rgb, int warm, double* mean) {
+    int worst = 0;
+    long total = 0, count = 0;
+
+    for(int y = VIDEO_LUMA_BLACK; y <= VIDEO_LUMA_WHITE; y++) {
+        for(int cb = VIDEO_CHROMA_MIN; cb <= VIDEO_CHROMA_MAX; cb += 4) {
+            for(int cr = VIDEO_CHROMA_MIN; cr <= VIDEO_CHROMA_MAX; cr += 4) {
+                int in[3] = {y, cb, cr}, expect[3] = {y, cb, cr};
+                float color[3];
+                ToRGB(in, color);
+                if(rgb && (color[0] < 0 || color[0] > 1 || color[1] < 0 || color[1] > 1 || color[2] < 0 ||
+                           color[2] > 1)) {
+                    continue;
+                }
+                if(warm) {
+                    float graded[3];
+                    Warm(color, graded);
+                    ToYUV(graded, expect);
+                }
+
+                u8 pair[4] = {y, cb, y, cr};
+                ColorLutYUYV(lut, pair, 1);
+                int out[3] = {pair[0], pair[1], pair[3]};
+                for(int k = 0; k < 3; k++) {
+                    int error = abs(out[k] - expect[k]);
+                    if(error > worst) worst = error;
+                    total += error;
+                    count++;
+                }
+            }
+        }
+    }
+    *mean = count ? (double)total / count : 0;
+    return worst;
+}
+
+// Gradients with some noise, within the video range
+static void FillFrame(u8* frame, int width, int height) {
+    u32 seed = 12345;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width * 2; x++) {
+            seed = seed * 1103515245 + 12345;
+            int value = (x & 1) ? 64 + (y * 128 / height) : 16 + (x * 200 / (width * 2));
+            frame[y * width * 2 + x] = value + ((seed >> 16) & 15);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    int width = 640, height = 480, frames = 20;
+    const char* userCube = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if(argv[i][0] != '-' && !userCube) {
+            userCube = argv[i];
+        } else {
+            fprintf(stderr, "usage: lutbench [-size WxH] [-frames count] [file.cube]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    int pairs = width * height / 2;
+    int size = pairs * 4;
+    u8* source = malloc(size);
+    u8* frame = malloc(size);
+    u8* expect = malloc(size);
+    if(!source || !frame || !expect || frames < 1 || size <= 0) return 1;
+    FillFrame(source, width, height);
+
+    int failures = 0;
+    ColorLut small = {0}, large = {0};
+    double mean;
+
+    // Identity
+    if(BuildColorLut(&small, COLOR_LUT_SMALL, Identity, NULL) != 0 ||
+       BuildColorLut(&large, COLOR_LUT_LARGE, Identity, NULL) != 0) {
+        return 1;
+    }
+    for(int n = 0; n < 2; n++) {
+        const ColorLut* lut = n ? &large : &small;
+        int worst = MaxError(lut, 0, 0, &mean);
+        printf("identity %d^3          worst %d, mean %.3f\n", lut->size, worst, mean);
+        if(worst > 1) {
+            printf("  identity is off by more than rounding\n");
+            failures++;
+        }
+    }
+
+    // Sepia
+    BuildColorLut(&large, COLOR_LUT_LARGE, Sepia, NULL);
+    memcpy(frame, source, size);
+    memcpy(expect, source, size);
+    ColorLutYUYV(&large, frame, pairs);
+    SepiaYUYV(expect, pairs);
+    int sepiaWorst = 0;
+    double sepiaTotal = 0;
+    for(int i = 0; i < size; i++) {
+        int error = abs(frame[i] - expect[i]);
+        if(error > sepiaWorst) sepiaWorst = error;
+        sepiaTotal += error;
+    }
+    printf("sepia as %d^3         worst %d, mean %.3f\n", large.size, sepiaWorst, sepiaTotal / size);
+    if(sepiaWorst > 2) {
+        printf("  sepia as a table is too far from the effect\n");
+        failures++;
+    }
+
+    // .cube files
+    char path[] = "/tmp/lutbenchXXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0) return 1;
+    close(fd);
+
+    static const struct {
+        int size;
+        int warm;
+        int expectSize;
+    } cubes[] = {{33, 0, COLOR_LUT_LARGE}, {9, 1, COLOR_LUT_SMALL}, {33, 1, COLOR_LUT_LARGE}, {65, 1, COLOR_LUT_LARGE}};
+    for(int c = 0; c < 4; c++) {
+        ColorLut lut = {0};
+        if(WriteCube(path, cubes[c].size, cubes[c].warm) != 0 || LoadCubeLut(&lut, path) != 0) {
+            printf("  %d^3 .cube did not load\n", cubes[c].size);
+            failures++;
+            continue;
+        }
+        int worst = MaxError(&lut, 1, cubes[c].warm, &mean);
+        printf("%-8s %2d^3 .cube %d^3 worst %d, mean %.3f\n", cubes[c].warm ? "warm" : "identity", cubes[c].size,
+               lut.size, worst, mean);
+        // The warm grade clips red, and the small grid rounds off that
+        // corner over a wider cell
+        if(lut.size != cubes[c].expectSize || worst > (lut.size == COLOR_LUT_SMALL ? 8 : 4) || mean > 0.5) {
+            printf("  .cube grade is off\n");
+            failures++;
+        }
+        FreeColorLut(&lut);
+    }
+
+    // Files that must be turned down, leaving the table as it was
+    static const char* bad[] = {
+        "LUT_3D_SIZE 2\n0 0 0\n1 0 0\n0 1 0\n",                 // short
+        "LUT_1D_SIZE 2\n0 0 0\n1 1 1\n",                        // 1D
+        "LUT_3D_SIZE 2\n0 0 0\n1 0 0\n0 1 0\n1 1 0\n0 0 1\n1 0 1\n0 1 1\n1 x 1\n",
+        "0 0 0\n1 1 1\n",                                       // no size
+        "LUT_3D_SIZE 200\n",
+    };
+    u8 before = large.luma[100];
+    for(int b = 0; b < 5; b++) {
+        if(WriteText(path, bad[b]) != 0 || LoadCubeLut(&large, path) == 0 || large.size != COLOR_LUT_LARGE ||
+           large.luma[100] != before) {
+            printf("  bad .cube %d was taken\n", b);
+            failures++;
+        }
+    }
+    unlink(path);
+
+    // Speed
+    printf("\nframe    %dx%d, %d frames, Mpixels/s\n", width, height, frames);
+    ColorLut user = {0};
+    if(userCube && LoadCubeLut(&user, userCube) != 0) {
+        printf("  %s did not load\n", userCube);
+        failures++;
+    }
+
+    for(int n = 0; n < 4; n++) {
+        const char* name = n == 0 ? "sepia effect" : n == 1 ? "lut 17^3" : n == 2 ? "lut 33^3" : userCube;
+        if(n == 1) BuildColorLut(&small, COLOR_LUT_SMALL, Sepia, NULL);
+        if(n == 3 && !user.size) break;
+
+        double start = Now();
+        for(int f = 0; f < frames; f++) {
+            memcpy(frame, source, size);
+            if(n == 0) SepiaYUYV(frame, pairs);
+            else ColorLutYUYV(n == 1 ? &small : n == 2 ? &large : &user, frame, pairs);
+        }
+        double seconds = Now() - start;
+        printf("%-20s %8.1f\n", name, width * (double)height * frames / seconds / 1e6);
+    }
+
+    printf("color lut: %s\n", failures ? "FAIL" : "ok");
+    FreeColorLut(&small);
+    FreeColorLut(&large);
+    FreeColorLut(&user);
+    free(source);
+    free(frame);
+    free(expect);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// Builds seek-index sidecars for a media folder on a PC (make bench)
+//
+// Walks each folder, and for every file a format claims by extension
+// opens it, completes its index and writes the sidecar the player would
+// otherwise build on first play. Files are spread over -j worker
+// processes; processes rather than threads because the probe and
+// metadata caches are not shared-safe. Point -o at the card's
+// wmz/index folder and the player finds them by path and size; the
+// card's mount point is taken from -o, or given with -root when the
+// index goes elsewhere.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bench.h"
+#include "registry.h"
+#include "sidecar.h"
+
+#define MAX_FILES 16384
+#define MAX_JOBS 64
+
+static char* files[MAX_FILES];
+static int fileCount = 0;
+
+static void AddFolder(const char* folder) {
+    DIR* dir = opendir(folder);
+    if(!dir) {
+        fprintf(stderr, "%s: cannot open\n", folder);
+        return;
+    }
+
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL && fileCount < MAX_FILES) {
+        if(entry->d_name[0] == '.') continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", folder, entry->d_name);
+
+        struct stat st;
+        if(stat(path, &st) != 0) continue;
+
+        if(S_ISDIR(st.st_mode)) {
+            AddFolder(path);
+        } else if(S_ISREG(st.st_mode)) {
+            const MediaFormat* format = FindMediaFormatByName(path);
+            if(format && format->saveIndex) files[fileCount++] = strdup(path);
+        }
+    }
+
+    closedir(dir);
+}
+
+// Every jobs-th file starting at job; returns how many failed
+static int RunJob(int job, int jobs) {
+    int failed = 0;
+
+    for(int i = job; i < fileCount; i += jobs) {
+        double start = Now();
+        int result = BuildMediaSidecar(files[i]);
+        double elapsed = Now() - start;
+
+        if(result == 0) {
+            printf("ok   %7.3f s  %s\n", elapsed, files[i]);
+        } else {
+            printf("fail %7.3f s  %s\n", elapsed, files[i]);
+            failed++;
+        }
+        fflush(stdout);
+    }
+
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int folders = 0;
+    const char* root = NULL;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            const char* index = argv[++i];
+            SetSidecarDirectory(index);
+
+            // <card>/wmz/index names the card
+            static char card[1024];
+            int length = strlen(index);
+            while(length > 0 && index[length - 1] == '/') length--;
+            if(length >= 10 && length - 10 < (int)sizeof(card) && strncmp(index + length - 10, "/wmz/index", 10) == 0) {
+                memcpy(card, index, length - 10);
+                card[length - 10] = 0;
+                if(!root) SetSidecarRoot(card);
+            }
+        } else if(strcmp(argv[i], "-root") == 0 && i + 1 < argc) {
+            root = argv[++i];
+            SetSidecarRoot(root);
+        } else {
+            AddFolder(argv[i]);
+            folders++;
+        }
+    }
+
+    if(folders == 0) {
+        fprintf(stderr, "usage: mkindex [-j jobs] [-o index-folder] [-root card-mount] folder...\n");
+        return 1;
+    }
+
+    if(jobs < 1) jobs = 1;
+    if(jobs > MAX_JOBS) jobs = MAX_JOBS;
+    if(jobs > fileCount) jobs = fileCount > 0 ? fileCount : 1;
+
+    double start = Now();
+    int failed = 0;
+
+    if(jobs == 1) {
+        failed = RunJob(0, 1);
+    } else {
+        pid_t workers[MAX_JOBS];
+        fflush(stdout);
+        for(int j = 0; j < jobs; j++) {
+            workers[j] = fork();
+            if(workers[j] == 0) exit(RunJob(j, jobs) > 0 ? 1 : 0);
+            if(workers[j] < 0) {
+                // Whatever could not be handed out is done here
+                failed += RunJob(j, jobs);
+            }
+        }
+
+        for(int j = 0; j < jobs; j++) {
+            int status;
+            if(workers[j] > 0 && (waitpid(workers[j], &status, 0) < 0 ||
+                                  !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                failed++;
+            }
+        }
+    }
+
+    // The lines above name the files that failed
+    printf("%d files, %d jobs, %.3f s\n", fileCount, jobs, Now() - start);
+    return failed ? 1 : 0;
+}
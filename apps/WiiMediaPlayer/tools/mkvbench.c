@@ -0,0 +1,107 @@
+// Host benchmark for the Matroska demuxer (make bench)
+//
+// Reads every packet of every track in file order through the zero-copy
+// packet calls, then times random seeks. Memory is reported twice: the
+// most the demuxer held at once (read buffer and cue points) and the
+// process high-water mark. Both should stay flat as files get longer;
+// run it on a 2 hour file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "bench.h"
+#include "mkv.h"
+
+static long MaxResidentKB() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char** argv) {
+    const char* filename = NULL;
+    int seeks = 1000;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-seeks") == 0 && i + 1 < argc) {
+            seeks = atoi(argv[++i]);
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if(!filename) {
+        fprintf(stderr, "usage: mkvbench [-seeks count] file\n");
+        return 1;
+    }
+
+    MediaIO io;
+    if(OpenMediaIO(&io, filename) != 0) {
+        fprintf(stderr, "%s: cannot open\n", filename);
+        return 1;
+    }
+
+    long baseKB = MaxResidentKB();
+    double start = Now();
+    MkvDemuxer* demux = OpenMkvDemuxer(&io);
+    double openTime = Now() - start;
+    if(!demux) {
+        fprintf(stderr, "%s: not a Matroska file\n", filename);
+        CloseMediaIO(&io);
+        return 1;
+    }
+
+    const MkvInfo* info = GetMkvInfo(demux);
+    printf("%s: %lld bytes, %d tracks, %dx%d, %d s, %d cue points\n", filename, (long long)io.size,
+           info->tracks, info->width, info->height, info->seconds, info->cues);
+    printf("open      %8.2f ms\n", openTime * 1000);
+
+    // Every packet in file order; the checksum keeps the data touched
+    MkvPacket packet;
+    s64 packets = 0, bytes = 0, keyframes = 0;
+    u32 checksum = 0;
+    start = Now();
+    while(ReadMkvPacket(demux, &packet)) {
+        packets++;
+        bytes += packet.size;
+        keyframes += packet.keyframe;
+        if(packet.size > 0) checksum += packet.data[0] + packet.data[packet.size - 1];
+    }
+    double readTime = Now() - start;
+    if(packets > 0) {
+        printf("read      %8.2f ms for %lld packets (%lld keyframes), %.0f packets/s, %.1f MB/s [%08x]\n",
+               readTime * 1000, (long long)packets, (long long)keyframes, packets / readTime,
+               bytes / readTime / (1024 * 1024), checksum);
+    }
+
+    // Seek and read the keyframe, as the player does after a jump
+    if(info->seconds > 0 && seeks > 0) {
+        double total = 0, worst = 0;
+        int failed = 0;
+
+        srand(1);
+        for(int i = 0; i < seeks; i++) {
+            s64 target = (s64)(rand() % info->seconds) * 1000;
+
+            start = Now();
+            if(SeekMkvTime(demux, target) < 0 || !ReadMkvPacket(demux, &packet)) failed++;
+            double t = Now() - start;
+
+            total += t;
+            if(t > worst) worst = t;
+        }
+
+        printf("seek      %8.3f ms average, %.3f ms worst over %d", total * 1000 / seeks,
+               worst * 1000, seeks);
+        if(failed) printf(", %d failed", failed);
+        printf("\n");
+    }
+
+    printf("memory    %8.1f KB demuxer peak, %ld KB process high-water (+%ld KB)\n",
+           GetMkvMemoryPeak(demux) / 1024.0, MaxResidentKB(), MaxResidentKB() - baseKB);
+
+    CloseMkvDemuxer(demux);
+    CloseMediaIO(&io);
+    return 0;
+}
@@ -0,0 +1,283 @@
+// Host check and benchmark for the PCM conversion kernels (make bench)
+//
+// Each kernel in pcm.c is run over random samples and checked against a
+// plain per-sample reference, at every alignment the decoders hand it and
+// in place where the WAV reader uses it that way, then timed in MB/s of
+// input. SwapSamples16 stands in for ConvertSamplesS16LE, which is that
+// kernel on the Wii but a copy on a little-endian host. Last, WAV files at
+// 8, 16, 24 and 32 bits are written to the temp folder and played through
+// the decoder into a ring refilled the way the stream's fill thread does
+// it (decoder reads topping up each buffer, then PadSamples32), checking
+// every sample that comes out; that rate is in MB/s of buffers filled.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "decoder.h"
+#include "pcm.h"
+
+#define BENCH_SAMPLES   32768       // per kernel pass
+#define SAMPLE_RATE     44100
+#define RING_BUFFERS    4           // as audio_stream.h
+#define RING_SIZE       8192
+
+static u32 randomState = 1;
+
+static u32 Random() {
+    randomState = randomState * 1664525 + 1013904223;
+    return randomState >> 8;
+}
+
+static void FillRandom(u8* buffer, int size) {
+    for(int i = 0; i < size; i++) buffer[i] = (u8)Random();
+}
+
+// The references, one sample at a time from the byte layout
+
+static s16 RefSwap16(const u8* s) {
+    u8 swapped[2] = {s[1], s[0]};
+    s16 sample;
+    memcpy(&sample, swapped, 2);
+    return sample;
+}
+static s16 RefU8(const u8* s) { return (s16)((s[0] - 128) * 256); }
+static s16 RefS24LE(const u8* s) { return (s16)((s[2] << 8) | s[1]); }
+static s16 RefS32LE(const u8* s) { return (s16)((s[3] << 8) | s[2]); }
+
+typedef struct {
+    const char* name;
+    int inBytes;                    // per sample
+    s16 (*reference)(const u8* s);
+} Kernel;
+
+static const Kernel kernels[] = {
+    {"u8",    1, RefU8},
+    {"s16",   2, RefSwap16},
+    {"s24le", 3, RefS24LE},
+    {"s32le", 4, RefS32LE},
+};
+
+static void RunKernel(int index, s16* dst, const u8* src, int count) {
+    switch(index) {
+        case 0: ConvertSamplesU8(dst, src, count); break;
+        case 1: SwapSamples16(dst, (const s16*)src, count); break;
+        case 2: ConvertSamplesS24LE(dst, src, count); break;
+        default: ConvertSamplesS32LE(dst, src, count); break;
+    }
+}
+
+// Converts count samples from src (inOffset bytes in) to dst (outOffset
+// bytes in), or in place at inOffset; returns the mismatches
+static int CheckKernel(int index, int count, int inOffset, int outOffset, int inPlace) {
+    const Kernel* kernel = &kernels[index];
+    static u8 source[BENCH_SAMPLES * 4 + 8];
+    static u8 input[BENCH_SAMPLES * 4 + 8];
+    static u8 output[BENCH_SAMPLES * 2 + 8];
+
+    FillRandom(source, count * kernel->inBytes);
+    memcpy(input + inOffset, source, count * kernel->inBytes);
+
+    s16* dst = (s16*)(inPlace ? input + inOffset : output + outOffset);
+    RunKernel(index, dst, input + inOffset, count);
+
+    int bad = 0;
+    for(int i = 0; i < count; i++) {
+        s16 got;
+        memcpy(&got, (u8*)dst + i * 2, 2);
+        if(got != kernel->reference(source + i * kernel->inBytes)) bad++;
+    }
+    return bad;
+}
+
+static int CheckKernels() {
+    int failed = 0;
+
+    for(int k = 0; k < 4; k++) {
+        int bad = 0;
+
+        // Every length up to a few unrolled blocks, then a long run; both
+        // pointers even and odd by 2, which is what separate or shared
+        // alignment means to the swap kernel
+        for(int count = 0; count < 40; count++) {
+            for(int in = 0; in <= 2; in += 2) {
+                for(int out = 0; out <= 2; out += 2) bad += CheckKernel(k, count, in, out, 0);
+            }
+        }
+        bad += CheckKernel(k, BENCH_SAMPLES, 0, 0, 0);
+        bad += CheckKernel(k, BENCH_SAMPLES - 1, 2, 0, 0);
+
+        // The WAV reader converts 8 and 16-bit data where it landed
+        if(kernels[k].inBytes <= 2) {
+            bad += CheckKernel(k, BENCH_SAMPLES, 0, 0, 1);
+            bad += CheckKernel(k, 37, 2, 0, 1);
+        }
+
+        printf("check     %-6s %s", kernels[k].name, bad ? "FAILED" : "ok");
+        if(bad) printf(", %d samples differ", bad);
+        printf("\n");
+        failed |= bad != 0;
+    }
+    return failed;
+}
+
+static void TimeKernels(int megabytes) {
+    static u8 input[BENCH_SAMPLES * 4];
+    static s16 output[BENCH_SAMPLES];
+
+    FillRandom(input, sizeof(input));
+    for(int k = 0; k < 4; k++) {
+        int passBytes = BENCH_SAMPLES * kernels[k].inBytes;
+        int passes = (int)((s64)megabytes * 1024 * 1024 / passBytes);
+        if(passes < 1) passes = 1;
+
+        double start = Now();
+        for(int p = 0; p < passes; p++) {
+            RunKernel(k, output, input, BENCH_SAMPLES);
+            input[p % sizeof(input)] ^= (u8)output[p % BENCH_SAMPLES];   // keep the work live
+        }
+        double time = Now() - start;
+
+        printf("kernel    %-6s %8.1f MB/s in, %8.1f Msamples/s\n", kernels[k].name,
+               time > 0 ? (double)passes * passBytes / time / 1e6 : 0,
+               time > 0 ? (double)passes * BENCH_SAMPLES / time / 1e6 : 0);
+    }
+}
+
+// The sample written at frame i, channel c: a pattern that reaches every
+// bit the conversion keeps
+static s16 TestSample(s64 i, int c) {
+    return (s16)(i * 2654435761u >> (c ? 7 : 13));
+}
+
+static void PutLE(u8* p, u32 value, int bytes) {
+    for(int b = 0; b < bytes; b++) p[b] = (u8)(value >> (b * 8));
+}
+
+static int WriteWav(const char* path, int bits, int frames) {
+    FILE* file = fopen(path, "wb");
+    if(!file) return -1;
+
+    int block = 2 * bits / 8;
+    u8 header[44];
+    memcpy(header, "RIFF", 4);
+    PutLE(header + 4, 36 + frames * block, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    PutLE(header + 16, 16, 4);
+    PutLE(header + 20, 1, 2);
+    PutLE(header + 22, 2, 2);
+    PutLE(header + 24, SAMPLE_RATE, 4);
+    PutLE(header + 28, SAMPLE_RATE * block, 4);
+    PutLE(header + 32, block, 2);
+    PutLE(header + 34, bits, 2);
+    memcpy(header + 36, "data", 4);
+    PutLE(header + 40, frames * block, 4);
+    fwrite(header, 1, sizeof(header), file);
+
+    // The low bytes under the top 16 carry noise the conversion drops
+    u8 frame[8];
+    for(int i = 0; i < frames; i++) {
+        for(int c = 0; c < 2; c++) {
+            u16 s = (u16)TestSample(i, c);
+            u8* p = frame + c * bits / 8;
+            if(bits == 8) {
+                p[0] = (u8)((s >> 8) ^ 0x80);
+            } else {
+                PutLE(p, ((u32)s << (bits - 16)) | (Random() & ((1u << (bits - 16)) - 1)), bits / 8);
+            }
+        }
+        fwrite(frame, 1, block, file);
+    }
+    return fclose(file);
+}
+
+// Plays the file through the decoder into the ring as FillNextBuffer does.
+// Returns the mismatched samples, or -1 if it doesn't open.
+static int RefillRing(const char* path, int bits, int frames) {
+    static u8 ring[RING_BUFFERS][RING_SIZE] __attribute__((aligned(32)));
+    AudioDecoder* decoder = InitAudioDecoder(path);
+    if(!decoder) return -1;
+
+    int frameBytes = decoder->channels * 2;
+    int wanted = RING_SIZE - (RING_SIZE % frameBytes);
+    s64 frame = 0, bytes = 0;
+    int bad = 0, slot = 0;
+
+    double start = Now();
+    double checking = 0;
+    for(;;) {
+        u8* buffer = ring[slot];
+        int size = 0;
+
+        while(size < wanted) {
+            int n = ReadAudioFrame(decoder, buffer + size, wanted - size);
+            if(n <= 0) break;
+            size += n;
+        }
+        if(size == 0) break;
+        bytes += PadSamples32(buffer, size);
+        slot = (slot + 1) % RING_BUFFERS;
+
+        // Not part of the refill
+        double paused = Now();
+        const s16* samples = (const s16*)buffer;
+        for(int i = 0; i < size / frameBytes; i++, frame++) {
+            for(int c = 0; c < 2; c++) {
+                s16 expect = TestSample(frame, c);
+                if(bits == 8) expect &= (s16)0xff00;
+                if(samples[i * 2 + c] != expect) bad++;
+            }
+        }
+        checking += Now() - paused;
+    }
+    double time = Now() - start - checking;
+
+    if(frame != frames) bad += 1 + (int)(frame > frames ? frame - frames : frames - frame);
+    printf("refill    %2d-bit %8.1f MB/s out, %7.0fx real time, %s\n", bits,
+           time > 0 ? bytes / time / 1e6 : 0, time > 0 ? (double)frames / SAMPLE_RATE / time : 0,
+           bad ? "FAILED" : "ok");
+
+    CloseAudioDecoder(decoder);
+    return bad;
+}
+
+int main(int argc, char** argv) {
+    int megabytes = 64;
+    int seconds = 60;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-mb") == 0 && i + 1 < argc) {
+            megabytes = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: pcmbench [-mb per-kernel] [-seconds wav-length]\n");
+            return 1;
+        }
+    }
+
+    int failed = CheckKernels();
+    TimeKernels(megabytes);
+
+    const char* folder = getenv("TMPDIR");
+    if(!folder || !*folder) folder = "/tmp";
+    int frames = seconds * SAMPLE_RATE;
+    static const int sizes[] = {8, 16, 24, 32};
+
+    for(int s = 0; s < 4; s++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/pcmbench-%d.wav", folder, sizes[s]);
+        if(WriteWav(path, sizes[s], frames) != 0) {
+            fprintf(stderr, "%s: cannot write\n", path);
+            return 1;
+        }
+
+        int bad = RefillRing(path, sizes[s], frames);
+        if(bad < 0) fprintf(stderr, "%s: cannot decode\n", path);
+        else if(bad) fprintf(stderr, "%d-bit: %d samples differ\n", sizes[s], bad);
+        failed |= bad != 0;
+        remove(path);
+    }
+
+    return failed;
+}
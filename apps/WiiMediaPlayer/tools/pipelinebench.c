@@ -0,0 +1,332 @@
+// Host check and benchmark for the playback pipeline (make bench)
+//
+// Writes raw YUY2 and UYVY AVIs, then plays them through the pipeline
+// the way the player does: RunPipeline and PresentPipelineFrame once per
+// display refresh, against a made-up clock. Checks that frames come out
+// in order with the right picture, that a slow display drops instead of
+// falling behind, that a seek lands where it should, that a frame too
+// big for the ring is skipped rather than cut short, and that once
+// playback is going nothing touches the heap (malloc and friends are
+// counted here). Then reports the stage counters and how fast frames go
+// through with the clock out of the way, and does it again with the
+// decode thread running against the presenter in this one.
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avifixture.h"
+#include "bench.h"
+#include "decoder.h"
+#include "pipeline.h"
+#include "sidecar.h"
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* block, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* block);
+
+static volatile long allocations = 0;
+
+void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* block, size_t size) {
+    allocations++;
+    return __libc_realloc(block, size);
+}
+
+int posix_memalign(void** block, size_t alignment, size_t size) {
+    allocations++;
+    *block = __libc_memalign(alignment, size);
+    return *block ? 0 : ENOMEM;
+}
+
+void free(void* block) {
+    __libc_free(block);
+}
+
+#define BENCH_FPS   25
+#define BIG_EXTRA   64     // bytes an oversized frame has too many
+
+// Byte i of frame n, as the decoder must hand it over
+static u8 Pattern(int frame, int i) {
+    return (u8)(frame * 7 + i * 3 + (i >> 9));
+}
+
+// The pattern, in the byte order of the codec named by userdata
+static void PatternPicture(u8* data, u32 size, int number, void* userdata) {
+    int uyvy = strcmp(userdata, "UYVY") == 0;
+    for(u32 i = 0; i < size; i++) data[uyvy ? i ^ 1 : i] = Pattern(number, i);
+}
+
+// One video stream, every frame a keyframe, no index: the demuxer scans.
+// Frame big, unless -1, is written with more bytes than a frame has.
+static int WriteAvi(const char* path, const char* codec, int width, int height, int frames, int big) {
+    AviFixture fixture = {codec, width, height, BENCH_FPS, 1, frames, 0, big, BIG_EXTRA, 0,
+                          PatternPicture, (void*)codec};
+    return WriteAviFixture(path, &fixture);
+}
+
+// A frame's picture against the pattern of the frame its pts names
+static int CheckFrame(const PipelineFrame* frame, int frameSize) {
+    int number = (int)(frame->pts * BENCH_FPS / 1000);
+    for(int i = 0; i < frameSize; i++) {
+        if(frame->data[i] != Pattern(number, i)) return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int shown;
+    int outOfOrder;
+    int wrongPicture;
+    long steadyAllocations;
+    s64 firstPts;
+} PlayResult;
+
+// Plays until the end, one pass per refresh of a display at hz, the clock
+// starting at start ms. With stopAt > 0, stops after that many frames.
+static void Play(Pipeline* pipeline, int hz, s64 start, int stopAt, PlayResult* result) {
+    int frameSize = pipeline->width * pipeline->height * 2;
+    s64 last = -1;
+    long before = 0;
+
+    memset(result, 0, sizeof(PlayResult));
+    result->firstPts = -1;
+    for(int pass = 0; !IsPipelineFinished(pipeline); pass++) {
+        RunPipeline(pipeline);
+        const PipelineFrame* frame = PresentPipelineFrame(pipeline, start + (s64)pass * 1000 / hz);
+        if(!frame) continue;
+
+        if(result->firstPts < 0) result->firstPts = frame->pts;
+        if(frame->pts <= last) result->outOfOrder++;
+        if(CheckFrame(frame, frameSize) != 0) result->wrongPicture++;
+        last = frame->pts;
+
+        // The first few frames are the warm-up: read-ahead, first reads
+        if(++result->shown == 8) before = allocations;
+        if(stopAt && result->shown == stopAt) break;
+    }
+    if(result->shown > 8) result->steadyAllocations = allocations - before;
+}
+
+// With the decode thread: every frame is asked for just as it falls due,
+// so whatever the two threads' timing none may be skipped. Starts at
+// from ms, seeks to 2s after stopAt frames. Returns the frames shown.
+static int PlayThreaded(Pipeline* pipeline, s64 from, int stopAt, PlayResult* result) {
+    int frameSize = pipeline->width * pipeline->height * 2;
+    s64 next = from * BENCH_FPS / 1000;    // nextFrame is the decode thread's now
+
+    memset(result, 0, sizeof(PlayResult));
+    result->firstPts = -1;
+    while(!IsPipelineFinished(pipeline)) {
+        const PipelineFrame* frame = PresentPipelineFrame(pipeline, GetPipelineFrameTime(pipeline, next));
+        if(!frame) continue;
+
+        if(result->firstPts < 0) result->firstPts = frame->pts;
+        if(frame->pts != GetPipelineFrameTime(pipeline, next)) result->outOfOrder++;
+        if(CheckFrame(frame, frameSize) != 0) result->wrongPicture++;
+        result->shown++;
+        next++;
+
+        if(result->shown == stopAt) {
+            s64 landed = SeekPipeline(pipeline, 2);
+            if(landed != 2000) return -1;
+            next = landed * BENCH_FPS / 1000;
+        }
+    }
+    return result->shown;
+}
+
+static void PrintStage(const char* name, const PipelineStageStats* stage) {
+    printf("  %-8s %6u items, depth %2u, peak %2u, %6u us avg, %6u us worst, %8u us latency\n", name,
+           stage->count, stage->depth, stage->peak, stage->averageMicroseconds, stage->worstMicroseconds,
+           stage->averageLatency);
+}
+
+static void PrintStats(const PipelineStats* stats) {
+    PrintStage("demux", &stats->demux);
+    PrintStage("decode", &stats->decode);
+    PrintStage("present", &stats->present);
+    printf("  dropped %u, repeated %u, undecodable %u, oversized %u, starved %u\n", stats->dropped,
+           stats->repeated, stats->undecodable, stats->oversized, stats->starved);
+}
+
+int main(int argc, char** argv) {
+    int width = 320, height = 240, frames = 100;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: pipelinebench [-size WxH] [-frames count]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    if(width <= 0 || height <= 0 || frames < BENCH_FPS * 3) {
+        fprintf(stderr, "pipelinebench: needs a size and at least %d frames\n", BENCH_FPS * 3);
+        return 1;
+    }
+
+    char directory[] = "/tmp/pipelinebenchXXXXXX";
+    if(!mkdtemp(directory)) return 1;
+    char path[64], sidecars[64];
+    snprintf(path, sizeof(path), "%s/bench.avi", directory);
+    snprintf(sidecars, sizeof(sidecars), "%s/index", directory);
+    SetSidecarDirectory(sidecars);
+
+    printf("frame   %dx%d, %d frames at %d fps\n", width, height, frames, BENCH_FPS);
+
+    int failures = 0;
+    static const char* codecs[] = {"YUY2", "UYVY"};
+    for(int c = 0; c < 2; c++) {
+        VideoDecoder* decoder = NULL;
+        Pipeline pipeline;
+        PlayResult result;
+
+        if(WriteAvi(path, codecs[c], width, height, frames, -1) != 0 || !(decoder = InitVideoDecoder(path)) ||
+           OpenPipeline(&pipeline, decoder) != 0) {
+            printf("%s: did not open\n", codecs[c]);
+            CloseVideoDecoder(decoder);
+            failures++;
+            continue;
+        }
+
+        // A 60Hz display shows every frame
+        Play(&pipeline, 60, 0, 0, &result);
+        printf("\n%s at 60Hz: %d shown\n", codecs[c], result.shown);
+        PrintStats(&pipeline.stats);
+        if(result.shown != frames || result.outOfOrder || result.wrongPicture || pipeline.stats.dropped ||
+           pipeline.stats.undecodable) {
+            printf("  %d out of order, %d wrong pictures\n", result.outOfOrder, result.wrongPicture);
+            failures++;
+        }
+        if(result.steadyAllocations) {
+            printf("  %ld heap allocations while playing\n", result.steadyAllocations);
+            failures++;
+        }
+
+        // Back to 1s, then an 8Hz display: the ones it can't show are dropped
+        ClosePipeline(&pipeline);
+        if(SeekVideoDecoder(decoder, 0) != 0 || OpenPipeline(&pipeline, decoder) != 0 ||
+           SeekPipeline(&pipeline, 1) != 1000) {
+            printf("  seek failed\n");
+            failures++;
+        } else {
+            Play(&pipeline, 8, 1000, 0, &result);
+            printf("%s from 1s at 8Hz: %d shown, first at %lld ms\n", codecs[c], result.shown,
+                   (long long)result.firstPts);
+            PrintStats(&pipeline.stats);
+            int expected = frames - BENCH_FPS;
+            if(result.firstPts != 1000 || result.outOfOrder || result.wrongPicture ||
+               result.shown + (int)pipeline.stats.dropped != expected || result.shown > expected / 2) {
+                printf("  %d out of order, %d wrong pictures, %d + %u dropped of %d\n", result.outOfOrder,
+                       result.wrongPicture, result.shown, pipeline.stats.dropped, expected);
+                failures++;
+            }
+        }
+
+        // A seek mid-play, back to 2s while later frames are queued
+        if(SeekPipeline(&pipeline, 0) == 0) {
+            Play(&pipeline, 60, 0, BENCH_FPS, &result);
+            if(SeekPipeline(&pipeline, 2) != 2000) {
+                printf("  seek failed\n");
+                failures++;
+            } else {
+                Play(&pipeline, 60, 2000, 1, &result);
+                if(result.firstPts != 2000 || result.wrongPicture) {
+                    printf("  seek to 2s showed %lld ms\n", (long long)result.firstPts);
+                    failures++;
+                }
+            }
+        }
+
+        // Throughput, clock out of the way
+        SeekPipeline(&pipeline, 0);
+        memset(&pipeline.stats, 0, sizeof(PipelineStats));
+        double start = Now();
+        int shown = 0;
+        while(!IsPipelineFinished(&pipeline)) {
+            RunPipeline(&pipeline);
+            shown += PresentPipelineFrame(&pipeline, 1LL << 40) != NULL;
+        }
+        double seconds = Now() - start;
+        printf("%s unpaced: %.0f frames/s shown, %.0f decoded\n", codecs[c], shown / seconds,
+               pipeline.stats.decode.count / seconds);
+
+        // Again on the decode thread, from 1s, with a seek back to 2s
+        if(StartPipelineThread(&pipeline, PIPELINE_PRIORITY) != 0 || SeekPipeline(&pipeline, 1) != 1000) {
+            printf("  decode thread did not start\n");
+            failures++;
+        } else {
+            memset(&pipeline.stats, 0, sizeof(PipelineStats));
+            start = Now();
+            shown = PlayThreaded(&pipeline, 1000, BENCH_FPS, &result);
+            seconds = Now() - start;
+            int expected = frames - BENCH_FPS;     // 1s to 2s, then 2s to the end
+            printf("%s on the decode thread: %d shown, %.0f frames/s\n", codecs[c], shown, shown / seconds);
+            PrintStats(&pipeline.stats);
+            if(shown != expected || result.firstPts != 1000 || result.outOfOrder || result.wrongPicture ||
+               pipeline.stats.dropped) {
+                printf("  %d out of order, %d wrong pictures, %u dropped of %d\n", result.outOfOrder,
+                       result.wrongPicture, pipeline.stats.dropped, expected);
+                failures++;
+            }
+        }
+
+        ClosePipeline(&pipeline);
+        CloseVideoDecoder(decoder);
+    }
+
+    // A frame too big for the ring is skipped whole, not cut short, and the
+    // ones after it keep their times
+    VideoDecoder* decoder = NULL;
+    Pipeline pipeline;
+    if(WriteAvi(path, "YUY2", width, height, BENCH_FPS * 2, 10) == 0 && (decoder = InitVideoDecoder(path)) &&
+       OpenPipeline(&pipeline, decoder) == 0) {
+        PlayResult result;
+        Play(&pipeline, 60, 0, 0, &result);
+        printf("\noversized frame: %d shown, %u skipped\n", result.shown, pipeline.stats.oversized);
+        if(result.shown != BENCH_FPS * 2 - 1 || pipeline.stats.oversized != 1 || result.outOfOrder ||
+           result.wrongPicture || pipeline.stats.undecodable) {
+            printf("  %d out of order, %d wrong pictures\n", result.outOfOrder, result.wrongPicture);
+            failures++;
+        }
+        ClosePipeline(&pipeline);
+    } else {
+        printf("oversized frame: did not open\n");
+        failures++;
+    }
+    CloseVideoDecoder(decoder);
+
+    // An unknown codec is refused rather than read to the end for nothing
+    decoder = NULL;
+    if(WriteAvi(path, "H264", width, height, BENCH_FPS, -1) == 0 && (decoder = InitVideoDecoder(path))) {
+        if(OpenPipeline(&pipeline, decoder) == 0) {
+            printf("H264: opened without a decoder\n");
+            ClosePipeline(&pipeline);
+            failures++;
+        }
+    } else {
+        printf("H264: demuxer did not open\n");
+        failures++;
+    }
+    CloseVideoDecoder(decoder);
+
+    RemoveDirectory(directory);
+    printf("\npipeline: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+// Host benchmark for the scaler (make bench)
+//
+// Scales the common source sizes into their letterbox on a 640x480 and a
+// 640x528 (PAL) framebuffer, both modes, and reports the time per frame
+// and output Mpixels/s. Then checks what has an exact answer: a source
+// the size of the frame comes through unchanged, a flat picture stays
+// flat, the bars are black, and each geometry's tables were built once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "scaler.h"
+#include "videofilter.h"
+
+// Gradients with some noise
+static void FillSource(u8* source, int width, int height) {
+    u32 seed = 12345;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width * 2; x++) {
+            seed = seed * 1103515245 + 12345;
+            int value = (x & 1) ? 64 + (y * 128 / height) : 16 + (x * 200 / (width * 2));
+            source[y * width * 2 + x] = value + ((seed >> 16) & 15);
+        }
+    }
+}
+
+static int IsBlack(const u8* p) {
+    return p[0] == VIDEO_LUMA_BLACK && p[1] == VIDEO_CHROMA_ZERO && p[2] == VIDEO_LUMA_BLACK &&
+           p[3] == VIDEO_CHROMA_ZERO;
+}
+
+int main(int argc, char** argv) {
+    static const int sources[][2] = {{320, 240}, {480, 272}, {720, 480}, {1280, 720}};
+    static const int frames[][2] = {{640, 480}, {640, 528}};
+    static const char* modeNames[] = {"bilinear", "polyphase"};
+    int count = 30;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: scalebench [-frames count]\n");
+            return 1;
+        }
+    }
+    if(count < 1) return 1;
+
+    u8* source = malloc(1280 * 720 * 2);
+    u8* frame = malloc(640 * 528 * 2);
+    if(!source || !frame) return 1;
+
+    printf("source      frame    letterbox         bilinear          polyphase\n");
+    printf("                                    ms  Mpixels/s      ms  Mpixels/s\n");
+
+    int geometries = 0;
+    for(int s = 0; s < 4; s++) {
+        int sourceWidth = sources[s][0], sourceHeight = sources[s][1];
+        FillSource(source, sourceWidth, sourceHeight);
+
+        for(int f = 0; f < 2; f++) {
+            int frameWidth = frames[f][0], frameHeight = frames[f][1];
+            VideoRect rect;
+            GetVideoLetterbox(sourceWidth, sourceHeight, 0, 0, frameWidth, frameHeight, &rect);
+            printf("%4dx%-4d  %dx%d  %3dx%-3d at %2d,%-2d", sourceWidth, sourceHeight, frameWidth, frameHeight,
+                   rect.width, rect.height, rect.x, rect.y);
+
+            for(int mode = VIDEO_SCALE_BILINEAR; mode <= VIDEO_SCALE_POLYPHASE; mode++) {
+                double start = Now();
+                for(int n = 0; n < count; n++) {
+                    ScaleYUYV(source, sourceWidth, sourceHeight, sourceWidth * 2, frame, frameWidth, frameHeight,
+                              &rect, mode);
+                }
+                double seconds = (Now() - start) / count;
+                printf("  %7.2f %9.1f", seconds * 1e3, rect.width * (double)rect.height / seconds / 1e6);
+                geometries++;
+            }
+            printf("\n");
+        }
+    }
+
+    int failures = 0;
+    VideoScaleStats stats;
+    GetVideoScaleStats(&stats);
+    printf("\n%u frames, tables built %u times, used %u times, %u lines reused\n", stats.frames,
+           stats.planMisses, stats.planHits, stats.linesReused);
+    if((int)stats.planMisses != geometries) {
+        printf("  tables built more than once per geometry\n");
+        failures++;
+    }
+
+    for(int mode = VIDEO_SCALE_BILINEAR; mode <= VIDEO_SCALE_POLYPHASE; mode++) {
+        // Frame-sized source, stretched: a copy
+        VideoRect whole = {0, 0, 640, 480};
+        FillSource(source, 640, 480);
+        ScaleYUYV(source, 640, 480, 640 * 2, frame, 640, 480, &whole, mode);
+        if(memcmp(source, frame, 640 * 480 * 2) != 0) {
+            printf("  %s: same size is not a copy\n", modeNames[mode]);
+            failures++;
+        }
+
+        // Flat 1280x720 into a letterbox: flat inside, black outside
+        for(int i = 0; i < 1280 * 720 * 2; i += 4) {
+            source[i] = source[i + 2] = 120;
+            source[i + 1] = 90;
+            source[i + 3] = 200;
+        }
+        VideoRect rect;
+        GetVideoLetterbox(1280, 720, 0, 0, 640, 528, &rect);
+        ScaleYUYV(source, 1280, 720, 1280 * 2, frame, 640, 528, &rect, mode);
+
+        int wrong = 0;
+        for(int y = 0; y < 528; y++) {
+            for(int x = 0; x < 640; x += 2) {
+                const u8* p = frame + (y * 640 + x) * 2;
+                int inside = y >= rect.y && y < rect.y + rect.height && x >= rect.x && x < rect.x + rect.width;
+                if(inside ? p[0] != 120 || p[1] != 90 || p[2] != 120 || p[3] != 200 : !IsBlack(p)) wrong++;
+            }
+        }
+        if(wrong) {
+            printf("  %s: %d pairs wrong in the flat letterbox\n", modeNames[mode], wrong);
+            failures++;
+        }
+    }
+
+    printf("scaler: %s\n", failures ? "FAIL" : "ok");
+    FreeVideoScalePlans();
+    free(source);
+    free(frame);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+// Host benchmark for the unsharp mask (make bench)
+//
+// Times what the sharpness setting used to cost, a wider chroma matrix in
+// the filter pass, against the streaming unsharp mask on its own, after
+// the filter pass and folded into it, and against a direct mask that
+// blurs a full-frame copy first. The streaming mask has to give the direct one's
+// bytes over a sweep of amounts, thresholds and frame sizes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "videofilter.h"
+
+static int Clamp(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+// The mask written out plainly: the 3x3 blur of Y from a copy of the
+// frame, 9 reads per pixel with edges repeated
+static void DirectSharpen(u8* frame, int width, int height, int amount, int threshold) {
+    static const int weights[3] = {1, 2, 1};
+    int stride = width * 2;
+    u8* copy = malloc(stride * height);
+    if(!copy) return;
+    memcpy(copy, frame, stride * height);
+
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width; x++) {
+            int sum = 0;
+            for(int j = -1; j <= 1; j++) {
+                for(int i = -1; i <= 1; i++) {
+                    int sy = Clamp(y + j, 0, height - 1), sx = Clamp(x + i, 0, width - 1);
+                    sum += weights[j + 1] * weights[i + 1] * copy[sy * stride + sx * 2];
+                }
+            }
+
+            int luma = copy[y * stride + x * 2];
+            int diff = luma - ((sum + 8) >> 4);
+            if(abs(diff) <= threshold) continue;
+
+            int add = (diff * amount + (1 << (VIDEO_SHARPEN_SHIFT - 1))) >> VIDEO_SHARPEN_SHIFT;
+            if(add) frame[y * stride + x * 2] = Clamp(luma + add, VIDEO_LUMA_BLACK, VIDEO_LUMA_WHITE);
+        }
+    }
+
+    free(copy);
+}
+
+// Gradients with edges and some noise, so the threshold sees both
+static void FillFrame(u8* frame, int width, int height) {
+    u32 seed = 12345;
+    for(int y = 0; y < height; y++) {
+        for(int x = 0; x < width * 2; x++) {
+            seed = seed * 1103515245 + 12345;
+            int edge = ((x / 32 + y / 24) & 1) * 80;
+            frame[y * width * 2 + x] = Clamp(40 + edge + x * 60 / (width * 2) + ((seed >> 16) & 7), 0, 255);
+        }
+    }
+}
+
+static double Rate(int width, int height, int frames, double seconds) {
+    return width * (double)height * frames / seconds / 1e6;
+}
+
+int main(int argc, char** argv) {
+    int width = 640, height = 480, frames = 30;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &width, &height);
+        } else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: sharpenbench [-size WxH] [-frames count]\n");
+            return 1;
+        }
+    }
+
+    width &= ~1;
+    int size = width * height * 2;
+    u8* source = malloc(size);
+    u8* frame = malloc(size);
+    u8* expect = malloc(size);
+    if(!source || !frame || !expect || frames < 1 || size <= 0) return 1;
+    FillFrame(source, width, height);
+
+    // Sharpness 5 both ways; before, it only made the matrix 1.5x wider
+    VideoFilter setting = {1.1f, 1.2f, 1.0f, 10.0f, 0.9f, 5, 0, 0, 0};
+    CompiledVideoFilter compiled, widened;
+    CompileVideoFilter(&setting, &compiled);
+    setting.saturation *= 1.5f;
+    CompileVideoFilter(&setting, &widened);
+
+    printf("frame         %dx%d, %d frames, Mpixels/s\n", width, height, frames);
+
+    double start = Now();
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        RunVideoFilter(&widened, frame, width * height / 2);
+    }
+    printf("old sharpness %8.1f (filter pass, chroma only)\n", Rate(width, height, frames, Now() - start));
+
+    start = Now();
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        DirectSharpen(frame, width, height, compiled.sharpenAmount, compiled.sharpenThreshold);
+    }
+    printf("direct mask   %8.1f\n", Rate(width, height, frames, Now() - start));
+
+    start = Now();
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        SharpenLumaYUYV(frame, width, height, compiled.sharpenAmount, compiled.sharpenThreshold);
+    }
+    printf("streaming     %8.1f\n", Rate(width, height, frames, Now() - start));
+
+    start = Now();
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        RunVideoFilter(&compiled, frame, width * height / 2);
+        SharpenLumaYUYV(frame, width, height, compiled.sharpenAmount, compiled.sharpenThreshold);
+    }
+    printf("filter, mask  %8.1f (two sweeps)\n", Rate(width, height, frames, Now() - start));
+
+    start = Now();
+    for(int f = 0; f < frames; f++) {
+        memcpy(frame, source, size);
+        RunVideoFilterFrame(&compiled, frame, width, height);
+    }
+    printf("filter + mask %8.1f (one sweep)\n", Rate(width, height, frames, Now() - start));
+
+    // Exact against the direct mask, odd sizes and 1-line frames included
+    static const int sizes[][2] = {{0, 0}, {2, 1}, {2, 5}, {6, 1}, {34, 17}};
+    int mismatches = 0, checks = 0;
+
+    for(int z = 0; z < 5; z++) {
+        int w = z ? sizes[z][0] : width, h = z ? sizes[z][1] : height;
+        FillFrame(source, w, h);
+
+        for(int sharpness = 1; sharpness <= 10; sharpness += 3) {
+            for(int threshold = 0; threshold <= 8; threshold += 4) {
+                int amount = sharpness * (1 << VIDEO_SHARPEN_SHIFT) / 5;
+                memcpy(frame, source, w * h * 2);
+                memcpy(expect, source, w * h * 2);
+                SharpenLumaYUYV(frame, w, h, amount, threshold);
+                DirectSharpen(expect, w, h, amount, threshold);
+                checks++;
+
+                for(int i = 0; i < w * h * 2; i++) {
+                    if(frame[i] != expect[i] && mismatches++ < 8) {
+                        printf("  %dx%d amount %d threshold %d: byte %d is %d, direct %d\n",
+                               w, h, amount, threshold, i, frame[i], expect[i]);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("accuracy      %d settings: %s\n", checks, mismatches ? "FAIL" : "exact");
+
+    free(source);
+    free(frame);
+    free(expect);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+// Host check and benchmark for the SPSC queues (make bench)
+//
+// A producer and a consumer pthread push items through the queue as
+// fast as they go, for several slot sizes and capacities. Every item
+// carries its sequence number and a payload made from it, and the
+// consumer checks each one arrives once, in order and whole. The
+// counters start just short of wrapping so that's crossed too. Then
+// reports items per second and how often each side found the queue
+// full or empty. A side that has to wait yields, so it also runs on one
+// core as on the Wii.
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "spsc.h"
+
+#define MAX_SLOT    64
+
+typedef struct {
+    u32 slotSize;
+    u32 count;
+} QueueCase;
+
+static const QueueCase cases[] = {
+    {4, 2}, {4, 256}, {16, 4}, {16, 64}, {64, 16}, {64, 1024},
+};
+
+typedef struct {
+    SpscQueue queue;
+    u32 slotSize;
+    u32 items;
+    u32 wrongItems;         // out of order, repeated or torn
+    long fullSpins;
+    long emptySpins;
+} Run;
+
+static void MakeItem(u8* item, u32 size, u32 sequence) {
+    memcpy(item, &sequence, 4);
+    for(u32 i = 4; i < size; i++) item[i] = (u8)(sequence * 31 + i);
+}
+
+static int CheckItem(const u8* item, u32 size, u32 sequence) {
+    u32 got;
+    memcpy(&got, item, 4);
+    if(got != sequence) return -1;
+    for(u32 i = 4; i < size; i++) {
+        if(item[i] != (u8)(sequence * 31 + i)) return -1;
+    }
+    return 0;
+}
+
+static void* Producer(void* arg) {
+    Run* run = arg;
+    u8 item[MAX_SLOT];
+
+    for(u32 n = 0; n < run->items; n++) {
+        MakeItem(item, run->slotSize, n);
+        while(PushSpscQueue(&run->queue, item) != 0) {
+            run->fullSpins++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void* Consumer(void* arg) {
+    Run* run = arg;
+    u8 item[MAX_SLOT];
+    u32 expected = 0;
+
+    while(expected < run->items) {
+        // Peek and pop must agree
+        const u8* head = PeekSpscQueue(&run->queue);
+        if(!head) {
+            run->emptySpins++;
+            sched_yield();
+            continue;
+        }
+        if(CheckItem(head, run->slotSize, expected) != 0 || PopSpscQueue(&run->queue, item) != 0 ||
+           CheckItem(item, run->slotSize, expected) != 0) {
+            run->wrongItems++;
+        }
+        expected++;
+    }
+    if(PopSpscQueue(&run->queue, item) == 0) run->wrongItems++;
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    u32 items = 4000000;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-items") == 0 && i + 1 < argc) {
+            items = (u32)atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: spscbench [-items count]\n");
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    SpscQueue queue;
+    u8 storage[4 * MAX_SLOT];
+    if(InitSpscQueue(&queue, storage, 4, 3) == 0 || InitSpscQueue(&queue, storage, 4, 0) == 0) {
+        printf("queue of 3 or 0 slots accepted\n");
+        failures++;
+    }
+
+    for(int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+        const QueueCase* test = &cases[c];
+        Run run;
+        u8* slots = malloc(test->slotSize * test->count);
+
+        memset(&run, 0, sizeof(Run));
+        run.slotSize = test->slotSize;
+        run.items = items;
+        if(!slots || InitSpscQueue(&run.queue, slots, test->slotSize, test->count) != 0) {
+            printf("%u x %u bytes: did not open\n", test->count, test->slotSize);
+            free(slots);
+            failures++;
+            continue;
+        }
+        run.queue.pushed = run.queue.popped = 0xffffffffu - items / 2;
+
+        pthread_t producer, consumer;
+        double start = Now();
+        pthread_create(&consumer, NULL, Consumer, &run);
+        pthread_create(&producer, NULL, Producer, &run);
+        pthread_join(producer, NULL);
+        pthread_join(consumer, NULL);
+        double seconds = Now() - start;
+
+        printf("%4u x %2u bytes: %6.1f M items/s, %ld full, %ld empty spins\n", test->count, test->slotSize,
+               items / seconds / 1e6, run.fullSpins, run.emptySpins);
+        if(run.wrongItems || GetSpscQueueDepth(&run.queue) != 0) {
+            printf("  %u wrong items, %u left\n", run.wrongItems, GetSpscQueueDepth(&run.queue));
+            failures++;
+        }
+        free(slots);
+    }
+
+    printf("spsc: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
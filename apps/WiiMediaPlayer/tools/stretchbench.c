@@ -0,0 +1,286 @@
+// Host check and benchmark for the time-stretch stage (make bench)
+//
+// A 440 Hz tone (left, and the right at half level) goes through the
+// stage at 0.5x to 2.0x, read in the fill thread's buffers from a source
+// handing out MP3-sized chunks. The output must be the right length for
+// the speed, still at 440 Hz, free of clicks where segments join and the
+// same on both channels; 1.0x must come through untouched, written by
+// the source straight into the caller's buffer. Then the speed changes
+// while it plays, and the stage must bypass itself again once back at
+// 1.0x. Last, a voice-like signal (a gliding 100-160 Hz pulse train in
+// syllables) is timed at each speed, scaled to the 729 MHz Broadway by
+// the host clock given with -mhz, as audiobench does.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "timestretch.h"
+
+#define SAMPLE_RATE     44100
+#define TONE_HZ         440
+#define TONE_LEVEL      12000
+#define SOURCE_CHUNK    1152        // sample frames a read hands out
+#define FILL_BYTES      8192        // as the stream's fill thread asks
+#define BROADWAY_MHZ    729.0
+
+typedef struct {
+    const s16* samples;         // stereo
+    int frames;
+    int read;
+    int lastWrite;              // frames written into the caller's buffer
+    const void* lastBuffer;
+} Source;
+
+static const int speeds[] = {128, 160, 192, 224, 256, 320, 384, 448, 512};
+
+static int ReadSource(void* userdata, void* buffer, int size) {
+    Source* source = userdata;
+    int frames = size / 4;
+    if(frames > SOURCE_CHUNK) frames = SOURCE_CHUNK;
+    if(frames > source->frames - source->read) frames = source->frames - source->read;
+
+    memcpy(buffer, source->samples + source->read * 2, frames * 4);
+    source->read += frames;
+    source->lastWrite = frames;
+    source->lastBuffer = buffer;
+    return frames * 4;
+}
+
+static s16* MakeTone(int frames) {
+    s16* samples = malloc(frames * 4);
+    for(int i = 0; i < frames; i++) {
+        s16 level = (s16)lrint(TONE_LEVEL * sin(2 * M_PI * TONE_HZ * i / SAMPLE_RATE));
+        samples[i * 2] = level;
+        samples[i * 2 + 1] = level / 2;
+    }
+    return samples;
+}
+
+// A decaying pulse at a gliding pitch, in 4 Hz syllables with gaps
+static s16* MakeVoice(int frames) {
+    s16* samples = malloc(frames * 4);
+    double phase = 1, ring = 0, velocity = 0;
+    for(int i = 0; i < frames; i++) {
+        double t = (double)i / SAMPLE_RATE;
+        double pitch = 130 + 30 * sin(2 * M_PI * 0.7 * t);
+        phase += pitch / SAMPLE_RATE;
+        if(phase >= 1) {
+            phase -= 1;
+            velocity += 0.5;
+        }
+        // A resonance near 700 Hz rung by each pulse
+        double w = 2 * M_PI * 700 / SAMPLE_RATE;
+        velocity = velocity * 0.995 - ring * w;
+        ring += velocity * w;
+        double envelope = sin(M_PI * fmod(t * 4, 1));
+        s16 level = (s16)lrint(envelope > 0.2 ? 6000 * ring * envelope : 0);
+        samples[i * 2] = level;
+        samples[i * 2 + 1] = level;
+    }
+    return samples;
+}
+
+// Everything the stage gives, read as the fill thread does; changes
+// speed at each of the output times given (sample frames)
+static s16* Stretch(TimeStretch* stretch, int* outFrames, const int* changeAt, const int* changeTo, int changes) {
+    int capacity = 1 << 20;
+    s16* out = malloc(capacity * 4);
+    int frames = 0;
+    int next = 0;
+
+    for(;;) {
+        while(next < changes && frames >= changeAt[next]) SetTimeStretchSpeed(stretch, changeTo[next++]);
+        if(frames + FILL_BYTES / 4 > capacity) {
+            capacity *= 2;
+            out = realloc(out, capacity * 4);
+        }
+        int bytes = ReadTimeStretch(stretch, out + frames * 2, FILL_BYTES);
+        if(bytes <= 0) break;
+        frames += bytes / 4;
+    }
+    *outFrames = frames;
+    return out;
+}
+
+// Largest step between neighbouring samples of the left channel, and the
+// tone's frequency from its zero crossings
+static int WorstStep(const s16* out, int from, int to) {
+    int worst = 0;
+    for(int i = from + 1; i < to; i++) {
+        int step = abs(out[i * 2] - out[i * 2 - 2]);
+        if(step > worst) worst = step;
+    }
+    return worst;
+}
+
+static double Frequency(const s16* out, int from, int to) {
+    int crossings = 0, first = -1, last = -1;
+    for(int i = from + 1; i < to; i++) {
+        if(out[i * 2 - 2] < 0 && out[i * 2] >= 0) {
+            if(first < 0) first = i;
+            last = i;
+            crossings++;
+        }
+    }
+    return crossings > 1 ? (double)(crossings - 1) * SAMPLE_RATE / (last - first) : 0;
+}
+
+static int WorstChannelGap(const s16* out, int frames) {
+    int worst = 0;
+    for(int i = 0; i < frames; i++) {
+        int gap = abs(out[i * 2] - 2 * out[i * 2 + 1]);
+        if(gap > worst) worst = gap;
+    }
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    double hostMhz = 0;
+    int seconds = 60;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-mhz") == 0 && i + 1 < argc) {
+            hostMhz = atof(argv[++i]);
+        } else if(strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: stretchbench [-mhz host-clock] [-seconds count]\n");
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    static TimeStretch stretch;
+    Source source;
+    int toneFrames = SAMPLE_RATE * 10;
+    s16* tone = MakeTone(toneFrames);
+    // A clean tone never moves more than this between samples; a join
+    // out of phase would
+    int naturalStep = (int)ceil(TONE_LEVEL * 2 * M_PI * TONE_HZ / SAMPLE_RATE);
+
+    if(InitTimeStretch(&stretch, 96000, 2, ReadSource, &source) == 0 ||
+       InitTimeStretch(&stretch, SAMPLE_RATE, 3, ReadSource, &source) == 0) {
+        printf("96kHz or 3 channels accepted\n");
+        failures++;
+    }
+
+    // Fixed speeds
+    for(int s = 0; s < (int)(sizeof(speeds) / sizeof(speeds[0])); s++) {
+        int speed = speeds[s];
+        memset(&source, 0, sizeof(Source));
+        source.samples = tone;
+        source.frames = toneFrames;
+        InitTimeStretch(&stretch, SAMPLE_RATE, 2, ReadSource, &source);
+        SetTimeStretchSpeed(&stretch, speed);
+
+        int frames;
+        s16* out = Stretch(&stretch, &frames, NULL, NULL, 0);
+        int expected = (int)((s64)toneFrames * TIME_STRETCH_UNITY / speed);
+        int slack = stretch.sequence + stretch.window;
+        double hz = Frequency(out, 0, frames);
+        int step = WorstStep(out, 0, frames);
+        int gap = WorstChannelGap(out, frames);
+
+        printf("%.3fx: %6d frames (%+5d), %.1f Hz, worst step %d, %u segments\n", speed / 256.0, frames,
+               frames - expected, hz, step, (unsigned)stretch.stats.segments);
+        if(abs(frames - expected) > slack || fabs(hz - TONE_HZ) > TONE_HZ * 0.01 || step > naturalStep * 5 / 4 ||
+           gap > 2) {
+            printf("  wrong: expected %d +-%d frames, %d Hz, steps to %d; channels %d apart\n", expected, slack,
+                   TONE_HZ, naturalStep, gap);
+            failures++;
+        }
+        if(speed == TIME_STRETCH_UNITY &&
+           (frames != toneFrames || memcmp(out, tone, frames * 4) != 0 || stretch.stats.stretchedFrames != 0)) {
+            printf("  1.0x changed the samples or went through the stage\n");
+            failures++;
+        }
+        free(out);
+    }
+
+    // 1.0x writes straight into the buffer it is given
+    {
+        static s16 buffer[FILL_BYTES / 2];
+        memset(&source, 0, sizeof(Source));
+        source.samples = tone;
+        source.frames = toneFrames;
+        InitTimeStretch(&stretch, SAMPLE_RATE, 2, ReadSource, &source);
+        int bytes = ReadTimeStretch(&stretch, buffer, sizeof(buffer));
+        if(source.lastBuffer != buffer || bytes != source.lastWrite * 4) {
+            printf("1.0x: not written in place\n");
+            failures++;
+        }
+    }
+
+    // Changing speed while playing, back to 1.0x in between
+    {
+        static const int changeAt[] = {SAMPLE_RATE, SAMPLE_RATE * 3, SAMPLE_RATE * 4, SAMPLE_RATE * 5, SAMPLE_RATE * 6};
+        static const int changeTo[] = {128, 256, 512, 192, 256};
+        memset(&source, 0, sizeof(Source));
+        source.samples = tone;
+        source.frames = toneFrames;
+        InitTimeStretch(&stretch, SAMPLE_RATE, 2, ReadSource, &source);
+
+        int frames;
+        s16* out = Stretch(&stretch, &frames, changeAt, changeTo, 5);
+        // 1 s at 1x, 2 s of output at 0.5x, 1 at 1x, 1 at 2x, 1 at 0.75x, the rest at 1x
+        int input = SAMPLE_RATE * (1 + 1 + 1 + 2) + SAMPLE_RATE * 3 / 4;
+        int expected = SAMPLE_RATE * 6 + (toneFrames - input);
+        int slack = 4 * (stretch.sequence + stretch.window);
+        double hz = Frequency(out, 0, frames);
+        int step = WorstStep(out, 0, frames);
+
+        printf("changing: %6d frames (%+5d), %.1f Hz, worst step %d, %llu bypassed\n", frames, frames - expected, hz,
+               step, (unsigned long long)stretch.stats.bypassedFrames);
+        if(abs(frames - expected) > slack || fabs(hz - TONE_HZ) > TONE_HZ * 0.01 || step > naturalStep * 5 / 4 ||
+           stretch.stats.bypassedFrames < SAMPLE_RATE * 3 / 2) {
+            printf("  wrong: expected %d +-%d frames, steps to %d, 1.5 s bypassed\n", expected, slack, naturalStep);
+            failures++;
+        }
+
+        // After a reset it starts again cleanly
+        source.read = 0;
+        ResetTimeStretch(&stretch);
+        SetTimeStretchSpeed(&stretch, 384);
+        free(out);
+        out = Stretch(&stretch, &frames, NULL, NULL, 0);
+        expected = toneFrames * 256 / 384;
+        if(abs(frames - expected) > stretch.sequence + stretch.window) {
+            printf("  after a reset %d frames, expected %d\n", frames, expected);
+            failures++;
+        }
+        free(out);
+    }
+
+    // Cost at each speed, of the stage alone: the voice is already decoded
+    int voiceFrames = SAMPLE_RATE * seconds;
+    s16* voice = MakeVoice(voiceFrames);
+    for(int s = 0; s < (int)(sizeof(speeds) / sizeof(speeds[0])); s += 2) {
+        static s16 buffer[FILL_BYTES / 2];
+        int speed = speeds[s];
+        memset(&source, 0, sizeof(Source));
+        source.samples = voice;
+        source.frames = voiceFrames;
+        InitTimeStretch(&stretch, SAMPLE_RATE, 2, ReadSource, &source);
+        SetTimeStretchSpeed(&stretch, speed);
+
+        s64 frames = 0;
+        int bytes;
+        double start = Now();
+        while((bytes = ReadTimeStretch(&stretch, buffer, sizeof(buffer))) > 0) frames += bytes / 4;
+        double took = Now() - start;
+        double audio = (double)frames / SAMPLE_RATE;
+
+        printf("voice %.3fx: %.2f ms per s of output, %.0fx real time, %.1f offsets per segment", speed / 256.0,
+               took * 1000 / audio, audio / took,
+               stretch.stats.segments ? (double)stretch.stats.searched / stretch.stats.segments : 0);
+        if(hostMhz > 0) printf(", %.2f%% of %.0f MHz", 100.0 * took * hostMhz / (audio * BROADWAY_MHZ), BROADWAY_MHZ);
+        printf("\n");
+    }
+
+    free(voice);
+    free(tone);
+    printf("time stretch: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+// Host check for keyframe trick play (make bench)
+//
+// Writes a two hour AVI at 25 fps (frames of 8x2 holding their number)
+// whose idx1 marks a keyframe every 12 frames, then scans it at every
+// speed both ways on a 60Hz display. The decoder is made to take a given
+// time per keyframe, as a real codec would on the Wii: it is only run
+// once the last one would have finished. Every picture must be a
+// keyframe with the right content, come up in the scan's direction and
+// stay within reach of the scan position; a cheap decoder must show
+// nearly every keyframe it passes, a dear one must skip rather than lag.
+// Then checks leaving trick play resumes at the picture on screen, a
+// full rewind ends on the first frame, and the decode thread does the
+// same for real.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "avifixture.h"
+#include "bench.h"
+#include "decoder.h"
+#include "pipeline.h"
+#include "sidecar.h"
+#include "trickplay.h"
+
+#define BENCH_FPS       25
+#define BENCH_GOP       12          // frames from keyframe to keyframe
+#define BENCH_SECONDS   7200
+#define FRAME_WIDTH     8
+#define FRAME_HEIGHT    2
+#define REFRESH         16683       // microseconds, 59.94Hz
+
+typedef struct {
+    int speed;
+    u32 decodeMicroseconds;
+    int seconds;            // of display, 0 to the end of the file
+} TrickCase;
+
+static const TrickCase cases[] = {
+    {2, 5000, 60}, {4, 5000, 60}, {8, 20000, 60}, {16, 20000, 60}, {32, 40000, 0},
+    {-2, 5000, 60}, {-4, 5000, 60}, {-8, 20000, 60}, {-16, 20000, 60}, {-32, 40000, 0},
+};
+
+// Raw YUY2 with an idx1, so the demuxer has keyframes to go by
+static int WriteAvi(const char* path, int frames) {
+    AviFixture fixture = {"YUY2", FRAME_WIDTH, FRAME_HEIGHT, BENCH_FPS, 1, frames, BENCH_GOP, -1, 0, 0, NULL, NULL};
+    return WriteAviFixture(path, &fixture);
+}
+
+static u32 FrameNumber(const PipelineFrame* frame) {
+    return AviFixtureNumber(frame->data);
+}
+
+typedef struct {
+    int shown;
+    int notKeyframe;
+    int wrongPicture;
+    int backwards;          // against the scan's direction
+    s64 worstLag;           // ms between the picture and the scan
+    s64 first;              // frame numbers of the first and last pictures
+    s64 last;
+    int refreshes;
+} ScanResult;
+
+// Refreshes until the scan hits an end or seconds of display have gone,
+// running the decoder only when the keyframe before would be done
+static void Scan(Pipeline* pipeline, TrickPlay* trick, const TrickCase* test, s64 startMs, ScanResult* result) {
+    u64 now = 0, busyUntil = 0;
+    u32 decoded = pipeline->stats.decode.count;
+
+    memset(result, 0, sizeof(ScanResult));
+    result->first = result->last = -1;
+    StartTrickPlay(trick, test->speed, startMs, (s64)BENCH_SECONDS * 1000, now);
+    for(;; result->refreshes++) {
+        now += REFRESH;
+        if(now >= busyUntil) {
+            RunPipeline(pipeline);
+            if(pipeline->stats.decode.count != decoded) {
+                decoded = pipeline->stats.decode.count;
+                busyUntil = now + test->decodeMicroseconds;
+            }
+        }
+
+        const PipelineFrame* frame = RunTrickPlay(trick, pipeline, now);
+        if(frame) {
+            s64 number = FrameNumber(frame);
+            if(number % BENCH_GOP) result->notKeyframe++;
+            if(frame->pts != GetPipelineFrameTime(pipeline, number)) result->wrongPicture++;
+            if(result->last >= 0 && (test->speed > 0 ? number <= result->last : number >= result->last)) {
+                result->backwards++;
+            }
+            if(result->first < 0) result->first = number;
+            result->last = number;
+            result->shown++;
+
+            s64 lag = frame->pts - trick->position / 1000;
+            if(lag < 0) lag = -lag;
+            if(lag > result->worstLag) result->worstLag = lag;
+        }
+
+        if(IsTrickPlayAtEnd(trick)) break;
+        if(test->seconds && now >= (u64)test->seconds * 1000000) break;
+    }
+}
+
+// The speeds Left and Right step through
+static int CheckSpeedSteps() {
+    static const int up[] = {2, 4, 8, 16, 32, 32};
+    static const int down[] = {16, 8, 4, 2, 1, -2, -4, -8, -16, -32, -32};
+    int speed = 1, failures = 0;
+
+    for(int i = 0; i < (int)(sizeof(up) / sizeof(up[0])); i++) {
+        speed = StepTrickSpeed(speed, 1);
+        if(speed != up[i]) failures++;
+    }
+    for(int i = 0; i < (int)(sizeof(down) / sizeof(down[0])); i++) {
+        speed = StepTrickSpeed(speed, -1);
+        if(speed != down[i]) failures++;
+    }
+    if(StepTrickSpeed(-2, 1) != 1) failures++;
+    if(failures) printf("speed steps wrong\n");
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        fprintf(stderr, "usage: trickbench\n");
+        return 1;
+    }
+
+    char directory[] = "/tmp/trickbenchXXXXXX";
+    if(!mkdtemp(directory)) return 1;
+    char path[64], sidecars[64];
+    snprintf(path, sizeof(path), "%s/trick.avi", directory);
+    snprintf(sidecars, sizeof(sidecars), "%s/index", directory);
+    SetSidecarDirectory(sidecars);
+
+    int frames = BENCH_SECONDS * BENCH_FPS;
+    int failures = CheckSpeedSteps();
+    VideoDecoder* decoder = NULL;
+    Pipeline pipeline;
+    if(WriteAvi(path, frames) != 0 || !(decoder = InitVideoDecoder(path)) || OpenPipeline(&pipeline, decoder) != 0) {
+        printf("did not open\n");
+        CloseVideoDecoder(decoder);
+        RemoveDirectory(directory);
+        return 1;
+    }
+
+    s64 gopMs = BENCH_GOP * 1000 / BENCH_FPS;
+    printf("%d s at %d fps, a keyframe every %lld ms, 59.94Hz display\n", BENCH_SECONDS, BENCH_FPS,
+           (long long)gopMs);
+    for(int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); c++) {
+        const TrickCase* test = &cases[c];
+        TrickPlay trick = {0};
+        ScanResult result;
+
+        // Forward from the start, backwards from the end
+        s64 startMs = test->speed > 0 ? 0 : (s64)BENCH_SECONDS * 1000;
+        memset(&pipeline.stats, 0, sizeof(PipelineStats));
+        double start = Now();
+        Scan(&pipeline, &trick, test, startMs, &result);
+        double seconds = Now() - start;
+
+        s64 scanned = (trick.position / 1000 - startMs) * (test->speed > 0 ? 1 : -1);
+        int passed = (int)(scanned / gopMs);
+        printf("%+3dx, %2u ms a keyframe: %5d of %5d keyframes shown, %5u asked, %4u repeated, lag up to %5lld ms"
+               " (%.2f s to run)\n", test->speed, test->decodeMicroseconds / 1000, result.shown, passed,
+               trick.stats.requested, trick.stats.repeated, (long long)result.worstLag, seconds);
+
+        // Up to a decode and a refresh behind or ahead, plus the gap to
+        // the keyframe at or before
+        s64 reach = (s64)abs(test->speed) * (test->decodeMicroseconds + 2 * REFRESH) / 1000 + gopMs;
+        int cheap = (s64)(test->decodeMicroseconds + 2 * REFRESH) * abs(test->speed) < gopMs * 1000;
+        if(result.notKeyframe || result.wrongPicture || result.backwards || result.worstLag > reach ||
+           (cheap && result.shown < passed * 9 / 10) || pipeline.stats.decode.count > (u32)result.refreshes) {
+            printf("  %d not keyframes, %d wrong, %d backwards, %u decoded in %d refreshes\n", result.notKeyframe,
+                   result.wrongPicture, result.backwards, pipeline.stats.decode.count, result.refreshes);
+            failures++;
+        }
+
+        // The full rewind ends on the very first frame
+        if(test->speed < 0 && !test->seconds) {
+            for(int i = 0; i < 10; i++) {
+                RunPipeline(&pipeline);
+                const PipelineFrame* frame = RunTrickPlay(&trick, &pipeline, (u64)(result.refreshes + 2 + i) * REFRESH);
+                if(frame) result.last = FrameNumber(frame);
+            }
+            if(result.last != 0) {
+                printf("  rewind ended on frame %lld\n", (long long)result.last);
+                failures++;
+            }
+        }
+
+        // Normal play picks up at the picture on screen, every frame
+        // from there
+        s64 landed = StopTrickPlay(&trick, &pipeline);
+        if(test->seconds) {
+            s64 expected = result.last;
+            for(s64 t = landed; t <= landed + 1000; t += 1000 / BENCH_FPS) {
+                RunPipeline(&pipeline);
+                const PipelineFrame* frame = PresentPipelineFrame(&pipeline, t);
+                if(frame && (s64)FrameNumber(frame) == expected) expected++;
+                else expected = -1;
+            }
+            if(landed != GetPipelineFrameTime(&pipeline, result.last) || expected != result.last + BENCH_FPS + 1) {
+                printf("  resumed at %lld ms, not frame %lld's time or not in order\n", (long long)landed,
+                       (long long)result.last);
+                failures++;
+            }
+        }
+    }
+
+    // The decode thread, in real time
+    if(StartPipelineThread(&pipeline, PIPELINE_PRIORITY) != 0) {
+        printf("decode thread did not start\n");
+        failures++;
+    } else {
+        TrickPlay trick = {0};
+        ScanResult result = {0};
+        double start = Now();
+        u64 now = 0;
+
+        result.last = -1;
+        StartTrickPlay(&trick, 32, 600000, (s64)BENCH_SECONDS * 1000, now);
+        while(Now() - start < 1.0) {
+            now = (u64)((Now() - start) * 1e6);
+            const PipelineFrame* frame = RunTrickPlay(&trick, &pipeline, now);
+            if(frame) {
+                s64 number = FrameNumber(frame);
+                if(number % BENCH_GOP || frame->pts != GetPipelineFrameTime(&pipeline, number)) result.wrongPicture++;
+                if(number <= result.last) result.backwards++;
+                result.last = number;
+                result.shown++;
+            }
+            usleep(REFRESH / 4);
+        }
+        s64 landed = StopTrickPlay(&trick, &pipeline);
+        printf("+32x on the decode thread: %d pictures in 1 s, resumed at %lld ms\n", result.shown,
+               (long long)landed);
+        if(!result.shown || result.wrongPicture || result.backwards ||
+           landed != GetPipelineFrameTime(&pipeline, result.last)) {
+            printf("  %d wrong, %d backwards\n", result.wrongPicture, result.backwards);
+            failures++;
+        }
+    }
+
+    ClosePipeline(&pipeline);
+    CloseVideoDecoder(decoder);
+    RemoveDirectory(directory);
+    printf("trick play: %s\n", failures ? "FAIL" : "ok");
+    return failures ? 1 : 0;
+}
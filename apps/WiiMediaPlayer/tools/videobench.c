@@ -0,0 +1,108 @@
+// Host benchmark for the video demuxers (make bench)
+//
+// Opens a file through the same VideoDecoder calls the player uses, which
+// loads the container index, then reads frames in order and times random
+// seeks. Run it on the largest files you have; open time grows with the
+// index and seek time should not grow at all.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "decoder.h"
+#include "readahead.h"
+
+#define BENCH_BUFFER_SIZE (1024 * 1024)
+
+int main(int argc, char** argv) {
+    const char* filename = NULL;
+    int frames = 2000;
+    int seeks = 1000;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-seeks") == 0 && i + 1 < argc) {
+            seeks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+            SetDecoderReadAhead(atoi(argv[++i]));
+        } else {
+            filename = argv[i];
+        }
+    }
+
+    if(!filename) {
+        fprintf(stderr, "usage: videobench [-frames count] [-seeks count] [-window blocks] file\n");
+        return 1;
+    }
+
+    double start = Now();
+    VideoDecoder* decoder = InitVideoDecoder(filename);
+    double openTime = Now() - start;
+    if(!decoder) {
+        fprintf(stderr, "%s: cannot open\n", filename);
+        return 1;
+    }
+
+    static u8 buffer[BENCH_BUFFER_SIZE];
+
+    printf("%s: %lld bytes, %dx%d, %d fps, %d s\n", filename, (long long)decoder->fileSize,
+           decoder->width, decoder->height, decoder->fps, decoder->duration);
+    printf("open      %8.2f ms\n", openTime * 1000);
+
+    // Frames in order from the start
+    s64 bytes = 0;
+    int read = 0, oversized = 0;
+    start = Now();
+    for(; read < frames; read++) {
+        int n = ReadVideoFrame(decoder, buffer, sizeof(buffer));
+        if(n == MEDIA_FRAME_TOO_BIG) {
+            oversized++;
+            continue;
+        }
+        if(n <= 0) break;
+        bytes += n;
+    }
+    double readTime = Now() - start;
+    if(read > 0) {
+        printf("read      %8.2f ms for %d frames, %.0f frames/s, %.1f MB/s\n", readTime * 1000,
+               read, read / readTime, bytes / readTime / (1024 * 1024));
+    }
+    if(oversized) printf("          %d frames over %d KB skipped\n", oversized, BENCH_BUFFER_SIZE >> 10);
+
+    // Seek and read the keyframe, as the player does after a jump
+    if(decoder->duration > 0 && seeks > 0) {
+        double total = 0, worst = 0;
+        int failed = 0;
+
+        srand(1);
+        for(int i = 0; i < seeks; i++) {
+            int target = rand() % decoder->duration;
+
+            start = Now();
+            if(SeekVideoDecoder(decoder, target) != 0 ||
+               ReadVideoFrame(decoder, buffer, sizeof(buffer)) <= 0) failed++;
+            double t = Now() - start;
+
+            total += t;
+            if(t > worst) worst = t;
+        }
+
+        printf("seek      %8.3f ms average, %.3f ms worst over %d", total * 1000 / seeks,
+               worst * 1000, seeks);
+        if(failed) printf(", %d failed", failed);
+        printf("\n");
+    }
+
+    // Counters of the read-ahead thread, when it ran
+    MediaIOStats stats;
+    GetMediaIOStats(&decoder->io, &stats);
+    if(stats.hits + stats.misses > 0) {
+        printf("io        %8.1f KB prefetched, %u hits, %u misses, %.2f ms stalled\n",
+               stats.bytesPrefetched / 1024.0, stats.hits, stats.misses,
+               stats.stallMicroseconds / 1000.0);
+    }
+
+    CloseVideoDecoder(decoder);
+    return 0;
+}